@@ -61,6 +61,156 @@ void warmup(const char* filename)
     printLine("image: {} x {} ({} KB)", header.width, header.height, memory.size / 1024);
 }
 
+static
+u64 decode_lowest(const char* filename, const ImageDecodeOptions& options, int count)
+{
+    u64 lowest = NOT_AVAILABLE;
+
+    for (int i = 0; i < count; ++i)
+    {
+        u64 time0 = Time::us();
+        Bitmap bitmap(filename, options);
+        u64 time1 = Time::us();
+        lowest = std::min(lowest, time1 - time0);
+    }
+
+    return lowest;
+}
+
+static
+void print_speedup(const char* filename)
+{
+    // compare single-threaded decoding against the multithreaded decoder,
+    // progressive files without restart markers use the scan pipeline
+    ImageDecodeOptions options;
+    options.simd = true;
+
+    options.multithread = false;
+    u64 single = decode_lowest(filename, options, 3);
+
+    options.multithread = true;
+    u64 multi = decode_lowest(filename, options, 3);
+
+    printLine("-----------------------------------------------------");
+    printLine("decode: {:.1f} ms (1 thread), {:.1f} ms ({} threads), speedup: {:.2f}x",
+        single / 1000.0, multi / 1000.0, ThreadPool::getHardwareConcurrency(),
+        double(single) / double(std::max(multi, u64(1))));
+}
+
+static
+void print_kernels(const char* filename)
+{
+    // decode into each output format with and without simd; single threaded
+    // so the times reflect the selected idct and color conversion kernels
+    struct Target
+    {
+        const char* name;
+        Format format;
+    };
+
+    const Target targets[] =
+    {
+        { "RGB ", Format(24, Format::UNORM, Format::RGB, 8, 8, 8) },
+        { "BGR ", Format(24, Format::UNORM, Format::BGR, 8, 8, 8) },
+        { "RGBA", Format(32, Format::UNORM, Format::RGBA, 8, 8, 8, 8) },
+        { "BGRA", Format(32, Format::UNORM, Format::BGRA, 8, 8, 8, 8) },
+    };
+
+    File file(filename);
+    ConstMemory memory = file;
+
+    ImageHeader header = ImageDecoder(memory, filename).header();
+
+    printLine("-----------------------------------------------------");
+
+    for (const Target& target : targets)
+    {
+        Bitmap bitmap(header.width, header.height, target.format);
+
+        for (bool simd : { false, true })
+        {
+            ImageDecodeOptions options;
+            options.simd = simd;
+            options.multithread = false;
+
+            ImageDecodeStatus status;
+            u64 lowest = NOT_AVAILABLE;
+
+            for (int i = 0; i < 3; ++i)
+            {
+                ImageDecoder decoder(memory, filename);
+
+                u64 time0 = Time::us();
+                status = decoder.decode(bitmap, options);
+                u64 time1 = Time::us();
+                lowest = std::min(lowest, time1 - time0);
+            }
+
+            printLine("{} {}: {} [{}]", target.name, simd ? "simd  " : "scalar", format_time(lowest), status.info);
+        }
+    }
+}
+
+static
+void print_encode_modes(const Bitmap& bitmap, bool multithread)
+{
+    // compare chroma subsampling and entropy coding modes;
+    // size, compression ratio and throughput
+    struct Mode
+    {
+        const char* name;
+        ImageEncodeOptions::Subsampling subsampling;
+        bool optimize;
+        bool progressive;
+    };
+
+    const Mode modes[] =
+    {
+        { "4:4:4            ", ImageEncodeOptions::S444, false, false },
+        { "4:2:2            ", ImageEncodeOptions::S422, false, false },
+        { "4:2:0            ", ImageEncodeOptions::S420, false, false },
+        { "4:2:0 optimized  ", ImageEncodeOptions::S420, true, false },
+        { "4:2:0 progressive", ImageEncodeOptions::S420, false, true },
+    };
+
+    const u64 raw = u64(bitmap.width) * bitmap.height * 3;
+
+    printLine("-----------------------------------------------------");
+
+    for (const Mode& mode : modes)
+    {
+        ImageEncodeOptions options;
+        options.quality = 0.70f;
+        options.simd = true;
+        options.multithread = multithread;
+        options.subsampling = mode.subsampling;
+        options.optimize = mode.optimize;
+        options.progressive = mode.progressive;
+
+        u64 lowest = NOT_AVAILABLE;
+        u64 size = 0;
+
+        for (int i = 0; i < 3; ++i)
+        {
+            MemoryStream stream;
+            ImageEncoder encoder(".jpg");
+
+            u64 time0 = Time::us();
+            encoder.encode(stream, bitmap, options);
+            u64 time1 = Time::us();
+
+            lowest = std::min(lowest, time1 - time0);
+            size = stream.size();
+        }
+
+        double ratio = double(raw) / double(std::max(size, u64(1)));
+        double speed = double(raw) / double(std::max(lowest, u64(1)));
+
+        printLine("encode {}: {} {:8} KB, ratio: {:5.1f}:1, {:7.1f} MB/s",
+            mode.name, format_time(lowest), size / 1024, ratio, speed);
+    }
+}
+
 // ----------------------------------------------------------------------
 // libjpeg
 // ----------------------------------------------------------------------
@@ -579,6 +729,14 @@ int main(int argc, const char* argv[])
     time2 = Time::us();
     print("mango:   ", time1 - time0, time2 - time1, size);
 
+    if (multithread)
+    {
+        print_speedup(filename);
+    }
+
+    print_kernels(filename);
+    print_encode_modes(bitmap, multithread);
+
     // ------------------------------------------------------------------
 
     if (test_count > 0)
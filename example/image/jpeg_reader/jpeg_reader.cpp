@@ -57,6 +57,8 @@ struct State
     std::atomic<size_t> total_input_bytes { 0 };
     std::atomic<size_t> total_image_bytes { 0 };
 
+    int scale = 1;
+
     ConcurrentQueue queue;
     Trace trace { "", "batch image reading" };
 
@@ -69,11 +71,16 @@ struct State
         if (decoder.isDecoder())
         {
             ImageHeader header = decoder.header();
-            Bitmap bitmap(header.width, header.height, header.format);
+
+            // reduced-size decoding rounds the dimensions up
+            int width = (header.width + scale - 1) / scale;
+            int height = (header.height + scale - 1) / scale;
+            Bitmap bitmap(width, height, header.format);
 
             ImageDecodeOptions options;
             options.simd = true;
             options.multithread = multithread;
+            options.scale = scale;
 
             ImageDecodeStatus status = decoder.decode(bitmap, options);
             if (!status)
@@ -82,7 +89,7 @@ struct State
             }
 
             input_bytes = memory.size;
-            image_bytes = header.width * header.height * 4;
+            image_bytes = width * height * 4;
         }
 
         total_input_files ++;
@@ -129,30 +136,43 @@ struct State
     }
 };
 
-void test_jpeg(const std::string& folder, bool mmap, bool multithread)
+struct Result
 {
-    u64 time0 = Time::ms();
-
-    Path path(folder);
+    u64 time;
+    size_t files;
+    size_t input_bytes;
+    size_t image_bytes;
+};
 
-    FileIndex index;
-    scan(path, index);
+Result test_jpeg(const FileIndex& index, bool mmap, bool multithread, int scale)
+{
+    u64 time0 = Time::ms();
 
     State state;
+    state.scale = scale;
     state.process(index, mmap, multithread);
     state.wait();
 
     u64 time1 = Time::ms();
 
-    printLine("\n{}", getSystemInfo());
-    printLine("MMAP: {}", mmap ? "ENABLED" : "DISABLED");
-    printLine("MT: {}", multithread ? "ENABLED" : "DISABLED");
-    printLine("");
-    printLine("Decoded {} files in {} ms ({} MB -> {} MB).",
-        size_t(state.total_input_files),
-        time1 - time0,
-        state.total_input_bytes >> 20,
-        state.total_image_bytes >> 20);
+    Result result;
+
+    result.time = time1 - time0;
+    result.files = state.total_input_files;
+    result.input_bytes = state.total_input_bytes;
+    result.image_bytes = state.total_image_bytes;
+
+    return result;
+}
+
+void print_result(const Result& result, int scale)
+{
+    printLine("Decoded {} files at 1/{} scale in {} ms ({} MB -> {} MB).",
+        result.files,
+        scale,
+        result.time,
+        result.input_bytes >> 20,
+        result.image_bytes >> 20);
 }
 
 // -----------------------------------------------------------------
@@ -163,7 +183,7 @@ int main(int argc, const char* argv[])
 {
     if (argc < 2)
     {
-        printLine("Too few arguments. Usage: {} <folder>", argv[0]);
+        printLine("Too few arguments. Usage: {} <folder> [--mmap] [--mt] [--scale 2|4|8] [--debug] [--trace]", argv[0]);
         return 1;
     }
 
@@ -172,6 +192,7 @@ int main(int argc, const char* argv[])
     bool mmap = false;
     bool multithread = false;
     bool tracing = false;
+    int scale = 1;
 
     for (int i = 2; i < argc; ++i)
     {
@@ -191,6 +212,10 @@ int main(int argc, const char* argv[])
         {
             tracing = true;
         }
+        else if (!strcmp(argv[i], "--scale") && i + 1 < argc)
+        {
+            scale = std::atoi(argv[++i]);
+        }
     }
 
     std::unique_ptr<filesystem::OutputFileStream> output;
@@ -201,7 +226,32 @@ int main(int argc, const char* argv[])
         startTrace(output.get());
     }
 
-    test_jpeg(pathname, mmap, multithread);
+    Path path(pathname);
+
+    FileIndex index;
+    scan(path, index);
+
+    Result full = test_jpeg(index, mmap, multithread, 1);
+    Result scaled;
+
+    if (scale > 1)
+    {
+        // the same files again with reduced-size decoding
+        scaled = test_jpeg(index, mmap, multithread, scale);
+    }
+
+    printLine("\n{}", getSystemInfo());
+    printLine("MMAP: {}", mmap ? "ENABLED" : "DISABLED");
+    printLine("MT: {}", multithread ? "ENABLED" : "DISABLED");
+    printLine("");
+
+    print_result(full, 1);
+
+    if (scale > 1)
+    {
+        print_result(scaled, scale);
+        printLine("Speedup: {:.2f}x", double(full.time) / double(std::max(scaled.time, u64(1))));
+    }
 
     if (tracing)
     {
@@ -0,0 +1,171 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2024 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <mango/core/core.hpp>
+#include <mango/image/image.hpp>
+#include <mango/filesystem/filesystem.hpp>
+
+#ifdef MANGO_PLATFORM_UNIX
+#include <sys/resource.h>
+#endif
+
+using namespace mango;
+using namespace mango::filesystem;
+using namespace mango::image;
+
+/*
+    Measures page faults (minor / major) and throughput of sequential decoding
+    with different MapHint flags. The files are images (decoded) or containers
+    (every file is mapped and read). The file cache is warm after the first pass;
+    drop the page cache between runs to see the major faults.
+
+    usage: map_hints image.jpg image.png data.mgx ...
+*/
+
+// ----------------------------------------------------------------------
+// utils
+// ----------------------------------------------------------------------
+
+struct Counters
+{
+    u64 time = 0;
+    u64 minor = 0;
+    u64 major = 0;
+
+    static Counters get()
+    {
+        Counters counters;
+        counters.time = Time::us();
+#ifdef MANGO_PLATFORM_UNIX
+        struct rusage usage;
+        if (!getrusage(RUSAGE_SELF, &usage))
+        {
+            counters.minor = u64(usage.ru_minflt);
+            counters.major = u64(usage.ru_majflt);
+        }
+#endif
+        return counters;
+    }
+
+    void add(const Counters& begin, const Counters& end)
+    {
+        time += end.time - begin.time;
+        minor += end.minor - begin.minor;
+        major += end.major - begin.major;
+    }
+};
+
+struct Result
+{
+    u64 bytes = 0;
+    Counters map;
+    Counters decode;
+};
+
+u64 touch(ConstMemory memory)
+{
+    // read the memory like a decoder would
+    u64 sum = 0;
+    for (size_t i = 0; i < memory.size; i += 64)
+    {
+        sum += memory.address[i];
+    }
+    return sum;
+}
+
+Result decode(const std::string& filename, u32 hints)
+{
+    Result result;
+
+    if (Mapper::isCustomMapper(filename))
+    {
+        Path path(filename + "/");
+        Mapper& mapper = path.getMapper();
+
+        std::function<void(const std::string&)> traverse = [&] (const std::string& folder)
+        {
+            Path current(path, folder);
+            for (const FileInfo& info : current)
+            {
+                if (info.isDirectory())
+                {
+                    traverse(folder + info.name);
+                }
+                else
+                {
+                    Counters counters0 = Counters::get();
+                    std::unique_ptr<VirtualMemory> memory = mapper.map(folder + info.name, hints);
+                    Counters counters1 = Counters::get();
+                    touch(*memory);
+                    Counters counters2 = Counters::get();
+
+                    result.map.add(counters0, counters1);
+                    result.decode.add(counters1, counters2);
+                    result.bytes += info.size;
+                }
+            }
+        };
+
+        traverse("");
+    }
+    else
+    {
+        Counters counters0 = Counters::get();
+        File file(filename, hints);
+        Counters counters1 = Counters::get();
+        Bitmap bitmap(file);
+        Counters counters2 = Counters::get();
+
+        result.map.add(counters0, counters1);
+        result.decode.add(counters1, counters2);
+        result.bytes = file.size();
+    }
+
+    return result;
+}
+
+// ----------------------------------------------------------------------
+// main()
+// ----------------------------------------------------------------------
+
+int main(int argc, const char* argv[])
+{
+    if (argc < 2)
+    {
+        printLine("Too few arguments. usage: <filename> ...");
+        return 0;
+    }
+
+    const std::pair<const char*, u32> configurations[] =
+    {
+        { "default", MapHint::NONE },
+        { "sequential", MapHint::SEQUENTIAL },
+        { "willneed", MapHint::WILLNEED },
+        { "populate", MapHint::POPULATE },
+        { "hugepage", MapHint::HUGEPAGE | MapHint::SEQUENTIAL },
+        { "readahead", MapHint::READAHEAD | MapHint::SEQUENTIAL },
+    };
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string filename = argv[i];
+        printLine("{}", filename);
+
+        // the first pass warms up the file cache and the containers
+        decode(filename, MapHint::NONE);
+
+        for (auto configuration : configurations)
+        {
+            Result result = decode(filename, configuration.second);
+
+            u64 time = std::max(u64(1), result.map.time + result.decode.time);
+            printLine("  {:<12} {:6}.{} ms {:6} MB/s | map: {:6}.{} ms, faults {:6} / {:4} | decode: {:6}.{} ms, faults {:6} / {:4}",
+                configuration.first, time / 1000, (time % 1000) / 100, result.bytes / time,
+                result.map.time / 1000, (result.map.time % 1000) / 100, result.map.minor, result.map.major,
+                result.decode.time / 1000, (result.decode.time % 1000) / 100, result.decode.minor, result.decode.major);
+        }
+    }
+
+    return 0;
+}
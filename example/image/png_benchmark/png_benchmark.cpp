@@ -33,6 +33,7 @@ using namespace mango::image;
 
 bool g_option_tracing = false;
 bool g_option_multithread = true;
+bool g_option_priming = false;
 int g_option_compression = 4;
 
 // ----------------------------------------------------------------------
@@ -658,6 +659,8 @@ size_t save_mango(const Bitmap& bitmap)
 
     ImageEncodeOptions options;
     options.compression = g_option_compression;
+    options.parallel = g_option_multithread;
+    options.priming = g_option_priming;
     bitmap.save(filename, options);
 
     return get_file_size(filename);
@@ -691,6 +694,10 @@ int main(int argc, const char* argv[])
         {
             g_option_compression = std::atoi(argv[++i]);
         }
+        else if (!strcmp(argv[i], "--priming"))
+        {
+            g_option_priming = true;
+        }
         else if (!strcmp(argv[i], "--debug"))
         {
             printEnable(Print::Info, true);
@@ -0,0 +1,151 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2024 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <mango/core/core.hpp>
+#include <mango/image/image.hpp>
+#include <mango/filesystem/filesystem.hpp>
+
+#ifdef MANGO_PLATFORM_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace mango;
+using namespace mango::filesystem;
+using namespace mango::image;
+
+/*
+    Measures the FileStream overhead when writing a large PNG file. The encoder
+    writes the chunks with small writes (write32, write8) so the file is written
+    both through FileStream and into memory; the file must be identical to the
+    MemoryStream output.
+
+    The small writes are also measured against a write(2) per byte (unix only),
+    which is what the stream did before it was buffered.
+*/
+
+// ----------------------------------------------------------------------
+// utils
+// ----------------------------------------------------------------------
+
+void print(const char* name, u64 time0, u64 time1, u64 bytes)
+{
+    u64 time = std::max(u64(1), time1 - time0);
+    printLine("{:<24} {:7}.{} ms  {:7} MB/s", name, time / 1000, (time % 1000) / 100, bytes / time);
+}
+
+bool compare(const std::string& filename, ConstMemory memory)
+{
+    File file(filename);
+    return file.size() == memory.size && !std::memcmp(file.data(), memory.address, memory.size);
+}
+
+// ----------------------------------------------------------------------
+// main()
+// ----------------------------------------------------------------------
+
+int main(int argc, const char* argv[])
+{
+    std::string filename = "png_write_output.png";
+    int compression = 0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-compression") && i <= (argc - 2))
+        {
+            compression = std::atoi(argv[++i]);
+        }
+        else
+        {
+            filename = argv[i];
+        }
+    }
+
+    // 100 MB image
+    Bitmap bitmap(5120, 5120, Format(32, Format::UNORM, Format::RGBA, 8, 8, 8, 8));
+
+    for (int y = 0; y < bitmap.height; ++y)
+    {
+        u32* scan = bitmap.address<u32>(0, y);
+        for (int x = 0; x < bitmap.width; ++x)
+        {
+            scan[x] = (x * 7) ^ (y * 13) ^ ((x * y) << 8);
+        }
+    }
+
+    ImageEncodeOptions options;
+    options.compression = compression;
+
+    u64 time0 = Time::us();
+
+    MemoryStream memory;
+    bitmap.save(memory, ".png", options);
+
+    u64 time1 = Time::us();
+
+    bitmap.save(filename, options);
+
+    u64 time2 = Time::us();
+
+    print("png: memory", time0, time1, memory.size());
+    print("png: file", time1, time2, memory.size());
+
+    bool success = compare(filename, memory);
+    printLine("png: compare            [{}]", success ? "Success" : "FAILED");
+
+    // small writes
+    const u64 count = 1024 * 1024;
+
+    Buffer expected(count);
+    for (u64 i = 0; i < count; ++i)
+    {
+        expected[i] = u8(i * 7);
+    }
+
+#ifdef MANGO_PLATFORM_UNIX
+    time0 = Time::us();
+
+    {
+        int file = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (file != -1)
+        {
+            for (u64 i = 0; i < count; ++i)
+            {
+                ssize_t status = ::write(file, expected.data() + i, 1);
+                MANGO_UNREFERENCED(status);
+            }
+
+            ::close(file);
+        }
+    }
+
+    time1 = Time::us();
+
+    print("write8: write(2)", time0, time1, count);
+#endif
+
+    time0 = Time::us();
+
+    {
+        OutputFileStream file(filename);
+        BigEndianStream s(file);
+
+        for (u64 i = 0; i < count; ++i)
+        {
+            s.write8(u8(i * 7));
+        }
+
+        file.flush();
+    }
+
+    time1 = Time::us();
+
+    print("write8: FileStream", time0, time1, count);
+
+    bool status = compare(filename, expected);
+    printLine("write8: compare         [{}]", status ? "Success" : "FAILED");
+    success &= status;
+
+    return success ? 0 : 1;
+}
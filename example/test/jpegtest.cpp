@@ -0,0 +1,210 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2024 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <mango/mango.hpp>
+
+using namespace mango;
+using namespace mango::image;
+using namespace mango::filesystem;
+
+/*
+    Region-of-interest decoding must produce the same pixels as a crop of the full
+    image. The test images are 301 x 203 pixels with 4:2:0 sampling so that the last
+    MCU column and row are partial:
+
+        data/jpeg/sequential.jpg    baseline, no restart markers
+        data/jpeg/restart.jpg       baseline, restart marker on every MCU row
+        data/jpeg/progressive.jpg   progressive
+
+    The scan index of the sequential image is tested the same way; an index which does
+    not match the file must be rejected and the result must not depend on it.
+*/
+
+static const Format format(32, Format::UNORM, Format::BGRA, 8, 8, 8, 8);
+
+struct Region
+{
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+static
+bool compare(const Surface& a, const Surface& b, int x, int y)
+{
+    // b is compared against the area of a at (x, y)
+    for (int i = 0; i < b.height; ++i)
+    {
+        const u8* scan0 = a.address(x, y + i);
+        const u8* scan1 = b.address(0, i);
+
+        if (std::memcmp(scan0, scan1, b.width * format.bytes()))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static
+bool test_region(const std::string& filename)
+{
+    File file(filename);
+
+    ImageDecoder decoder(file, ".jpg");
+    ImageHeader header = decoder.header();
+
+    bool success = true;
+
+    for (int scale : { 1, 2 })
+    {
+        const int width = div_ceil(header.width, scale);
+        const int height = div_ceil(header.height, scale);
+
+        ImageDecodeOptions options;
+        options.scale = scale;
+
+        Bitmap full(width, height, format);
+        decoder.decode(full, options);
+
+        const Region regions [] =
+        {
+            { 0, 0, width, height },          // whole image
+            { 0, 0, 5, 5 },                   // inside the first MCU
+            { 37, 29, width / 3, 61 },        // unaligned interior
+            { 32, 32, 64, 48 },               // aligned to MCUs
+            { width - 11, 50, 11, 40 },       // partial MCU column
+            { 0, height - 13, width, 13 },    // bottom rows
+            { width - 21, height - 23, 21, 23 }, // bottom-right corner
+            { width - 1, height - 1, 1, 1 },  // last pixel
+        };
+
+        for (const Region& region : regions)
+        {
+            for (bool multithread : { false, true })
+            {
+                options.multithread = multithread;
+                options.roi.x = region.x;
+                options.roi.y = region.y;
+                options.roi.width = region.width;
+                options.roi.height = region.height;
+
+                Bitmap bitmap(region.width, region.height, format);
+                ImageDecodeStatus status = decoder.decode(bitmap, options);
+
+                bool match = status && compare(full, bitmap, region.x, region.y);
+                if (!match)
+                {
+                    printLine("  scale: {} region: {} {} {} {} mt: {} [FAILED]",
+                        scale, region.x, region.y, region.width, region.height, multithread);
+                }
+
+                success &= match;
+            }
+        }
+    }
+
+    printLine("  {:<28} [{}]", filename, success ? "Success" : "FAILED");
+    return success;
+}
+
+static
+Bitmap decode(ConstMemory memory, const Region& region, Buffer* index)
+{
+    ImageDecoder decoder(memory, ".jpg");
+
+    ImageDecodeOptions options;
+    options.roi.x = region.x;
+    options.roi.y = region.y;
+    options.roi.width = region.width;
+    options.roi.height = region.height;
+    options.index = index;
+
+    // corrupted data might not cover the whole surface
+    Bitmap bitmap(region.width, region.height, format);
+    bitmap.clear(0, 0, 0, 0);
+    decoder.decode(bitmap, options);
+    return bitmap;
+}
+
+static
+bool test_index(const std::string& filename)
+{
+    File file(filename);
+
+    ImageDecoder decoder(file, ".jpg");
+    ImageHeader header = decoder.header();
+
+    const Region image = { 0, 0, header.width, header.height };
+    Bitmap full = decode(file, image, nullptr);
+
+    // the index is created by a full decode
+    Buffer index;
+    Bitmap indexed = decode(file, image, &index);
+
+    bool success = index.size() > 0 && compare(full, indexed, 0, 0);
+
+    const Region regions [] =
+    {
+        { 0, 0, 5, 5 },
+        { 37, 29, 100, 61 },
+        { header.width - 11, 50, 11, 40 },
+        { 0, header.height - 13, header.width, 13 },
+        { header.width - 21, header.height - 23, 21, 23 },
+    };
+
+    for (const Region& region : regions)
+    {
+        Bitmap bitmap = decode(file, region, &index);
+        success &= compare(full, bitmap, region.x, region.y);
+    }
+
+    // re-encode a section in the upper half of the scan; the file size stays the same and
+    // no markers are created. The section is longer than the distance between the chunks
+    // sampled by the index so the change is detected even though the decoded rows are after it.
+    Buffer modified(file);
+
+    const size_t offset = modified.size() / 4;
+
+    for (size_t i = offset; i < offset + modified.size() / 16; ++i)
+    {
+        if (modified[i - 1] != 0xff && modified[i] != 0xff && modified[i] != 0xef)
+        {
+            modified[i] ^= 0x10;
+        }
+    }
+
+    const Region lower = { 0, header.height / 2, header.width, header.height - header.height / 2 };
+
+    // the stale index must give the same result as decoding without it
+    Buffer stale(index.data(), index.size());
+
+    Bitmap reference0 = decode(modified, lower, nullptr);
+    Bitmap bitmap0 = decode(modified, lower, &stale);
+    success &= compare(reference0, bitmap0, 0, 0);
+
+    Bitmap reference1 = decode(modified, image, nullptr);
+    Bitmap bitmap1 = decode(modified, image, &stale);
+    success &= compare(reference1, bitmap1, 0, 0);
+
+    printLine("  {:<28} [{}]", filename, success ? "Success" : "FAILED");
+    return success;
+}
+
+int main()
+{
+    bool success = true;
+
+    printLine("Region-of-interest:");
+    success &= test_region("data/jpeg/sequential.jpg");
+    success &= test_region("data/jpeg/restart.jpg");
+    success &= test_region("data/jpeg/progressive.jpg");
+
+    printLine("Scan index:");
+    success &= test_index("data/jpeg/sequential.jpg");
+
+    return success ? 0 : 1;
+}
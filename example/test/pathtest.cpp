@@ -404,6 +404,121 @@ void test32()
     print(path3, "data/fake/random.snitch/");
 }
 
+// streaming decoders
+
+static
+bool compare(Stream& stream, ConstMemory memory)
+{
+    if (stream.size() != memory.size)
+        return false;
+
+    // sequential reads in uneven pieces
+    std::vector<u8> buffer(memory.size);
+
+    for (size_t offset = 0, piece = 777; offset < memory.size; )
+    {
+        size_t bytes = std::min(piece, size_t(memory.size - offset));
+        stream.read(buffer.data() + offset, bytes);
+        offset += bytes;
+        piece = piece * 3 % 50021 + 1;
+    }
+
+    bool status = !std::memcmp(buffer.data(), memory.address, memory.size);
+
+    // backward seek restarts the decoder; forward seek skips
+    u8 sample[16];
+    stream.seek(12345, Stream::BEGIN);
+    stream.read(sample, 16);
+    status &= !std::memcmp(sample, memory.address + 12345, 16);
+
+    stream.seek(-1000, Stream::END);
+    stream.read(sample, 16);
+    status &= !std::memcmp(sample, memory.address + memory.size - 1000, 16);
+
+    return status;
+}
+
+void test33()
+{
+    // every compression method through open() must give the same bytes as map()
+
+    const char* filenames [] =
+    {
+        "stored.bin",
+        "deflate.bin",
+        "bzip2.bin",
+        "lzma.bin",
+        "zstd.bin",
+    };
+
+    Path path("data/streams.zip/");
+
+    for (const char* filename : filenames)
+    {
+        File file(path, filename);
+        InputPathStream stream(path, filename);
+
+        bool status = compare(stream, file);
+        g_count_failed += !status;
+
+        printf("[stream]      data/streams.zip/%s [%s]\n", filename, status ? "PASSED" : "FAILED");
+    }
+
+    printf("\n");
+}
+
+void test34()
+{
+    // an entry which does not fit into the archive must be rejected by both map() and open()
+
+    File file("data/streams.zip");
+    Buffer buffer(file);
+
+    // the central directory record of deflate.bin gets a compressed size past the end
+    const std::string name = "deflate.bin";
+
+    for (size_t offset = 0; offset + 46 + name.length() <= buffer.size(); ++offset)
+    {
+        u8* record = buffer.data() + offset;
+        if (littleEndian::uload32(record) == 0x02014b50 &&
+            littleEndian::uload16(record + 28) == name.length() &&
+            !std::memcmp(record + 46, name.data(), name.length()))
+        {
+            littleEndian::ustore32(record + 20, u32(buffer.size()));
+        }
+    }
+
+    Path path(buffer, ".zip");
+
+    bool status_map = false;
+    bool status_open = false;
+
+    try
+    {
+        File entry(path, name);
+    }
+    catch (const Exception&)
+    {
+        status_map = true;
+    }
+
+    try
+    {
+        InputPathStream stream(path, name);
+    }
+    catch (const Exception&)
+    {
+        status_open = true;
+    }
+
+    g_count_failed += !status_map;
+    g_count_failed += !status_open;
+
+    printf("[corrupted]   map:  %s [%s]\n", name.c_str(), status_map ? "PASSED" : "FAILED");
+    printf("[corrupted]   open: %s [%s]\n", name.c_str(), status_open ? "PASSED" : "FAILED");
+    printf("\n");
+}
+
 // -----------------------------------------------------------------------------------
 // main()
 // -----------------------------------------------------------------------------------
@@ -450,6 +565,8 @@ int main(int argc, char *argv[])
     MAKE_TEST(30);
     MAKE_TEST(31);
     MAKE_TEST(32);
+    MAKE_TEST(33);
+    MAKE_TEST(34);
 
     printLine();
     if (g_count_failed)
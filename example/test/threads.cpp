@@ -1,6 +1,6 @@
 /*
     MANGO Multimedia Development Platform
-    Copyright (C) 2012-2023 Twilight Finland 3D Oy Ltd. All rights reserved.
+    Copyright (C) 2012-2024 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
 #include <algorithm>
 #include <mango/mango.hpp>
@@ -386,6 +386,478 @@ bool test7()
     return true;
 }
 
+bool test8()
+{
+    // Compare the schedulers with a fine-grained nested workload; each root task
+    // spawns a small tree of children from inside the pool.
+
+    constexpr int N = 16;
+    constexpr u64 icount = 200'000 / N;
+
+    const size_t size = ThreadPool::getHardwareConcurrency();
+
+    auto benchmark = [=] (ThreadPool::Scheduler scheduler, bool affinity, const char* name) -> bool
+    {
+        ThreadPool pool(size, scheduler, affinity);
+        std::atomic<u64> counter { 0 };
+
+        u64 time0 = Time::us();
+
+        {
+            ConcurrentQueue q(pool);
+
+            for (u64 i = 0; i < icount; ++i)
+            {
+                q.enqueue([&]
+                {
+                    for (int j = 0; j < N; ++j)
+                    {
+                        q.enqueue([&]
+                        {
+                            counter.fetch_add(1, std::memory_order_relaxed);
+                        });
+                    }
+                });
+            }
+
+            q.wait();
+        }
+
+        u64 time1 = Time::us();
+
+        bool success = counter == icount * N;
+        printf("  %-24s %8d us [%s]\n", name, int(time1 - time0), success ? "Success" : "FAILED");
+        return success;
+    };
+
+    bool success = true;
+    success &= benchmark(ThreadPool::Scheduler::Shared, false, "shared:");
+    success &= benchmark(ThreadPool::Scheduler::WorkStealing, false, "work-stealing:");
+    success &= benchmark(ThreadPool::Scheduler::WorkStealing, true, "work-stealing+affinity:");
+    return success;
+}
+
+bool test9()
+{
+    // Enqueue / dequeue throughput with 1, 8 and 64 producer threads. The captures are
+    // sized to fit in the TaskFunction inline storage so no task touches the heap.
+
+    constexpr u64 total = 2'000'000;
+
+    bool success = true;
+
+    for (int producers : { 1, 8, 64 })
+    {
+        std::atomic<u64> counter { 0 };
+        const u64 count = total / producers;
+
+        u64 time0 = Time::us();
+
+        {
+            ConcurrentQueue q;
+            std::vector<std::thread> threads;
+
+            for (int i = 0; i < producers; ++i)
+            {
+                threads.emplace_back([&]
+                {
+                    u64 payload[4] = { 1, 2, 3, 4 };
+
+                    for (u64 j = 0; j < count; ++j)
+                    {
+                        q.enqueue([&counter, payload]
+                        {
+                            counter.fetch_add(payload[0], std::memory_order_relaxed);
+                        });
+                    }
+                });
+            }
+
+            for (auto& thread : threads)
+            {
+                thread.join();
+            }
+
+            q.wait();
+        }
+
+        u64 time1 = Time::us();
+
+        bool status = counter == count * producers;
+        success &= status;
+
+        double mtasks = double(count * producers) / double(std::max(time1 - time0, u64(1)));
+        printf("  producers: %2d  %8d us  %6.2f M tasks/s [%s]\n",
+            producers, int(time1 - time0), mtasks, status ? "Success" : "FAILED");
+    }
+
+    return success;
+}
+
+bool test10()
+{
+    constexpr int N = 1'000'000;
+
+    // every index must be visited exactly once
+    std::vector<u8> visited(N, 0);
+    std::atomic<int> tasks { 0 };
+
+    u64 time0 = Time::us();
+
+    parallelFor(0, N, 1, [&] (int i0, int i1)
+    {
+        ++tasks;
+        for (int i = i0; i < i1; ++i)
+        {
+            ++visited[i];
+        }
+    });
+
+    u64 time1 = Time::us();
+
+    bool success = std::all_of(visited.begin(), visited.end(), [] (u8 value) { return value == 1; });
+    printf("  parallelFor: %d us, %d tasks [%s]\n", int(time1 - time0), tasks.load(), success ? "Success" : "FAILED");
+
+    // tiles must cover the area exactly once
+    constexpr int width = 1000;
+    constexpr int height = 700;
+    std::vector<u8> area(width * height, 0);
+
+    parallelFor2D(width, height, 64, 48, [&] (int x0, int y0, int x1, int y1)
+    {
+        for (int y = y0; y < y1; ++y)
+        {
+            for (int x = x0; x < x1; ++x)
+            {
+                ++area[y * width + x];
+            }
+        }
+    });
+
+    bool status = std::all_of(area.begin(), area.end(), [] (u8 value) { return value == 1; });
+    printf("  parallelFor2D: [%s]\n", status ? "Success" : "FAILED");
+    success &= status;
+
+    // returning false cancels the pieces which have not started; the other pieces are held
+    // until the first one returns so only the pieces already running in the pool can complete
+    const int threads = ThreadPool::getInstance().size();
+    const int grain = detail::getParallelGrain(ThreadPool::getInstance(), N, 1000);
+
+    std::atomic<int> processed { 0 };
+    std::atomic<bool> cancelling { false };
+
+    bool completed = parallelFor(0, N, 1000, [&] (int i0, int i1) -> bool
+    {
+        if (i0 == 0)
+        {
+            cancelling = true;
+            return false;
+        }
+
+        while (!cancelling)
+        {
+            std::this_thread::yield();
+        }
+
+        processed += i1 - i0;
+        return true;
+    });
+
+    // one piece per pool thread, and one more for a thread which picks a piece
+    // between the first piece returning and the cancellation
+    const int limit = threads > 1 ? grain * (threads + 1) : 0;
+
+    status = !completed && processed < N && processed <= limit;
+    printf("  cancel: processed %d / %d [%s]\n", processed.load(), N, status ? "Success" : "FAILED");
+    success &= status;
+
+    // the pieces are sized for the pool of the queue, not for the hardware
+    ThreadPool pool(4);
+    ConcurrentQueue queue(pool);
+
+    tasks = 0;
+
+    parallelFor(queue, 0, N, 1, [&] (int i0, int i1)
+    {
+        MANGO_UNREFERENCED(i0);
+        MANGO_UNREFERENCED(i1);
+        ++tasks;
+    });
+
+    status = tasks == 4 * 4;
+    printf("  pool(4): %d tasks [%s]\n", tasks.load(), status ? "Success" : "FAILED");
+    success &= status;
+
+    return success;
+}
+
+bool test11()
+{
+    // A pipeline of two stages over N bands: stage1 of band i must wait for stage0 of
+    // band i and stage1 of band i - 1. Verifies the order and that the graph can be re-run.
+
+    constexpr int N = 64;
+
+    std::atomic<int> stage0[N];
+    std::atomic<int> stage1[N];
+    std::atomic<int> errors { 0 };
+
+    TaskGraph graph("pipeline");
+
+    TaskGraph::Node previous = 0;
+
+    for (int i = 0; i < N; ++i)
+    {
+        auto a = graph.node([&, i]
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+            ++stage0[i];
+        });
+
+        auto b = graph.node([&, i]
+        {
+            if (stage0[i] != stage1[i] + 1)
+                ++errors;
+            if (i > 0 && stage1[i - 1] != stage1[i] + 1)
+                ++errors;
+            ++stage1[i];
+        });
+
+        graph.edge(a, b);
+        if (i > 0)
+        {
+            graph.edge(previous, b);
+        }
+
+        previous = b;
+    }
+
+    for (int i = 0; i < N; ++i)
+    {
+        stage0[i] = 0;
+        stage1[i] = 0;
+    }
+
+    constexpr int runs = 4;
+
+    u64 time0 = Time::us();
+
+    for (int run = 0; run < runs; ++run)
+    {
+        graph.run();
+        graph.wait();
+    }
+
+    u64 time1 = Time::us();
+
+    bool success = errors == 0;
+    for (int i = 0; i < N; ++i)
+    {
+        success &= stage1[i] == runs;
+    }
+
+    printf("  nodes: %d, runs: %d, %d us [%s]\n", int(graph.size()), runs, int(time1 - time0), success ? "Success" : "FAILED");
+    return success;
+}
+
+bool test12()
+{
+    // wait() latency of a short queue while the pool is flooded with long tasks from
+    // an unrelated queue; reports p50 / p99 for both wait policies.
+
+    const int threads = int(ThreadPool::getHardwareConcurrency());
+
+    auto benchmark = [=] (WaitPolicy policy, const char* name) -> bool
+    {
+        std::atomic<bool> running { true };
+        std::atomic<int> counter { 0 };
+
+        ConcurrentQueue background("long");
+
+        // the long tasks keep replacing themselves until the measurement is complete
+        std::function<void()> work = [&]
+        {
+            if (running)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                background.enqueue(work);
+            }
+        };
+
+        for (int i = 0; i < threads * 4; ++i)
+        {
+            background.enqueue(work);
+        }
+
+        std::vector<u64> samples;
+
+        for (int i = 0; i < 100; ++i)
+        {
+            ConcurrentQueue q("short", Priority::Normal, policy);
+
+            for (int j = 0; j < 8; ++j)
+            {
+                q.enqueue([&]
+                {
+                    ++counter;
+                });
+            }
+
+            u64 time0 = Time::us();
+            q.wait();
+            u64 time1 = Time::us();
+
+            samples.push_back(time1 - time0);
+        }
+
+        running = false;
+        background.wait();
+
+        std::sort(samples.begin(), samples.end());
+        u64 p50 = samples[samples.size() * 50 / 100];
+        u64 p99 = samples[samples.size() * 99 / 100];
+
+        bool success = counter == 100 * 8;
+        printf("  %-12s p50: %6d us  p99: %6d us [%s]\n", name, int(p50), int(p99), success ? "Success" : "FAILED");
+        return success;
+    };
+
+    bool success = true;
+    success &= benchmark(WaitPolicy::Cooperative, "cooperative:");
+    success &= benchmark(WaitPolicy::Scoped, "scoped:");
+    return success;
+}
+
+bool test13()
+{
+    // Cost of a trace event while a trace is running; the events go into per-thread
+    // buffers and are written into the stream by a background thread.
+
+    constexpr int count = 1'000'000;
+
+    u64 time_disabled;
+    u64 time_strings;
+    u64 time_ids;
+
+    const std::string category = "test";
+    const std::string name = "event";
+
+    u64 time0 = Time::ns();
+
+    for (int i = 0; i < count; ++i)
+    {
+        Trace trace(category, name);
+    }
+
+    time_disabled = Time::ns() - time0;
+
+    BufferStream output;
+    startTrace(&output);
+
+    const u32 category_id = Trace::intern(category);
+    const u32 name_id = Trace::intern(name);
+
+    time0 = Time::ns();
+
+    for (int i = 0; i < count; ++i)
+    {
+        Trace trace(category, name);
+    }
+
+    time_strings = Time::ns() - time0;
+    time0 = Time::ns();
+
+    for (int i = 0; i < count; ++i)
+    {
+        Trace trace(category_id, name_id);
+    }
+
+    time_ids = Time::ns() - time0;
+
+    stopTrace();
+
+    // each event reads the clock twice
+    time0 = Time::ns();
+
+    u64 sum = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        sum += Time::us();
+    }
+
+    u64 time_clock = Time::ns() - time0;
+
+    printf("  clock:    %6.1f ns / Time::us() (%d)\n", double(time_clock) / count, int(sum & 1));
+    printf("  disabled: %6.1f ns / event\n", double(time_disabled) / count);
+    printf("  strings:  %6.1f ns / event\n", double(time_strings) / count);
+    printf("  ids:      %6.1f ns / event\n", double(time_ids) / count);
+    printf("  output:   %d KB\n", int(output.size() >> 10));
+
+    return output.size() > 0;
+}
+
+bool test14()
+{
+    // Scoped wait() while the last task of the queue is running in the pool: the waiting
+    // thread must be woken up when the task completes and it must not run the tasks which
+    // the running task enqueues into its nested queue.
+
+    const std::thread::id self = std::this_thread::get_id();
+
+    std::atomic<int> counter { 0 };
+    std::atomic<bool> helped { false };
+    std::vector<u64> samples;
+
+    for (int i = 0; i < 50; ++i)
+    {
+        ConcurrentQueue q("outer", Priority::Normal, WaitPolicy::Scoped);
+
+        std::atomic<bool> started { false };
+        std::atomic<u64> complete { 0 };
+
+        q.enqueue([&]
+        {
+            started = true;
+
+            ConcurrentQueue nested("nested", Priority::Normal, WaitPolicy::Scoped);
+
+            for (int j = 0; j < 8; ++j)
+            {
+                nested.enqueue([&]
+                {
+                    if (std::this_thread::get_id() == self)
+                    {
+                        helped = true;
+                    }
+
+                    std::this_thread::sleep_for(std::chrono::microseconds(200));
+                    ++counter;
+                });
+            }
+
+            nested.wait();
+            complete = Time::us();
+        });
+
+        // the task must be running in the pool before we start waiting
+        while (!started)
+        {
+            std::this_thread::yield();
+        }
+
+        q.wait();
+        samples.push_back(Time::us() - complete);
+    }
+
+    std::sort(samples.begin(), samples.end());
+    u64 p50 = samples[samples.size() * 50 / 100];
+    u64 p99 = samples[samples.size() * 99 / 100];
+
+    bool success = counter == 50 * 8 && !helped;
+    printf("  wake-up latency  p50: %6d us  p99: %6d us [%s]\n", int(p50), int(p99), success ? "Success" : "FAILED");
+    return success;
+}
+
 int main(int argc, char* argv[])
 {
     int count = 1;
@@ -406,6 +878,13 @@ int main(int argc, char* argv[])
         test5,
         test6,
         test7,
+        test8,
+        test9,
+        test10,
+        test11,
+        test12,
+        test13,
+        test14,
     };
 
     for (int i = 0; i < count; ++i)
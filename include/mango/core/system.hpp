@@ -5,6 +5,7 @@
 #pragma once
 
 #include <string>
+#include <unordered_map>
 #include <mango/core/configure.hpp>
 #include <mango/core/thread.hpp>
 #include <mango/core/timer.hpp>
@@ -31,38 +32,103 @@ namespace mango
         TraceThread(const std::string& name);
     };
 
+    /*
+        Trace records a duration event into a per-thread ring buffer; a background thread
+        writes the events into the Chrome trace JSON stream given to startTrace(). The
+        category and name strings are interned into IDs; use the ID constructor with
+        IDs from Trace::intern() in hot paths to skip the lookup. Nothing is recorded
+        unless a trace is running.
+
+        MANGO_DISABLE_TRACE makes Trace an empty inline class so that the call sites compile
+        to nothing. The define changes the class, so the library and its users must agree on it:
+        the DISABLE_TRACE (cmake) and disable_trace (meson) options set it as a public definition.
+    */
+
+#if defined(MANGO_DISABLE_TRACE)
+
     struct Trace
     {
-        struct Data
+        // the arguments are not converted so no strings are constructed
+        template <typename... T>
+        Trace(T&&...)
         {
-            u32 tid;
-            u64 time0;
-            u64 time1;
-            std::string category;
-            std::string name;
-        } data;
+        }
+
+        void stop()
+        {
+        }
+
+        static constexpr bool enabled()
+        {
+            return false;
+        }
+
+        static u32 intern(const std::string& text)
+        {
+            MANGO_UNREFERENCED(text);
+            return 0;
+        }
+    };
+
+#else
+
+    struct Trace
+    {
+        u32 category;
+        u32 name;
+        u64 time0;
+        bool active;
 
         Trace(const std::string& category, const std::string& name);
+        Trace(u32 category, u32 name);
         ~Trace();
 
         void stop();
+
+        static bool enabled();
+        static u32 intern(const std::string& text);
     };
 
+#endif
+
     struct Tracer
     {
+        struct Event
+        {
+            u32 category;
+            u32 name;
+            u64 time0;
+            u64 time1;
+        };
+
+        struct Buffer;
+
         std::mutex mutex;
         Stream* output { nullptr };
         std::vector<TraceThread> threads;
-        std::vector<Trace::Data> traces;
-        std::vector<Trace::Data> traces_out;
-        SerialQueue writer;
+        std::vector<std::shared_ptr<Buffer>> buffers;
+        std::vector<std::string> names;
+        std::unordered_map<std::string, u32> name_map;
+        std::atomic<bool> enabled { false };
+        std::atomic<u32> session { 0 };
+        u32 task_category;
         bool comma;
-        u32 count;
+
+        // owned by the flusher; formatted without holding the mutex
+        std::vector<std::pair<u32, Event>> flush_events;
+        std::vector<std::string> flush_names;
+
+        std::thread flusher;
+        std::mutex flush_mutex;
+        std::condition_variable flush_condition;
+        bool flush_stop;
 
         Tracer();
         ~Tracer();
 
-        void append(const Trace& trace);
+        u32 intern(const std::string& text);
+        void append(const Event& event);
+        void flush();
 
         void start(Stream* stream);
         void stop();
@@ -1,10 +1,11 @@
 /*
     MANGO Multimedia Development Platform
-    Copyright (C) 2012-2021 Twilight Finland 3D Oy Ltd. All rights reserved.
+    Copyright (C) 2012-2024 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
 #pragma once
 
 #include <queue>
+#include <algorithm>
 #include <vector>
 #include <memory>
 #include <thread>
@@ -12,6 +13,7 @@
 #include <functional>
 #include <condition_variable>
 #include <future>
+#include <type_traits>
 #include <mango/core/exception.hpp>
 #include <mango/core/memory.hpp>
 #include <mango/core/atomic.hpp>
@@ -19,6 +21,175 @@
 namespace mango
 {
 
+    // ----------------------------------------------------------------------------------
+    // TaskFunction
+    // ----------------------------------------------------------------------------------
+
+    /*
+        TaskFunction is a move-only void() callable used for the tasks in the queues. Unlike
+        std::function it stores callables up to InlineCapacity bytes inside the object so
+        that submitting a typical lambda does not touch the heap. Larger callables are
+        stored in the heap.
+    */
+
+    class TaskFunction
+    {
+    public:
+        static constexpr size_t InlineCapacity = 64;
+
+    private:
+        struct Operations
+        {
+            void (*invoke)(void* storage);
+            void (*move)(void* dest, void* source);
+            void (*destroy)(void* storage);
+        };
+
+        template <typename F>
+        static constexpr bool is_inline =
+            sizeof(F) <= InlineCapacity &&
+            alignof(F) <= alignof(std::max_align_t) &&
+            std::is_nothrow_move_constructible<F>::value;
+
+        template <typename F>
+        struct InlineOperations
+        {
+            static void invoke(void* storage)
+            {
+                (*reinterpret_cast<F*>(storage))();
+            }
+
+            static void move(void* dest, void* source)
+            {
+                F* f = reinterpret_cast<F*>(source);
+                new (dest) F(std::move(*f));
+                f->~F();
+            }
+
+            static void destroy(void* storage)
+            {
+                reinterpret_cast<F*>(storage)->~F();
+            }
+
+            static constexpr Operations operations { invoke, move, destroy };
+        };
+
+        template <typename F>
+        struct HeapOperations
+        {
+            static void invoke(void* storage)
+            {
+                (**reinterpret_cast<F**>(storage))();
+            }
+
+            static void move(void* dest, void* source)
+            {
+                *reinterpret_cast<F**>(dest) = *reinterpret_cast<F**>(source);
+            }
+
+            static void destroy(void* storage)
+            {
+                delete *reinterpret_cast<F**>(storage);
+            }
+
+            static constexpr Operations operations { invoke, move, destroy };
+        };
+
+        alignas(std::max_align_t) unsigned char m_storage[InlineCapacity];
+        const Operations* m_operations = nullptr;
+
+        void reset()
+        {
+            if (m_operations)
+            {
+                m_operations->destroy(m_storage);
+                m_operations = nullptr;
+            }
+        }
+
+    public:
+        TaskFunction() = default;
+
+        template <typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, TaskFunction>::value>::type>
+        TaskFunction(F&& f)
+        {
+            using T = typename std::decay<F>::type;
+
+            if constexpr (is_inline<T>)
+            {
+                new (m_storage) T(std::forward<F>(f));
+                m_operations = &InlineOperations<T>::operations;
+            }
+            else
+            {
+                *reinterpret_cast<T**>(m_storage) = new T(std::forward<F>(f));
+                m_operations = &HeapOperations<T>::operations;
+            }
+        }
+
+        TaskFunction(TaskFunction&& other) noexcept
+            : m_operations(other.m_operations)
+        {
+            if (m_operations)
+            {
+                m_operations->move(m_storage, other.m_storage);
+                other.m_operations = nullptr;
+            }
+        }
+
+        TaskFunction& operator = (TaskFunction&& other) noexcept
+        {
+            if (this != &other)
+            {
+                reset();
+                m_operations = other.m_operations;
+                if (m_operations)
+                {
+                    m_operations->move(m_storage, other.m_storage);
+                    other.m_operations = nullptr;
+                }
+            }
+            return *this;
+        }
+
+        TaskFunction(const TaskFunction&) = delete;
+        TaskFunction& operator = (const TaskFunction&) = delete;
+
+        ~TaskFunction()
+        {
+            reset();
+        }
+
+        explicit operator bool () const
+        {
+            return m_operations != nullptr;
+        }
+
+        void operator () ()
+        {
+            m_operations->invoke(m_storage);
+        }
+    };
+
+    namespace detail
+    {
+
+        // bind the arguments only when there are any; a plain callable is stored as-is
+        template <class F, class... Args>
+        auto bindTask(F&& f, Args&&... args)
+        {
+            if constexpr (sizeof...(Args) == 0)
+            {
+                return typename std::decay<F>::type(std::forward<F>(f));
+            }
+            else
+            {
+                return std::bind(std::forward<F>(f), std::forward<Args>(args)...);
+            }
+        }
+
+    } // namespace detail
+
     // ----------------------------------------------------------------------------------
     // ThreadPool
     // ----------------------------------------------------------------------------------
@@ -28,11 +199,16 @@ namespace mango
     private:
         friend class ConcurrentQueue;
 
+        // tasks of a scoped queue; the pool only sees tokens which run one task each
+        struct ScopedQueue;
+
         struct Queue
         {
             ThreadPool* pool;
             int priority;
             std::string name;
+            std::shared_ptr<ScopedQueue> scoped;
+            std::atomic<u32> trace_name { 0 }; // interned lazily
 
             alignas(64) std::atomic<int> task_counter { 0 };
             alignas(64) std::atomic<bool> cancelled { false };
@@ -48,19 +224,31 @@ namespace mango
         struct Task
         {
             Queue* queue;
-            std::function<void()> func;
+            TaskFunction func;
         };
 
     public:
+        enum class Scheduler
+        {
+            // all tasks are submitted into shared priority queues
+            Shared,
+
+            // tasks submitted from worker threads are pushed into the worker's own LIFO deque,
+            // idle workers steal from the FIFO end of other workers' deques
+            WorkStealing,
+        };
+
         ThreadPool(size_t size);
+        ThreadPool(size_t size, Scheduler scheduler, bool affinity = false);
         ~ThreadPool();
 
         static size_t getHardwareConcurrency();
         static ThreadPool& getInstance();
 
         int size() const;
+        Scheduler scheduler() const;
 
-        void enqueue(std::function<void()>&& func)
+        void enqueue(TaskFunction&& func)
         {
             enqueue(&m_static_queue, std::move(func));
         }
@@ -68,20 +256,33 @@ namespace mango
     protected:
         void thread(size_t threadID);
 
-        void enqueue(Queue* queue, std::function<void()>&& func);
+        void enqueue(Queue* queue, TaskFunction&& func);
+        void submit(Task&& task, int priority);
+        bool dequeue(Task& task);
+        void process(Task& task);
         bool dequeue_and_process();
         void cancel(Queue* queue);
         void wait(Queue* queue);
+        void wait_scoped(Queue* queue);
 
     private:
         struct TaskQueue;
         alignas(64) TaskQueue* m_queues;
 
+        struct Worker;
+        Worker* m_workers;
+        Worker* getLocalWorker() const;
+        bool steal(Task& task, size_t start);
+
+        Scheduler m_scheduler;
+        bool m_affinity;
+
         alignas(64) std::atomic<bool> m_stop { false };
         std::mutex m_queue_mutex;
         std::condition_variable m_condition;
 
         Queue m_static_queue;
+        Queue m_token_queue;
         std::vector<std::thread> m_threads;
     };
 
@@ -92,6 +293,19 @@ namespace mango
         Low    = 2
     };
 
+    enum class WaitPolicy
+    {
+        // wait() helps the pool with any tasks until the queue is drained
+        Cooperative,
+
+        // wait() only runs tasks of the waited queue and sleeps while the remaining
+        // tasks are running in other threads; a long task from an unrelated queue
+        // cannot delay the waiting thread. The thread is woken up when a task completes.
+        // Tasks of nested queues created by the running tasks are not run by the
+        // waiting thread, only by the pool and the threads waiting for those queues.
+        Scoped,
+    };
+
     // ----------------------------------------------------------------------------------
     // ConcurrentQueue
     // ----------------------------------------------------------------------------------
@@ -117,6 +331,10 @@ namespace mango
         // wait until the queue is drained
         q.wait(); // cooperative, blocking (helps pool until all tasks are complete)
 
+        A queue created with WaitPolicy::Scoped only helps with its own tasks in wait().
+        Tasks which wait for their own nested queues help those queues in the same way;
+        the thread waiting for the outer queue does not run the nested tasks.
+
     */
 
     class ConcurrentQueue : private NonCopyable
@@ -127,15 +345,20 @@ namespace mango
 
     public:
         ConcurrentQueue();
-        ConcurrentQueue(const std::string& name, Priority priority = Priority::Normal);
+        ConcurrentQueue(const std::string& name, Priority priority = Priority::Normal, WaitPolicy policy = WaitPolicy::Cooperative);
         ConcurrentQueue(ThreadPool& pool);
-        ConcurrentQueue(ThreadPool& pool, const std::string& name, Priority priority = Priority::Normal);
+        ConcurrentQueue(ThreadPool& pool, const std::string& name, Priority priority = Priority::Normal, WaitPolicy policy = WaitPolicy::Cooperative);
         ~ConcurrentQueue();
 
         template <class F, class... Args>
         void enqueue(F&& f, Args&&... args)
         {
-            m_pool.enqueue(&m_queue, std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+            m_pool.enqueue(&m_queue, detail::bindTask(std::forward<F>(f), std::forward<Args>(args)...));
+        }
+
+        ThreadPool& pool() const
+        {
+            return m_pool;
         }
 
         void steal();
@@ -143,6 +366,182 @@ namespace mango
         void wait();
     };
 
+    // ----------------------------------------------------------------------------------
+    // parallelFor
+    // ----------------------------------------------------------------------------------
+
+    /*
+        parallelFor processes the range [begin, end) in the ThreadPool and returns when the
+        whole range is complete. The range is split recursively in halves until the pieces
+        are not larger than the grain size; the calling thread processes the first piece and
+        helps the pool with the rest.
+
+        The grain is the smallest piece worth a task. It is increased automatically so that
+        the pool gets a few pieces per thread instead of one task per item; grain = 0 means
+        fully automatic sizing. The function may return bool; returning false cancels the
+        pieces which have not started yet and parallelFor returns false.
+
+        parallelFor2D does the same for tiles of a 2D area; the tiles are clipped to the area.
+
+        Usage example:
+
+        parallelFor(0, height, 8, [&] (int y0, int y1)
+        {
+            for (int y = y0; y < y1; ++y)
+            {
+                // process scanline y
+            }
+        });
+
+        parallelFor2D(width, height, 64, 64, [&] (int x0, int y0, int x1, int y1)
+        {
+            // process tile
+        });
+
+    */
+
+    namespace detail
+    {
+
+        inline int getParallelGrain(const ThreadPool& pool, int count, int grain)
+        {
+            const int threads = pool.size();
+            if (threads <= 1)
+            {
+                // no point splitting the work
+                return std::max(count, 1);
+            }
+
+            const int pieces = threads * 4;
+            return std::max(std::max(grain, 1), (count + pieces - 1) / pieces);
+        }
+
+        template <typename F>
+        struct ParallelFor
+        {
+            ConcurrentQueue& queue;
+            F& func;
+            int grain;
+            std::atomic<bool> cancelled { false };
+
+            ParallelFor(ConcurrentQueue& queue, F& func, int grain)
+                : queue(queue)
+                , func(func)
+                , grain(grain)
+            {
+            }
+
+            void run(int begin, int end)
+            {
+                // a cancelled range is neither split nor processed
+                if (cancelled.load(std::memory_order_relaxed))
+                {
+                    return;
+                }
+
+                // give away the upper halves, keep the lowest piece
+                while (end - begin > grain)
+                {
+                    if (cancelled.load(std::memory_order_relaxed))
+                    {
+                        return;
+                    }
+
+                    int middle = begin + (end - begin) / 2;
+
+                    queue.enqueue([this, middle, end]
+                    {
+                        run(middle, end);
+                    });
+
+                    end = middle;
+                }
+
+                if (cancelled.load(std::memory_order_relaxed))
+                {
+                    return;
+                }
+
+                if constexpr (std::is_same<decltype(func(begin, end)), bool>::value)
+                {
+                    if (!func(begin, end))
+                    {
+                        cancelled = true;
+                    }
+                }
+                else
+                {
+                    func(begin, end);
+                }
+            }
+        };
+
+    } // namespace detail
+
+    template <typename F>
+    bool parallelFor(ConcurrentQueue& queue, int begin, int end, int grain, F&& func)
+    {
+        if (begin >= end)
+        {
+            return true;
+        }
+
+        grain = detail::getParallelGrain(queue.pool(), end - begin, grain);
+
+        detail::ParallelFor<F> state(queue, func, grain);
+        state.run(begin, end);
+        queue.wait();
+
+        return !state.cancelled;
+    }
+
+    template <typename F>
+    bool parallelFor(int begin, int end, int grain, F&& func)
+    {
+        ConcurrentQueue queue("parallel.for", Priority::High);
+        return parallelFor(queue, begin, end, grain, std::forward<F>(func));
+    }
+
+    template <typename F>
+    bool parallelFor2D(ConcurrentQueue& queue, int width, int height, int tile_width, int tile_height, F&& func)
+    {
+        tile_width = std::max(tile_width, 1);
+        tile_height = std::max(tile_height, 1);
+
+        const int xtiles = (width + tile_width - 1) / tile_width;
+        const int ytiles = (height + tile_height - 1) / tile_height;
+
+        return parallelFor(queue, 0, xtiles * ytiles, 0, [&] (int i0, int i1) -> bool
+        {
+            for (int i = i0; i < i1; ++i)
+            {
+                const int x0 = (i % xtiles) * tile_width;
+                const int y0 = (i / xtiles) * tile_height;
+                const int x1 = std::min(x0 + tile_width, width);
+                const int y1 = std::min(y0 + tile_height, height);
+
+                if constexpr (std::is_same<decltype(func(x0, y0, x1, y1)), bool>::value)
+                {
+                    if (!func(x0, y0, x1, y1))
+                        return false;
+                }
+                else
+                {
+                    func(x0, y0, x1, y1);
+                }
+            }
+
+            return true;
+        });
+    }
+
+    template <typename F>
+    bool parallelFor2D(int width, int height, int tile_width, int tile_height, F&& func)
+    {
+        ConcurrentQueue queue("parallel.for2d", Priority::High);
+        return parallelFor2D(queue, width, height, tile_width, tile_height, std::forward<F>(func));
+    }
+
     // ----------------------------------------------------------------------------------
     // SerialQueue
     // ----------------------------------------------------------------------------------
@@ -174,7 +573,7 @@ namespace mango
     class SerialQueue : private NonCopyable
     {
     protected:
-        using Task = std::function<void()>;
+        using Task = TaskFunction;
 
         std::string m_name;
         std::thread m_thread;
@@ -199,7 +598,7 @@ namespace mango
         void enqueue(F&& f, Args&&... args)
         {
             std::unique_lock<std::mutex> lock(m_queue_mutex);
-            m_task_queue.emplace_back(f, (args)...);
+            m_task_queue.emplace_back(detail::bindTask(std::forward<F>(f), std::forward<Args>(args)...));
             ++m_task_counter;
             m_task_condition.notify_one();
         }
@@ -252,7 +651,7 @@ namespace mango
         struct Task
         {
             std::atomic<int> count { 1 };
-            std::function<void()> func;
+            TaskFunction func;
             std::promise<void> promise;
         };
 
@@ -276,7 +675,7 @@ namespace mango
             template <class F, class... Args>
             void consume(F&& f, Args&&... args) const
             {
-                task->func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
+                task->func = detail::bindTask(std::forward<F>(f), std::forward<Args>(args)...);
                 task->promise.set_value();
             }
         };
@@ -304,6 +703,76 @@ namespace mango
         bool dequeue_and_process();
     };
 
+    // ----------------------------------------------------------------------------------
+    // TaskGraph
+    // ----------------------------------------------------------------------------------
+
+    /*
+        TaskGraph is API to submit tasks with dependencies into the ThreadPool. The graph
+        is built from nodes and edges; an edge from A to B means that B is started only
+        after A has completed. When a node completes, the nodes waiting for it are enqueued
+        immediately (continuation) so that independent chains progress without waiting
+        for each other. The graph can be run again after it has completed.
+
+        Usage example:
+
+        TaskGraph graph("decode");
+
+        auto a = graph.node([] { decompress(top); });
+        auto b = graph.node([] { decompress(bottom); });
+        auto c = graph.node([] { process(top); });
+        auto d = graph.node([] { process(bottom); });
+
+        graph.edge(a, c);
+        graph.edge(b, d);
+        graph.edge(c, d); // bottom uses last scanline of the top
+
+        graph.run();
+        graph.wait(); // cooperative, blocking (helps pool until all nodes are complete)
+
+    */
+
+    class TaskGraph : private NonCopyable
+    {
+    public:
+        using Node = size_t;
+
+    protected:
+        struct NodeData
+        {
+            TaskFunction func;
+            std::vector<NodeData*> successors;
+            std::atomic<int> pending { 0 };
+            int dependencies = 0;
+        };
+
+        ConcurrentQueue m_queue;
+        std::deque<NodeData> m_nodes;
+
+        void submit(NodeData* node);
+
+    public:
+        TaskGraph();
+        TaskGraph(const std::string& name, Priority priority = Priority::Normal);
+        TaskGraph(ThreadPool& pool, const std::string& name, Priority priority = Priority::Normal);
+        ~TaskGraph();
+
+        template <class F, class... Args>
+        Node node(F&& f, Args&&... args)
+        {
+            m_nodes.emplace_back();
+            m_nodes.back().func = detail::bindTask(std::forward<F>(f), std::forward<Args>(args)...);
+            return m_nodes.size() - 1;
+        }
+
+        void edge(Node from, Node to);
+        size_t size() const;
+
+        void run();
+        void cancel();
+        void wait();
+    };
+
     // ----------------------------------------------------------------------------------
     // Task
     // ----------------------------------------------------------------------------------
@@ -320,7 +789,7 @@ namespace mango
         Task(F&& f, Args&&... args)
         {
             ThreadPool& pool = ThreadPool::getInstance();
-            pool.enqueue(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+            pool.enqueue(detail::bindTask(std::forward<F>(f), std::forward<Args>(args)...));
         }
     };
 
@@ -352,7 +821,6 @@ namespace mango
     private:
         using Future = std::future<T>;
         using Promise = std::promise<T>;
-        using Function = std::function<T()>;
 
         Promise m_promise;
         Future m_future;
@@ -363,14 +831,13 @@ namespace mango
             : m_promise()
             , m_future(m_promise.get_future())
         {
-            Function func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
-            auto container = std::bind([this] (Function func) {
-                T value = func();
-                m_promise.set_value(value);
-            }, func);
+            auto func = detail::bindTask(std::forward<F>(f), std::forward<Args>(args)...);
 
             ThreadPool& pool = ThreadPool::getInstance();
-            pool.enqueue(container);
+            pool.enqueue([this, func = std::move(func)] () mutable
+            {
+                m_promise.set_value(func());
+            });
         }
 
         T get()
@@ -390,7 +857,6 @@ namespace mango
     private:
         using Future = std::future<void>;
         using Promise = std::promise<void>;
-        using Function = std::function<void()>;
 
         Promise m_promise;
         Future m_future;
@@ -401,14 +867,14 @@ namespace mango
             : m_promise()
             , m_future(m_promise.get_future())
         {
-            Function func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
-            auto container = std::bind([this] (Function func) {
-                func();
-                m_promise.set_value();
-            }, func);
+            auto func = detail::bindTask(std::forward<F>(f), std::forward<Args>(args)...);
 
             ThreadPool& pool = ThreadPool::getInstance();
-            pool.enqueue(container);
+            pool.enqueue([this, func = std::move(func)] () mutable
+            {
+                func();
+                m_promise.set_value();
+            });
         }
 
         void get()
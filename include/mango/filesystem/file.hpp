@@ -23,11 +23,11 @@ namespace mango::filesystem
         std::unique_ptr<VirtualMemory> m_virtual_memory;
         ConstMemory m_memory;
 
-        void initMemory(Mapper& mapper);
+        void initMemory(Mapper& mapper, u32 hints);
 
     public:
-        File(const std::string& filename);
-        File(const Path& path, const std::string& filename);
+        File(const std::string& filename, u32 hints = MapHint::NONE);
+        File(const Path& path, const std::string& filename, u32 hints = MapHint::NONE);
         File(ConstMemory memory, const std::string& extension, const std::string& filename);
         ~File();
 
@@ -42,6 +42,32 @@ namespace mango::filesystem
         u64 size() const;
     };
 
+    // Sequential read access to a file; compressed files in containers are decompressed
+    // incrementally as they are read instead of all at once like with File (zip).
+    class InputPathStream : public Stream
+    {
+    protected:
+        std::string m_filename;
+        std::unique_ptr<Path> m_path;
+        std::unique_ptr<Stream> m_stream;
+
+        void initStream(Mapper& mapper);
+
+    public:
+        InputPathStream(const std::string& filename);
+        InputPathStream(const Path& path, const std::string& filename);
+        ~InputPathStream();
+
+        const Path& path() const;
+        const std::string& filename() const;
+
+        u64 size() const override;
+        u64 offset() const override;
+        void seek(s64 distance, SeekMode mode) override;
+        void read(void* dest, u64 size) override;
+        void write(const void* data, u64 size) override;
+    };
+
     class FileStream : public Stream
     {
     protected:
@@ -63,6 +89,13 @@ namespace mango::filesystem
         {
             Stream::write(memory);
         }
+
+        // positional read which does not use or move the stream offset; can be called concurrently.
+        // Unlike the sequential read, reading past the end of file throws an exception.
+        void read(void* dest, u64 size, u64 offset) const;
+
+        // write buffered data into the file; the errors of background writes are reported here
+        void flush();
     };
 
     class InputFileStream : public FileStream
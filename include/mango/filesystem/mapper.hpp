@@ -6,8 +6,16 @@
 
 #include <string>
 #include <vector>
+#include <future>
+#include <mutex>
 #include <mango/core/configure.hpp>
 #include <mango/core/memory.hpp>
+#include <mango/core/stream.hpp>
+
+namespace mango
+{
+    class ConcurrentQueue;
+}
 
 namespace mango::filesystem
 {
@@ -89,6 +97,35 @@ namespace mango::filesystem
         }
     };
 
+    struct MapperCacheStatistics
+    {
+        u64 hits = 0;        // blocks found in the cache
+        u64 misses = 0;      // blocks decompressed
+        u64 waits = 0;       // blocks waited for while another thread was decompressing them
+        u64 evictions = 0;   // blocks removed from the cache to make room
+        size_t size = 0;     // decompressed bytes in the cache
+        size_t capacity = 0; // maximum decompressed bytes in the cache
+    };
+
+    // Access hints for mapped memory; the flags can be combined
+    struct MapHint
+    {
+        enum Flags : u32
+        {
+            NONE       = 0x00,
+            SEQUENTIAL = 0x01, // the memory is read from beginning to end (more aggressive read-ahead)
+            WILLNEED   = 0x02, // start reading the pages in the background
+            POPULATE   = 0x04, // read all pages before map() returns; no page faults later
+            HUGEPAGE   = 0x08, // use huge pages when possible; less TLB misses. Most filesystems
+                               // do not back shared file mappings with huge pages, so this usually
+                               // helps only with anonymous memory (eg. decompressed container files)
+            READAHEAD  = 0x10, // pool task which touches the pages in order while the memory is alive
+        };
+    };
+
+    // Apply the hints (except READAHEAD) to memory; unsupported hints are ignored
+    void adviseMemory(ConstMemory memory, u32 hints);
+
     class AbstractMapper : protected NonCopyable
     {
     public:
@@ -98,21 +135,51 @@ namespace mango::filesystem
         virtual bool isFile(const std::string& filename) const = 0;
         virtual void getIndex(FileIndex& index, const std::string& pathname) = 0;
         virtual std::unique_ptr<VirtualMemory> map(const std::string& filename) = 0;
+
+        // map with access hints (MapHint); the hints are applied to the memory returned by map()
+        std::unique_ptr<VirtualMemory> map(const std::string& filename, u32 hints);
+
+        // optional: read-only stream which decompresses only the data that is read (zip)
+        // - the default implementation is a stream over the mapped memory
+        virtual std::unique_ptr<Stream> open(const std::string& filename);
+
+        // optional: position of the file in the container; batch mapping uses it for sequential access
+        virtual u64 getFileOffset(const std::string& filename) const;
+
+        // optional: cache for decompressed blocks shared by many files (mgx)
+        virtual void setCacheCapacity(size_t bytes);
+        virtual MapperCacheStatistics getCacheStatistics() const;
+
+        // optional: the container was opened from a file in the native filesystem
+        virtual void setContainerFilename(const std::string& filename);
     };
 
+    struct MapperContainer;
+    struct MapperExtension;
+
     class Mapper : public AbstractMapper
     {
     protected:
         std::shared_ptr<Mapper> m_parent_mapper;
         std::vector<std::unique_ptr<AbstractMapper>> m_mappers;
-        std::unique_ptr<VirtualMemory> m_parent_memory { nullptr };
+        std::shared_ptr<MapperContainer> m_current_container;
         AbstractMapper* m_current_mapper { nullptr };
+        AbstractMapper* m_file_mapper { nullptr };
 
         std::string m_basepath;
         std::string m_pathname;
 
+        // batch mapping; declared last so that the destructor waits for the tasks first
+        std::mutex m_batch_mutex;
+        std::unique_ptr<ConcurrentQueue> m_batch_queue;
+
         AbstractMapper* createFileMapper(const std::string& basepath);
         std::string parse(const std::string& pathname, const std::string& password);
+        std::shared_ptr<MapperContainer> openContainer(const std::string& container, const MapperExtension& node, const std::string& password);
+
+        // string which identifies a file in the native filesystem and changes when the file is modified:
+        // canonical name, device and file index, size and modification time with sub-second resolution
+        static bool getFileIdentity(const std::string& filename, std::string& identity);
 
     public:
         Mapper(const std::string& pathname, const std::string& password);
@@ -127,7 +194,35 @@ namespace mango::filesystem
 
         bool isFile(const std::string& filename) const override;
         void getIndex(FileIndex& index, const std::string& pathname) override;
+
+        using AbstractMapper::map;
         std::unique_ptr<VirtualMemory> map(const std::string& filename) override;
+        std::unique_ptr<Stream> open(const std::string& filename) override;
+        u64 getFileOffset(const std::string& filename) const override;
+
+        // map files in parallel in the ThreadPool; the futures are in the same order as the filenames
+        // - sequential: schedule the files in the order they are stored in the container
+        std::vector<std::future<std::unique_ptr<VirtualMemory>>> map(const std::vector<std::string>& filenames, bool sequential = true);
+
+        void setCacheCapacity(size_t bytes) override;
+        MapperCacheStatistics getCacheStatistics() const override;
     };
 
+    // Persistent index cache for archives in the native filesystem (zip)
+    // - the central directory index is stored into the folder when an archive is indexed and
+    //   memory mapped when the same archive is opened again
+    // - the index is validated with the archive size, modification time and the checksum of
+    //   the directory end record
+    // - empty folder disables the cache (default)
+    void setIndexCacheFolder(const std::string& folder);
+
+    // Process-wide cache of opened containers (archives) shared by Path, File and nested containers
+    // - a container is identified by its canonical path, file index, size and modification time so that
+    //   opening many files from the same archive parses the archive only once
+    // - containers are released when no Path is using them, except for the most recently used
+    //   ones which are kept open up to the capacity (default: 0, disabled)
+    // - a container which is kept open stays mapped; on Windows the archive cannot be replaced
+    //   or deleted meanwhile
+    void setContainerCacheCapacity(size_t count);
+
 } // namespace mango::filesystem
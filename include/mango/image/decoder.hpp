@@ -5,7 +5,9 @@
 #pragma once
 
 #include <string>
+#include <functional>
 #include <mango/core/memory.hpp>
+#include <mango/core/buffer.hpp>
 #include <mango/core/exception.hpp>
 #include <mango/image/format.hpp>
 #include <mango/image/compression.hpp>
@@ -83,6 +85,38 @@ namespace mango::image
         bool simd = true;
         bool multithread = true;
         bool icc = false; // apply ICC profile
+
+        // request reduced-size decoding (jpg: 1, 2, 4 or 8)
+        // - decode() destination surface should be ceil(width / scale) x ceil(height / scale)
+        int scale = 1;
+
+        // request region-of-interest decoding (jpg)
+        // - the region is in destination pixels (after scaling) and clipped to the image
+        // - decode() destination surface should be the size of the clipped region
+        // - empty region decodes the whole image
+        struct
+        {
+            int x = 0;
+            int y = 0;
+            int width = 0;
+            int height = 0;
+        } roi;
+
+        // random access index (jpg: sequential Huffman scans without restart markers)
+        // - an empty index buffer is filled when the whole image is decoded
+        // - the index can be stored next to the image and given to later decode() calls;
+        //   these start from the nearest indexed MCU row and decode in parallel
+        Buffer* index = nullptr;
+
+        // streaming decoding (png)
+        // - the compressed data is inflated a few scanlines at a time instead of into a buffer
+        //   for the whole image, so the transient memory depends only on the image width
+        // - decoded scanlines are written into the decode() destination surface; when the surface
+        //   has no image memory the scanlines are only given to the scanline callback
+        // - the callback receives the scanlines in top-to-bottom order in the destination format
+        // - interlaced and animated images are decoded normally
+        bool streaming = false;
+        std::function<void(int y, const u8* scanline)> scanline;
     };
 
     class ImageDecoderInterface : protected NonCopyable
@@ -1,6 +1,6 @@
 /*
     MANGO Multimedia Development Platform
-    Copyright (C) 2012-2022 Twilight Finland 3D Oy Ltd. All rights reserved.
+    Copyright (C) 2012-2024 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
 #pragma once
 
@@ -23,6 +23,13 @@ namespace mango::image
 
     struct ImageEncodeOptions
     {
+        enum Subsampling : u8
+        {
+            S444, // full resolution chroma
+            S422, // chroma at half horizontal resolution
+            S420, // chroma at half horizontal and vertical resolution
+        };
+
         Palette palette;          // gif, png
 
         ConstMemory icc;          // jpg, png, jp2
@@ -30,8 +37,12 @@ namespace mango::image
         float quality = 0.90f;    // jpg, jp2, heif: [0.0, 1.0]
         int compression = 5;      // png: [0, 10]
         bool parallel = true;     // png
+        bool priming = false;     // png: parallel segments use previous 32 KB as dictionary (no pLLD)
         bool dithering = true;    // gif
         bool lossless = false;    // webp, jp2, heif
+        Subsampling subsampling = S444; // jpg
+        bool optimize = false;    // jpg: two-pass encoding with optimized huffman tables
+        bool progressive = false; // jpg: spectral selection scans, implies optimize
 
         bool simd = true;         // jpg
         bool multithread = true;  // jpg, jp2
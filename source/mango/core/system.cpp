@@ -319,26 +319,26 @@ namespace mango
     static
     constexpr u32 trace_pool_offset = 0x10000;
 
-    static
-    void write(Stream& output, const std::vector<Trace::Data>& traces, bool& comma)
+    // single producer (the owner thread), single consumer (the flusher) ring of events
+    struct Tracer::Buffer
     {
-        fmt::memory_buffer buffer;
+        static constexpr u32 capacity = 4096;
 
-        for (const auto& trace : traces)
-        {
-            u32 offset = 0;
-            if (trace.category == "Task")
-                offset = trace_pool_offset;
+        u32 tid;
+        u32 session;
 
-            fmt::format_to(std::back_inserter(buffer),
-                "{}\n{{ \"cat\":\"{}\", \"pid\":1, \"tid\":{}, \"ts\":{}, \"dur\":{}, \"ph\":\"X\", \"name\":\"{}\" }}",
-                    comma ? "," : "", trace.category, trace.tid + offset, trace.time0, trace.time1 - trace.time0, trace.name);
+        alignas(64) std::atomic<u32> head { 0 };
+        alignas(64) std::atomic<u32> tail { 0 };
+        std::atomic<u32> dropped { 0 };
 
-            comma = true;
-        }
+        Event events[capacity];
 
-        output.write(buffer.data(), buffer.size());
-    }
+        Buffer(u32 tid, u32 session)
+            : tid(tid)
+            , session(session)
+        {
+        }
+    };
 
     TraceThread::TraceThread(const std::string& name)
         : tid(getThreadID())
@@ -348,12 +348,28 @@ namespace mango
         g_context.tracer.threads.push_back(*this);
     }
 
+#if !defined(MANGO_DISABLE_TRACE)
+
     Trace::Trace(const std::string& category, const std::string& name)
+        : active(g_context.tracer.enabled.load(std::memory_order_relaxed))
+    {
+        if (active)
+        {
+            this->category = intern(category);
+            this->name = intern(name);
+            time0 = Time::us();
+        }
+    }
+
+    Trace::Trace(u32 category, u32 name)
+        : category(category)
+        , name(name)
+        , active(g_context.tracer.enabled.load(std::memory_order_relaxed))
     {
-        data.tid = getThreadID();
-        data.time0 = Time::us();
-        data.category = category;
-        data.name = name;
+        if (active)
+        {
+            time0 = Time::us();
+        }
     }
 
     Trace::~Trace()
@@ -363,12 +379,41 @@ namespace mango
 
     void Trace::stop()
     {
-        data.time1 = Time::us();
-        g_context.tracer.append(*this);
+        if (active)
+        {
+            active = false;
+            g_context.tracer.append({ category, name, time0, Time::us() });
+        }
+    }
+
+    bool Trace::enabled()
+    {
+        return g_context.tracer.enabled.load(std::memory_order_relaxed);
+    }
+
+    u32 Trace::intern(const std::string& text)
+    {
+        // the IDs are never released so each thread can cache them
+        thread_local std::unordered_map<std::string, u32> cache;
+
+        auto i = cache.find(text);
+        if (i != cache.end())
+        {
+            return i->second;
+        }
+
+        u32 id = g_context.tracer.intern(text);
+        cache[text] = id;
+        return id;
     }
 
+#endif
+
     Tracer::Tracer()
     {
+        // ID zero is the empty string
+        intern("");
+        task_category = intern("Task");
     }
 
     Tracer::~Tracer()
@@ -376,6 +421,123 @@ namespace mango
         stop();
     }
 
+    u32 Tracer::intern(const std::string& text)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        auto i = name_map.find(text);
+        if (i != name_map.end())
+        {
+            return i->second;
+        }
+
+        u32 id = u32(names.size());
+        names.push_back(text);
+        name_map[text] = id;
+        return id;
+    }
+
+    void Tracer::append(const Event& event)
+    {
+        thread_local std::shared_ptr<Buffer> local;
+
+        const u32 current = session.load(std::memory_order_acquire);
+
+        if (!local || local->session != current)
+        {
+            // first event of this thread in the current trace session
+            std::unique_lock<std::mutex> lock(mutex);
+            if (!output || session.load() != current)
+            {
+                return;
+            }
+
+            local = std::make_shared<Buffer>(getThreadID(), current);
+            buffers.push_back(local);
+        }
+
+        Buffer& buffer = *local;
+
+        const u32 head = buffer.head.load(std::memory_order_relaxed);
+        const u32 tail = buffer.tail.load(std::memory_order_acquire);
+        const u32 size = head - tail;
+
+        if (size >= Buffer::capacity)
+        {
+            // the flusher is behind; drop the event rather than stall the caller
+            buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        buffer.events[head % Buffer::capacity] = event;
+        buffer.head.store(head + 1, std::memory_order_release);
+
+        if (size == Buffer::capacity / 2)
+        {
+            flush_condition.notify_one();
+        }
+    }
+
+    void Tracer::flush()
+    {
+        // Only the events and the new names are copied under the lock; intern() and the
+        // first event of a thread take the same lock so they must not wait for the output.
+        // The flush state is used by one thread at a time: the flusher, or stop() after
+        // the flusher has been joined.
+        Stream* stream;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            stream = output;
+            if (!stream)
+            {
+                return;
+            }
+
+            flush_events.clear();
+
+            for (auto& buffer : buffers)
+            {
+                const u32 tail = buffer->tail.load(std::memory_order_relaxed);
+                const u32 head = buffer->head.load(std::memory_order_acquire);
+
+                for (u32 i = tail; i != head; ++i)
+                {
+                    flush_events.emplace_back(buffer->tid, buffer->events[i % Buffer::capacity]);
+                }
+
+                buffer->tail.store(head, std::memory_order_release);
+            }
+
+            // the IDs are never released; copy only the names interned after the previous flush
+            flush_names.insert(flush_names.end(), names.begin() + flush_names.size(), names.end());
+        }
+
+        if (flush_events.empty())
+        {
+            return;
+        }
+
+        fmt::memory_buffer text;
+
+        for (const auto& [tid, event] : flush_events)
+        {
+            u32 offset = 0;
+            if (event.category == task_category)
+                offset = trace_pool_offset;
+
+            fmt::format_to(std::back_inserter(text),
+                "{}\n{{ \"cat\":\"{}\", \"pid\":1, \"tid\":{}, \"ts\":{}, \"dur\":{}, \"ph\":\"X\", \"name\":\"{}\" }}",
+                    comma ? "," : "", flush_names[event.category], tid + offset,
+                    event.time0, event.time1 - event.time0, flush_names[event.name]);
+
+            comma = true;
+        }
+
+        stream->write(text.data(), text.size());
+    }
+
     void Tracer::start(Stream* stream)
     {
         std::unique_lock<std::mutex> lock(mutex);
@@ -388,14 +550,29 @@ namespace mango
 
         output = stream;
 
-        traces.clear();
-
+        buffers.clear();
         comma = false;
-        count = 0;
 
         // write header
         std::string s = fmt::format("{{\n\"traceEvents\": [");
         output->write(s.data(), s.length());
+
+        ++session;
+        enabled = true;
+
+        flush_stop = false;
+        flusher = std::thread([this]
+        {
+            std::unique_lock<std::mutex> flush_lock(flush_mutex);
+
+            while (!flush_stop)
+            {
+                flush_condition.wait_for(flush_lock, std::chrono::milliseconds(10));
+                flush_lock.unlock();
+                flush();
+                flush_lock.lock();
+            }
+        });
     }
 
     void Tracer::stop()
@@ -408,7 +585,21 @@ namespace mango
             return;
         }
 
-        writer.wait();
+        enabled = false;
+        ++session;
+
+        lock.unlock();
+
+        std::unique_lock<std::mutex> flush_lock(flush_mutex);
+        flush_stop = true;
+        flush_lock.unlock();
+        flush_condition.notify_one();
+        flusher.join();
+
+        // write the remaining events
+        flush();
+
+        lock.lock();
 
         fmt::memory_buffer buffer;
 
@@ -425,11 +616,21 @@ namespace mango
                     comma ? "," : "", th.tid + trace_pool_offset, th.name + " tasks:");
         }
 
+        u32 dropped = 0;
+        for (const auto& b : buffers)
+        {
+            dropped += b->dropped.load();
+        }
+
+        if (dropped)
+        {
+            printLine(Print::Warning, "Tracer: {} events dropped.", dropped);
+        }
+
         threads.clear();
-        output->write(buffer.data(), buffer.size());
+        buffers.clear();
 
-        write(*output, traces, comma);
-        traces.clear();
+        output->write(buffer.data(), buffer.size());
 
         // write footer
         std::string s = fmt::format("\n]\n}}\n");
@@ -438,27 +639,6 @@ namespace mango
         output = nullptr;
     }
 
-    void Tracer::append(const Trace& trace)
-    {
-        std::unique_lock<std::mutex> lock(mutex);
-        if (output)
-        {
-            traces.push_back(trace.data);
-
-            if (traces.size() >= 1024)
-            {
-                writer.wait();
-                std::swap(traces_out, traces);
-
-                writer.enqueue([&]
-                {
-                    write(*output, traces_out, comma);
-                    traces_out.clear();
-                });
-            }
-        }
-    }
-
     void startTrace(Stream* stream)
     {
         g_context.tracer.start(stream);
@@ -3,6 +3,7 @@
     Copyright (C) 2012-2024 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
 #include <chrono>
+#include <deque>
 #include <mango/core/system.hpp>
 #include <mango/core/thread.hpp>
 #include "../../external/concurrentqueue/concurrentqueue.h"
@@ -99,22 +100,115 @@ namespace mango
         moodycamel::ConcurrentQueue<Task> tasks;
     };
 
+    struct alignas(64) ThreadPool::Worker
+    {
+        using Task = ThreadPool::Task;
+
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::atomic<size_t> count { 0 };
+
+        void push(Task&& task)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+            count.store(tasks.size(), std::memory_order_relaxed);
+        }
+
+        // owner thread: newest task first (LIFO) for cache locality
+        bool pop(Task& task)
+        {
+            if (!count.load(std::memory_order_relaxed))
+                return false;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (tasks.empty())
+                return false;
+
+            task = std::move(tasks.back());
+            tasks.pop_back();
+            count.store(tasks.size(), std::memory_order_relaxed);
+            return true;
+        }
+
+        // other threads: oldest task first (FIFO); these are usually the largest ones.
+        // Without blocking a contended deque is skipped and reported in contended.
+        bool steal(Task& task, bool blocking, bool& contended)
+        {
+            if (!count.load(std::memory_order_relaxed))
+                return false;
+
+            std::unique_lock<std::mutex> lock(mutex, std::defer_lock);
+            if (blocking)
+            {
+                lock.lock();
+            }
+            else if (!lock.try_lock())
+            {
+                contended = true;
+                return false;
+            }
+
+            if (tasks.empty())
+                return false;
+
+            task = std::move(tasks.front());
+            tasks.pop_front();
+            count.store(tasks.size(), std::memory_order_relaxed);
+            return true;
+        }
+    };
+
+    struct ThreadPool::ScopedQueue
+    {
+        using Task = ThreadPool::Task;
+        moodycamel::ConcurrentQueue<Task> tasks;
+
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::atomic<int> waiting { 0 };
+
+        void notify()
+        {
+            if (waiting.load())
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                condition.notify_all();
+            }
+        }
+    };
+
+    // the pool and worker index of the current thread (if it is a worker thread)
+    static thread_local const ThreadPool* t_worker_pool = nullptr;
+    static thread_local size_t t_worker_index = 0;
+
     ThreadPool::ThreadPool(size_t size)
+        : ThreadPool(size, Scheduler::Shared, false)
+    {
+    }
+
+    ThreadPool::ThreadPool(size_t size, Scheduler scheduler, bool affinity)
         : m_queues(nullptr)
+        , m_workers(nullptr)
+        , m_scheduler(scheduler)
+        , m_affinity(affinity && getHardwareConcurrency() > 1)
         , m_static_queue(this, int(Priority::Normal), "static")
+        , m_token_queue(this, int(Priority::Normal), "")
         , m_threads(size)
     {
         m_queues = new TaskQueue[3];
+        m_workers = new Worker[size];
 
-        // NOTE: let OS scheduler shuffle tasks as it sees fit
-        //       this gives better performance overall UNTIL we have some practical
-        //       use for the affinity (eg. dependent tasks using same cache)
-        const bool affinity = false; //std::thread::hardware_concurrency() > 1;
-        if (affinity)
+        // NOTE: by default we let OS scheduler shuffle tasks as it sees fit
+        //       this gives better performance overall UNLESS the tasks benefit from
+        //       staying on the same core (eg. work-stealing keeps dependent tasks local)
+        if (m_affinity)
         {
             set_current_thread_affinity(0);
         }
 
+        const size_t processors = getHardwareConcurrency();
+
         for (size_t i = 0; i < size; ++i)
         {
             m_threads[i] = std::thread([this, i]
@@ -123,7 +217,7 @@ namespace mango
             });
 
 #if defined(MANGO_PLATFORM_WINDOWS)
-            if (getHardwareConcurrency() > 64)
+            if (processors > 64)
             {
                 // HACK: work around Windows 64 logical processor per ProcessorGroup limitation
                 GROUP_AFFINITY group{};
@@ -135,9 +229,9 @@ namespace mango
             }
 #endif
 
-            if (affinity)
+            if (m_affinity)
             {
-                set_thread_affinity(get_native_handle(m_threads[i]), int(i + 1));
+                set_thread_affinity(get_native_handle(m_threads[i]), int((i + 1) % processors));
             }
         }
     }
@@ -152,6 +246,7 @@ namespace mango
             thread.join();
         }
 
+        delete[] m_workers;
         delete[] m_queues;
     }
 
@@ -170,8 +265,26 @@ namespace mango
         return int(m_threads.size());
     }
 
+    ThreadPool::Scheduler ThreadPool::scheduler() const
+    {
+        return m_scheduler;
+    }
+
+    ThreadPool::Worker* ThreadPool::getLocalWorker() const
+    {
+        if (m_scheduler != Scheduler::WorkStealing || t_worker_pool != this)
+        {
+            return nullptr;
+        }
+
+        return m_workers + t_worker_index;
+    }
+
     void ThreadPool::thread(size_t threadID)
     {
+        t_worker_pool = this;
+        t_worker_index = threadID;
+
         std::string name = fmt::format("TP#{:03}", threadID + 1);
         TraceThread th(name);
 
@@ -203,9 +316,11 @@ namespace mango
                 }
             }
         }
+
+        t_worker_pool = nullptr;
     }
 
-    void ThreadPool::enqueue(Queue* queue, std::function<void()>&& func)
+    void ThreadPool::enqueue(Queue* queue, TaskFunction&& func)
     {
         Task task;
         task.queue = queue;
@@ -213,58 +328,202 @@ namespace mango
 
         ++queue->task_counter;
 
-        auto& tasks = m_queues[queue->priority].tasks;
-        //moodycamel::ProducerToken token(tasks);
+        if (queue->scoped)
+        {
+            std::shared_ptr<ScopedQueue> scoped = queue->scoped;
+            scoped->tasks.enqueue(std::move(task));
+            scoped->notify();
+
+            // the token runs one task of the scoped queue unless the waiting thread
+            // has already taken it; the shared state outlives the queue
+            Task token;
+            token.queue = &m_token_queue;
+            token.func = [this, scoped]
+            {
+                Task task;
+                if (scoped->tasks.try_dequeue(task))
+                {
+                    process(task);
+                    scoped->notify();
+                }
+            };
 
-        tasks.enqueue(std::move(task));
-        //tasks.enqueue(token, std::move(task));
+            ++m_token_queue.task_counter;
+            submit(std::move(token), queue->priority);
+        }
+        else
+        {
+            submit(std::move(task), queue->priority);
+        }
+    }
+
+    void ThreadPool::submit(Task&& task, int priority)
+    {
+        Worker* worker = getLocalWorker();
+        if (worker)
+        {
+            // NOTE: nested tasks stay in the worker's deque; the priority is
+            //       only applied to tasks submitted from outside of the pool
+            worker->push(std::move(task));
+        }
+        else
+        {
+            auto& tasks = m_queues[priority].tasks;
+            //moodycamel::ProducerToken token(tasks);
+
+            tasks.enqueue(std::move(task));
+            //tasks.enqueue(token, std::move(task));
+        }
 
         m_condition.notify_one();
     }
 
-    bool ThreadPool::dequeue_and_process()
+    bool ThreadPool::steal(Task& task, size_t start)
     {
+        const size_t count = m_threads.size();
+
+        // the first pass skips the deques which are locked by their owner or another thief;
+        // if any was skipped the second pass waits for the locks so that the thread does not
+        // go to sleep while there is work to steal
+        bool contended = false;
+
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            const bool blocking = pass > 0;
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                size_t index = (start + i) % count;
+                if (m_workers[index].steal(task, blocking, contended))
+                {
+                    return true;
+                }
+            }
+
+            if (!contended)
+            {
+                break;
+            }
+        }
+
+        return false;
+    }
+
+    bool ThreadPool::dequeue(Task& task)
+    {
+        Worker* worker = getLocalWorker();
+        if (worker && worker->pop(task))
+        {
+            return true;
+        }
+
         // scan task queues in priority order
         for (size_t priority = 0; priority < 3; ++priority)
         {
             auto& tasks = m_queues[priority].tasks;
             moodycamel::ConsumerToken token(tasks);
 
-            Task task;
             if (tasks.try_dequeue(token, task))
             {
-                Queue* queue = task.queue;
+                return true;
+            }
+        }
+
+        if (m_scheduler == Scheduler::WorkStealing)
+        {
+            // start from the next worker so that the victims are spread evenly
+            size_t start = worker ? t_worker_index + 1 : 0;
+            return steal(task, start);
+        }
+
+        return false;
+    }
+
+    void ThreadPool::process(Task& task)
+    {
+        Queue* queue = task.queue;
+
+        // check if the task is cancelled
+        if (!queue->cancelled)
+        {
+            if (queue->name.empty() || !Trace::enabled())
+            {
+                task.func();
+            }
+            else
+            {
+                static const u32 category = Trace::intern("Task");
 
-                // check if the task is cancelled
-                if (!queue->cancelled)
+                u32 name = queue->trace_name.load(std::memory_order_relaxed);
+                if (!name)
                 {
-                    if (queue->name.empty())
-                    {
-                        task.func();
-                    }
-                    else
-                    {
-                        Trace trace("Task", queue->name);
-                        task.func();
-                    }
+                    name = Trace::intern(queue->name);
+                    queue->trace_name.store(name, std::memory_order_relaxed);
                 }
 
-                --queue->task_counter;
-                return true;
+                Trace trace(category, name);
+                task.func();
             }
         }
 
+        --queue->task_counter;
+    }
+
+    bool ThreadPool::dequeue_and_process()
+    {
+        Task task;
+        if (dequeue(task))
+        {
+            process(task);
+            return true;
+        }
+
         return false;
     }
 
     void ThreadPool::wait(Queue* queue)
     {
+        if (queue->scoped)
+        {
+            wait_scoped(queue);
+            return;
+        }
+
         while (queue->task_counter > 0)
         {
             dequeue_and_process();
         }
     }
 
+    void ThreadPool::wait_scoped(Queue* queue)
+    {
+        std::shared_ptr<ScopedQueue> scoped = queue->scoped;
+
+        while (queue->task_counter > 0)
+        {
+            Task task;
+            if (scoped->tasks.try_dequeue(task))
+            {
+                process(task);
+                scoped->notify();
+                continue;
+            }
+
+            // the remaining tasks are running in other threads; sleep until one completes
+            // or a new task is enqueued. Both sides update their state before checking the
+            // other one so a notification cannot be lost between the predicate and the wait.
+            // NOTE: the tasks enqueued into nested queues by the running tasks are not run
+            //       here; the threads waiting for those queues help them instead.
+            std::unique_lock<std::mutex> lock(scoped->mutex);
+            ++scoped->waiting;
+            scoped->condition.wait(lock, [&]
+            {
+                return queue->task_counter == 0 || scoped->tasks.size_approx() > 0;
+            });
+            --scoped->waiting;
+        }
+    }
+
     void ThreadPool::cancel(Queue* queue)
     {
         queue->cancelled = true;
@@ -282,10 +541,14 @@ namespace mango
     {
     }
 
-    ConcurrentQueue::ConcurrentQueue(const std::string& name, Priority priority)
+    ConcurrentQueue::ConcurrentQueue(const std::string& name, Priority priority, WaitPolicy policy)
         : m_pool(ThreadPool::getInstance())
         , m_queue(&m_pool, int(priority), name)
     {
+        if (policy == WaitPolicy::Scoped)
+        {
+            m_queue.scoped = std::make_shared<ThreadPool::ScopedQueue>();
+        }
     }
 
     ConcurrentQueue::ConcurrentQueue(ThreadPool& pool)
@@ -294,10 +557,14 @@ namespace mango
     {
     }
 
-    ConcurrentQueue::ConcurrentQueue(ThreadPool& pool, const std::string& name, Priority priority)
+    ConcurrentQueue::ConcurrentQueue(ThreadPool& pool, const std::string& name, Priority priority, WaitPolicy policy)
         : m_pool(pool)
         , m_queue(&m_pool, int(priority), name)
     {
+        if (policy == WaitPolicy::Scoped)
+        {
+            m_queue.scoped = std::make_shared<ThreadPool::ScopedQueue>();
+        }
     }
 
     ConcurrentQueue::~ConcurrentQueue()
@@ -320,6 +587,88 @@ namespace mango
         m_pool.wait(&m_queue);
     }
 
+    // ------------------------------------------------------------
+    // TaskGraph
+    // ------------------------------------------------------------
+
+    TaskGraph::TaskGraph()
+        : m_queue()
+    {
+    }
+
+    TaskGraph::TaskGraph(const std::string& name, Priority priority)
+        : m_queue(name, priority)
+    {
+    }
+
+    TaskGraph::TaskGraph(ThreadPool& pool, const std::string& name, Priority priority)
+        : m_queue(pool, name, priority)
+    {
+    }
+
+    TaskGraph::~TaskGraph()
+    {
+        wait();
+    }
+
+    void TaskGraph::edge(Node from, Node to)
+    {
+        NodeData& source = m_nodes[from];
+        NodeData& target = m_nodes[to];
+        source.successors.push_back(&target);
+        ++target.dependencies;
+    }
+
+    size_t TaskGraph::size() const
+    {
+        return m_nodes.size();
+    }
+
+    void TaskGraph::submit(NodeData* node)
+    {
+        m_queue.enqueue([this, node]
+        {
+            node->func();
+
+            // the successors are enqueued before this task completes so wait() cannot
+            // observe an empty queue while the graph still has work left
+            for (NodeData* successor : node->successors)
+            {
+                if (--successor->pending == 0)
+                {
+                    submit(successor);
+                }
+            }
+        });
+    }
+
+    void TaskGraph::run()
+    {
+        for (auto& node : m_nodes)
+        {
+            node.pending = node.dependencies;
+        }
+
+        for (auto& node : m_nodes)
+        {
+            if (!node.dependencies)
+            {
+                submit(&node);
+            }
+        }
+    }
+
+    void TaskGraph::cancel()
+    {
+        // the cancelled nodes do not trigger their successors
+        m_queue.cancel();
+    }
+
+    void TaskGraph::wait()
+    {
+        m_queue.wait();
+    }
+
     // ------------------------------------------------------------
     // SerialQueue
     // ------------------------------------------------------------
@@ -13,7 +13,7 @@ namespace mango::filesystem
     // File
     // -----------------------------------------------------------------
 
-    File::File(const std::string& s)
+    File::File(const std::string& s, u32 hints)
     {
         // split s into pathname + filename
         size_t n = s.find_last_of("/\\:");
@@ -26,10 +26,10 @@ namespace mango::filesystem
         m_path = std::make_unique<Path>(filepath);
 
         Mapper& mapper = m_path->getMapper();
-        initMemory(mapper);
+        initMemory(mapper, hints);
     }
 
-    File::File(const Path& path, const std::string& s)
+    File::File(const Path& path, const std::string& s, u32 hints)
     {
         // split s into pathname + filename
         size_t n = s.find_last_of("/\\:");
@@ -42,7 +42,7 @@ namespace mango::filesystem
         m_path = std::make_unique<Path>(path, filepath);
 
         Mapper& mapper = m_path->getMapper();
-        initMemory(mapper);
+        initMemory(mapper, hints);
     }
 
     File::File(ConstMemory memory, const std::string& extension, const std::string& s)
@@ -62,16 +62,16 @@ namespace mango::filesystem
         m_path = std::make_unique<Path>(path, filepath);
 
         Mapper& mapper = m_path->getMapper();
-        initMemory(mapper);
+        initMemory(mapper, MapHint::NONE);
     }
 
     File::~File()
     {
     }
 
-    void File::initMemory(Mapper& mapper)
+    void File::initMemory(Mapper& mapper, u32 hints)
     {
-        m_virtual_memory = mapper.map(m_filename);
+        m_virtual_memory = mapper.map(m_filename, hints);
         if (m_virtual_memory)
         {
             m_memory = *m_virtual_memory;
@@ -113,4 +113,90 @@ namespace mango::filesystem
         return m_memory.size;
     }
 
+    // -----------------------------------------------------------------
+    // InputPathStream
+    // -----------------------------------------------------------------
+
+    InputPathStream::InputPathStream(const std::string& s)
+    {
+        // split s into pathname + filename
+        size_t n = s.find_last_of("/\\:");
+        std::string filename = s.substr(n + 1);
+        std::string filepath = s.substr(0, n + 1);
+
+        m_filename = filename;
+
+        // create a internal path
+        m_path = std::make_unique<Path>(filepath);
+
+        Mapper& mapper = m_path->getMapper();
+        initStream(mapper);
+    }
+
+    InputPathStream::InputPathStream(const Path& path, const std::string& s)
+    {
+        // split s into pathname + filename
+        size_t n = s.find_last_of("/\\:");
+        std::string filename = s.substr(n + 1);
+        std::string filepath = s.substr(0, n + 1);
+
+        m_filename = filename;
+
+        // create a internal path
+        m_path = std::make_unique<Path>(path, filepath);
+
+        Mapper& mapper = m_path->getMapper();
+        initStream(mapper);
+    }
+
+    InputPathStream::~InputPathStream()
+    {
+    }
+
+    void InputPathStream::initStream(Mapper& mapper)
+    {
+        m_stream = mapper.open(m_filename);
+        if (!m_stream)
+        {
+            MANGO_EXCEPTION("[InputPathStream] Opening \"{}\" failed.", m_filename);
+        }
+    }
+
+    const Path& InputPathStream::path() const
+    {
+        return *m_path;
+    }
+
+    const std::string& InputPathStream::filename() const
+    {
+        return m_filename;
+    }
+
+    u64 InputPathStream::size() const
+    {
+        return m_stream->size();
+    }
+
+    u64 InputPathStream::offset() const
+    {
+        return m_stream->offset();
+    }
+
+    void InputPathStream::seek(s64 distance, SeekMode mode)
+    {
+        m_stream->seek(distance, mode);
+    }
+
+    void InputPathStream::read(void* dest, u64 size)
+    {
+        m_stream->read(dest, size);
+    }
+
+    void InputPathStream::write(const void* data, u64 size)
+    {
+        MANGO_UNREFERENCED(data);
+        MANGO_UNREFERENCED(size);
+        MANGO_EXCEPTION("[InputPathStream] Writing into read-only stream.");
+    }
+
 } // namespace mango::filesystem
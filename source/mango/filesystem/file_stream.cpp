@@ -0,0 +1,343 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2023 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <cstring>
+#include <algorithm>
+#include <mango/core/string.hpp>
+#include <mango/core/exception.hpp>
+#include <mango/core/system.hpp>
+#include <mango/core/thread.hpp>
+#include <mango/filesystem/file.hpp>
+#include "native_file.hpp"
+
+namespace mango::filesystem
+{
+
+    // -----------------------------------------------------------------
+    // FileHandle
+    // -----------------------------------------------------------------
+
+    /*
+        The stream is buffered so that small reads and writes (write8, write16, ..) do not
+        each become a system call. When writing, a full buffer is written by a task in the
+        shared ThreadPool while the next buffer is filled; the queue has scoped wait policy
+        so waiting for the write does not run unrelated tasks. Large reads and writes
+        bypass the buffer.
+
+        A read which reaches the end of file is short: the bytes after the end are not
+        written and the offset stops at the end, as with the unbuffered stream.
+    */
+
+    struct FileHandle
+    {
+        static constexpr size_t BUFFER_SIZE = 256 * 1024;
+
+        std::unique_ptr<NativeFile> m_file;
+        std::string m_filename;
+        Stream::OpenMode m_mode;
+
+        u64 m_offset = 0; // stream offset
+        u64 m_size = 0; // file size including buffered data (WRITE)
+
+        // READ: cached file data, WRITE: data not written yet
+        std::unique_ptr<u8[]> m_buffer;
+        u64 m_buffer_offset = 0;
+        size_t m_buffer_bytes = 0;
+
+        // write-behind; the queue is destroyed first since its task uses the buffer
+        std::unique_ptr<u8[]> m_writer_buffer;
+        std::unique_ptr<ConcurrentQueue> m_writer;
+        std::mutex m_error_mutex;
+        std::string m_error;
+
+        FileHandle(const std::string& filename, Stream::OpenMode mode)
+            : m_file(createNativeFile(filename, mode))
+            , m_filename(filename)
+            , m_mode(mode)
+        {
+        }
+
+        ~FileHandle()
+        {
+            try
+            {
+                flush();
+            }
+            catch (const Exception& e)
+            {
+                // destructor cannot throw; the caller must use flush() to handle errors
+                printLine(Print::Error, "{}", e.what());
+            }
+        }
+
+        const std::string& filename() const
+        {
+            return m_filename;
+        }
+
+        u64 size() const
+        {
+            return m_mode == Stream::WRITE ? m_size : m_file->size();
+        }
+
+        u64 offset() const
+        {
+            return m_offset;
+        }
+
+        void seek(s64 distance, Stream::SeekMode mode)
+        {
+            s64 offset = 0;
+
+            switch (mode)
+            {
+                case Stream::BEGIN:
+                    offset = distance;
+                    break;
+
+                case Stream::CURRENT:
+                    offset = s64(m_offset) + distance;
+                    break;
+
+                case Stream::END:
+                    offset = s64(size()) + distance;
+                    break;
+            }
+
+            if (offset < 0)
+            {
+                MANGO_EXCEPTION("[FileStream] Seeking before the beginning of \"{}\".", m_filename);
+            }
+
+            if (m_mode == Stream::WRITE && u64(offset) != m_offset)
+            {
+                // the buffered data must be contiguous
+                writeBuffer();
+            }
+
+            m_offset = u64(offset);
+        }
+
+        void read(void* dest, u64 size)
+        {
+            u8* data = reinterpret_cast<u8*>(dest);
+
+            while (size > 0)
+            {
+                if (m_offset >= m_buffer_offset && m_offset < m_buffer_offset + m_buffer_bytes)
+                {
+                    size_t position = size_t(m_offset - m_buffer_offset);
+                    size_t bytes = size_t(std::min(size, u64(m_buffer_bytes - position)));
+
+                    std::memcpy(data, m_buffer.get() + position, bytes);
+                    data += bytes;
+                    size -= bytes;
+                    m_offset += bytes;
+                    continue;
+                }
+
+                if (size >= BUFFER_SIZE)
+                {
+                    // large read goes directly into the destination
+                    m_offset += m_file->read(data, size_t(size), m_offset);
+                    break;
+                }
+
+                if (!m_buffer)
+                {
+                    m_buffer.reset(new u8[BUFFER_SIZE]);
+                }
+
+                m_buffer_offset = m_offset;
+                m_buffer_bytes = m_file->read(m_buffer.get(), BUFFER_SIZE, m_offset);
+                if (!m_buffer_bytes)
+                {
+                    // end of file
+                    break;
+                }
+            }
+        }
+
+        void read(void* dest, size_t size, u64 offset) const
+        {
+            if (m_file->read(dest, size, offset) != size)
+            {
+                MANGO_EXCEPTION("[FileStream] Reading past end of \"{}\".", m_filename);
+            }
+        }
+
+        void write(const void* data, u64 size)
+        {
+            checkError();
+
+            const u8* source = reinterpret_cast<const u8*>(data);
+
+            if (!m_buffer_bytes)
+            {
+                m_buffer_offset = m_offset;
+            }
+
+            while (size > 0)
+            {
+                if (!m_buffer_bytes && size >= BUFFER_SIZE)
+                {
+                    // large write goes directly into the file
+                    waitWriter();
+                    m_file->write(source, size_t(size), m_offset);
+                    m_offset += size;
+                    break;
+                }
+
+                if (!m_buffer)
+                {
+                    m_buffer.reset(new u8[BUFFER_SIZE]);
+                }
+
+                size_t bytes = size_t(std::min(size, u64(BUFFER_SIZE - m_buffer_bytes)));
+                std::memcpy(m_buffer.get() + m_buffer_bytes, source, bytes);
+
+                m_buffer_bytes += bytes;
+                source += bytes;
+                size -= bytes;
+                m_offset += bytes;
+
+                if (m_buffer_bytes == BUFFER_SIZE)
+                {
+                    submitBuffer();
+                }
+            }
+
+            m_size = std::max(m_size, m_offset);
+        }
+
+        void flush()
+        {
+            if (m_mode == Stream::WRITE)
+            {
+                writeBuffer();
+                checkError();
+            }
+        }
+
+        void submitBuffer()
+        {
+            if (!m_writer)
+            {
+                m_writer = std::make_unique<ConcurrentQueue>("filestream.writer", Priority::Normal, WaitPolicy::Scoped);
+                m_writer_buffer.reset(new u8[BUFFER_SIZE]);
+            }
+
+            // the writer buffer is free when the previous write is complete
+            m_writer->wait();
+            std::swap(m_buffer, m_writer_buffer);
+
+            const u8* data = m_writer_buffer.get();
+            size_t bytes = m_buffer_bytes;
+            u64 offset = m_buffer_offset;
+
+            m_writer->enqueue([this, data, bytes, offset]
+            {
+                try
+                {
+                    m_file->write(data, bytes, offset);
+                }
+                catch (const Exception& e)
+                {
+                    std::lock_guard<std::mutex> lock(m_error_mutex);
+                    if (m_error.empty())
+                    {
+                        m_error = e.what();
+                    }
+                }
+            });
+
+            m_buffer_bytes = 0;
+            m_buffer_offset = m_offset;
+        }
+
+        void writeBuffer()
+        {
+            waitWriter();
+
+            if (m_buffer_bytes)
+            {
+                m_file->write(m_buffer.get(), m_buffer_bytes, m_buffer_offset);
+                m_buffer_bytes = 0;
+            }
+        }
+
+        void waitWriter()
+        {
+            if (m_writer)
+            {
+                m_writer->wait();
+            }
+        }
+
+        void checkError()
+        {
+            std::lock_guard<std::mutex> lock(m_error_mutex);
+            if (!m_error.empty())
+            {
+                MANGO_EXCEPTION("{}", m_error);
+            }
+        }
+    };
+
+    // -----------------------------------------------------------------
+    // FileStream
+    // -----------------------------------------------------------------
+
+    FileStream::FileStream(const std::string& filename, OpenMode mode)
+        : m_handle(nullptr)
+    {
+        m_handle = new FileHandle(filename, mode);
+    }
+
+    FileStream::~FileStream()
+    {
+        delete m_handle;
+    }
+
+    const std::string& FileStream::filename() const
+    {
+        return m_handle->filename();
+    }
+
+    u64 FileStream::size() const
+    {
+        return m_handle->size();
+    }
+
+    u64 FileStream::offset() const
+    {
+        return m_handle->offset();
+    }
+
+    void FileStream::seek(s64 distance, SeekMode mode)
+    {
+        m_handle->seek(distance, mode);
+    }
+
+    void FileStream::read(void* dest, u64 size)
+    {
+        m_handle->read(dest, size);
+    }
+
+    void FileStream::read(void* dest, u64 size, u64 offset) const
+    {
+        m_handle->read(dest, size_t(size), offset);
+    }
+
+    void FileStream::write(const void* data, u64 size)
+    {
+        m_handle->write(data, size);
+    }
+
+    void FileStream::flush()
+    {
+        m_handle->flush();
+    }
+
+} // namespace mango::filesystem
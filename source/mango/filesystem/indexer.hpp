@@ -5,40 +5,311 @@
 #pragma once
 
 #include <string>
-#include <map>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <mango/core/configure.hpp>
+#include <mango/core/hash.hpp>
 
 namespace mango::filesystem
 {
 
+    // -----------------------------------------------------------------
+    // StringArena
+    // -----------------------------------------------------------------
+
+    class StringArena
+    {
+    protected:
+        static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+        std::vector<std::unique_ptr<char[]>> m_blocks;
+        size_t m_used = BLOCK_SIZE;
+
+    public:
+        // the returned view is valid for the lifetime of the arena
+        std::string_view store(std::string_view s)
+        {
+            char* dest;
+
+            if (s.size() > BLOCK_SIZE / 4)
+            {
+                // large strings are stored in their own block so that the current one is not wasted
+                auto position = m_blocks.empty() ? m_blocks.end() : m_blocks.end() - 1;
+                dest = m_blocks.emplace(position, new char[s.size()])->get();
+            }
+            else
+            {
+                if (m_used + s.size() > BLOCK_SIZE)
+                {
+                    m_blocks.emplace_back(new char[BLOCK_SIZE]);
+                    m_used = 0;
+                }
+
+                dest = m_blocks.back().get() + m_used;
+                m_used += s.size();
+            }
+
+            std::memcpy(dest, s.data(), s.size());
+            return std::string_view(dest, s.size());
+        }
+    };
+
+    // -----------------------------------------------------------------
+    // Indexer
+    // -----------------------------------------------------------------
+
+    /*
+        The paths are stored as a tree of nodes which only hold the last path component
+        ("bar.txt" or "foo/") so that shared prefixes are stored once. The nodes are found by
+        hashing the full path into an open addressing table; the candidate is compared by
+        walking its parent chain against the path from the end.
+    */
+
     template <typename Header>
     class Indexer
     {
     public:
         struct Folder
         {
-            std::map<std::string, Header *> headers;
+            // children sorted by name
+            std::vector<std::pair<std::string_view, const Header*>> headers;
+            bool sorted = true;
         };
 
     protected:
-        std::map<std::string, Folder> folders;
-        std::map<std::string, Header> headers;
+        static constexpr u32 NONE = 0xffffffff;
+
+        struct Node
+        {
+            u64 hash;         // hash of the full path
+            const char* name; // last path component
+            u32 length;
+            u32 parent;
+            u32 folder;
+            u32 header;
+
+            std::string_view getName() const
+            {
+                return std::string_view(name, length);
+            }
+        };
+
+        StringArena m_strings;
+        std::vector<Node> m_nodes;
+        std::vector<u32> m_table; // node index + 1 (0: empty slot)
+
+        std::deque<Header> m_headers;
+        mutable std::deque<Folder> m_folders;
+
+        // folders which have children that are not sorted yet
+        mutable std::vector<u32> m_unsorted;
+        mutable std::atomic<bool> m_dirty { false };
+        mutable std::mutex m_mutex;
+
+        static u64 hash(std::string_view path)
+        {
+            return xx3hash64(0, ConstMemory(reinterpret_cast<const u8*>(path.data()), path.size()));
+        }
+
+        static std::string_view getParent(std::string_view path)
+        {
+            // same as getPath() but the trailing separator of a folder is ignored
+            if (path.size() < 2)
+            {
+                return std::string_view();
+            }
+
+            size_t n = path.find_last_of("/\\:", path.size() - 2);
+            if (n == std::string_view::npos)
+            {
+                return std::string_view();
+            }
+
+            return path.substr(0, n + 1);
+        }
+
+        bool compare(u32 index, std::string_view path) const
+        {
+            size_t length = path.size();
+
+            for ( ; index; index = m_nodes[index].parent)
+            {
+                std::string_view name = m_nodes[index].getName();
+
+                if (length < name.size() || std::memcmp(path.data() + length - name.size(), name.data(), name.size()))
+                {
+                    return false;
+                }
+
+                length -= name.size();
+            }
+
+            // the root node is the empty path
+            return length == 0;
+        }
+
+        u32 find(std::string_view path, u64 h) const
+        {
+            const size_t mask = m_table.size() - 1;
+
+            for (size_t i = h & mask; m_table[i]; i = (i + 1) & mask)
+            {
+                u32 index = m_table[i] - 1;
+                if (m_nodes[index].hash == h && compare(index, path))
+                {
+                    return index;
+                }
+            }
+
+            return NONE;
+        }
+
+        void link(u32 index)
+        {
+            const size_t mask = m_table.size() - 1;
+
+            size_t i = m_nodes[index].hash & mask;
+            while (m_table[i])
+            {
+                i = (i + 1) & mask;
+            }
+
+            m_table[i] = index + 1;
+        }
+
+        u32 create(u64 h, u32 parent, std::string_view name)
+        {
+            if ((m_nodes.size() + 1) * 4 > m_table.size() * 3)
+            {
+                // keep the load factor below 75%
+                m_table.assign(m_table.size() * 2, 0);
+                for (u32 i = 0; i < u32(m_nodes.size()); ++i)
+                {
+                    link(i);
+                }
+            }
+
+            name = m_strings.store(name);
+
+            u32 index = u32(m_nodes.size());
+            m_nodes.push_back({ h, name.data(), u32(name.size()), parent, NONE, NONE });
+            link(index);
+
+            return index;
+        }
+
+        u32 findOrCreate(std::string_view path)
+        {
+            u64 h = hash(path);
+
+            u32 index = find(path, h);
+            if (index == NONE)
+            {
+                std::string_view parent = getParent(path);
+                u32 parent_index = findOrCreate(parent);
+                index = create(h, parent_index, path.substr(parent.size()));
+            }
+
+            return index;
+        }
+
+        u32 getFolderIndex(u32 index)
+        {
+            Node& node = m_nodes[index];
+            if (node.folder == NONE)
+            {
+                node.folder = u32(m_folders.size());
+                m_folders.emplace_back();
+            }
+
+            return node.folder;
+        }
+
+        void sort() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            for (u32 index : m_unsorted)
+            {
+                Folder& folder = m_folders[index];
+                std::sort(folder.headers.begin(), folder.headers.end(), [] (const auto& a, const auto& b)
+                {
+                    return a.first < b.first;
+                });
+                folder.sorted = true;
+            }
+
+            m_unsorted.clear();
+            m_dirty = false;
+        }
 
     public:
-        void insert(const std::string& foldername, const std::string& filename, const Header& header)
+        Indexer()
+            : m_table(64, 0)
+        {
+            // root node
+            m_nodes.push_back({ hash(std::string_view()), nullptr, 0, NONE, NONE, NONE });
+            link(0);
+        }
+
+        // Returns true when the filename was not indexed before. Otherwise the header is replaced
+        // and the caller can assume that the parent folders are already indexed.
+        bool insert(const std::string& foldername, const std::string& filename, const Header& header)
         {
-            Header* ptr = &headers[filename];
-            *ptr = header;
-            folders[foldername].headers.emplace(filename, ptr);
+            u32 parent = findOrCreate(foldername);
+            u32 folder_index = getFolderIndex(parent);
+
+            u64 h = hash(filename);
+            u32 index = find(filename, h);
+            if (index == NONE)
+            {
+                index = create(h, parent, std::string_view(filename).substr(foldername.length()));
+            }
+
+            Node& node = m_nodes[index];
+            if (node.header != NONE)
+            {
+                m_headers[node.header] = header;
+                return false;
+            }
+
+            node.header = u32(m_headers.size());
+            m_headers.push_back(header);
+
+            std::string_view name = node.getName();
+
+            Folder& folder = m_folders[folder_index];
+            if (folder.sorted && !folder.headers.empty() && name < folder.headers.back().first)
+            {
+                // sorting is deferred until the folder is requested
+                folder.sorted = false;
+                m_unsorted.push_back(folder_index);
+                m_dirty = true;
+            }
+
+            folder.headers.emplace_back(name, &m_headers.back());
+            return true;
         }
 
         const Folder* getFolder(const std::string& pathname) const
         {
             const Folder* result = nullptr; // default: not found
 
-            auto i = folders.find(pathname);
-            if (i != folders.end())
+            u32 index = find(pathname, hash(pathname));
+            if (index != NONE && m_nodes[index].folder != NONE)
             {
-                result = &i->second;
+                if (m_dirty)
+                {
+                    sort();
+                }
+
+                result = &m_folders[m_nodes[index].folder];
             }
 
             return result;
@@ -48,10 +319,10 @@ namespace mango::filesystem
         {
             const Header* result = nullptr; // default: not found
 
-            auto i = headers.find(filename);
-            if (i != headers.end())
+            u32 index = find(filename, hash(filename));
+            if (index != NONE && m_nodes[index].header != NONE)
             {
-                result = &i->second;
+                result = &m_headers[m_nodes[index].header];
             }
 
             return result;
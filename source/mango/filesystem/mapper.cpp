@@ -3,11 +3,17 @@
     Copyright (C) 2012-2023 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
 #include <vector>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <numeric>
 #include <algorithm>
 #include <string_view>
 #include <mango/core/string.hpp>
+#include <mango/core/thread.hpp>
 #include <mango/filesystem/mapper.hpp>
 #include <mango/filesystem/path.hpp>
+#include "native_file.hpp"
 
 namespace mango::filesystem
 {
@@ -67,6 +73,122 @@ namespace mango::filesystem
         return nullptr;
     }
 
+    // -----------------------------------------------------------------
+    // container cache
+    // -----------------------------------------------------------------
+
+    struct MapperContainer
+    {
+        std::string key; // empty: the container is not shared
+        std::shared_ptr<MapperContainer> parent; // the memory is mapped from the parent container
+        std::unique_ptr<VirtualMemory> memory;
+        std::unique_ptr<AbstractMapper> mapper;
+    };
+
+    class ContainerCache
+    {
+    protected:
+        std::mutex m_mutex;
+        std::unordered_map<std::string, std::weak_ptr<MapperContainer>> m_containers;
+
+        // most recently used containers are kept open even when no Path is using them
+        std::list<std::shared_ptr<MapperContainer>> m_recent;
+        size_t m_capacity = 0;
+
+        void touch(const std::shared_ptr<MapperContainer>& container, std::vector<std::shared_ptr<MapperContainer>>& released)
+        {
+            auto i = std::find(m_recent.begin(), m_recent.end(), container);
+            if (i != m_recent.end())
+            {
+                m_recent.splice(m_recent.begin(), m_recent, i);
+            }
+            else if (m_capacity > 0)
+            {
+                m_recent.push_front(container);
+            }
+
+            trim(released);
+        }
+
+        void trim(std::vector<std::shared_ptr<MapperContainer>>& released)
+        {
+            // the containers are released by the caller after the lock is gone
+            while (m_recent.size() > m_capacity)
+            {
+                released.push_back(std::move(m_recent.back()));
+                m_recent.pop_back();
+            }
+        }
+
+    public:
+        std::shared_ptr<MapperContainer> find(const std::string& key)
+        {
+            std::vector<std::shared_ptr<MapperContainer>> released;
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            std::shared_ptr<MapperContainer> container;
+
+            auto i = m_containers.find(key);
+            if (i != m_containers.end())
+            {
+                container = i->second.lock();
+                if (container)
+                {
+                    touch(container, released);
+                }
+            }
+
+            return container;
+        }
+
+        std::shared_ptr<MapperContainer> insert(std::shared_ptr<MapperContainer> container)
+        {
+            std::vector<std::shared_ptr<MapperContainer>> released;
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            // another thread might have opened the same container meanwhile
+            std::weak_ptr<MapperContainer>& entry = m_containers[container->key];
+            std::shared_ptr<MapperContainer> current = entry.lock();
+            if (current)
+            {
+                released.push_back(std::move(container));
+                container = current;
+            }
+            else
+            {
+                entry = container;
+
+                // forget the containers which have been released
+                for (auto i = m_containers.begin(); i != m_containers.end(); )
+                {
+                    if (i->second.expired())
+                        i = m_containers.erase(i);
+                    else
+                        ++i;
+                }
+            }
+
+            touch(container, released);
+            return container;
+        }
+
+        void setCapacity(size_t count)
+        {
+            std::vector<std::shared_ptr<MapperContainer>> released;
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            m_capacity = count;
+            trim(released);
+        }
+    };
+
+    static ContainerCache g_container_cache;
+
+    void setContainerCacheCapacity(size_t count)
+    {
+        g_container_cache.setCapacity(count);
+    }
+
     // -----------------------------------------------------------------
     // FileInfo
     // -----------------------------------------------------------------
@@ -134,6 +256,139 @@ namespace mango::filesystem
         }
     }
 
+    // -----------------------------------------------------------------
+    // VirtualMemoryStream
+    // -----------------------------------------------------------------
+
+    class VirtualMemoryStream : public ConstMemoryStream
+    {
+    protected:
+        std::unique_ptr<VirtualMemory> m_virtual_memory;
+
+    public:
+        VirtualMemoryStream(std::unique_ptr<VirtualMemory> memory)
+            : ConstMemoryStream(*memory)
+            , m_virtual_memory(std::move(memory))
+        {
+        }
+
+        ~VirtualMemoryStream()
+        {
+        }
+    };
+
+    // -----------------------------------------------------------------
+    // VirtualMemoryReadahead
+    // -----------------------------------------------------------------
+
+    class VirtualMemoryReadahead : public VirtualMemory
+    {
+    protected:
+        static constexpr size_t CHUNK_SIZE = 1024 * 1024;
+
+        std::unique_ptr<VirtualMemory> m_virtual_memory;
+        uintptr_t m_page_size;
+        ConcurrentQueue m_queue;
+
+        // touch the pages of one chunk and continue with the next one in a new task so that
+        // a large file does not keep a pool thread busy from the other queues
+        void touch(size_t offset)
+        {
+            const uintptr_t begin = uintptr_t(m_memory.address + offset) & ~(m_page_size - 1);
+            const uintptr_t end = uintptr_t(m_memory.address + std::min(offset + CHUNK_SIZE, m_memory.size));
+
+            for (uintptr_t page = begin; page < end; page += m_page_size)
+            {
+                u8 value = *reinterpret_cast<const volatile u8*>(page);
+                MANGO_UNREFERENCED(value);
+            }
+
+            offset += CHUNK_SIZE;
+            if (offset < m_memory.size)
+            {
+                m_queue.enqueue([this, offset]
+                {
+                    touch(offset);
+                });
+            }
+        }
+
+    public:
+        VirtualMemoryReadahead(std::unique_ptr<VirtualMemory> memory)
+            : m_virtual_memory(std::move(memory))
+            , m_page_size(uintptr_t(getPageSize()))
+            , m_queue("readahead", Priority::Low, WaitPolicy::Scoped)
+        {
+            m_memory = *m_virtual_memory;
+
+            // touch the pages in order so that the consumer finds them resident
+            if (m_memory.size)
+            {
+                m_queue.enqueue([this]
+                {
+                    touch(0);
+                });
+            }
+        }
+
+        ~VirtualMemoryReadahead()
+        {
+            // the remaining chunks are skipped and the running one completes before
+            // the memory is released
+            m_queue.cancel();
+        }
+    };
+
+    // -----------------------------------------------------------------
+    // AbstractMapper
+    // -----------------------------------------------------------------
+
+    std::unique_ptr<Stream> AbstractMapper::open(const std::string& filename)
+    {
+        std::unique_ptr<VirtualMemory> memory = map(filename);
+        if (!memory)
+            return nullptr;
+
+        return std::make_unique<VirtualMemoryStream>(std::move(memory));
+    }
+
+    void AbstractMapper::setCacheCapacity(size_t bytes)
+    {
+        MANGO_UNREFERENCED(bytes);
+    }
+
+    std::unique_ptr<VirtualMemory> AbstractMapper::map(const std::string& filename, u32 hints)
+    {
+        std::unique_ptr<VirtualMemory> memory = map(filename);
+        if (!memory)
+            return nullptr;
+
+        adviseMemory(*memory, hints);
+
+        if (hints & MapHint::READAHEAD)
+        {
+            memory = std::make_unique<VirtualMemoryReadahead>(std::move(memory));
+        }
+
+        return memory;
+    }
+
+    u64 AbstractMapper::getFileOffset(const std::string& filename) const
+    {
+        MANGO_UNREFERENCED(filename);
+        return 0;
+    }
+
+    MapperCacheStatistics AbstractMapper::getCacheStatistics() const
+    {
+        return MapperCacheStatistics();
+    }
+
+    void AbstractMapper::setContainerFilename(const std::string& filename)
+    {
+        MANGO_UNREFERENCED(filename);
+    }
+
     // -----------------------------------------------------------------
     // Mapper
     // -----------------------------------------------------------------
@@ -149,7 +404,9 @@ namespace mango::filesystem
     {
         // use parent's mapper
         m_parent_mapper = mapper;
+        m_current_container = mapper->m_current_container;
         m_current_mapper = mapper->m_current_mapper;
+        m_file_mapper = mapper->m_file_mapper;
 
         // parse and create mappers
         m_pathname = mapper->m_pathname + pathname;
@@ -162,9 +419,10 @@ namespace mango::filesystem
         const MapperExtension* node = findMapperExtension(ext);
         if (node)
         {
-            AbstractMapper* mapper = node->create(memory, password);
-            m_mappers.emplace_back(mapper);
-            m_current_mapper = mapper;
+            // the memory is owned by the caller so the container is not shared
+            m_current_container = std::make_shared<MapperContainer>();
+            m_current_container->mapper.reset(node->create(memory, password));
+            m_current_mapper = m_current_container->mapper.get();
             m_pathname = "@memory" + extension + "/";
         }
     }
@@ -178,6 +436,7 @@ namespace mango::filesystem
         if (!m_current_mapper)
         {
             m_current_mapper = createFileMapper("");
+            m_file_mapper = m_current_mapper;
         }
 
         std::string lowercase = toLower(pathname);
@@ -202,10 +461,9 @@ namespace mango::filesystem
 
                     if (m_current_mapper->isFile(container))
                     {
-                        m_parent_memory = m_current_mapper->map(container);
+                        m_current_container = openContainer(container, node, password);
 
-                        mapper = node.create(*m_parent_memory, password);
-                        m_mappers.emplace_back(mapper);
+                        mapper = m_current_container->mapper.get();
                         m_current_mapper = mapper;
 
                         offset += n;
@@ -225,6 +483,51 @@ namespace mango::filesystem
         return pathname.substr(offset);
     }
 
+    std::shared_ptr<MapperContainer> Mapper::openContainer(const std::string& container, const MapperExtension& node, const std::string& password)
+    {
+        // identify the container
+        std::string key;
+
+        if (m_current_mapper == m_file_mapper)
+        {
+            getFileIdentity(container, key);
+        }
+        else if (m_current_container && !m_current_container->key.empty())
+        {
+            key = m_current_container->key + "|" + container;
+        }
+
+        if (!key.empty())
+        {
+            key += "|" + std::to_string(std::hash<std::string>()(password));
+
+            std::shared_ptr<MapperContainer> shared = g_container_cache.find(key);
+            if (shared)
+            {
+                return shared;
+            }
+        }
+
+        std::shared_ptr<MapperContainer> shared = std::make_shared<MapperContainer>();
+
+        shared->key = key;
+        shared->parent = m_current_container;
+        shared->memory = m_current_mapper->map(container);
+        shared->mapper.reset(node.create(*shared->memory, password));
+
+        if (m_current_mapper == m_file_mapper)
+        {
+            shared->mapper->setContainerFilename(container);
+        }
+
+        if (!key.empty())
+        {
+            shared = g_container_cache.insert(shared);
+        }
+
+        return shared;
+    }
+
     bool Mapper::isCustomMapper(const std::string& filename)
     {
         const std::string extension = toLower(getExtension(filename));
@@ -266,4 +569,105 @@ namespace mango::filesystem
         return m_current_mapper->map(m_basepath + filename);
     }
 
+    std::unique_ptr<Stream> Mapper::open(const std::string& filename)
+    {
+        if (!m_current_mapper)
+            return nullptr;
+
+        return m_current_mapper->open(m_basepath + filename);
+    }
+
+    u64 Mapper::getFileOffset(const std::string& filename) const
+    {
+        if (!m_current_mapper)
+            return 0;
+
+        return m_current_mapper->getFileOffset(m_basepath + filename);
+    }
+
+    std::vector<std::future<std::unique_ptr<VirtualMemory>>> Mapper::map(const std::vector<std::string>& filenames, bool sequential)
+    {
+        using Promise = std::promise<std::unique_ptr<VirtualMemory>>;
+
+        const size_t count = filenames.size();
+
+        std::vector<Promise> promises(count);
+        std::vector<std::future<std::unique_ptr<VirtualMemory>>> futures;
+
+        for (auto& promise : promises)
+        {
+            futures.push_back(promise.get_future());
+        }
+
+        if (!m_current_mapper)
+        {
+            for (auto& promise : promises)
+            {
+                promise.set_value(nullptr);
+            }
+
+            return futures;
+        }
+
+        std::vector<size_t> order(count);
+        std::iota(order.begin(), order.end(), 0);
+
+        if (sequential)
+        {
+            std::vector<u64> offsets(count);
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                offsets[i] = getFileOffset(filenames[i]);
+            }
+
+            std::stable_sort(order.begin(), order.end(), [&] (size_t a, size_t b)
+            {
+                return offsets[a] < offsets[b];
+            });
+        }
+
+        std::lock_guard<std::mutex> lock(m_batch_mutex);
+
+        if (!m_batch_queue)
+        {
+            m_batch_queue = std::make_unique<ConcurrentQueue>("mapper.batch", Priority::High);
+        }
+
+        for (size_t i : order)
+        {
+            std::string filename = m_basepath + filenames[i];
+
+            m_batch_queue->enqueue([this, filename, promise = std::move(promises[i])] () mutable
+            {
+                try
+                {
+                    promise.set_value(m_current_mapper->map(filename));
+                }
+                catch (...)
+                {
+                    promise.set_exception(std::current_exception());
+                }
+            });
+        }
+
+        return futures;
+    }
+
+    void Mapper::setCacheCapacity(size_t bytes)
+    {
+        if (!m_current_mapper)
+            return;
+
+        m_current_mapper->setCacheCapacity(bytes);
+    }
+
+    MapperCacheStatistics Mapper::getCacheStatistics() const
+    {
+        if (!m_current_mapper)
+            return MapperCacheStatistics();
+
+        return m_current_mapper->getCacheStatistics();
+    }
+
 } // namespace mango::filesystem
@@ -41,7 +41,6 @@ namespace
         u32 checksum;
         bool is_compressed;
         std::vector<Segment> segments;
-        std::string filename;
 
         bool isCompressed() const
         {
@@ -203,12 +202,186 @@ namespace
                     fs::getPath(filename.substr(0, length - 1)) :
                     fs::getPath(filename);
 
-                header.filename = filename.substr(folder.length());
                 m_folders.insert(folder, filename, header);
             }
         }
     };
 
+    // -----------------------------------------------------------------
+    // BlockCache
+    // -----------------------------------------------------------------
+
+    class BlockCache
+    {
+    protected:
+        using Value = std::shared_ptr<Buffer>;
+
+        struct Shard
+        {
+            std::mutex mutex;
+            std::list<std::pair<u32, Value>> values; // most-recently-used first
+            std::unordered_map<u32, decltype(values)::iterator> index;
+            std::unordered_map<u32, std::shared_future<Value>> pending;
+        };
+
+        // Blocks are distributed into independently locked shards by index. The capacity is
+        // shared; eviction starts from the locked shard and continues with the shards that are
+        // not busy so the cache can temporarily hold a few blocks more than the capacity.
+        static constexpr u32 SHARDS = 16;
+
+        Shard m_shards[SHARDS];
+        std::atomic<size_t> m_capacity;
+        std::atomic<size_t> m_size { 0 };
+
+        std::atomic<u64> m_hits { 0 };
+        std::atomic<u64> m_misses { 0 };
+        std::atomic<u64> m_waits { 0 };
+        std::atomic<u64> m_evictions { 0 };
+
+        void evictShard(Shard& shard, size_t bytes)
+        {
+            while (!shard.values.empty() && m_size + bytes > m_capacity)
+            {
+                // delete the least-recently-used value
+                auto& node = shard.values.back();
+                m_size -= node.second->size();
+                shard.index.erase(node.first);
+                shard.values.pop_back();
+                ++m_evictions;
+            }
+        }
+
+        void evict(Shard& shard, size_t bytes)
+        {
+            evictShard(shard, bytes);
+
+            for (auto& other : m_shards)
+            {
+                if (m_size + bytes <= m_capacity)
+                    break;
+
+                if (&other == &shard)
+                    continue;
+
+                // the caller holds the lock to shard; never block on another one
+                std::unique_lock<std::mutex> lock(other.mutex, std::try_to_lock);
+                if (lock.owns_lock())
+                {
+                    evictShard(other, bytes);
+                }
+            }
+        }
+
+        void insert(Shard& shard, u32 key, Value value)
+        {
+            const size_t bytes = value->size();
+            if (bytes > m_capacity)
+            {
+                // the block does not fit in the cache; it is shared only with the waiting threads
+                return;
+            }
+
+            evict(shard, bytes);
+
+            shard.values.emplace_front(key, value);
+            shard.index.emplace(key, shard.values.begin());
+            m_size += bytes;
+        }
+
+    public:
+        BlockCache(size_t capacity)
+            : m_capacity(capacity)
+        {
+        }
+
+        // Get a decompressed block from the cache. The block is decompressed outside of the lock
+        // on a miss; concurrent misses on the same block wait for the first one to complete.
+        template <typename DecompressFunc>
+        Value get(u32 key, size_t bytes, DecompressFunc decompress)
+        {
+            Shard& shard = m_shards[key % SHARDS];
+
+            std::unique_lock<std::mutex> lock(shard.mutex);
+
+            auto it = shard.index.find(key);
+            if (it != shard.index.end())
+            {
+                // cache hit; make the value most-recently-used
+                shard.values.splice(shard.values.begin(), shard.values, it->second);
+                ++m_hits;
+                return it->second->second;
+            }
+
+            auto pending = shard.pending.find(key);
+            if (pending != shard.pending.end())
+            {
+                // another thread is decompressing the block
+                std::shared_future<Value> future = pending->second;
+                lock.unlock();
+
+                ++m_waits;
+                return future.get();
+            }
+
+            // cache miss
+            std::promise<Value> promise;
+            shard.pending.emplace(key, promise.get_future().share());
+            lock.unlock();
+
+            ++m_misses;
+
+            Value value;
+
+            try
+            {
+                value = std::make_shared<Buffer>(bytes);
+                decompress(*value);
+            }
+            catch (...)
+            {
+                lock.lock();
+                shard.pending.erase(key);
+                lock.unlock();
+
+                promise.set_exception(std::current_exception());
+                throw;
+            }
+
+            lock.lock();
+            shard.pending.erase(key);
+            insert(shard, key, value);
+            lock.unlock();
+
+            promise.set_value(value);
+            return value;
+        }
+
+        void setCapacity(size_t bytes)
+        {
+            m_capacity = bytes;
+
+            for (auto& shard : m_shards)
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                evict(shard, 0);
+            }
+        }
+
+        fs::MapperCacheStatistics getStatistics() const
+        {
+            fs::MapperCacheStatistics statistics;
+
+            statistics.hits = m_hits;
+            statistics.misses = m_misses;
+            statistics.waits = m_waits;
+            statistics.evictions = m_evictions;
+            statistics.size = m_size;
+            statistics.capacity = m_capacity;
+
+            return statistics;
+        }
+    };
+
 } // namespace
 
 namespace mango::filesystem
@@ -250,15 +423,26 @@ namespace mango::filesystem
         HeaderMGX m_header;
         std::string m_password;
 
-        // block cache
-        LRUCache<u32, std::shared_ptr<Buffer>, 6> m_cache;
-        std::mutex m_cache_mutex;
+        // decompressed blocks shared by small files
+        static constexpr size_t DEFAULT_CACHE_CAPACITY = 64 * 1024 * 1024;
+        BlockCache m_cache;
 
     public:
         MapperMGX(ConstMemory parent, const std::string& password)
             : m_header(parent)
             , m_password(password)
+            , m_cache(DEFAULT_CACHE_CAPACITY)
+        {
+        }
+
+        void setCacheCapacity(size_t bytes) override
         {
+            m_cache.setCapacity(bytes);
+        }
+
+        MapperCacheStatistics getCacheStatistics() const override
+        {
+            return m_cache.getStatistics();
         }
 
         bool isFile(const std::string& filename) const override
@@ -292,11 +476,23 @@ namespace mango::filesystem
                         flags |= FileInfo::COMPRESSED;
                     }
 
-                    index.emplace(header.filename, header.size, flags);
+                    index.emplace(std::string(i.first), header.size, flags);
                 }
             }
         }
 
+        u64 getFileOffset(const std::string& filename) const override
+        {
+            const FileHeader* header = m_header.m_folders.getHeader(filename);
+            if (!header || header->isFolder())
+            {
+                return 0;
+            }
+
+            const Block& block = m_header.m_blocks[header->segments[0].block];
+            return u64(block.compressed.address - m_header.m_memory.address);
+        }
+
         std::unique_ptr<VirtualMemory> map(const std::string& filename) override
         {
             const FileHeader* ptrHeader = m_header.m_folders.getHeader(filename);
@@ -322,23 +518,10 @@ namespace mango::filesystem
                     {
                         // a small file stored in one block with other small files
 
-                        std::shared_ptr<Buffer> buffer;
-
-                        std::unique_lock<std::mutex> cache_lock(m_cache_mutex);
-
-                        auto value = m_cache.get(blockIndex);
-                        if (value)
+                        std::shared_ptr<Buffer> buffer = m_cache.get(blockIndex, size_t(block.uncompressed), [&block] (Memory dest)
                         {
-                            // cache hit
-                            buffer = *value;
-                        }
-                        else
-                        {
-                            // cache miss
-                            buffer = std::make_shared<Buffer>(block.uncompressed);
-                            block.decompress(*buffer);
-                            m_cache.insert(blockIndex, buffer);
-                        }
+                            block.decompress(dest);
+                        });
 
                         ConstMemory memory(*buffer + segment.offset, segment.size);
                         return std::make_unique<VirtualMemoryMGX>(buffer, memory);
@@ -421,13 +421,15 @@ namespace mango::filesystem
     class MapperRAR : public AbstractMapper
     {
     public:
+        ConstMemory m_parent_memory;
         std::string m_password;
         std::vector<FileHeader> m_files;
         Indexer<FileHeader> m_folders;
         bool is_encrypted { false };
 
         MapperRAR(ConstMemory parent, const std::string& password)
-            : m_password(password)
+            : m_parent_memory(parent)
+            , m_password(password)
         {
             if (parent.address)
             {
@@ -462,8 +464,12 @@ namespace mango::filesystem
                     {
                         std::string folder = getPath(filename.substr(0, filename.length() - 1));
 
-                        header.filename = filename.substr(folder.length());
-                        m_folders.insert(folder, filename, header);
+                        if (!m_folders.insert(folder, filename, header))
+                        {
+                            // the parent folders are already indexed
+                            break;
+                        }
+
                         header.folder = true;
                         filename = folder;
                     }
@@ -735,11 +741,22 @@ namespace mango::filesystem
                         flags |= FileInfo::ENCRYPTED;
                     }
 
-                    index.emplace(header.filename, size, flags);
+                    index.emplace(std::string(i.first), size, flags);
                 }
             }
         }
 
+        u64 getFileOffset(const std::string& filename) const override
+        {
+            const FileHeader* header = m_folders.getHeader(filename);
+            if (!header || !header->data)
+            {
+                return 0;
+            }
+
+            return u64(header->data - m_parent_memory.address);
+        }
+
         std::unique_ptr<VirtualMemory> map(const std::string& filename) override
         {
             const FileHeader* ptrHeader = m_folders.getHeader(filename);
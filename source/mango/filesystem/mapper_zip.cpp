@@ -2,15 +2,28 @@
     MANGO Multimedia Development Platform
     Copyright (C) 2012-2023 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
+#include <cstdio>
 #include <mango/core/pointer.hpp>
 #include <mango/core/string.hpp>
 #include <mango/core/exception.hpp>
 #include <mango/core/compress.hpp>
+#include <mango/core/buffer.hpp>
+#include <mango/core/crc32.hpp>
+#include <mango/core/timer.hpp>
 #include <mango/filesystem/mapper.hpp>
 #include <mango/filesystem/path.hpp>
+#include <mango/filesystem/file.hpp>
 #include "indexer.hpp"
+#include "native_file.hpp"
 
 #include "../../external/libdeflate/libdeflate.h"
+#include "../../external/zlib/zlib.h"
+#include "../../external/bzip2/bzlib.h"
+#include "../../external/lzma/Alloc.h"
+#include "../../external/lzma/LzmaDec.h"
+
+#define ZSTD_DISABLE_DEPRECATE_WARNINGS
+#include "../../external/zstd/zstd.h"
 
 /*
 https://courses.cs.ut.ee/MTAT.07.022/2015_fall/uploads/Main/dmitri-report-f15-16.pdf
@@ -32,6 +45,11 @@ namespace
 {
     using namespace mango;
     using mango::filesystem::Indexer;
+    using mango::filesystem::File;
+    using mango::filesystem::OutputFileStream;
+    using mango::filesystem::getPath;
+    using mango::filesystem::FileStatus;
+    using mango::filesystem::getFileStatus;
 
     enum { DCKEYSIZE = 12 };
 
@@ -333,6 +351,7 @@ namespace
         u64	dirSize;           // size of the central directory
         u64	dirStartOffset;    // offset of the start of central directory on the disk
         u16	commentLen;        // zip file comment length
+        u32 crc;               // checksum of the record (identifies the archive for the index cache)
 
         DirEndRecord(ConstMemory memory)
         {
@@ -367,7 +386,11 @@ namespace
                         signature = 0;
                     }
 
-                    if (dirStartOffset == 0xffffffff)
+                    // any of the fields can be saturated when the ZIP64 record is present; eg.
+                    // Python's zipfile saturates only the entry count after 65535 entries
+                    bool zip64 = numEntriesTotal == 0xffff || dirSize == 0xffffffff || dirStartOffset == 0xffffffff;
+
+                    if (zip64 && end - start >= 20)
                     {
                         p = end - 20;
                         u32 magic = p.read32();
@@ -377,20 +400,34 @@ namespace
                             p += 4;
                             u64 offset = p.read64();
 
-                            p = start + offset;
-                            magic = p.read32();
-                            if (magic == 0x06064b50)
+                            // the ZIP64 record (56 bytes) must be before the locator
+                            const u64 locator = u64(end - start) - 20;
+                            if (offset <= locator && locator - offset >= 56)
                             {
-                                // ZIP64 End of Central Directory
-                                p += 20;
-                                numEntriesOnDisk = p.read64();
-                                numEntriesTotal  = p.read64();
-                                dirSize          = p.read64();
-                                dirStartOffset   = p.read64();
+                                p = start + offset;
+                                magic = p.read32();
+                                if (magic == 0x06064b50)
+                                {
+                                    // ZIP64 End of Central Directory
+                                    p += 20;
+                                    numEntriesOnDisk = p.read64();
+                                    numEntriesTotal  = p.read64();
+                                    dirSize          = p.read64();
+                                    dirStartOffset   = p.read64();
+                                }
                             }
                         }
                     }
 
+                    // the record is followed only by the comment
+                    crc = crc32(0, ConstMemory(end, memory.end() - end));
+
+                    u8 temp[24];
+                    littleEndian::ustore64(temp + 0, numEntriesTotal);
+                    littleEndian::ustore64(temp + 8, dirSize);
+                    littleEndian::ustore64(temp + 16, dirStartOffset);
+                    crc = crc32(crc, ConstMemory(temp, 24));
+
                     break;
                 }
             }
@@ -514,6 +551,788 @@ namespace
         return true;
     }
 
+    // --------------------------------------------------------------------
+    // CentralDirectory
+    // --------------------------------------------------------------------
+
+    struct DirectoryEntry
+    {
+        static constexpr u64 IMPLICIT = ~u64(0);
+
+        u64 offset; // record offset in the central directory (IMPLICIT: folder without record)
+        bool is_folder;
+    };
+
+    static std::mutex g_index_cache_mutex;
+    static std::string g_index_cache_folder;
+
+    /*
+        The central directory records are parsed on demand: a lookup scans the records until
+        the requested path is indexed and listing a folder scans the remaining records.
+
+        The persistent index is a memory mapped open addressing table which gives the record
+        of a file directly from the hash of the path:
+
+            u32 magic
+            u32 version
+            u64 archive size
+            u64 archive modification time (ns, 100 ns units on Windows)
+            u64 archive inode (file index on Windows)
+            u32 directory end record checksum
+            u32 reserved
+            u64 number of records
+            u64 number of slots (power of two, more than the records)
+            slot[]: u64 path hash, u64 record offset + 1 (0: empty)
+    */
+
+    class CentralDirectory
+    {
+    protected:
+        static constexpr u32 CACHE_MAGIC = u32_mask('z', 'i', 'x', '0');
+        static constexpr u32 CACHE_VERSION = 2;
+        static constexpr size_t CACHE_HEADER_SIZE = 56;
+        static constexpr size_t CACHE_SLOT_SIZE = 16;
+        static constexpr size_t RECORD_SIZE = 46;
+
+        ConstMemory m_memory;
+        u64 m_count = 0;
+        u32 m_crc = 0;
+
+        // lazily built index
+        Indexer<DirectoryEntry> m_indexer;
+        u64 m_scan_offset = 0;
+        u64 m_scan_index = 0;
+        std::atomic<bool> m_complete { false };
+        std::mutex m_mutex;
+
+        // persistent index
+        std::unique_ptr<File> m_cache_file;
+        const u8* m_cache_table = nullptr;
+        u64 m_cache_mask = 0;
+        std::string m_cache_filename; // the index is written here when the scan is complete
+        FileStatus m_archive;
+
+        static u64 hash(std::string_view path)
+        {
+            return xx3hash64(0, ConstMemory(reinterpret_cast<const u8*>(path.data()), path.size()));
+        }
+
+        std::string_view getRecordName(u64 offset) const
+        {
+            if (offset + RECORD_SIZE > m_memory.size)
+            {
+                return std::string_view();
+            }
+
+            const u8* record = m_memory.address + offset;
+            size_t length = littleEndian::uload16(record + 28);
+            length = std::min(length, size_t(m_memory.size - offset - RECORD_SIZE));
+
+            return std::string_view(reinterpret_cast<const char*>(record + RECORD_SIZE), length);
+        }
+
+        // index the next record; returns false when all records are indexed
+        bool scan()
+        {
+            while (m_scan_index < m_count && m_scan_offset + RECORD_SIZE <= m_memory.size)
+            {
+                LittleEndianConstPointer p = m_memory.address + m_scan_offset;
+
+                FileHeader header;
+                if (!header.read(p))
+                {
+                    // corrupted directory
+                    break;
+                }
+
+                DirectoryEntry entry { m_scan_offset, header.is_folder };
+
+                const u8* next = p;
+                m_scan_offset = u64(next - m_memory.address);
+                ++m_scan_index;
+
+                // NOTE: Don't index files that can't be decompressed
+                if (!isCompressionSupported(header.compression))
+                {
+                    continue;
+                }
+
+                std::string filename = std::move(header.filename);
+                while (!filename.empty())
+                {
+                    std::string folder = getPath(filename.substr(0, filename.length() - 1));
+
+                    if (!m_indexer.insert(folder, filename, entry))
+                    {
+                        // the parent folders are already indexed
+                        break;
+                    }
+
+                    entry = { DirectoryEntry::IMPLICIT, true };
+                    filename = folder;
+                }
+
+                return true;
+            }
+
+            m_scan_index = m_count;
+            m_complete = true;
+
+            if (!m_cache_filename.empty())
+            {
+                writeCache();
+                m_cache_filename.clear();
+            }
+
+            return false;
+        }
+
+        bool findCache(const std::string& filename, DirectoryEntry& entry) const
+        {
+            const u64 h = hash(filename);
+
+            // a corrupted table might not have an empty slot; probe each slot at most once
+            for (u64 i = h & m_cache_mask, n = 0; n <= m_cache_mask; i = (i + 1) & m_cache_mask, ++n)
+            {
+                const u8* slot = m_cache_table + i * CACHE_SLOT_SIZE;
+
+                u64 offset = littleEndian::uload64(slot + 8);
+                if (!offset)
+                {
+                    return false;
+                }
+
+                --offset;
+
+                if (littleEndian::uload64(slot) == h && getRecordName(offset) == filename)
+                {
+                    entry = { offset, !filename.empty() && filename.back() == '/' };
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        void readCache()
+        {
+            FileStatus status;
+
+            if (!getFileStatus(m_cache_filename, status) || status.size < CACHE_HEADER_SIZE)
+            {
+                return;
+            }
+
+            try
+            {
+                m_cache_file = std::make_unique<File>(m_cache_filename);
+            }
+            catch (Exception&)
+            {
+                return;
+            }
+
+            ConstMemory memory = *m_cache_file;
+            LittleEndianConstPointer p = memory.address;
+
+            u32 magic = p.read32();
+            u32 version = p.read32();
+            u64 archive_size = p.read64();
+            u64 archive_time = p.read64();
+            u64 archive_index = p.read64();
+            u32 crc = p.read32();
+            p += 4;
+            u64 count = p.read64();
+            u64 slots = p.read64();
+
+            bool valid = magic == CACHE_MAGIC &&
+                         version == CACHE_VERSION &&
+                         archive_size == m_archive.size &&
+                         archive_time == m_archive.time &&
+                         archive_index == m_archive.index &&
+                         crc == m_crc &&
+                         count == m_count &&
+                         slots > count && !(slots & (slots - 1)) &&
+                         slots <= (memory.size - CACHE_HEADER_SIZE) / CACHE_SLOT_SIZE && // no overflow below
+                         memory.size == CACHE_HEADER_SIZE + slots * CACHE_SLOT_SIZE;
+
+            if (!valid)
+            {
+                m_cache_file.reset();
+                return;
+            }
+
+            m_cache_table = memory.address + CACHE_HEADER_SIZE;
+            m_cache_mask = slots - 1;
+        }
+
+        void writeCache()
+        {
+            // load factor is kept below 50%
+            u64 slots = 16;
+            while (slots < m_count * 2)
+            {
+                slots *= 2;
+            }
+
+            const u64 mask = slots - 1;
+            Buffer table(slots * CACHE_SLOT_SIZE, 0);
+
+            LittleEndianConstPointer p = m_memory.address;
+
+            for (u64 i = 0; i < m_count; ++i)
+            {
+                const u8* record = p;
+                const u64 offset = u64(record - m_memory.address);
+
+                FileHeader header;
+                if (offset + RECORD_SIZE > m_memory.size || !header.read(p))
+                {
+                    break;
+                }
+
+                if (!isCompressionSupported(header.compression))
+                {
+                    continue;
+                }
+
+                const u64 h = hash(header.filename);
+
+                for (u64 j = h & mask; ; j = (j + 1) & mask)
+                {
+                    u8* slot = table.data() + j * CACHE_SLOT_SIZE;
+
+                    u64 stored = littleEndian::uload64(slot + 8);
+                    if (!stored || (littleEndian::uload64(slot) == h && getRecordName(stored - 1) == header.filename))
+                    {
+                        // the last record with the same name replaces the previous ones
+                        littleEndian::ustore64(slot + 0, h);
+                        littleEndian::ustore64(slot + 8, offset + 1);
+                        break;
+                    }
+                }
+            }
+
+            // write into a temporary file which is renamed so that concurrent readers see a complete index
+            std::string temp = fmt::format("{}.{:x}", m_cache_filename, Time::us() ^ u64(uintptr_t(this)));
+
+            try
+            {
+                OutputFileStream file(temp);
+                LittleEndianStream s(file);
+
+                s.write32(CACHE_MAGIC);
+                s.write32(CACHE_VERSION);
+                s.write64(m_archive.size);
+                s.write64(m_archive.time);
+                s.write64(m_archive.index);
+                s.write32(m_crc);
+                s.write32(0);
+                s.write64(m_count);
+                s.write64(slots);
+                file.write(table);
+            }
+            catch (Exception&)
+            {
+                std::remove(temp.c_str());
+                return;
+            }
+
+            if (std::rename(temp.c_str(), m_cache_filename.c_str()) != 0)
+            {
+                std::remove(temp.c_str());
+            }
+        }
+
+    public:
+        CentralDirectory(ConstMemory parent)
+        {
+            DirEndRecord record(parent);
+            if (record.status() && record.dirStartOffset + record.dirSize <= parent.size)
+            {
+                m_memory = ConstMemory(parent.address + record.dirStartOffset, size_t(record.dirSize));
+                m_count = record.numEntriesTotal;
+                m_crc = record.crc;
+            }
+        }
+
+        void setArchiveFilename(const std::string& filename)
+        {
+            std::string folder;
+            {
+                std::lock_guard<std::mutex> lock(g_index_cache_mutex);
+                folder = g_index_cache_folder;
+            }
+
+            if (folder.empty() || !m_count || !getFileStatus(filename, m_archive))
+            {
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            m_cache_filename = fmt::format("{}{:016x}.zix", folder, hash(filename));
+            readCache();
+
+            if (m_cache_table)
+            {
+                // the index is up to date
+                m_cache_filename.clear();
+            }
+        }
+
+        bool find(const std::string& filename, DirectoryEntry& entry)
+        {
+            if (m_cache_table)
+            {
+                return findCache(filename, entry);
+            }
+
+            const DirectoryEntry* result = nullptr;
+
+            if (m_complete)
+            {
+                result = m_indexer.getHeader(filename);
+            }
+            else
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                if (!m_cache_filename.empty())
+                {
+                    // the whole directory is indexed once to create the persistent index
+                    while (scan())
+                    {
+                    }
+                }
+
+                // index records until the path is found
+                result = m_indexer.getHeader(filename);
+                while (!result && scan())
+                {
+                    result = m_indexer.getHeader(filename);
+                }
+            }
+
+            if (result)
+            {
+                entry = *result;
+            }
+
+            return result != nullptr;
+        }
+
+        const Indexer<DirectoryEntry>::Folder* getFolder(const std::string& pathname)
+        {
+            if (!m_complete)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                while (scan())
+                {
+                }
+            }
+
+            return m_indexer.getFolder(pathname);
+        }
+
+        bool getHeader(const DirectoryEntry& entry, FileHeader& header) const
+        {
+            if (entry.offset == DirectoryEntry::IMPLICIT || entry.offset + RECORD_SIZE > m_memory.size)
+            {
+                return false;
+            }
+
+            LittleEndianConstPointer p = m_memory.address + entry.offset;
+            return header.read(p);
+        }
+    };
+
+    // -----------------------------------------------------------------
+    // EntryDecoder
+    // -----------------------------------------------------------------
+
+    // Incremental decompression of one entry directly from the archive memory; only the
+    // decompressor state is allocated and the output is written into the caller's buffer.
+
+    class EntryDecoder
+    {
+    protected:
+        // the decompressors take the input size as 32 bit integer
+        static constexpr size_t MAX_CHUNK = 1 << 30;
+
+        ConstMemory m_input;
+        size_t m_consumed = 0;
+
+    public:
+        EntryDecoder(ConstMemory input)
+            : m_input(input)
+        {
+        }
+
+        virtual ~EntryDecoder() = default;
+
+        // restart from the beginning of the entry
+        virtual void reset() = 0;
+
+        // returns the number of bytes decompressed; less than requested only at the end of data
+        virtual size_t decode(u8* dest, size_t size) = 0;
+    };
+
+    class EntryDecoderDeflate : public EntryDecoder
+    {
+    protected:
+        z_stream m_stream;
+
+    public:
+        EntryDecoderDeflate(ConstMemory input)
+            : EntryDecoder(input)
+        {
+            std::memset(&m_stream, 0, sizeof(m_stream));
+
+            // raw deflate stream (no zlib header)
+            if (inflateInit2(&m_stream, -MAX_WBITS) != Z_OK)
+            {
+                MANGO_EXCEPTION("[mapper.zip] Inflate initialization failed.");
+            }
+        }
+
+        ~EntryDecoderDeflate()
+        {
+            inflateEnd(&m_stream);
+        }
+
+        void reset() override
+        {
+            inflateReset(&m_stream);
+            m_stream.avail_in = 0;
+            m_consumed = 0;
+        }
+
+        size_t decode(u8* dest, size_t size) override
+        {
+            size_t bytes = 0;
+
+            while (bytes < size)
+            {
+                if (!m_stream.avail_in)
+                {
+                    size_t chunk = std::min(m_input.size - m_consumed, MAX_CHUNK);
+                    m_stream.next_in = const_cast<Bytef*>(m_input.address + m_consumed);
+                    m_stream.avail_in = uInt(chunk);
+                    m_consumed += chunk;
+                }
+
+                uInt chunk = uInt(std::min(size - bytes, MAX_CHUNK));
+                m_stream.next_out = dest + bytes;
+                m_stream.avail_out = chunk;
+
+                int status = inflate(&m_stream, Z_NO_FLUSH);
+                bytes += chunk - m_stream.avail_out;
+
+                if (status != Z_OK)
+                {
+                    // Z_STREAM_END or corrupted / truncated data
+                    break;
+                }
+            }
+
+            return bytes;
+        }
+    };
+
+    class EntryDecoderZSTD : public EntryDecoder
+    {
+    protected:
+        ZSTD_DStream* m_stream;
+        ZSTD_inBuffer m_buffer;
+
+    public:
+        EntryDecoderZSTD(ConstMemory input)
+            : EntryDecoder(input)
+        {
+            m_stream = ZSTD_createDStream();
+            reset();
+        }
+
+        ~EntryDecoderZSTD()
+        {
+            ZSTD_freeDStream(m_stream);
+        }
+
+        void reset() override
+        {
+            ZSTD_initDStream(m_stream);
+            m_buffer.src = m_input.address;
+            m_buffer.size = m_input.size;
+            m_buffer.pos = 0;
+        }
+
+        size_t decode(u8* dest, size_t size) override
+        {
+            ZSTD_outBuffer output;
+
+            output.dst = dest;
+            output.size = size;
+            output.pos = 0;
+
+            while (output.pos < output.size)
+            {
+                size_t pos = output.pos;
+                size_t status = ZSTD_decompressStream(m_stream, &output, &m_buffer);
+                if (ZSTD_isError(status) || (output.pos == pos && m_buffer.pos == m_buffer.size))
+                {
+                    break;
+                }
+            }
+
+            return output.pos;
+        }
+    };
+
+    class EntryDecoderBZIP2 : public EntryDecoder
+    {
+    protected:
+        bz_stream m_stream;
+        bool m_end = false;
+
+        void init()
+        {
+            std::memset(&m_stream, 0, sizeof(m_stream));
+
+            if (BZ2_bzDecompressInit(&m_stream, 0, 0) != BZ_OK)
+            {
+                MANGO_EXCEPTION("[mapper.zip] BZIP2 initialization failed.");
+            }
+
+            m_consumed = 0;
+            m_end = false;
+        }
+
+    public:
+        EntryDecoderBZIP2(ConstMemory input)
+            : EntryDecoder(input)
+        {
+            init();
+        }
+
+        ~EntryDecoderBZIP2()
+        {
+            BZ2_bzDecompressEnd(&m_stream);
+        }
+
+        void reset() override
+        {
+            // bzip2 has no reset; the decompressor is created again
+            BZ2_bzDecompressEnd(&m_stream);
+            init();
+        }
+
+        size_t decode(u8* dest, size_t size) override
+        {
+            size_t bytes = 0;
+
+            while (bytes < size && !m_end)
+            {
+                if (!m_stream.avail_in)
+                {
+                    size_t chunk = std::min(m_input.size - m_consumed, MAX_CHUNK);
+                    m_stream.next_in = const_cast<char*>(reinterpret_cast<const char*>(m_input.address + m_consumed));
+                    m_stream.avail_in = static_cast<unsigned int>(chunk);
+                    m_consumed += chunk;
+                }
+
+                unsigned int chunk = static_cast<unsigned int>(std::min(size - bytes, MAX_CHUNK));
+                m_stream.next_out = reinterpret_cast<char*>(dest + bytes);
+                m_stream.avail_out = chunk;
+
+                int status = BZ2_bzDecompress(&m_stream);
+                size_t count = chunk - m_stream.avail_out;
+                bytes += count;
+
+                if (status == BZ_STREAM_END)
+                {
+                    m_end = true;
+                }
+                else if (status != BZ_OK || (!count && !m_stream.avail_in && m_consumed == m_input.size))
+                {
+                    // corrupted or truncated data
+                    break;
+                }
+            }
+
+            return bytes;
+        }
+    };
+
+    class EntryDecoderLZMA : public EntryDecoder
+    {
+    protected:
+        CLzmaDec m_state;
+
+    public:
+        EntryDecoderLZMA(ConstMemory input)
+            : EntryDecoder(input)
+        {
+            if (input.size < LZMA_PROPS_SIZE)
+            {
+                MANGO_EXCEPTION("[mapper.zip] Incorrect LZMA header.");
+            }
+
+            LzmaDec_Construct(&m_state);
+
+            // the properties are stored in front of the compressed data
+            if (LzmaDec_Allocate(&m_state, input.address, LZMA_PROPS_SIZE, &g_Alloc) != SZ_OK)
+            {
+                MANGO_EXCEPTION("[mapper.zip] Incorrect LZMA header.");
+            }
+
+            reset();
+        }
+
+        ~EntryDecoderLZMA()
+        {
+            LzmaDec_Free(&m_state, &g_Alloc);
+        }
+
+        void reset() override
+        {
+            LzmaDec_Init(&m_state);
+            m_consumed = LZMA_PROPS_SIZE;
+        }
+
+        size_t decode(u8* dest, size_t size) override
+        {
+            size_t bytes = 0;
+
+            while (bytes < size)
+            {
+                SizeT output_size = size - bytes;
+                SizeT input_size = m_input.size - m_consumed;
+
+                ELzmaStatus status;
+                SRes result = LzmaDec_DecodeToBuf(&m_state, dest + bytes, &output_size,
+                    m_input.address + m_consumed, &input_size, LZMA_FINISH_ANY, &status);
+
+                bytes += output_size;
+                m_consumed += input_size;
+
+                if (result != SZ_OK || status == LZMA_STATUS_FINISHED_WITH_MARK || (!output_size && !input_size))
+                {
+                    break;
+                }
+            }
+
+            return bytes;
+        }
+    };
+
+    // -----------------------------------------------------------------
+    // EntryStream
+    // -----------------------------------------------------------------
+
+    class EntryStream : public Stream
+    {
+    protected:
+        std::unique_ptr<EntryDecoder> m_decoder;
+        std::unique_ptr<u8[]> m_scratch;
+        u64 m_size;
+        u64 m_offset = 0;
+
+        void skip(u64 bytes)
+        {
+            constexpr size_t SCRATCH_SIZE = 64 * 1024;
+
+            if (!m_scratch)
+            {
+                m_scratch.reset(new u8[SCRATCH_SIZE]);
+            }
+
+            while (bytes > 0)
+            {
+                size_t chunk = size_t(std::min(u64(SCRATCH_SIZE), bytes));
+                read(m_scratch.get(), chunk);
+                bytes -= chunk;
+            }
+        }
+
+    public:
+        EntryStream(std::unique_ptr<EntryDecoder> decoder, u64 size)
+            : m_decoder(std::move(decoder))
+            , m_size(size)
+        {
+        }
+
+        ~EntryStream()
+        {
+        }
+
+        u64 size() const override
+        {
+            return m_size;
+        }
+
+        u64 offset() const override
+        {
+            return m_offset;
+        }
+
+        void seek(s64 distance, SeekMode mode) override
+        {
+            u64 target = m_offset;
+
+            switch (mode)
+            {
+                case BEGIN:
+                    target = u64(std::max(s64(0), distance));
+                    break;
+
+                case CURRENT:
+                    target = u64(std::max(s64(0), s64(m_offset) + distance));
+                    break;
+
+                case END:
+                    target = u64(std::max(s64(0), s64(m_size) + std::min(s64(0), distance)));
+                    break;
+            }
+
+            target = std::min(target, m_size);
+
+            if (target < m_offset)
+            {
+                // compressed data can only be decoded forward
+                m_decoder->reset();
+                m_offset = 0;
+            }
+
+            skip(target - m_offset);
+        }
+
+        void read(void* dest, u64 size) override
+        {
+            if (m_size - m_offset < size)
+            {
+                MANGO_EXCEPTION("[mapper.zip] Reading past end of file.");
+            }
+
+            size_t bytes = m_decoder->decode(reinterpret_cast<u8*>(dest), size_t(size));
+            if (bytes != size)
+            {
+                MANGO_EXCEPTION("[mapper.zip] Decompression failed.");
+            }
+
+            m_offset += size;
+        }
+
+        void write(const void* data, u64 size) override
+        {
+            MANGO_UNREFERENCED(data);
+            MANGO_UNREFERENCED(size);
+            MANGO_EXCEPTION("[mapper.zip] Writing into read-only stream.");
+        }
+    };
+
+
 } // namespace
 
 namespace mango::filesystem
@@ -550,64 +1369,61 @@ namespace mango::filesystem
     public:
         ConstMemory m_parent_memory;
         std::string m_password;
-        Indexer<FileHeader> m_folders;
+        mutable CentralDirectory m_directory;
 
         MapperZIP(ConstMemory parent, const std::string& password)
             : m_parent_memory(parent)
             , m_password(password)
+            , m_directory(parent)
         {
-            if (parent.address)
-            {
-                DirEndRecord record(parent);
-                if (record.status())
-                {
-                    const int numFiles = int(record.numEntriesTotal);
-
-                    // read file headers
-                    LittleEndianConstPointer p = parent.address + record.dirStartOffset;
-
-                    for (int i = 0; i < numFiles; ++i)
-                    {
-                        FileHeader header;
-                        if (header.read(p))
-                        {
-                            // NOTE: Don't index files that can't be decompressed
-                            if (isCompressionSupported(header.compression))
-                            {
-                                std::string filename = header.filename;
-                                while (!filename.empty())
-                                {
-                                    std::string folder = getPath(filename.substr(0, filename.length() - 1));
-
-                                    header.filename = filename.substr(folder.length());
-                                    m_folders.insert(folder, filename, header);
-                                    header.is_folder = true;
-                                    filename = folder;
-                                }
-                            }
-                        }
-                    }
-                }
-            }
         }
 
         ~MapperZIP()
         {
         }
 
-        std::unique_ptr<VirtualMemory> map(FileHeader header, const u8* start, const std::string& password)
+        // the local header and the entry data must be inside the parent memory; the sizes
+        // come from the archive so they are checked before anything is read or decoded
+        static const u8* getEntryAddress(const FileHeader& header, ConstMemory parent)
         {
-            LittleEndianConstPointer p = start + header.localOffset;
+            const u64 size = parent.size;
 
-            LocalFileHeader localHeader(p);
+            if (header.localOffset > size || size - header.localOffset < 30)
+            {
+                MANGO_EXCEPTION("[mapper.zip] Invalid local header offset.");
+            }
+
+            const u8* start = parent.address + header.localOffset;
+            u64 offset = header.localOffset + 30 + littleEndian::uload16(start + 26) + littleEndian::uload16(start + 28);
+            if (offset > size)
+            {
+                MANGO_EXCEPTION("[mapper.zip] Invalid local header.");
+            }
+
+            LocalFileHeader localHeader(start);
             if (!localHeader.status())
             {
                 MANGO_EXCEPTION("[mapper.zip] Invalid local header.");
             }
 
-            u64 offset = header.localOffset + 30 + localHeader.filenameLen + localHeader.extraFieldLen;
+            if (header.compressedSize > size - offset)
+            {
+                MANGO_EXCEPTION("[mapper.zip] Entry data is outside of the archive.");
+            }
+
+            if (header.compression == COMPRESSION_NONE && header.encryption == ENCRYPTION_NONE &&
+                header.uncompressedSize > header.compressedSize)
+            {
+                MANGO_EXCEPTION("[mapper.zip] Invalid stored entry size.");
+            }
+
+            return parent.address + offset;
+        }
 
-            const u8* address = start + offset;
+        std::unique_ptr<VirtualMemory> map(FileHeader header, ConstMemory parent, const std::string& password)
+        {
+            const u8* address = getEntryAddress(header, parent);
+            LittleEndianConstPointer p = address;
             u64 size = 0;
 
             u8* buffer = nullptr; // remember allocated memory
@@ -767,7 +1583,7 @@ namespace mango::filesystem
                 address = buffer;
                 size = header.uncompressedSize;
             }
-            else if (size > 0)
+            else if (header.compression == COMPRESSION_NONE)
             {
                 // no compression -> mapped directly to parent address
             }
@@ -779,29 +1595,42 @@ namespace mango::filesystem
             return std::make_unique<VirtualMemoryZIP>(address, buffer, size_t(size));
         }
 
+        void setContainerFilename(const std::string& filename) override
+        {
+            m_directory.setArchiveFilename(filename);
+        }
+
         bool isFile(const std::string& filename) const override
         {
-            const FileHeader* ptrHeader = m_folders.getHeader(filename);
-            if (ptrHeader)
+            DirectoryEntry entry;
+            if (m_directory.find(filename, entry))
             {
-                return !ptrHeader->is_folder;
+                return !entry.is_folder;
             }
             return false;
         }
 
         void getIndex(FileIndex& index, const std::string& pathname) override
         {
-            const Indexer<FileHeader>::Folder* ptrFolder = m_folders.getFolder(pathname);
+            const Indexer<DirectoryEntry>::Folder* ptrFolder = m_directory.getFolder(pathname);
             if (ptrFolder)
             {
                 for (auto i : ptrFolder->headers)
                 {
-                    const FileHeader& header = *i.second;
+                    const DirectoryEntry& entry = *i.second;
+
+                    FileHeader header;
+                    if (!m_directory.getHeader(entry, header))
+                    {
+                        // folder without a record of its own
+                        index.emplace(std::string(i.first), 0, FileInfo::DIRECTORY);
+                        continue;
+                    }
 
                     u32 flags = 0;
                     u64 size = header.uncompressedSize;
 
-                    if (header.is_folder)
+                    if (entry.is_folder)
                     {
                         flags |= FileInfo::DIRECTORY;
                         size = 0;
@@ -817,21 +1646,95 @@ namespace mango::filesystem
                         flags |= FileInfo::ENCRYPTED;
                     }
 
-                    index.emplace(header.filename, size, flags);
+                    index.emplace(std::string(i.first), size, flags);
                 }
             }
         }
 
         std::unique_ptr<VirtualMemory> map(const std::string& filename) override
         {
-            const FileHeader* ptrHeader = m_folders.getHeader(filename);
-            if (!ptrHeader)
+            DirectoryEntry entry;
+            FileHeader header;
+
+            if (!m_directory.find(filename, entry) || !m_directory.getHeader(entry, header))
             {
                 MANGO_EXCEPTION("[mapper.zip] File \"{}\" not found.", filename);
             }
 
-            const FileHeader& header = *ptrHeader;
-            return map(header, m_parent_memory.address, m_password);
+            return map(header, m_parent_memory, m_password);
+        }
+
+        u64 getFileOffset(const std::string& filename) const override
+        {
+            DirectoryEntry entry;
+            FileHeader header;
+
+            if (!m_directory.find(filename, entry) || !m_directory.getHeader(entry, header))
+            {
+                return 0;
+            }
+
+            return header.localOffset;
+        }
+
+        std::unique_ptr<Stream> open(const std::string& filename) override
+        {
+            DirectoryEntry entry;
+            FileHeader header;
+
+            if (!m_directory.find(filename, entry) || !m_directory.getHeader(entry, header))
+            {
+                MANGO_EXCEPTION("[mapper.zip] File \"{}\" not found.", filename);
+            }
+
+            if (header.encryption != ENCRYPTION_NONE)
+            {
+                // the decryption needs the whole entry
+                return AbstractMapper::open(filename);
+            }
+
+            const u8* address = getEntryAddress(header, m_parent_memory);
+            ConstMemory input(address, size_t(header.compressedSize));
+
+            std::unique_ptr<EntryDecoder> decoder;
+
+            switch (header.compression)
+            {
+                case COMPRESSION_NONE:
+                    // window into the parent memory
+                    return std::make_unique<ConstMemoryStream>(ConstMemory(address, size_t(header.uncompressedSize)));
+
+                case COMPRESSION_DEFLATE:
+                    decoder = std::make_unique<EntryDecoderDeflate>(input);
+                    break;
+
+                case COMPRESSION_BZIP2:
+                    decoder = std::make_unique<EntryDecoderBZIP2>(input);
+                    break;
+
+                case COMPRESSION_ZSTD:
+                    decoder = std::make_unique<EntryDecoderZSTD>(input);
+                    break;
+
+                case COMPRESSION_LZMA:
+                {
+                    // skip LZMA version and properties size
+                    if (input.size < 4 || littleEndian::uload16(address + 2) != 5)
+                    {
+                        MANGO_EXCEPTION("[mapper.zip] Incorrect LZMA header.");
+                    }
+
+                    input.address += 4;
+                    input.size -= 4;
+                    decoder = std::make_unique<EntryDecoderLZMA>(input);
+                    break;
+                }
+
+                default:
+                    return AbstractMapper::open(filename);
+            }
+
+            return std::make_unique<EntryStream>(std::move(decoder), header.uncompressedSize);
         }
     };
 
@@ -845,4 +1748,15 @@ namespace mango::filesystem
         return mapper;
     }
 
+    void setIndexCacheFolder(const std::string& folder)
+    {
+        std::lock_guard<std::mutex> lock(g_index_cache_mutex);
+
+        g_index_cache_folder = folder;
+        if (!folder.empty() && folder.back() != '/' && folder.back() != '\\')
+        {
+            g_index_cache_folder += '/';
+        }
+    }
+
 } // namespace mango::filesystem
@@ -0,0 +1,58 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2023 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#pragma once
+
+#include <string>
+#include <memory>
+#include <mango/core/configure.hpp>
+#include <mango/core/stream.hpp>
+
+namespace mango::filesystem
+{
+
+    // -----------------------------------------------------------------
+    // NativeFile
+    // -----------------------------------------------------------------
+
+    // Unbuffered file in the native filesystem with positional access; the functions do not
+    // share a file position so they can be called concurrently. The platform implementation
+    // is in unix/ and win32/ folders.
+
+    class NativeFile : protected NonCopyable
+    {
+    public:
+        NativeFile() = default;
+        virtual ~NativeFile() = default;
+
+        virtual u64 size() const = 0;
+
+        // returns the number of bytes read; less than requested only at the end of file
+        virtual size_t read(void* dest, size_t size, u64 offset) const = 0;
+        virtual void write(const void* data, size_t size, u64 offset) = 0;
+    };
+
+    std::unique_ptr<NativeFile> createNativeFile(const std::string& filename, Stream::OpenMode mode);
+
+    // -----------------------------------------------------------------
+    // FileStatus
+    // -----------------------------------------------------------------
+
+    // Attributes which change when a file in the native filesystem is replaced or modified.
+    // The time has sub-second resolution: nanoseconds (100 ns units on Windows).
+
+    struct FileStatus
+    {
+        u64 device = 0; // device (volume serial number on Windows)
+        u64 index = 0;  // inode (file index on Windows)
+        u64 size = 0;
+        u64 time = 0;   // modification time
+    };
+
+    bool getFileStatus(const std::string& filename, FileStatus& status);
+
+    // size of a virtual memory page
+    size_t getPageSize();
+
+} // namespace mango::filesystem
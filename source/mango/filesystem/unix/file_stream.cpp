@@ -7,149 +7,143 @@
 #define _FILE_OFFSET_BITS 64 /* LFS: 64 bit off_t */
 #endif
 
-#include <cstdio>
+#include <cerrno>
+#include <cstring>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 
 #include <mango/core/string.hpp>
 #include <mango/core/exception.hpp>
-#include <mango/filesystem/file.hpp>
+#include "../native_file.hpp"
 
-namespace mango::filesystem
+namespace
 {
+    using namespace mango;
+    using namespace mango::filesystem;
 
     // -----------------------------------------------------------------
-    // FileHandle
+    // NativeFileUnix
     // -----------------------------------------------------------------
 
-    struct FileHandle
+    class NativeFileUnix : public NativeFile
     {
+    protected:
         int m_file;
         std::string m_filename;
 
-        FileHandle(const std::string& filename, int flags)
+    public:
+        NativeFileUnix(const std::string& filename, int flags)
             : m_file(::open(filename.c_str(), flags, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH))
             , m_filename(filename)
         {
+            if (m_file == -1)
+            {
+                MANGO_EXCEPTION("[FileStream] Opening \"{}\" failed ({}).", filename, std::strerror(errno));
+            }
+
+#if defined(POSIX_FADV_SEQUENTIAL)
+            if ((flags & O_ACCMODE) == O_RDONLY)
+            {
+                // the streams are mostly read from the beginning to the end; larger read-ahead
+                ::posix_fadvise(m_file, 0, 0, POSIX_FADV_SEQUENTIAL);
+            }
+#endif
         }
 
-        ~FileHandle()
+        ~NativeFileUnix()
         {
             ::close(m_file);
         }
 
-        const std::string& filename() const
-        {
-            return m_filename;
-        }
-
-        u64 size() const
+        u64 size() const override
         {
             struct stat sb;
-            ::fstat(m_file, &sb);
-            return sb.st_size;
+            if (::fstat(m_file, &sb) == -1)
+            {
+                MANGO_EXCEPTION("[FileStream] Cannot fstat \"{}\".", m_filename);
+            }
+            return u64(sb.st_size);
         }
 
-        u64 offset() const
+        size_t read(void* dest, size_t size, u64 offset) const override
         {
-            return u64(::lseek(m_file, 0, SEEK_CUR));
+            u8* buffer = reinterpret_cast<u8*>(dest);
+            size_t bytes = 0;
+
+            while (bytes < size)
+            {
+                ssize_t status = ::pread(m_file, buffer + bytes, size - bytes, off_t(offset + bytes));
+                if (status < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+
+                    MANGO_EXCEPTION("[FileStream] Reading \"{}\" failed ({}).", m_filename, std::strerror(errno));
+                }
+
+                if (status == 0)
+                {
+                    // end of file
+                    break;
+                }
+
+                bytes += size_t(status);
+            }
+
+            return bytes;
         }
 
-        void seek(s64 distance, int method)
+        void write(const void* data, size_t size, u64 offset) override
         {
-            ::lseek(m_file, distance, method);
+            const u8* buffer = reinterpret_cast<const u8*>(data);
+            size_t bytes = 0;
+
+            while (bytes < size)
+            {
+                ssize_t status = ::pwrite(m_file, buffer + bytes, size - bytes, off_t(offset + bytes));
+                if (status < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+
+                    MANGO_EXCEPTION("[FileStream] Writing \"{}\" failed ({}).", m_filename, std::strerror(errno));
+                }
+
+                bytes += size_t(status);
+            }
         }
+    };
 
-        void read(void* dest, u64 size)
-        {
-            ssize_t status = ::read(m_file, dest, size_t(size));
-            MANGO_UNREFERENCED(status);
-        }
+} // namespace
 
-        void write(const void* data, u64 size)
-        {
-            ssize_t status = ::write(m_file, data, size_t(size));
-            MANGO_UNREFERENCED(status);
-        }
-    };
+namespace mango::filesystem
+{
 
     // -----------------------------------------------------------------
-    // FileStream
+    // createNativeFile()
     // -----------------------------------------------------------------
 
-    FileStream::FileStream(const std::string& filename, OpenMode openmode)
-        : m_handle(nullptr)
+    std::unique_ptr<NativeFile> createNativeFile(const std::string& filename, Stream::OpenMode mode)
     {
-       	switch (openmode)
-        {
-            case READ:
-                m_handle = new FileHandle(filename, O_RDONLY);
-                break;
-
-            case WRITE:
-                m_handle = new FileHandle(filename, O_WRONLY | O_CREAT | O_TRUNC);
-                break;
-
-            default:
-                MANGO_EXCEPTION("[FileStream] Incorrect OpenMode.");
-                break;
-        }
-    }
-
-    FileStream::~FileStream()
-    {
-        delete m_handle;
-    }
-
-    const std::string& FileStream::filename() const
-    {
-        return m_handle->filename();
-    }
-
-    u64 FileStream::size() const
-    {
-        return m_handle->size();
-    }
-
-    u64 FileStream::offset() const
-    {
-        return m_handle->offset();
-    }
-
-    void FileStream::seek(s64 distance, SeekMode mode)
-    {
-        int method;
+        int flags;
 
         switch (mode)
         {
-            case BEGIN:
-                method = SEEK_SET;
-                break;
-
-            case CURRENT:
-                method = SEEK_CUR;
+            case Stream::READ:
+                flags = O_RDONLY;
                 break;
 
-            case END:
-                method = SEEK_END;
+            case Stream::WRITE:
+                flags = O_WRONLY | O_CREAT | O_TRUNC;
                 break;
 
             default:
-                MANGO_EXCEPTION("[FileStream] Invalid seek mode.");
+                MANGO_EXCEPTION("[FileStream] Incorrect OpenMode.");
+                break;
         }
 
-        m_handle->seek(distance, method);
-    }
-
-    void FileStream::read(void* dest, u64 size)
-    {
-        m_handle->read(dest, size);
-    }
-
-    void FileStream::write(const void* data, u64 size)
-    {
-        m_handle->write(data, size);
+        return std::make_unique<NativeFileUnix>(filename, flags);
     }
 
 } // namespace mango::filesystem
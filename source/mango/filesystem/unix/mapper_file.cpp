@@ -2,10 +2,12 @@
     MANGO Multimedia Development Platform
     Copyright (C) 2012-2023 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
+#include <cstdlib>
 #include <mango/core/exception.hpp>
 #include <mango/core/string.hpp>
 #include <mango/filesystem/mapper.hpp>
 #include <mango/filesystem/path.hpp>
+#include "../native_file.hpp"
 
 #include <dirent.h>
 #include <fcntl.h>
@@ -275,4 +277,122 @@ namespace mango::filesystem
         return mapper;
     }
 
+    // -----------------------------------------------------------------
+    // adviseMemory()
+    // -----------------------------------------------------------------
+
+    void adviseMemory(ConstMemory memory, u32 hints)
+    {
+        if (!memory.address || !memory.size || !hints)
+        {
+            return;
+        }
+
+        // madvise() needs page aligned address
+        const uintptr_t page_size = uintptr_t(get_pagesize());
+        const uintptr_t begin = uintptr_t(memory.address) & ~(page_size - 1);
+        const uintptr_t end = uintptr_t(memory.address + memory.size);
+
+        void* address = reinterpret_cast<void*>(begin);
+        const size_t size = size_t(end - begin);
+
+        // the hints are advisory so the errors are ignored
+
+        if (hints & MapHint::SEQUENTIAL)
+        {
+            ::madvise(address, size, MADV_SEQUENTIAL);
+        }
+
+#ifdef MADV_HUGEPAGE
+        if (hints & MapHint::HUGEPAGE)
+        {
+            ::madvise(address, size, MADV_HUGEPAGE);
+        }
+#endif
+
+        if (hints & MapHint::WILLNEED)
+        {
+            ::madvise(address, size, MADV_WILLNEED);
+        }
+
+        if (hints & MapHint::POPULATE)
+        {
+#ifdef MADV_POPULATE_READ
+            // same as MAP_POPULATE for memory which is already mapped (Linux 5.14)
+            if (!::madvise(address, size, MADV_POPULATE_READ))
+            {
+                return;
+            }
+#endif
+
+            // the first page starts before the memory but it is mapped
+            for (uintptr_t page = begin; page < end; page += page_size)
+            {
+                u8 value = *reinterpret_cast<const volatile u8*>(page);
+                MANGO_UNREFERENCED(value);
+            }
+        }
+    }
+
+    // -----------------------------------------------------------------
+    // getPageSize()
+    // -----------------------------------------------------------------
+
+    size_t getPageSize()
+    {
+        return size_t(get_pagesize());
+    }
+
+    // -----------------------------------------------------------------
+    // getFileStatus()
+    // -----------------------------------------------------------------
+
+    bool getFileStatus(const std::string& filename, FileStatus& status)
+    {
+        struct stat s;
+        if (::stat(filename.c_str(), &s) != 0)
+        {
+            return false;
+        }
+
+        // st_mtime has only one second resolution; a file can be rewritten within the same second
+#if defined(MANGO_PLATFORM_OSX) || defined(MANGO_PLATFORM_IOS)
+        const struct timespec& time = s.st_mtimespec;
+#else
+        const struct timespec& time = s.st_mtim;
+#endif
+
+        status.device = u64(s.st_dev);
+        status.index = u64(s.st_ino);
+        status.size = u64(s.st_size);
+        status.time = u64(time.tv_sec) * 1000000000 + u64(time.tv_nsec);
+        return true;
+    }
+
+    // -----------------------------------------------------------------
+    // Mapper::getFileIdentity()
+    // -----------------------------------------------------------------
+
+    bool Mapper::getFileIdentity(const std::string& filename, std::string& identity)
+    {
+        FileStatus status;
+        if (!getFileStatus(filename, status))
+        {
+            return false;
+        }
+
+        char* name = ::realpath(filename.c_str(), nullptr);
+        if (!name)
+        {
+            return false;
+        }
+
+        std::string canonical = name;
+        std::free(name);
+
+        identity = fmt::format("{}|{}:{}|{}|{}", canonical,
+            status.device, status.index, status.size, status.time);
+        return true;
+    }
+
 } // namespace mango::filesystem
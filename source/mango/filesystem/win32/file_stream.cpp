@@ -1,98 +1,131 @@
 /*
     MANGO Multimedia Development Platform
-    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+    Copyright (C) 2012-2023 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
+#include <algorithm>
 #include <mango/core/string.hpp>
 #include <mango/core/exception.hpp>
-#include <mango/filesystem/file.hpp>
+#include "../native_file.hpp"
 
-namespace mango::filesystem
+namespace
 {
+    using namespace mango;
+    using namespace mango::filesystem;
 
     // -----------------------------------------------------------------
-    // FileHandle
+    // NativeFileWin32
     // -----------------------------------------------------------------
 
-    struct FileHandle
+    class NativeFileWin32 : public NativeFile
     {
+    protected:
+        // ReadFile and WriteFile take the size as 32 bit integer
+        static constexpr size_t MAX_CHUNK = 1 << 30;
+
         std::string m_filename;
         HANDLE m_handle;
 
-        FileHandle(const std::string& filename, HANDLE handle)
-            : m_filename(filename)
-            , m_handle(handle)
+        static OVERLAPPED getOverlapped(u64 offset)
         {
+            // positional access with synchronous handle
+            OVERLAPPED overlapped = {};
+            overlapped.Offset = DWORD(offset);
+            overlapped.OffsetHigh = DWORD(offset >> 32);
+            return overlapped;
         }
 
-        ~FileHandle()
+    public:
+        NativeFileWin32(const std::string& filename, HANDLE handle)
+            : m_filename(filename)
+            , m_handle(handle)
         {
-            CloseHandle(m_handle);
         }
 
-        const std::string& filename() const
+        ~NativeFileWin32()
         {
-            return m_filename;
+            CloseHandle(m_handle);
         }
 
-        u64 size() const
+        u64 size() const override
         {
             LARGE_INTEGER integer;
             BOOL status = GetFileSizeEx(m_handle, &integer);
             return status ? u64(integer.QuadPart) : 0;
         }
 
-        u64 offset() const
+        size_t read(void* dest, size_t size, u64 offset) const override
         {
-            LARGE_INTEGER dist = { { 0, 0 } };
-            LARGE_INTEGER result = { { 0, 0 } };
-            BOOL status = SetFilePointerEx(m_handle, dist, &result, FILE_CURRENT);
-            MANGO_UNREFERENCED(status);
-            return result.QuadPart;
+            u8* buffer = reinterpret_cast<u8*>(dest);
+            size_t bytes = 0;
+
+            while (bytes < size)
+            {
+                OVERLAPPED overlapped = getOverlapped(offset + bytes);
+
+                DWORD bytes_read = 0;
+                BOOL status = ReadFile(m_handle, buffer + bytes, DWORD(std::min(size - bytes, MAX_CHUNK)), &bytes_read, &overlapped);
+                if (!status && GetLastError() != ERROR_HANDLE_EOF)
+                {
+                    MANGO_EXCEPTION("[FileStream] Reading \"{}\" failed.", m_filename);
+                }
+
+                if (!bytes_read)
+                {
+                    // end of file
+                    break;
+                }
+
+                bytes += bytes_read;
+            }
+
+            return bytes;
         }
 
-        void seek(s64 distance, DWORD method)
+        void write(const void* data, size_t size, u64 offset) override
         {
-            LARGE_INTEGER dist;
-            dist.QuadPart = distance;
-            BOOL status = SetFilePointerEx(m_handle, dist, NULL, method);
-            MANGO_UNREFERENCED(status);
+            const u8* buffer = reinterpret_cast<const u8*>(data);
+            size_t bytes = 0;
+
+            while (bytes < size)
+            {
+                OVERLAPPED overlapped = getOverlapped(offset + bytes);
+
+                DWORD bytes_written = 0;
+                BOOL status = WriteFile(m_handle, buffer + bytes, DWORD(std::min(size - bytes, MAX_CHUNK)), &bytes_written, &overlapped);
+                if (!status)
+                {
+                    MANGO_EXCEPTION("[FileStream] Writing \"{}\" failed.", m_filename);
+                }
+
+                bytes += bytes_written;
+            }
         }
+    };
 
-        void read(void* dest, u64 size)
-        {
-            DWORD bytes_read;
-            BOOL status = ReadFile(m_handle, dest, DWORD(size), &bytes_read, NULL);
-            MANGO_UNREFERENCED(status);
-            MANGO_UNREFERENCED(bytes_read);
-        }
+} // namespace
 
-        void write(const void* data, u64 size)
-        {
-            DWORD bytes_written;
-            BOOL status = WriteFile(m_handle, data, DWORD(size), &bytes_written, NULL);
-            MANGO_UNREFERENCED(status);
-            MANGO_UNREFERENCED(bytes_written);
-        }
-    };
+namespace mango::filesystem
+{
 
     // -----------------------------------------------------------------
-    // FileStream
+    // createNativeFile()
     // -----------------------------------------------------------------
 
-    FileStream::FileStream(const std::string& filename, OpenMode mode)
-        : m_handle(nullptr)
+    std::unique_ptr<NativeFile> createNativeFile(const std::string& filename, Stream::OpenMode mode)
     {
         DWORD access;
         DWORD disposition;
+        DWORD flags = FILE_ATTRIBUTE_NORMAL;
 
         switch (mode)
         {
-            case READ:
+            case Stream::READ:
                 access = GENERIC_READ;
                 disposition = OPEN_EXISTING;
+                flags |= FILE_FLAG_SEQUENTIAL_SCAN;
                 break;
 
-            case WRITE:
+            case Stream::WRITE:
                 access = GENERIC_WRITE;
                 disposition = CREATE_ALWAYS;
                 break;
@@ -102,68 +135,13 @@ namespace mango::filesystem
                 break;
         }
 
-        HANDLE handle = CreateFileW(u16_fromBytes(filename).c_str(), access, FILE_SHARE_READ, NULL, disposition, FILE_ATTRIBUTE_NORMAL, NULL);
+        HANDLE handle = CreateFileW(u16_fromBytes(filename).c_str(), access, FILE_SHARE_READ, NULL, disposition, flags, NULL);
         if (handle == INVALID_HANDLE_VALUE)
         {
             MANGO_EXCEPTION("[FileStream] CreateFileW(\"{}\") failed.", filename);
         }
 
-        m_handle = new FileHandle(filename, handle);
-    }
-
-    FileStream::~FileStream()
-    {
-        delete m_handle;
-    }
-
-    const std::string& FileStream::filename() const
-    {
-        return m_handle->filename();
-    }
-
-    u64 FileStream::size() const
-    {
-        return m_handle->size();
-    }
-
-    u64 FileStream::offset() const
-    {
-        return m_handle->offset();
-    }
-
-    void FileStream::seek(s64 distance, SeekMode mode)
-    {
-        DWORD method;
-
-        switch (mode)
-        {
-            case BEGIN:
-                method = FILE_BEGIN;
-                break;
-
-            case CURRENT:
-                method = FILE_CURRENT;
-                break;
-
-            case END:
-                method = FILE_END;
-                break;
-
-            default:
-                MANGO_EXCEPTION("[FileStream] Invalid seek mode.");
-        }
-
-        m_handle->seek(distance, method);
-    }
-
-    void FileStream::read(void* dest, u64 size)
-    {
-        m_handle->read(dest, size);
-    }
-
-    void FileStream::write(const void* data, u64 size)
-    {
-        m_handle->write(data, size);
+        return std::make_unique<NativeFileWin32>(filename, handle);
     }
 
 } // namespace mango::filesystem
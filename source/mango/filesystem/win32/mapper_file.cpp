@@ -2,10 +2,12 @@
     MANGO Multimedia Development Platform
     Copyright (C) 2012-2023 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
+#include <cstdlib>
 #include <mango/core/exception.hpp>
 #include <mango/core/string.hpp>
 #include <mango/filesystem/mapper.hpp>
 #include <mango/filesystem/path.hpp>
+#include "../native_file.hpp"
 
 #include <io.h>
 #include <fcntl.h>
@@ -220,4 +222,117 @@ namespace mango::filesystem
         return mapper;
     }
 
+    // -----------------------------------------------------------------
+    // adviseMemory()
+    // -----------------------------------------------------------------
+
+    void adviseMemory(ConstMemory memory, u32 hints)
+    {
+        if (!memory.address || !memory.size)
+        {
+            return;
+        }
+
+        // SEQUENTIAL and HUGEPAGE have no equivalent for mapped files
+
+#if _WIN32_WINNT >= 0x0602
+        if (hints & (MapHint::WILLNEED | MapHint::POPULATE))
+        {
+            // asynchronous read of the pages
+            WIN32_MEMORY_RANGE_ENTRY range;
+            range.VirtualAddress = const_cast<u8*>(memory.address);
+            range.NumberOfBytes = memory.size;
+            PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+        }
+#endif
+
+        if (hints & MapHint::POPULATE)
+        {
+            // touch every page from the page aligned beginning; the first page is mapped
+            const uintptr_t page_size = uintptr_t(getPageSize());
+            const uintptr_t begin = uintptr_t(memory.address) & ~(page_size - 1);
+            const uintptr_t end = uintptr_t(memory.address + memory.size);
+
+            for (uintptr_t page = begin; page < end; page += page_size)
+            {
+                u8 value = *reinterpret_cast<const volatile u8*>(page);
+                MANGO_UNREFERENCED(value);
+            }
+        }
+    }
+
+    // -----------------------------------------------------------------
+    // getPageSize()
+    // -----------------------------------------------------------------
+
+    size_t getPageSize()
+    {
+        static const size_t page_size = []
+        {
+            SYSTEM_INFO info;
+            GetSystemInfo(&info);
+            return size_t(info.dwPageSize);
+        }();
+
+        return page_size;
+    }
+
+    // -----------------------------------------------------------------
+    // getFileStatus()
+    // -----------------------------------------------------------------
+
+    bool getFileStatus(const std::string& filename, FileStatus& status)
+    {
+        HANDLE file = CreateFileW(u16_fromBytes(filename).c_str(), FILE_READ_ATTRIBUTES,
+            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+
+        BY_HANDLE_FILE_INFORMATION info;
+        BOOL result = GetFileInformationByHandle(file, &info);
+        CloseHandle(file);
+
+        if (!result)
+        {
+            return false;
+        }
+
+        status.device = u64(info.dwVolumeSerialNumber);
+        status.index = (u64(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+        status.size = (u64(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+        status.time = (u64(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime; // 100 ns units
+        return true;
+    }
+
+    // -----------------------------------------------------------------
+    // Mapper::getFileIdentity()
+    // -----------------------------------------------------------------
+
+    bool Mapper::getFileIdentity(const std::string& filename, std::string& identity)
+    {
+        FileStatus status;
+        if (!getFileStatus(filename, status))
+        {
+            return false;
+        }
+
+        std::wstring name = u16_fromBytes(filename);
+
+        wchar_t* fullpath = _wfullpath(nullptr, name.c_str(), 0);
+        if (!fullpath)
+        {
+            return false;
+        }
+
+        // the filesystem is case-insensitive
+        std::string canonical = toLower(u16_toBytes(fullpath));
+        std::free(fullpath);
+
+        identity = fmt::format("{}|{}:{}|{}|{}", canonical,
+            status.device, status.index, status.size, status.time);
+        return true;
+    }
+
 } // namespace mango::filesystem
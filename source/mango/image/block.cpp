@@ -1102,18 +1102,20 @@ namespace
 
         if (multithread)
         {
-            ConcurrentQueue queue;
+            const size_t data_stride = size_t(info.bytes) * xblocks;
 
-            for (int y = 0; y < yblocks; ++y)
+            parallelFor(0, yblocks, 1, [=, &info] (int y0, int y1)
             {
-                queue.enqueue([=]
-                {
-                    scanBlockDecode(info, image, data, stride, xblocks, xstride);
-                });
+                u8* scan_image = image + y0 * std::ptrdiff_t(ystride);
+                const u8* scan_data = data + y0 * data_stride;
 
-                image += ystride;
-                data += info.bytes * xblocks;
-            }
+                for (int y = y0; y < y1; ++y)
+                {
+                    scanBlockDecode(info, scan_image, scan_data, stride, xblocks, xstride);
+                    scan_image += ystride;
+                    scan_data += data_stride;
+                }
+            });
         }
         else
         {
@@ -1337,19 +1339,17 @@ namespace mango::image
         }
         else
         {
-            ConcurrentQueue queue;
-
             u8* address = memory.address;
 
             const int xblocks = getBlocksX(surface.width);
             const int yblocks = getBlocksY(surface.height);
 
-            for (int y = 0; y < yblocks; ++y)
+            parallelFor(0, yblocks, 1, [this, xblocks, &surface, address] (int y0, int y1)
             {
-                queue.enqueue([this, y, xblocks, &surface, address]
-                {
-                    Bitmap temp(xblocks * width, height, format);
+                Bitmap temp(xblocks * width, height, format);
 
+                for (int y = y0; y < y1; ++y)
+                {
                     int w = std::min(surface.width, xblocks * width);
                     int h = std::min(height, surface.height - y * height);
 
@@ -1366,8 +1366,8 @@ namespace mango::image
                         data += bytes;
                         image += step;
                     }
-                });
-            }
+                }
+            });
         }
 
         return status;
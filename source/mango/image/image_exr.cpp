@@ -2682,9 +2682,7 @@ void ContextEXR::decodeImage(const ImageDecodeOptions& options)
 
     u64 time0 = mango::Time::us();
 
-    LittleEndianConstPointer p = m_pointer;
-
-    ConcurrentQueue q;
+    const u8* table = m_pointer;
 
     if (is_single_tile)
     {
@@ -2694,49 +2692,52 @@ void ContextEXR::decodeImage(const ImageDecodeOptions& options)
 
         printLine(Print::Info, "Tiles: {} x {} ({})", xtiles, ytiles, ntiles);
 
-        for (int i = 0; i < ntiles; ++i)
+        auto decodeTiles = [&] (int i0, int i1) -> bool
         {
-            u64 offset = p.read64();
-            LittleEndianConstPointer ptr = m_memory.address + offset;
+            for (int i = i0; i < i1; ++i)
+            {
+                LittleEndianConstPointer p = table + i * 8;
+                u64 offset = p.read64();
+                LittleEndianConstPointer ptr = m_memory.address + offset;
 
-            int tilex = ptr.read32();
-            int tiley = ptr.read32();
-            int xlevel = ptr.read32();
-            int ylevel = ptr.read32();
-            u32 size = ptr.read32();
+                int tilex = ptr.read32();
+                int tiley = ptr.read32();
+                int xlevel = ptr.read32();
+                int ylevel = ptr.read32();
+                u32 size = ptr.read32();
 
-            //printLine(Print::Info, "  pos:({},{}) level:({},{}) size: {} bytes", tilex, tiley, xlevel, ylevel, size);
-            MANGO_UNREFERENCED(xlevel);
-            MANGO_UNREFERENCED(ylevel);
+                //printLine(Print::Info, "  pos:({},{}) level:({},{}) size: {} bytes", tilex, tiley, xlevel, ylevel, size);
+                MANGO_UNREFERENCED(xlevel);
+                MANGO_UNREFERENCED(ylevel);
 
-            int tileWidth = m_attributes.tiledesc.xsize;
-            int tileHeight = m_attributes.tiledesc.ysize;
+                int tileWidth = m_attributes.tiledesc.xsize;
+                int tileHeight = m_attributes.tiledesc.ysize;
 
-            int x0 = tilex * tileWidth;
-            int y0 = tiley * tileHeight;
-            int x1 = std::min(width, x0 + tileWidth);
-            int y1 = std::min(height, y0 + tileHeight);
+                int x0 = tilex * tileWidth;
+                int y0 = tiley * tileHeight;
+                int x1 = std::min(width, x0 + tileWidth);
+                int y1 = std::min(height, y0 + tileHeight);
 
-            if (x0 < 0 || x1 > width || y0 < 0 || y1 > height)
-            {
-                // incorrect tile
-                return;
-            }
+                if (x0 < 0 || x1 > width || y0 < 0 || y1 > height)
+                {
+                    // incorrect tile
+                    return false;
+                }
 
-            auto task = [=]
-            {
                 ConstMemory memory(ptr, size);
                 decodeBlock(m_surface, memory, x0, y0, x1, y1);
-            };
-
-            if (options.multithread)
-            {
-                q.enqueue(task);
-            }
-            else
-            {
-                task();
             }
+
+            return true;
+        };
+
+        if (options.multithread)
+        {
+            parallelFor(0, ntiles, 1, decodeTiles);
+        }
+        else
+        {
+            decodeTiles(0, ntiles);
         }
     }
     else
@@ -2745,46 +2746,47 @@ void ContextEXR::decodeImage(const ImageDecodeOptions& options)
 
         printLine(Print::Info, "Blocks: {}", nblocks);
 
-        for (int i = 0; i < nblocks; ++i)
+        auto decodeBlocks = [&] (int i0, int i1) -> bool
         {
-            u64 offset = p.read64();
-            LittleEndianConstPointer ptr = m_memory.address + offset;
+            for (int i = i0; i < i1; ++i)
+            {
+                LittleEndianConstPointer p = table + i * 8;
+                u64 offset = p.read64();
+                LittleEndianConstPointer ptr = m_memory.address + offset;
 
-            int ystart = ptr.read32();
-            u32 size = ptr.read32();
+                int ystart = ptr.read32();
+                u32 size = ptr.read32();
 
-            int x0 = 0;
-            int y0 = ystart - m_attributes.dataWindow.ymin;
-            int x1 = width;
-            int y1 = std::min(height, y0 + m_scanLinesPerBlock);
+                int x0 = 0;
+                int y0 = ystart - m_attributes.dataWindow.ymin;
+                int x1 = width;
+                int y1 = std::min(height, y0 + m_scanLinesPerBlock);
 
-            if (y0 < 0 || y1 > height)
-            {
-                // incorrect block
-                return;
-            }
+                if (y0 < 0 || y1 > height)
+                {
+                    // incorrect block
+                    return false;
+                }
 
-            //printLine(Print::Info, "  y:{}, size: {} bytes", y0, size);
+                //printLine(Print::Info, "  y:{}, size: {} bytes", y0, size);
 
-            auto task = [=]
-            {
                 ConstMemory memory(ptr, size);
                 decodeBlock(m_surface, memory, x0, y0, x1, y1);
-            };
-
-            if (options.multithread)
-            {
-                q.enqueue(task);
-            }
-            else
-            {
-                task();
             }
+
+            return true;
+        };
+
+        if (options.multithread)
+        {
+            parallelFor(0, nblocks, 1, decodeBlocks);
+        }
+        else
+        {
+            decodeBlocks(0, nblocks);
         }
     }
 
-    q.wait();
-
     u64 time1 = mango::Time::us();
     m_time_decode += (time1 - time0);
 
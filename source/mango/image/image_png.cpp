@@ -55,6 +55,9 @@ namespace fpng
         Integration with mango includes some modifications:
         - use the existing architecture neutral load/store
         - defer Adler32 checksum computation to the caller
+        - optionally terminate the output with a sync flush instead of the final block so that
+          independently compressed segments can be concatenated into one stream
+        - optionally omit the zlib header when the output continues an existing stream
     */
     using namespace mango;
 
@@ -119,14 +122,23 @@ namespace fpng
 } while(0)
 
     static
-    u32 pixel_deflate_dyn_4_rle_one_pass(const u8* pImg, u32 w, u32 h, u8* pDst, u32 dst_buf_size)
+    u32 pixel_deflate_dyn_4_rle_one_pass(const u8* pImg, u32 w, u32 h, u8* pDst, u32 dst_buf_size, bool final = true, bool header = true)
     {
         const u32 bpl = 1 + w * 4;
 
+        // skip the 2 byte zlib header when continuing a stream
+        const u32 skip = header ? 0 : 2;
+
         if (dst_buf_size < sizeof(g_dyn_huff_4))
             return false;
-        memcpy(pDst, g_dyn_huff_4, sizeof(g_dyn_huff_4));
-        u32 dst_ofs = sizeof(g_dyn_huff_4);
+        memcpy(pDst, g_dyn_huff_4 + skip, sizeof(g_dyn_huff_4) - skip);
+        u32 dst_ofs = sizeof(g_dyn_huff_4) - skip;
+
+        if (!final)
+        {
+            // clear BFINAL in the block header (the first bit after the zlib header)
+            pDst[2 - skip] &= 0xfe;
+        }
 
         u64 bit_buf = DYN_HUFF_4_BITBUF;
         int bit_buf_size = DYN_HUFF_4_BITBUF_SIZE;
@@ -232,28 +244,50 @@ do_literals:
 
         PUT_BITS_CZ(g_dyn_huff_4_codes[256].m_code, g_dyn_huff_4_codes[256].m_code_size);
 
+        if (!final)
+        {
+            // sync flush: empty non-final stored block aligned to byte boundary
+            PUT_BITS(0, 3);
+        }
+
         PUT_BITS_FORCE_FLUSH;
 
+        if (!final)
+        {
+            if ((dst_ofs + 4) > dst_buf_size)
+                return 0;
+
+            pDst[dst_ofs++] = 0x00;
+            pDst[dst_ofs++] = 0x00;
+            pDst[dst_ofs++] = 0xff;
+            pDst[dst_ofs++] = 0xff;
+        }
+
         return dst_ofs;
     }
 
     static
-    u32 write_raw_block(const u8* pSrc, u32 src_len, u8* pDst, u32 dst_buf_size)
+    u32 write_raw_block(const u8* pSrc, u32 src_len, u8* pDst, u32 dst_buf_size, bool final = true, bool header = true)
     {
-        if (dst_buf_size < 2)
-            return 0;
+        u32 dst_ofs = 0;
+
+        if (header)
+        {
+            if (dst_buf_size < 2)
+                return 0;
 
-        pDst[0] = 0x78;
-        pDst[1] = 0x01;
+            pDst[0] = 0x78;
+            pDst[1] = 0x01;
 
-        u32 dst_ofs = 2;
+            dst_ofs = 2;
+        }
 
         u32 src_ofs = 0;
         while (src_ofs < src_len)
         {
             const u32 src_remaining = src_len - src_ofs;
             const u32 block_size = std::min<u32>(UINT16_MAX, src_remaining);
-            const bool final_block = (block_size == src_remaining);
+            const bool final_block = (block_size == src_remaining) && final;
 
             if ((dst_ofs + 5 + block_size) > dst_buf_size)
                 return 0;
@@ -2066,6 +2100,10 @@ namespace
         u8 m_parallel_flags = 0;
         std::vector<ConstMemory> m_parallel_segments;
 
+        // streaming: IDAT chunks are decompressed in place
+        bool m_streaming = false;
+        std::vector<ConstMemory> m_stream_chunks;
+
         void read_IHDR(BigEndianConstPointer p, u32 size);
         void read_IDAT(BigEndianConstPointer p, u32 size);
         void read_PLTE(BigEndianConstPointer p, u32 size);
@@ -2093,9 +2131,11 @@ namespace
         void deinterlace8(u8* output, int width, int height, size_t stride, u8* buffer);
         void filter(u8* buffer, int bytes, int height);
         void process_range(u8* image, u8* buffer, size_t stride, int width, const FilterDispatcher& filter, int y0, int y1);
+        void process_rows(u8* image, u8* buffer, size_t stride, int width, const FilterDispatcher& filter, int y0, int y1, bool multithread);
         void process(u8* dest, int width, int height, size_t stride, u8* buffer, bool multithread);
 
         void blend(Surface& d, Surface& s, Palette* palette);
+        void configurePalette(Palette* palette);
 
         size_t getBytesPerLine(int width) const
         {
@@ -2117,6 +2157,8 @@ namespace
 
         const ImageHeader& getHeader();
         ImageDecodeStatus decode(const Surface& dest, bool multithread, bool use_icc, Palette* palette);
+        ImageDecodeStatus decodeStreaming(const Surface& dest, const ImageDecodeOptions& options, Palette* palette);
+        bool isStreamable() const;
 
         ConstMemory icc()
         {
@@ -2330,7 +2372,11 @@ namespace
 
     void ParserPNG::read_IDAT(BigEndianConstPointer p, u32 size)
     {
-        if (m_parallel_height)
+        if (m_streaming)
+        {
+            m_stream_chunks.emplace_back(p, size);
+        }
+        else if (m_parallel_height)
         {
             m_parallel_segments.emplace_back(p, size);
         }
@@ -3039,39 +3085,59 @@ namespace
                 return;
 
             FilterDispatcher filter(bpp);
+            process_rows(image, buffer, stride, width, filter, 0, height, multithread);
+        }
+    }
+
+    void ParserPNG::process_rows(u8* image, u8* buffer, size_t stride, int width, const FilterDispatcher& filter, int y0, int y1, bool multithread)
+    {
+        if (multithread)
+        {
+            const size_t bytes_per_line = getBytesPerLine(width) + PNG_FILTER_BYTE;
 
-            int y0 = 0;
+            // scanlines which do not use the previous scanline may start a new range
+            std::vector<int> starts;
+            starts.push_back(y0);
 
-            if (multithread)
+            for (int y = y0 + 1; y < y1; ++y)
             {
-                ConcurrentQueue q("png:process", Priority::High);
-
-                for (int y = 0; y < height; ++y)
+                u8 f = buffer[bytes_per_line * y]; // extract filter byte
+                if (f <= 1 && (y - starts.back()) > 32)
                 {
-                    u8 f = buffer[bytes_per_line * y]; // extract filter byte
-                    if (f <= 1)
-                    {
-                        // does not use previous scanline -> may start a new range
-                        if ((y - y0) > 32)
-                        {
-                            // enqueue current range
-                            q.enqueue([=] ()
-                            {
-                                process_range(image, buffer, stride, width, filter, y0, y);
-                            });
-
-                            // start a new range
-                            y0 = y;
-                        }
-                    }
-                    else
-                    {
-                        // uses previous scanline -> must continue current range
-                    }
+                    starts.push_back(y);
                 }
             }
 
-            process_range(image, buffer, stride, width, filter, y0, height);
+            starts.push_back(y1);
+
+            const int ranges = int(starts.size() - 1);
+
+            ConcurrentQueue q("png:process", Priority::High, WaitPolicy::Scoped);
+
+            // adjacent ranges are merged into one task
+            parallelFor(q, 0, ranges, 0, [&] (int i0, int i1)
+            {
+                process_range(image, buffer, stride, width, filter, starts[i0], starts[i1]);
+            });
+        }
+        else
+        {
+            process_range(image, buffer, stride, width, filter, y0, y1);
+        }
+    }
+
+    void ParserPNG::configurePalette(Palette* ptr_palette)
+    {
+        if (ptr_palette)
+        {
+            // caller requests palette; give it and decode u8 indices
+            *ptr_palette = m_palette;
+            m_color_state.palette = nullptr;
+        }
+        else
+        {
+            // caller doesn't want palette; lookup RGBA colors from palette
+            m_color_state.palette = m_palette.color;
         }
     }
 
@@ -3095,17 +3161,7 @@ namespace
             return status;
         }
 
-        if (ptr_palette)
-        {
-            // caller requests palette; give it and decode u8 indices
-            *ptr_palette = m_palette;
-            m_color_state.palette = nullptr;
-        }
-        else
-        {
-            // caller doesn't want palette; lookup RGBA colors from palette
-            m_color_state.palette = m_palette.color;
-        }
+        configurePalette(ptr_palette);
 
         // default: main image from "IHDR" chunk
         int width = m_width;
@@ -3154,14 +3210,14 @@ namespace
             // pLLD decoding
             // ----------------------------------------------------------------------
 
-            ConcurrentQueue q("png:decode", Priority::High);
+            TaskGraph graph("png:decode", Priority::High);
 
             const int bpp = (m_color_state.bits < 8) ? 1 : m_channels * m_color_state.bits / 8;
 
-            if ((m_parallel_flags & 1) && !m_interlace && bpp <= 8)
-            {
-                is_inline_process = true;
-            }
+            // the segments are unfiltered as soon as they are decompressed; when the segments
+            // are not independent, the unfiltering is chained in scanline order
+            const bool is_independent = (m_parallel_flags & 1) != 0;
+            is_inline_process = !m_interlace && bpp <= 8;
 
             u32 y = 0;
             auto decompress = deflate_zlib::decompress;
@@ -3171,6 +3227,8 @@ namespace
             decompress = compressor.decompress;
 #endif
 
+            TaskGraph::Node previous = 0;
+
             for (ConstMemory memory : m_parallel_segments)
             {
                 int h = std::min(m_parallel_height, m_height - y);
@@ -3179,7 +3237,7 @@ namespace
                 output.address = buffer.address + bytes_per_line * y;
                 output.size = bytes_per_line * h;
 
-                q.enqueue([=]
+                auto node = graph.node([=]
                 {
                     CompressionStatus result = decompress(output, memory);
                     if (!result)
@@ -3187,19 +3245,32 @@ namespace
                         // NOTE: libdeflate will report "Bad Data", zlib works but slower
                         //printLine(Print::Error, "  {}", result.info);
                     }
+                });
 
-                    if (is_inline_process)
+                if (is_inline_process)
+                {
+                    auto process = graph.node([=]
                     {
                         FilterDispatcher filter(bpp);
                         process_range(image, buffer, stride, width, filter, y, y + h);
+                    });
+
+                    graph.edge(node, process);
+
+                    if (!is_independent && y > 0)
+                    {
+                        graph.edge(previous, process);
                     }
-                });
+
+                    previous = process;
+                }
 
                 decompress = deflate::decompress;
                 y += m_parallel_height;
             }
 
-            q.wait();
+            graph.run();
+            graph.wait();
         }
         else if (m_idot_address && multithread)
         {
@@ -3225,29 +3296,55 @@ namespace
             bottom_memory.address = m_compressed.data() + m_idot_offset;
             bottom_memory.size = m_compressed.size() - m_idot_offset;
 
-            // enqueue task into the threadpool
-            FutureTask<size_t> task([=] () -> size_t
-            {
-                // Apple uses raw deflate format for iDOT extended IDAT chunks
-                CompressionStatus result = deflate::decompress(bottom_buffer, bottom_memory);
-                return result.size;
-            });
-
             // Apple uses raw deflate format
             // png standard uses zlib frame format
             auto decompress = m_iphoneOptimized ?
                 deflate::decompress :
                 deflate_zlib::decompress;
 
-            CompressionStatus result = decompress(top_buffer, top_memory);
+            TaskGraph graph("png:idot", Priority::High);
+
+            auto top = graph.node([=]
+            {
+                CompressionStatus result = decompress(top_buffer, top_memory);
+                printLine(Print::Info, "  output top bytes:     {}", result.size);
+            });
+
+            auto bottom = graph.node([=]
+            {
+                // Apple uses raw deflate format for iDOT extended IDAT chunks
+                CompressionStatus result = deflate::decompress(bottom_buffer, bottom_memory);
+                printLine(Print::Info, "  output bottom bytes:  {}", result.size);
+            });
+
+            const int bpp = (m_color_state.bits < 8) ? 1 : m_channels * m_color_state.bits / 8;
+
+            if (!m_interlace && bpp <= 8 && !m_error)
+            {
+                // unfilter the top half while the bottom half is still being decompressed
+                const int y0 = std::min(int(m_first_half_height), height);
+
+                auto process_top = graph.node([=]
+                {
+                    FilterDispatcher filter(bpp);
+                    process_rows(image, buffer, stride, width, filter, 0, y0, true);
+                });
+
+                auto process_bottom = graph.node([=]
+                {
+                    FilterDispatcher filter(bpp);
+                    process_rows(image, buffer, stride, width, filter, y0, height, true);
+                });
+
+                graph.edge(top, process_top);
+                graph.edge(bottom, process_bottom);
+                graph.edge(process_top, process_bottom); // the first bottom scanline may use the previous one
 
-            size_t bytes_out_top = result.size;
-            size_t bytes_out_bottom = task.get(); // synchronize
+                is_inline_process = true;
+            }
 
-            printLine(Print::Info, "  output top bytes:     {}", bytes_out_top);
-            printLine(Print::Info, "  output bottom bytes:  {}", bytes_out_bottom);
-            MANGO_UNREFERENCED(bytes_out_top);
-            MANGO_UNREFERENCED(bytes_out_bottom);
+            graph.run();
+            graph.wait();
         }
         else
         {
@@ -3299,288 +3396,924 @@ namespace
         return status;
     }
 
-    // ------------------------------------------------------------
-    // write_png()
-    // ------------------------------------------------------------
-
-    static
-    void write_filter_sub(u8* dest, const u8* scan, size_t bpp, size_t bytes)
+    bool ParserPNG::isStreamable() const
     {
-        std::memcpy(dest, scan, bpp);
-        bytes -= bpp;
-        dest += bpp;
-
-        for (size_t i = 0; i < bytes; ++i)
+        if (!m_header.success || m_interlace)
         {
-            dest[i] = u8(scan[i + bpp] - scan[i]);
+            // interlaced scanlines are not stored in top-to-bottom order
+            return false;
         }
-    }
 
-#if 0
-    // NOTE: This is what the UP/AVERAGE/PAETH filters would look like if we wanted to use them.
-    //       We don't want to use them because these depend on previous scanline so don't work
-    //       with parallel decoder unless each segment starts with NONE or SUB filter which do not
-    //       require the previous scanline. Selecting which filter is the best one is too slow so
-    //       we go with the SUB filter every time. :)
+        // animation frames are composited from the whole frame; look for acTL before the image data
+        BigEndianConstPointer p = m_pointer;
 
-    static
-    void write_filter_up(u8* dest, const u8* scan, const u8* prev, size_t bytes)
-    {
-        for (size_t i = 0; i < bytes; ++i)
+        for ( ; p < m_end - 8; )
         {
-            dest[i] = u8(scan[i] - prev[i]);
+            const u32 size = p.read32();
+            const u32 id = p.read32();
+
+            if (id == u32_mask_rev('a', 'c', 'T', 'L'))
+            {
+                return false;
+            }
+
+            if (id == u32_mask_rev('I', 'D', 'A', 'T') || p + size + 4 > m_end)
+            {
+                break;
+            }
+
+            p += size + 4; // skip chunk data and crc
         }
+
+        return true;
     }
 
-    static
-    void write_filter_average(u8* dest, const u8* scan, const u8* prev, size_t bpp, size_t bytes)
+    ImageDecodeStatus ParserPNG::decodeStreaming(const Surface& dest, const ImageDecodeOptions& options, Palette* ptr_palette)
     {
-        for (size_t i = 0; i < bpp; ++i)
-        {
-            dest[i] = u8(scan[i] - (prev[i] / 2));
-        }
+        ImageDecodeStatus status;
 
-        bytes -= bpp;
-        dest += bpp;
-        prev += bpp;
+        m_stream_chunks.clear();
 
-        for (size_t i = 0; i < bytes; ++i)
+        m_streaming = true;
+        parse();
+        m_streaming = false;
+
+        if (m_stream_chunks.empty())
         {
-            dest[i] = u8(scan[i + bpp] - ((prev[i] + scan[i]) / 2));
+            status.setError("No compressed data.");
+            return status;
         }
-    }
 
-    static
-    void write_filter_paeth(u8* dest, const u8* scan, const u8* prev, size_t bpp, size_t bytes)
-    {
-        for (size_t i = 0; i < bpp; ++i)
+        if (!m_header.success)
         {
-            dest[i] = u8(scan[i] - prev[i]);
+            status.setError(m_header.info);
+            return status;
         }
 
-        bytes -= bpp;
-        dest += bpp;
+        configurePalette(ptr_palette);
 
-        for (size_t i = 0; i < bytes; ++i)
-        {
-            int b = prev[i + bpp];
-            int c = prev[i];
-            int a = scan[i];
+        const int width = m_width;
+        const int height = m_height;
 
-            int p = b - c;
-            int q = a - c;
+        const int bpp = (m_color_state.bits < 8) ? 1 : m_channels * m_color_state.bits / 8;
+        const size_t bytes_per_line = getBytesPerLine(width) + PNG_FILTER_BYTE;
 
-            int pa = abs(p);
-            int pb = abs(q);
-            int pc = abs(p + q);
+        // The scanlines are decompressed in bands which are stored in a small ring buffer. When
+        // the pipeline is enabled the next bands are decompressed while the previous ones are
+        // unfiltered and color converted in a serial queue.
+        constexpr size_t band_target_size = 256 * 1024;
+        const int band_height = int(std::clamp(band_target_size / bytes_per_line, size_t(1), size_t(height)));
+        const int bands = div_ceil(height, band_height);
+        const bool pipeline = options.multithread && bands > 2;
+        const int ring_size = pipeline ? 4 : 1;
+        const size_t band_bytes = band_height * bytes_per_line;
 
-            p = (pa <= pb && pa <=pc) ? a : (pb <= pc) ? b : c;
+        Buffer ring(band_bytes * ring_size + PNG_SIMD_PADDING);
+        Buffer previous(bytes_per_line + PNG_SIMD_PADDING, 0); // last scanline of the previous band
 
-            dest[i] = u8(scan[i + bpp] - p);
-        }
-    }
-#endif
+        // scanline delivery
+        const Format& format = ptr_palette ? dest.format : m_header.format;
+        const int target_width = dest.image ? std::min(width, dest.width) : width;
+        const bool direct = dest.format == format && target_width == width;
 
-    static
-    void write_chunk(Stream& stream, u32 chunk_id, ConstMemory memory)
-    {
-        BigEndianStream s(stream);
+        Buffer converted(direct ? 0 : width * format.bytes());
+        Buffer scanline(width * dest.format.bytes());
 
-        u8 temp[4];
-        bigEndian::ustore32(temp, chunk_id);
+        ColorState::Function convert = getColorFunction(m_color_state, m_color_type, m_color_state.bits);
 
-        u32 crc = crc32(0, Memory(temp, 4));
-        crc = crc32(crc, memory);
+        struct ColorTransform
+        {
+            image::ColorManager manager;
+            image::ColorProfile profile;
+            image::ColorProfile display;
 
-        u32 chunk_size = u32(memory.size);
+            ColorTransform(ConstMemory icc)
+                : profile(manager.create(icc))
+                , display(manager.createSRGB())
+            {
+            }
+        };
 
-        s.write32(chunk_size);
-        s.write32(chunk_id);
-        s.write(memory);
-        s.write32(crc);
-    }
+        std::unique_ptr<ColorTransform> transform;
 
-    static
-    void write_IHDR(Stream& stream, const Surface& surface, u8 color_bits, ColorType color_type)
-    {
-        BufferStream buffer;
-        BigEndianStream s(buffer);
+        if (m_icc.size() > 0 && options.icc)
+        {
+            transform = std::make_unique<ColorTransform>(ConstMemory(m_icc.data(), m_icc.size()));
+        }
 
-        s.write32(surface.width);
-        s.write32(surface.height);
-        s.write8(color_bits);
-        s.write8(color_type);
-        s.write8(0); // compression
-        s.write8(0); // filter
-        s.write8(0); // interlace
+        auto process_band = [&] (u8* buffer, int y0, int y1)
+        {
+            FilterDispatcher filter(bpp);
 
-        write_chunk(stream, u32_mask_rev('I', 'H', 'D', 'R'), buffer);
-    }
+            const u8* prev = previous;
 
-    static
-    void write_PLTE(Stream& stream, const Palette& palette)
-    {
-        BufferStream buffer;
-        BigEndianStream s(buffer);
+            for (int y = y0; y < y1; ++y)
+            {
+                filter(buffer, prev, int(bytes_per_line));
 
-        for (int i = 0; i < 256; ++i)
-        {
-            s.write8(palette[i].r);
-            s.write8(palette[i].g);
-            s.write8(palette[i].b);
-        }
+                u8* target = (dest.image && y < dest.height) ? dest.address(0, y) : scanline.data();
 
-        write_chunk(stream, u32_mask_rev('P', 'L', 'T', 'E'), buffer);
-    }
+                if (direct)
+                {
+                    convert(m_color_state, width, target, buffer + PNG_FILTER_BYTE);
+                }
+                else
+                {
+                    convert(m_color_state, width, converted, buffer + PNG_FILTER_BYTE);
 
-    static
-    void write_iCCP(Stream& stream, const ImageEncodeOptions& options)
-    {
-        if (options.icc.size == 0)
-        {
-            // empty profile chunk
-            return;
-        }
+                    Surface s(target_width, 1, format, 0, converted);
+                    Surface d(target_width, 1, dest.format, 0, target);
+                    d.blit(0, 0, s);
+                }
 
-        BufferStream buffer;
-        BigEndianStream s(buffer);
+                if (transform)
+                {
+                    Surface d(target_width, 1, dest.format, 0, target);
+                    transform->manager.transform(d, transform->display, transform->profile);
+                }
 
-        s.write8('-'); // profile name is 1-79 char according to spec. we dont have/need name
-        s.write8(0); // profile name null separator
-        s.write8(0); // compression method, 0=deflate
+                if (options.scanline)
+                {
+                    options.scanline(y, target);
+                }
 
-        size_t bound = deflate_zlib::bound(options.icc.size);
-        Buffer compressed(bound);
-        CompressionStatus result = deflate_zlib::compress(compressed, options.icc, options.compression);
-        if (result)
-        {
-            buffer.write(compressed, result.size); // rest of chunk is compressed profile
-            write_chunk(stream, u32_mask_rev('i', 'C', 'C', 'P'), buffer);
-        }
-    }
+                prev = buffer;
+                buffer += bytes_per_line;
+            }
 
-    static
-    void write_pLLD(Stream& stream, int segment_height)
-    {
-        BufferStream buffer;
-        BigEndianStream s(buffer);
+            std::memcpy(previous, prev, bytes_per_line);
+        };
 
-        s.write32(segment_height);
-        s.write8(0x01); // parallel filtering is supported (because we always use SUB filter)
+        // decompression
 
-        write_chunk(stream, u32_mask_rev('p', 'L', 'L', 'D'), buffer);
-    }
+        z_stream strm;
 
-    static
-    void filter_range(u8* buffer, const Surface& surface, int y0, int y1)
-    {
-        const int bpp = surface.format.bytes();
-        const int bytes_per_scan = surface.width * bpp;
+        strm.zalloc = 0;
+        strm.zfree = 0;
+        strm.opaque = 0;
+        strm.next_in = nullptr;
+        strm.avail_in = 0;
 
-        u8* image = surface.address(0, y0);
+        // Apple uses raw deflate format
+        ::inflateInit2(&strm, m_iphoneOptimized ? -MAX_WBITS : MAX_WBITS);
 
-        for (int y = y0; y < y1; ++y)
+        size_t chunk = 0;
+
+        auto inflate_band = [&] (u8* output, size_t bytes) -> bool
         {
-            *buffer++ = FILTER_SUB;
-            write_filter_sub(buffer, image, bpp, bytes_per_scan);
-            buffer += bytes_per_scan;
-            image += surface.stride;
+            strm.next_out = output;
+            strm.avail_out = uInt(bytes);
+
+            while (strm.avail_out)
+            {
+                if (!strm.avail_in)
+                {
+                    if (chunk == m_stream_chunks.size())
+                    {
+                        // out of compressed data
+                        return false;
+                    }
+
+                    strm.next_in = const_cast<u8*>(m_stream_chunks[chunk].address);
+                    strm.avail_in = uInt(m_stream_chunks[chunk].size);
+                    ++chunk;
+                }
+
+                int result = ::inflate(&strm, Z_NO_FLUSH);
+                if (result == Z_STREAM_END)
+                {
+                    return strm.avail_out == 0;
+                }
+
+                if (result != Z_OK && !(result == Z_BUF_ERROR && !strm.avail_in))
+                {
+                    return false;
+                }
+            }
+
+            return true;
+        };
+
+        bool decoding_failure = false;
+
+        if (pipeline)
+        {
+            SerialQueue queue("png:stream");
+
+            std::mutex mutex;
+            std::condition_variable condition;
+            int processed = 0;
+
+            for (int band = 0; band < bands; ++band)
+            {
+                {
+                    // wait until the band previously stored in the ring slot has been processed
+                    std::unique_lock<std::mutex> lock(mutex);
+                    condition.wait(lock, [&] { return processed > band - ring_size; });
+                }
+
+                const int y0 = band * band_height;
+                const int y1 = std::min(y0 + band_height, height);
+                u8* buffer = ring.data() + (band % ring_size) * band_bytes;
+
+                if (!inflate_band(buffer, (y1 - y0) * bytes_per_line))
+                {
+                    decoding_failure = true;
+                    break;
+                }
+
+                queue.enqueue([&, buffer, y0, y1]
+                {
+                    process_band(buffer, y0, y1);
+
+                    std::lock_guard<std::mutex> lock(mutex);
+                    ++processed;
+                    condition.notify_one();
+                });
+            }
+
+            queue.wait();
+        }
+        else
+        {
+            for (int y0 = 0; y0 < height; y0 += band_height)
+            {
+                const int y1 = std::min(y0 + band_height, height);
+
+                if (!inflate_band(ring, (y1 - y0) * bytes_per_line))
+                {
+                    decoding_failure = true;
+                    break;
+                }
+
+                process_band(ring, y0, y1);
+            }
+        }
+
+        if (decoding_failure)
+        {
+            status.setError(strm.msg ? strm.msg : "Incomplete compressed data.");
+        }
+
+        ::inflateEnd(&strm);
+
+        status.direct = direct && dest.image != nullptr;
+
+        return status;
+    }
+
+    // ------------------------------------------------------------
+    // write_png()
+    // ------------------------------------------------------------
+
+    // ------------------------------------------------------------
+    // filter selection
+    // ------------------------------------------------------------
+
+    // NOTE: The filter for each scanline is chosen with the "minimum sum of absolute differences"
+    //       heuristic recommended by the PNG specification: the residuals are interpreted as
+    //       signed bytes and the filter with the smallest sum of magnitudes wins. The first
+    //       scanline of a pLLD segment is restricted to NONE and SUB filters which do not
+    //       depend on the previous scanline so that the decoder can unfilter segments in parallel.
+
+    enum : u32
+    {
+        FILTER_MASK_NONE    = 1 << FILTER_NONE,
+        FILTER_MASK_SUB     = 1 << FILTER_SUB,
+        FILTER_MASK_UP      = 1 << FILTER_UP,
+        FILTER_MASK_AVERAGE = 1 << FILTER_AVERAGE,
+        FILTER_MASK_PAETH   = 1 << FILTER_PAETH,
+
+        FILTER_MASK_INDEPENDENT = FILTER_MASK_NONE | FILTER_MASK_SUB,
+        FILTER_MASK_ALL = FILTER_MASK_INDEPENDENT | FILTER_MASK_UP | FILTER_MASK_AVERAGE | FILTER_MASK_PAETH,
+    };
+
+    static inline
+    int paeth_predictor(int a, int b, int c)
+    {
+        int p = b - c;
+        int q = a - c;
+
+        int pa = std::abs(p);
+        int pb = std::abs(q);
+        int pc = std::abs(p + q);
+
+        return (pa <= pb && pa <= pc) ? a : (pb <= pc) ? b : c;
+    }
+
+    static
+    void write_filter_none(u8* dest, const u8* scan, const u8* prev, int bpp, int bytes)
+    {
+        MANGO_UNREFERENCED(prev);
+        MANGO_UNREFERENCED(bpp);
+
+        std::memcpy(dest, scan, bytes);
+    }
+
+    static inline
+    void write_difference(u8* dest, const u8* a, const u8* b, int bytes)
+    {
+        int i = 0;
+
+#if defined(MANGO_ENABLE_SSE2)
+        for ( ; i + 16 <= bytes; i += 16)
+        {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), _mm_sub_epi8(va, vb));
+        }
+#elif defined(MANGO_ENABLE_NEON)
+        for ( ; i + 16 <= bytes; i += 16)
+        {
+            vst1q_u8(dest + i, vsubq_u8(vld1q_u8(a + i), vld1q_u8(b + i)));
+        }
+#endif
+
+        for ( ; i < bytes; ++i)
+        {
+            dest[i] = u8(a[i] - b[i]);
+        }
+    }
+
+    static
+    void write_filter_sub(u8* dest, const u8* scan, const u8* prev, int bpp, int bytes)
+    {
+        MANGO_UNREFERENCED(prev);
+
+        std::memcpy(dest, scan, bpp);
+        write_difference(dest + bpp, scan + bpp, scan, bytes - bpp);
+    }
+
+    static
+    void write_filter_up(u8* dest, const u8* scan, const u8* prev, int bpp, int bytes)
+    {
+        MANGO_UNREFERENCED(bpp);
+
+        write_difference(dest, scan, prev, bytes);
+    }
+
+    static
+    void write_filter_average(u8* dest, const u8* scan, const u8* prev, int bpp, int bytes)
+    {
+        for (int i = 0; i < bpp; ++i)
+        {
+            dest[i] = u8(scan[i] - (prev[i] / 2));
+        }
+
+        for (int i = bpp; i < bytes; ++i)
+        {
+            dest[i] = u8(scan[i] - ((prev[i] + scan[i - bpp]) / 2));
+        }
+    }
+
+    static
+    void write_filter_paeth(u8* dest, const u8* scan, const u8* prev, int bpp, int bytes)
+    {
+        for (int i = 0; i < bpp; ++i)
+        {
+            dest[i] = u8(scan[i] - prev[i]);
+        }
+
+        for (int i = bpp; i < bytes; ++i)
+        {
+            int p = paeth_predictor(scan[i - bpp], prev[i], prev[i - bpp]);
+            dest[i] = u8(scan[i] - p);
+        }
+    }
+
+    using WriteFilterFunc = void (*)(u8* dest, const u8* scan, const u8* prev, int bpp, int bytes);
+
+    static const WriteFilterFunc g_write_filter [] =
+    {
+        write_filter_none,
+        write_filter_sub,
+        write_filter_up,
+        write_filter_average,
+        write_filter_paeth,
+    };
+
+    static inline
+    u32 residual(int value)
+    {
+        // magnitude of the residual interpreted as signed byte
+        u32 r = u8(value);
+        return r < 128 ? r : 256 - r;
+    }
+
+    static
+    void score_filters_range(u64* score, const u8* scan, const u8* prev, int bpp, int x0, int x1)
+    {
+        for (int x = x0; x < x1; ++x)
+        {
+            int a = x >= bpp ? scan[x - bpp] : 0;
+            int b = prev[x];
+            int c = x >= bpp ? prev[x - bpp] : 0;
+            int s = scan[x];
+
+            score[FILTER_NONE]    += residual(s);
+            score[FILTER_SUB]     += residual(s - a);
+            score[FILTER_UP]      += residual(s - b);
+            score[FILTER_AVERAGE] += residual(s - ((a + b) >> 1));
+            score[FILTER_PAETH]   += residual(s - paeth_predictor(a, b, c));
+        }
+    }
+
+    static
+    void score_filters(u64* score, const u8* scan, const u8* prev, int bpp, int bytes)
+    {
+        score_filters_range(score, scan, prev, bpp, 0, bytes);
+    }
+
+#if defined(MANGO_ENABLE_SSE2)
+
+    static inline
+    __m128i residual_sse2(__m128i sum, __m128i s, __m128i p)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i r = _mm_sub_epi8(s, p);
+        r = _mm_min_epu8(r, _mm_sub_epi8(zero, r));
+        return _mm_add_epi64(sum, _mm_sad_epu8(r, zero));
+    }
+
+    static
+    void score_filters_sse2(u64* score, const u8* scan, const u8* prev, int bpp, int bytes)
+    {
+        // the first pixel does not have left neighbour
+        int x = std::min(bpp, bytes);
+        score_filters_range(score, scan, prev, bpp, 0, x);
+
+        const __m128i zero = _mm_setzero_si128();
+
+        __m128i sum[5];
+        for (int i = 0; i < 5; ++i)
+        {
+            sum[i] = zero;
+        }
+
+        for ( ; x + 16 <= bytes; x += 16)
+        {
+            __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(scan + x));
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(scan + x - bpp));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + x));
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + x - bpp));
+
+            __m128i average = average_sse2(a, b, zero);
+
+            int16x8 a0(_mm_unpacklo_epi8(a, zero));
+            int16x8 b0(_mm_unpacklo_epi8(b, zero));
+            int16x8 c0(_mm_unpacklo_epi8(c, zero));
+            int16x8 a1(_mm_unpackhi_epi8(a, zero));
+            int16x8 b1(_mm_unpackhi_epi8(b, zero));
+            int16x8 c1(_mm_unpackhi_epi8(c, zero));
+            int16x8 d = 0;
+
+            __m128i paeth = _mm_packus_epi16(nearest_sse2(a0, b0, c0, d),
+                                             nearest_sse2(a1, b1, c1, d));
+
+            sum[FILTER_NONE]    = residual_sse2(sum[FILTER_NONE], s, zero);
+            sum[FILTER_SUB]     = residual_sse2(sum[FILTER_SUB], s, a);
+            sum[FILTER_UP]      = residual_sse2(sum[FILTER_UP], s, b);
+            sum[FILTER_AVERAGE] = residual_sse2(sum[FILTER_AVERAGE], s, average);
+            sum[FILTER_PAETH]   = residual_sse2(sum[FILTER_PAETH], s, paeth);
+        }
+
+        for (int i = 0; i < 5; ++i)
+        {
+            u64 temp[2];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(temp), sum[i]);
+            score[i] += temp[0] + temp[1];
+        }
+
+        score_filters_range(score, scan, prev, bpp, x, bytes);
+    }
+
+#endif // MANGO_ENABLE_SSE2
+
+#if defined(MANGO_ENABLE_NEON)
+
+    static inline
+    uint32x4_t residual_neon(uint32x4_t sum, uint8x16_t s, uint8x16_t p)
+    {
+        uint8x16_t r = vsubq_u8(s, p);
+        r = vminq_u8(r, vsubq_u8(vdupq_n_u8(0), r));
+        return vpadalq_u16(sum, vpaddlq_u8(r));
+    }
+
+    static inline
+    uint8x8_t paeth_predictor_neon(uint8x8_t a, uint8x8_t b, uint8x8_t c)
+    {
+        int16x8_t p = vreinterpretq_s16_u16(vsubl_u8(b, c));
+        int16x8_t q = vreinterpretq_s16_u16(vsubl_u8(a, c));
+
+        int16x8_t pa = vabsq_s16(p);
+        int16x8_t pb = vabsq_s16(q);
+        int16x8_t pc = vabsq_s16(vaddq_s16(p, q));
+
+        uint8x8_t use_a = vmovn_u16(vandq_u16(vcleq_s16(pa, pb), vcleq_s16(pa, pc)));
+        uint8x8_t use_b = vmovn_u16(vcleq_s16(pb, pc));
+
+        return vbsl_u8(use_a, a, vbsl_u8(use_b, b, c));
+    }
+
+    static
+    void score_filters_neon(u64* score, const u8* scan, const u8* prev, int bpp, int bytes)
+    {
+        // the first pixel does not have left neighbour
+        int x = std::min(bpp, bytes);
+        score_filters_range(score, scan, prev, bpp, 0, x);
+
+        uint32x4_t sum[5];
+        for (int i = 0; i < 5; ++i)
+        {
+            sum[i] = vdupq_n_u32(0);
+        }
+
+        for ( ; x + 16 <= bytes; x += 16)
+        {
+            uint8x16_t s = vld1q_u8(scan + x);
+            uint8x16_t a = vld1q_u8(scan + x - bpp);
+            uint8x16_t b = vld1q_u8(prev + x);
+            uint8x16_t c = vld1q_u8(prev + x - bpp);
+
+            uint8x16_t average = vhaddq_u8(a, b);
+            uint8x16_t paeth = vcombine_u8(paeth_predictor_neon(vget_low_u8(a), vget_low_u8(b), vget_low_u8(c)),
+                                           paeth_predictor_neon(vget_high_u8(a), vget_high_u8(b), vget_high_u8(c)));
+
+            sum[FILTER_NONE]    = residual_neon(sum[FILTER_NONE], s, vdupq_n_u8(0));
+            sum[FILTER_SUB]     = residual_neon(sum[FILTER_SUB], s, a);
+            sum[FILTER_UP]      = residual_neon(sum[FILTER_UP], s, b);
+            sum[FILTER_AVERAGE] = residual_neon(sum[FILTER_AVERAGE], s, average);
+            sum[FILTER_PAETH]   = residual_neon(sum[FILTER_PAETH], s, paeth);
+        }
+
+        for (int i = 0; i < 5; ++i)
+        {
+            score[i] += u64(vgetq_lane_u32(sum[i], 0)) + vgetq_lane_u32(sum[i], 1) +
+                        vgetq_lane_u32(sum[i], 2) + vgetq_lane_u32(sum[i], 3);
+        }
+
+        score_filters_range(score, scan, prev, bpp, x, bytes);
+    }
+
+#endif // MANGO_ENABLE_NEON
+
+    struct FilterSelector
+    {
+        using ScoreFunc = void (*)(u64* score, const u8* scan, const u8* prev, int bpp, int bytes);
+
+        ScoreFunc score = score_filters;
+        int bpp = 0;
+
+        FilterSelector(int bpp)
+            : bpp(bpp)
+        {
+            u64 features = getCPUFlags();
+
+#if defined(MANGO_ENABLE_SSE2)
+            score = score_filters_sse2;
+#endif
+#if defined(MANGO_ENABLE_NEON)
+            if (features & ARM_NEON)
+            {
+                score = score_filters_neon;
+            }
+#endif
+
+            MANGO_UNREFERENCED(features);
+        }
+
+        int operator () (const u8* scan, const u8* prev, int bytes, u32 mask) const
+        {
+            if (!(mask & (mask - 1)))
+            {
+                // only one filter is allowed
+                return u32_tzcnt(mask);
+            }
+
+            u64 sums[5] = { 0, 0, 0, 0, 0 };
+            score(sums, scan, prev, bpp, bytes);
+
+            int best = -1;
+
+            for (int i = 0; i < 5; ++i)
+            {
+                if (mask & (1 << i))
+                {
+                    if (best < 0 || sums[i] < sums[best])
+                    {
+                        best = i;
+                    }
+                }
+            }
+
+            return best;
+        }
+    };
+
+    static
+    void write_chunk(Stream& stream, u32 chunk_id, ConstMemory memory)
+    {
+        BigEndianStream s(stream);
+
+        u8 temp[4];
+        bigEndian::ustore32(temp, chunk_id);
+
+        u32 crc = crc32(0, Memory(temp, 4));
+        crc = crc32(crc, memory);
+
+        u32 chunk_size = u32(memory.size);
+
+        s.write32(chunk_size);
+        s.write32(chunk_id);
+        s.write(memory);
+        s.write32(crc);
+    }
+
+    static
+    void write_IHDR(Stream& stream, const Surface& surface, u8 color_bits, ColorType color_type)
+    {
+        BufferStream buffer;
+        BigEndianStream s(buffer);
+
+        s.write32(surface.width);
+        s.write32(surface.height);
+        s.write8(color_bits);
+        s.write8(color_type);
+        s.write8(0); // compression
+        s.write8(0); // filter
+        s.write8(0); // interlace
+
+        write_chunk(stream, u32_mask_rev('I', 'H', 'D', 'R'), buffer);
+    }
+
+    static
+    void write_PLTE(Stream& stream, const Palette& palette)
+    {
+        BufferStream buffer;
+        BigEndianStream s(buffer);
+
+        for (int i = 0; i < 256; ++i)
+        {
+            s.write8(palette[i].r);
+            s.write8(palette[i].g);
+            s.write8(palette[i].b);
         }
+
+        write_chunk(stream, u32_mask_rev('P', 'L', 'T', 'E'), buffer);
     }
 
     static
-    void compress_serial(Stream& stream, ImageEncodeStatus& status, const Surface& surface, const ImageEncodeOptions& options)
+    void write_iCCP(Stream& stream, const ImageEncodeOptions& options)
+    {
+        if (options.icc.size == 0)
+        {
+            // empty profile chunk
+            return;
+        }
+
+        BufferStream buffer;
+        BigEndianStream s(buffer);
+
+        s.write8('-'); // profile name is 1-79 char according to spec. we dont have/need name
+        s.write8(0); // profile name null separator
+        s.write8(0); // compression method, 0=deflate
+
+        size_t bound = deflate_zlib::bound(options.icc.size);
+        Buffer compressed(bound);
+        CompressionStatus result = deflate_zlib::compress(compressed, options.icc, options.compression);
+        if (result)
+        {
+            buffer.write(compressed, result.size); // rest of chunk is compressed profile
+            write_chunk(stream, u32_mask_rev('i', 'C', 'C', 'P'), buffer);
+        }
+    }
+
+    static
+    void write_pLLD(Stream& stream, int segment_height)
+    {
+        BufferStream buffer;
+        BigEndianStream s(buffer);
+
+        s.write32(segment_height);
+        s.write8(0x01); // parallel filtering is supported (segments start with NONE or SUB filter)
+
+        write_chunk(stream, u32_mask_rev('p', 'L', 'L', 'D'), buffer);
+    }
+
+    static
+    const u8* read_scanline(u8* temp, const Surface& surface, int color_bits, int y)
+    {
+        const u8* image = surface.address(0, y);
+
+        if (color_bits == 16)
+        {
+            // PNG stores 16 bit samples in big endian order
+            const int count = surface.width * surface.format.bytes() / 2;
+
+            for (int x = 0; x < count; ++x)
+            {
+                bigEndian::ustore16(temp + x * 2, uload16(image + x * 2));
+            }
+
+            image = temp;
+        }
+
+        return image;
+    }
+
+    static
+    void filter_range(u8* buffer, const Surface& surface, int color_bits, u32 mask, int segment_height, int y0, int y1)
     {
         const int bpp = surface.format.bytes();
-        const int bytes_per_scan = surface.width * bpp + 1;
+        const int bytes_per_scan = surface.width * bpp;
 
-        Buffer buffer(bytes_per_scan * surface.height);
+        FilterSelector selector(bpp);
 
-        // filtering
-        filter_range(buffer, surface, 0, surface.height);
+        // zero scanline for filters at the beginning + two scanlines for byteswapping
+        Buffer temp(bytes_per_scan * 3, 0);
+
+        u8* zero = temp.data();
+        u8* scanline[] = { zero + bytes_per_scan, zero + bytes_per_scan * 2 };
+
+        const u8* prev = zero;
+        if (y0 > 0)
+        {
+            prev = read_scanline(scanline[(y0 - 1) & 1], surface, color_bits, y0 - 1);
+        }
+
+        for (int y = y0; y < y1; ++y)
+        {
+            const u8* scan = read_scanline(scanline[y & 1], surface, color_bits, y);
+
+            u32 allowed = mask;
+
+            if (segment_height && y > 0 && (y % segment_height) == 0)
+            {
+                // first scanline in pLLD segment must not depend on the previous segment
+                allowed &= FILTER_MASK_INDEPENDENT;
+            }
+
+            int filter = selector(scan, prev, bytes_per_scan, allowed);
+
+            *buffer++ = u8(filter);
+            g_write_filter[filter](buffer, scan, prev, bpp, bytes_per_scan);
+            buffer += bytes_per_scan;
+
+            prev = scan;
+        }
+    }
+
+    static
+    int get_fast_factor(const Surface& surface, const ImageEncodeOptions& options)
+    {
+        // the fpng compressor is used for the fastest compression levels (0 and 1); the returned
+        // factor is the number of 4 byte symbols in a pixel (0: the format is not supported)
+        if (options.compression > 1)
+        {
+            return 0;
+        }
 
-        // compute fpng scaling factor
-        int factor = 0; // default: not supported
         switch (surface.format.bits)
         {
             case 32:
-                factor = 1;
-                break;
+                return 1;
             case 64:
-                factor = 2;
-                break;
+                return 2;
         }
 
-        if (factor)
+        return 0;
+    }
+
+    static
+    Memory compress_fast(const Surface& surface, int color_bits, int factor, int y0, int y1, bool final, u32& adler)
+    {
+        // use fpng for compression; it has very low intertia and is also very high performance:
+        // single pass, static huffman table and run-length matches only. The performance comes
+        // with a string attached: it can only compress 4 byte size symbols (pixels) and the
+        // huffman table is tuned for SUB filtered scanlines.
+
+        const size_t bytes_per_scan = size_t(surface.width) * surface.format.bytes() + PNG_FILTER_BYTE;
+
+        // The scanlines are filtered and compressed in bands which stay in the cache. Each band
+        // ends with a sync flush so that the blocks continue the same zlib stream.
+        constexpr size_t BAND_SIZE = 256 * 1024;
+        const int band_height = int(std::max(size_t(1), BAND_SIZE / bytes_per_scan));
+
+        // The stored blocks have 5 bytes of overhead per 65535 bytes of data in form of a header;
+        // we add 2 byte zlib header, 4 bytes for adler checksum and a 4K "gimme a break" -guardband.
+        auto get_bound = [] (size_t bytes)
         {
-            // use fpng for compression; it is always best choice for serial writes which are small
-            // because it has very low intertia (and is also very high performance). The performance
-            // comes with a string attached: it can only compress 3 and 4 byte size symbols (pixels).
+            return bytes + ((bytes + 65534) / 65535) * 5 + 6 + 4096;
+        };
 
-            // compress
-            size_t guardband = 4096; // 4K "gimme a break" -guardband
-            size_t bytes_in = bytes_per_scan * surface.height;
-            Buffer compressed(bytes_in + guardband);
-            size_t bytes_out = fpng::pixel_deflate_dyn_4_rle_one_pass(buffer.data(), surface.width * factor, surface.height, compressed.data(), u32(compressed.size()));
+        Buffer filtered(bytes_per_scan * std::min(band_height, y1 - y0));
 
-            if (!bytes_out)
-            {
-                // compression failed because the output buffer was too small; as it already was
-                // guardband bytes larger than the input we want to change strategy and store the
-                // data without compression.
+        Buffer compressed;
+        compressed.reserve(get_bound(bytes_per_scan * (y1 - y0)));
 
-                // The compression algorithm stores data in 65535 byte chunks which have 5 bytes
-                // of overhead in form of a header. We compute number of block headers needed on top of
-                // the stored data. THEN we still add the guardband.
+        adler = 1;
 
-                u32 block_overhead = u32(((bytes_in + 65534) / 65535) * 5);
-                u32 header_and_adler = 6; // 2 byte header, 4 bytes for adler checksum
+        for (int y = y0; y < y1; y += band_height)
+        {
+            const int h = std::min(band_height, y1 - y);
+            const bool is_first = y == y0;
+            const bool is_final = final && (y + h == y1);
 
-                compressed.resize(bytes_in + block_overhead + header_and_adler + guardband);
-                bytes_out = fpng::write_raw_block(buffer.data(), u32(bytes_in), compressed.data(), u32(compressed.size()));
-            }
+            ConstMemory source(filtered, h * bytes_per_scan);
 
+            filter_range(filtered, surface, color_bits, FILTER_MASK_SUB, 0, y, y + h);
+            adler = adler32(adler, source);
+
+            const size_t offset = compressed.size();
+            const u32 bound = u32(get_bound(source.size));
+            u8* dest = compressed.append(bound);
+
+            u32 bytes_out = fpng::pixel_deflate_dyn_4_rle_one_pass(source.address, surface.width * factor, h, dest, bound, is_final, is_first);
             if (!bytes_out)
             {
-                status.setError("fpng deflate failed.");
-                return;
+                // compression failed because the output buffer was too small; we change strategy
+                // and store the data without compression.
+                bytes_out = fpng::write_raw_block(source.address, u32(source.size), dest, bound, is_final, is_first);
             }
 
-            // compute checksum
-            u32 adler = adler32(1, buffer);
+            if (!bytes_out)
+            {
+                return Memory();
+            }
 
-            // append adler checksum
-            bigEndian::ustore32(compressed.data() + bytes_out, adler);
-            bytes_out += 4;
+            compressed.resize(offset + bytes_out);
+        }
 
-            // write chunkdID + compressed data
-            write_chunk(stream, u32_mask_rev('I', 'D', 'A', 'T'), ConstMemory(compressed.data(), bytes_out));
+        if (final)
+        {
+            // store adler checksum
+            bigEndian::ustore32(compressed.append(4), adler);
         }
-        else
+
+        return compressed.acquire();
+    }
+
+    static
+    void compress_serial(Stream& stream, ImageEncodeStatus& status, const Surface& surface, int color_bits, u32 mask, const ImageEncodeOptions& options)
+    {
+        const int factor = get_fast_factor(surface, options);
+        if (factor)
         {
-            // use libdeflate for compression
+            u32 adler;
 
-            // compress
-            size_t bound = deflate_zlib::bound(buffer.size());
-            Buffer compressed(bound);
-            size_t bytes_out = deflate_zlib::compress(compressed, buffer, options.compression);
+            Memory compressed = compress_fast(surface, color_bits, factor, 0, surface.height, true, adler);
+            if (!compressed.address)
+            {
+                status.setError("fpng deflate failed.");
+                return;
+            }
 
             // write chunkdID + compressed data
-            write_chunk(stream, u32_mask_rev('I', 'D', 'A', 'T'), ConstMemory(compressed, bytes_out));
+            write_chunk(stream, u32_mask_rev('I', 'D', 'A', 'T'), compressed);
+
+            Buffer::release(compressed);
+            return;
         }
+
+        const int bpp = surface.format.bytes();
+        const int bytes_per_scan = surface.width * bpp + 1;
+
+        Buffer buffer(bytes_per_scan * surface.height);
+
+        // filtering
+        filter_range(buffer, surface, color_bits, mask, 0, 0, surface.height);
+
+        // use libdeflate for compression
+
+        // compress
+        size_t bound = deflate_zlib::bound(buffer.size());
+        Buffer compressed(bound);
+        size_t bytes_out = deflate_zlib::compress(compressed, buffer, options.compression);
+
+        // write chunkdID + compressed data
+        write_chunk(stream, u32_mask_rev('I', 'D', 'A', 'T'), ConstMemory(compressed, bytes_out));
     }
 
     static
-    void compress_parallel(Stream& stream, ImageEncodeStatus& status, const Surface& surface, int segment_height, const ImageEncodeOptions& options)
+    void compress_parallel(Stream& stream, ImageEncodeStatus& status, const Surface& surface, int color_bits, u32 mask, int segment_height, bool priming, const ImageEncodeOptions& options)
     {
         const size_t bpp = surface.format.bytes();
         const size_t bytes_per_scan = size_t(surface.width) * bpp + 1;
 
-        Buffer buffer(bytes_per_scan * surface.height);
-
         const int N = div_ceil(surface.height, segment_height);
         const int level = math::clamp(options.compression, 0, 9);
 
+        // the fast compressor filters the scanlines in small bands so it does not need the buffer
+        const int factor = get_fast_factor(surface, options);
+
+        Buffer buffer(factor ? 0 : bytes_per_scan * surface.height);
+
+        // size of the preset dictionary (deflate window)
+        constexpr size_t DICTIONARY_SIZE = 32 * 1024;
+
+        // independently decoded segments must start with filter which does not use previous scanline
+        const int independent_height = priming ? 0 : segment_height;
+
         u32 cumulative_adler = 1;
 
         ConcurrentQueue q;
@@ -3588,13 +4321,32 @@ namespace
 
         std::atomic<bool> encoding_failure { false };
 
+        if (priming)
+        {
+            // the segments are compressed using the end of the previous segment as preset dictionary
+            // so all of the filtered scanlines must be available before the compression begins
+            for (int i = 0; i < N; ++i)
+            {
+                int y = i * segment_height;
+                int h = std::min(segment_height, surface.height - y);
+                u8* dest = buffer.data() + y * bytes_per_scan;
+
+                q.enqueue([=, &surface]
+                {
+                    filter_range(dest, surface, color_bits, mask, independent_height, y, y + h);
+                });
+            }
+
+            q.wait();
+        }
+
         for (int i = 0; i < N; ++i)
         {
             int y = i * segment_height;
             int h = std::min(segment_height, surface.height - y);
 
             Memory source;
-            source.address = buffer.data() + y * bytes_per_scan;
+            source.address = factor ? nullptr : buffer.data() + y * bytes_per_scan;
             source.size = h * bytes_per_scan;
 
             bool is_first = (i == 0);
@@ -3604,7 +4356,56 @@ namespace
 
             q.enqueue([=, &encoding_failure, &surface, &stream, &cumulative_adler]
             {
-                filter_range(source.address, surface, y, y + h);
+                auto write_segment = [=, &cumulative_adler, &stream] (Memory segment_memory, u32 segment_adler, u32 segment_length)
+                {
+                    ticket.consume([=, &cumulative_adler, &stream]
+                    {
+                        cumulative_adler = ::adler32_combine(cumulative_adler, segment_adler, segment_length);
+
+                        Memory c = segment_memory;
+
+                        if (!is_first)
+                        {
+                            // trim zlib header (and dictionary identifier when FDICT is set)
+                            size_t header = (c.address[1] & 0x20) ? 6 : 2;
+                            c.address += header;
+                            c.size -= header;
+                        }
+
+                        if (is_last)
+                        {
+                            // 4 last bytes is adler, overwrite it with cumulative adler
+                            bigEndian::ustore32(c.address + c.size - 4, cumulative_adler);
+                        }
+
+                        // write chunkdID + compressed data
+                        write_chunk(stream, u32_mask_rev('I', 'D', 'A', 'T'), c);
+
+                        // free compressed memory
+                        Buffer::release(segment_memory);
+                    });
+                };
+
+                if (factor)
+                {
+                    // the segments end with a sync flush so that they can be concatenated
+                    u32 segment_adler;
+
+                    Memory segment_memory = compress_fast(surface, color_bits, factor, y, y + h, is_last, segment_adler);
+                    if (!segment_memory.address)
+                    {
+                        encoding_failure = true;
+                        return;
+                    }
+
+                    write_segment(segment_memory, segment_adler, u32(source.size));
+                    return;
+                }
+
+                if (!priming)
+                {
+                    filter_range(source.address, surface, color_bits, mask, independent_height, y, y + h);
+                }
 
 #ifdef MANGO_ENABLE_ISAL
                 constexpr size_t TEMP_SIZE = 128 * 1024;
@@ -3663,6 +4464,12 @@ namespace
                 zstream.gzip_flag = IGZIP_ZLIB;
                 zstream.hist_bits = 15; // log2 compression window size
 
+                if (priming && !is_first)
+                {
+                    size_t size = std::min(DICTIONARY_SIZE, y * bytes_per_scan);
+                    isal_deflate_set_dict(&zstream, source.address - size, u32(size));
+                }
+
                 Buffer compressed;
 
                 while (zstream.avail_in != 0)
@@ -3726,6 +4533,12 @@ namespace
 
                 ::deflateInit(&strm, level);
 
+                if (priming && !is_first)
+                {
+                    size_t size = std::min(DICTIONARY_SIZE, y * bytes_per_scan);
+                    ::deflateSetDictionary(&strm, source.address - size, uInt(size));
+                }
+
                 Buffer compressed;
 
                 while (strm.avail_in != 0)
@@ -3768,31 +4581,7 @@ namespace
                 u32 segment_length = u32(source.size);
 #endif
 
-                ticket.consume([=, &cumulative_adler, &stream]
-                {
-                    cumulative_adler = ::adler32_combine(cumulative_adler, segment_adler, segment_length);
-
-                    Memory c = segment_memory;
-
-                    if (!is_first)
-                    {
-                        // trim zlib header
-                        c.address += 2;
-                        c.size -= 2;
-                    }
-
-                    if (is_last)
-                    {
-                        // 4 last bytes is adler, overwrite it with cumulative adler
-                        bigEndian::ustore32(c.address + c.size - 4, cumulative_adler);
-                    }
-
-                    // write chunkdID + compressed data
-                    write_chunk(stream, u32_mask_rev('I', 'D', 'A', 'T'), c);
-
-                    // free compressed memory
-                    Buffer::release(segment_memory);
-                });
+                write_segment(segment_memory, segment_adler, segment_length);
             });
         }
 
@@ -3847,20 +4636,29 @@ namespace
 
         int segment_height = configure_segment(surface, options);
 
+        u32 mask = FILTER_MASK_ALL;
+
         if (options.palette.size > 0)
         {
             write_PLTE(stream, options.palette);
-            segment_height = 0; // parallel encoder only supports 24 and 32 bit color
+            mask = FILTER_MASK_NONE; // indexed colors do not have meaningful differences between neighbours
         }
 
         if (segment_height)
         {
-            write_pLLD(stream, segment_height);
-            compress_parallel(stream, status, surface, segment_height, options);
+            // the fpng compressor does not support preset dictionary
+            const bool priming = options.priming && !get_fast_factor(surface, options);
+
+            if (!priming)
+            {
+                write_pLLD(stream, segment_height);
+            }
+
+            compress_parallel(stream, status, surface, color_bits, mask, segment_height, priming, options);
         }
         else
         {
-            compress_serial(stream, status, surface, options);
+            compress_serial(stream, status, surface, color_bits, mask, options);
         }
 
         // write IEND
@@ -3911,6 +4709,45 @@ namespace
                 return status;
             }
 
+            if (options.streaming)
+            {
+                if (m_parser.isStreamable())
+                {
+                    Palette* palette = header.palette ? options.palette : nullptr;
+                    return m_parser.decodeStreaming(dest, options, palette);
+                }
+
+                if (!dest.image || options.scanline)
+                {
+                    // decode the whole image and deliver the scanlines afterwards
+                    ImageDecodeOptions whole = options;
+                    whole.streaming = false;
+
+                    std::unique_ptr<Bitmap> temp;
+                    Surface target = dest;
+
+                    if (!dest.image)
+                    {
+                        temp = std::make_unique<Bitmap>(header.width, header.height, dest.format);
+                        target = *temp;
+                    }
+
+                    status = decode(target, whole, level, depth, face);
+
+                    if (status && options.scanline)
+                    {
+                        const int height = std::min(target.height, header.height);
+
+                        for (int y = 0; y < height; ++y)
+                        {
+                            options.scanline(y, target.address(0, y));
+                        }
+                    }
+
+                    return status;
+                }
+            }
+
             bool direct = dest.format == header.format &&
                           dest.width >= header.width &&
                           dest.height >= header.height &&
@@ -501,30 +501,31 @@ namespace
             const int xs = div_ceil(m_header.width, m_xtile);
             const int ys = div_ceil(m_header.height, m_ytile);
 
-            ConcurrentQueue q;
+            // the tiles are stored back-to-back; locate them before decoding
+            std::vector<ConstMemory> tiles(xs * ys);
 
             LittleEndianConstPointer p = m_memory.address;
 
-            for (int y = 0; y < ys; ++y)
+            for (auto& memory : tiles)
             {
-                for (int x = 0; x < xs; ++x)
-                {
-                    Surface rect(dest, x * m_xtile, y * m_ytile, m_xtile, m_ytile);
+                u32 size = p.read32();
+                memory = ConstMemory(p, size);
+                p += size;
+            }
 
-                    u32 size = p.read32();
-                    ConstMemory memory(p, size);
-                    p += size;
+            parallelFor2D(m_header.width, m_header.height, m_xtile, m_ytile, [&] (int x0, int y0, int x1, int y1)
+            {
+                const ConstMemory& memory = tiles[(y0 / m_ytile) * xs + x0 / m_xtile];
 
-                    q.enqueue([rect, memory]
-                    {
-                        int w = rect.width;
-                        int h = rect.height;
-                        qoi_decode(rect.image, memory.address, memory.size, w, h, rect.stride);
-                    });
-                }
-            }
+                Surface rect(dest, x0, y0, m_xtile, m_ytile);
+
+                int w = rect.width;
+                int h = rect.height;
+                qoi_decode(rect.image, memory.address, memory.size, w, h, rect.stride);
 
-            q.wait();
+                MANGO_UNREFERENCED(x1);
+                MANGO_UNREFERENCED(y1);
+            });
         }
     };
 
@@ -337,22 +337,16 @@ namespace mango::image
         {
             ConcurrentQueue queue("blit", Priority::High);
 
-            for (int y = 0; y < rect.height; y += slice)
+            parallelFor(queue, 0, rect.height, slice, [&] (int y0, int y1)
             {
-                queue.enqueue([=, &blitter]
-                {
-                    int y0 = y;
-                    int y1 = std::min(y + slice, rect.height);
-
-                    BlitRect temp = rect;
+                BlitRect temp = rect;
 
-                    temp.dest.address += y0 * rect.dest.stride;
-                    temp.source.address += y0 * rect.source.stride;
-                    temp.height = y1 - y0;
+                temp.dest.address += y0 * rect.dest.stride;
+                temp.source.address += y0 * rect.source.stride;
+                temp.height = y1 - y0;
 
-                    blitter.convert(temp);
-                });
-            }
+                blitter.convert(temp);
+            });
         }
         else
 #endif
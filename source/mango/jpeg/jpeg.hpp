@@ -1,6 +1,6 @@
 /*
     MANGO Multimedia Development Platform
-    Copyright (C) 2012-2023 Twilight Finland 3D Oy Ltd. All rights reserved.
+    Copyright (C) 2012-2024 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
 #pragma once
 
@@ -323,6 +323,24 @@ namespace mango::image::jpeg
         void (*decode)(s16* output, DecodeState* state);
     };
 
+    struct ProgressiveScan
+    {
+        DecodeState state;
+        const Frame* frame; // component frame for non-interleaved scans
+        bool interleaved;   // scan is decoded in MCU order
+        u32 components;     // mask of frame indices in the scan
+        int spectral_start; // first coefficient written by the scan
+        int spectral_end;   // last coefficient written by the scan
+        int restart_interval;
+        int restart_counter;
+    };
+
+    struct ScanIndexEntry
+    {
+        u64 position; // bit position in the scan
+        int dc[JPEG_MAX_COMPS_IN_SCAN]; // DC predictors
+    };
+
     struct Block
     {
         s16* qt;
@@ -341,6 +359,10 @@ namespace mango::image::jpeg
 
         void (*idct) (u8* dest, const s16* data, const s16* qt);
 
+        // optional transforms for 2 and 4 consecutive blocks (nullptr when not available)
+        void (*idct2) (u8* dest, const s16* data, const Block* block) = nullptr;
+        void (*idct4) (u8* dest, const s16* data, const Block* block) = nullptr;
+
         void (*process            ) (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
         void (*process_y          ) (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
         void (*process_cmyk       ) (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
@@ -349,8 +371,24 @@ namespace mango::image::jpeg
         void (*process_ycbcr_8x16 ) (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
         void (*process_ycbcr_16x8 ) (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
         void (*process_ycbcr_16x16) (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
+
+        // reduced-size decoding
+        int scale = 1; // 1, 2, 4 or 8
+        int hmax = 1;  // MCU size in blocks
+        int vmax = 1;
+        void (*idct_scaled[4]) (u8* dest, const s16* data, const s16* qt); // 1x1, 2x2, 4x4 and 8x8 outputs
+        void (*convert_row) (u8* dest, const u8* y, const u8* cb, const u8* cr, int count) = nullptr;
     };
 
+    // log2 of the reduced transform size used for a component in scaled decoding;
+    // subsampled components use a larger transform to avoid upsampling them
+    static inline
+    int getScaledBlockBits(const Frame& frame, int scale)
+    {
+        const int bits = u32_log2(8 / scale) + std::max(frame.hsf, frame.vsf);
+        return std::min(bits, 3);
+    }
+
     // ----------------------------------------------------------------------------
     // ComputeDecoder
     // ----------------------------------------------------------------------------
@@ -417,6 +455,9 @@ namespace mango::image::jpeg
 
         int m_hardware_concurrency;
 
+        bool m_pipeline = false; // defer progressive scans and decode them as a task graph
+        std::vector<ProgressiveScan> m_scans;
+
         std::string m_encoding;
         std::string m_compression;
         std::string m_idct_name;
@@ -447,10 +488,39 @@ namespace mango::image::jpeg
         int ymcu;
         int mcus;
 
+        // output geometry; reduced from the above with scaled decoding
+        int m_scale = 1;
+        int xblock_scaled;
+        int yblock_scaled;
+        int xsize_scaled;
+        int ysize_scaled;
+
+        // region-of-interest decoding; MCUs which are decoded into m_surface
+        struct MCURegion
+        {
+            int x0 = 0;
+            int y0 = 0;
+            int x1 = 0;
+            int y1 = 0;
+
+            bool contains(int x, int y) const
+            {
+                return x >= x0 && x < x1 && y >= y0 && y < y1;
+            }
+        };
+
+        MCURegion m_region;
+
+        // random access index of a sequential scan; decoder state at the start of each MCU row
+        Buffer* m_index_buffer = nullptr;
+        std::vector<ScanIndexEntry> m_index;
+        const u8* m_index_start = nullptr; // first byte of the scan
+
         bool isJPEG(ConstMemory memory) const;
 
         const u8* stepMarker(const u8* p, const u8* end) const;
         const u8* seekMarker(const u8* p, const u8* end) const;
+        const u8* seekScanEnd(const u8* p, const u8* end) const;
         const u8* processSOS(const u8* p, const u8* end);
 
         void processSOI();
@@ -473,16 +543,27 @@ namespace mango::image::jpeg
         void parse(ConstMemory memory, bool decode);
 
         bool handleRestart();
+        bool skipProgressiveAC() const;
+        int seekRestartInterval(const u8*& p) const;
+
+        bool readScanIndex();
+        void writeScanIndex();
+        void indexScanRow(int y, const BitBuffer& buffer, const int* dc);
 
         void decodeLossless();
         void decodeSequential();
         void decodeSequentialST();
         void decodeSequentialMT(int N);
+        bool decodeSequentialSpeculative();
+        void decodeSequentialIndexed();
         void decodeSequentialCompute();
         void decodeMultiScan();
         void decodeProgressive();
         void decodeProgressiveDC();
         void decodeProgressiveAC();
+        void appendProgressiveScan();
+        void decodeProgressiveScan(ProgressiveScan& scan, int y0, int y1);
+        void decodeProgressivePipeline();
         void finishProgressive();
 
         void process_range(int y0, int y1, const s16* data);
@@ -515,6 +596,7 @@ namespace mango::image::jpeg
     void huff_decode_dc_refine          (s16* output, DecodeState* state);
     void huff_decode_ac_first           (s16* output, DecodeState* state);
     void huff_decode_ac_refine          (s16* output, DecodeState* state);
+    void huff_skip_mcu                  (DecodeState* state);
 
     void arith_decode_mcu_lossless      (s16* output, DecodeState* state);
     void arith_decode_mcu               (s16* output, DecodeState* state);
@@ -525,12 +607,27 @@ namespace mango::image::jpeg
 
     void idct8                          (u8* dest, const s16* data, const s16* qt);
     void idct12                         (u8* dest, const s16* data, const s16* qt);
+    void idct8_4x4                      (u8* dest, const s16* data, const s16* qt);
+    void idct8_2x2                      (u8* dest, const s16* data, const s16* qt);
+    void idct8_1x1                      (u8* dest, const s16* data, const s16* qt);
+    void idct12_4x4                     (u8* dest, const s16* data, const s16* qt);
+    void idct12_2x2                     (u8* dest, const s16* data, const s16* qt);
+    void idct12_1x1                     (u8* dest, const s16* data, const s16* qt);
 
     void process_y_8bit                 (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
     void process_y_24bit                (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
     void process_y_32bit                (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
     void process_cmyk_bgra              (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
     void process_ycbcr_8bit             (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
+    void process_scaled                 (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
+
+    void convert_y_8bit_row             (u8* dest, const u8* y, const u8* cb, const u8* cr, int count);
+    void convert_y_24bit_row            (u8* dest, const u8* y, const u8* cb, const u8* cr, int count);
+    void convert_y_32bit_row            (u8* dest, const u8* y, const u8* cb, const u8* cr, int count);
+    void convert_ycbcr_bgr_row          (u8* dest, const u8* y, const u8* cb, const u8* cr, int count);
+    void convert_ycbcr_rgb_row          (u8* dest, const u8* y, const u8* cb, const u8* cr, int count);
+    void convert_ycbcr_bgra_row         (u8* dest, const u8* y, const u8* cb, const u8* cr, int count);
+    void convert_ycbcr_rgba_row         (u8* dest, const u8* y, const u8* cb, const u8* cr, int count);
 
     void process_ycbcr_bgr              (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
     void process_ycbcr_bgr_8x8          (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
@@ -580,6 +677,11 @@ namespace mango::image::jpeg
     void process_ycbcr_rgb_16x8_neon    (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
     void process_ycbcr_rgb_16x16_neon   (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
 
+    void convert_ycbcr_bgra_row_neon    (u8* dest, const u8* y, const u8* cb, const u8* cr, int count);
+    void convert_ycbcr_rgba_row_neon    (u8* dest, const u8* y, const u8* cb, const u8* cr, int count);
+    void convert_ycbcr_bgr_row_neon     (u8* dest, const u8* y, const u8* cb, const u8* cr, int count);
+    void convert_ycbcr_rgb_row_neon     (u8* dest, const u8* y, const u8* cb, const u8* cr, int count);
+
 #endif // MANGO_ENABLE_NEON
 
 #if defined(MANGO_ENABLE_SSE2)
@@ -596,6 +698,9 @@ namespace mango::image::jpeg
     void process_ycbcr_rgba_16x8_sse2   (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
     void process_ycbcr_rgba_16x16_sse2  (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
 
+    void convert_ycbcr_bgra_row_sse2    (u8* dest, const u8* y, const u8* cb, const u8* cr, int count);
+    void convert_ycbcr_rgba_row_sse2    (u8* dest, const u8* y, const u8* cb, const u8* cr, int count);
+
 #endif // MANGO_ENABLE_SSE2
 
 #if defined(MANGO_ENABLE_SSE4_1)
@@ -610,14 +715,43 @@ namespace mango::image::jpeg
     void process_ycbcr_rgb_16x8_ssse3   (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
     void process_ycbcr_rgb_16x16_ssse3  (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
 
+    void convert_ycbcr_bgr_row_ssse3    (u8* dest, const u8* y, const u8* cb, const u8* cr, int count);
+    void convert_ycbcr_rgb_row_ssse3    (u8* dest, const u8* y, const u8* cb, const u8* cr, int count);
+
 #endif // MANGO_ENABLE_SSE4_1
 
 #if defined(MANGO_ENABLE_AVX2)
 
+    void idct_avx2                      (u8* dest, const s16* data, const Block* block);
+
+    void process_ycbcr_bgr_8x8_avx2     (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_bgr_8x16_avx2    (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_bgr_16x8_avx2    (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_bgr_16x16_avx2   (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
+
+    void process_ycbcr_rgb_8x8_avx2     (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_rgb_8x16_avx2    (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_rgb_16x8_avx2    (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_rgb_16x16_avx2   (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
+
+    void process_ycbcr_bgra_8x8_avx2    (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_bgra_8x16_avx2   (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_bgra_16x8_avx2   (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_bgra_16x16_avx2  (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
+
     void process_ycbcr_rgba_8x8_avx2    (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_rgba_8x16_avx2   (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_rgba_16x8_avx2   (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
+    void process_ycbcr_rgba_16x16_avx2  (u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height);
 
 #endif // MANGO_ENABLE_AVX2
 
+#if defined(MANGO_ENABLE_AVX512) && defined(__AVX512BW__)
+
+    void idct_avx512                    (u8* dest, const s16* data, const Block* block);
+
+#endif // MANGO_ENABLE_AVX512
+
     SampleFormat getSampleFormat(const Format& format);
     ImageEncodeStatus encodeImage(Stream& stream, const Surface& surface, const ImageEncodeOptions& options);
 
@@ -29,6 +29,53 @@ namespace mango::image::jpeg
         return is;
     }
 
+    static constexpr size_t JPEG_INVALID_POSITION = ~size_t(0);
+
+    static
+    size_t getBitPosition(const BitBuffer& buffer, const u8* start, const u8* end)
+    {
+        // Position of the next unconsumed bit in the byte-stuffed scan; this does not
+        // depend on how far ahead the buffer has been filled so two decoders at the same
+        // position in the bitstream always agree.
+        const u8* p = buffer.ptr;
+
+        if (p >= end)
+        {
+            // the buffer has been filled with zeros past the end of the scan
+            return JPEG_INVALID_POSITION;
+        }
+
+        if (!buffer.remain)
+        {
+            return size_t(p - start) * 8;
+        }
+
+        // step back over the bytes which are still in the buffer
+        const int bytes = (buffer.remain - 1) / 8 + 1;
+
+        for (int i = 0; i < bytes; ++i)
+        {
+            bool stuffed = p - 2 >= start && p[-1] == 0x00 && p[-2] == 0xff;
+            p -= stuffed ? 2 : 1;
+        }
+
+        return size_t(p - start) * 8 + 7 - ((buffer.remain - 1) & 7);
+    }
+
+    static
+    void setBitPosition(BitBuffer& buffer, const u8* start, const u8* end, size_t position)
+    {
+        buffer.ptr = start + position / 8;
+        buffer.end = end;
+        buffer.restart();
+
+        int bits = int(position & 7);
+        if (bits)
+        {
+            buffer.getBits(bits);
+        }
+    }
+
     static
     void jpegPrintMemory(const u8* ptr)
     {
@@ -234,6 +281,20 @@ namespace mango::image::jpeg
         return end + 1;
     }
 
+    const u8* Parser::seekScanEnd(const u8* p, const u8* end) const
+    {
+        // skip the entropy coded segment, including restart markers
+        for (;;)
+        {
+            p = seekMarker(p, end);
+            if (p >= end || !isRestartMarker(p))
+                break;
+            p += 2;
+        }
+
+        return p;
+    }
+
     void Parser::processSOI()
     {
         printLine(Print::Info, "[ SOI ]");
@@ -662,6 +723,16 @@ namespace mango::image::jpeg
         ymcu = height / yblock;
         mcus = xmcu * ymcu;
 
+        xblock_scaled = xblock;
+        yblock_scaled = yblock;
+        xsize_scaled = xsize;
+        ysize_scaled = ysize;
+
+        m_region.x0 = 0;
+        m_region.y0 = 0;
+        m_region.x1 = xmcu;
+        m_region.y1 = ymcu;
+
         printLine(Print::Info, "  {} MCUs ({} x {}) -> ({} x {})", mcus, xmcu, ymcu, xmcu * xblock, ymcu * yblock);
         printLine(Print::Info, "  Image: {} x {}", xsize, ysize);
 
@@ -847,6 +918,13 @@ namespace mango::image::jpeg
         bool dc_scan = (decodeState.spectral_start == 0);
         bool refine_scan = (decodeState.successive_high != 0);
 
+        if (is_progressive && !dc_scan && m_scale > 1 && skipProgressiveAC())
+        {
+            // the DC-only transform does not use the AC coefficients
+            printLine(Print::Info, "  * skip_ac()");
+            return seekScanEnd(p, end);
+        }
+
         restartCounter = restartInterval;
 
         if (decodeState.is_arithmetic)
@@ -957,7 +1035,20 @@ namespace mango::image::jpeg
                     }
                 }
 
-                decodeProgressive();
+                if (m_pipeline && m_scans.empty() && restartInterval)
+                {
+                    // restart intervals are already decoded in parallel
+                    m_pipeline = false;
+                }
+
+                if (m_pipeline)
+                {
+                    appendProgressiveScan();
+                }
+                else
+                {
+                    decodeProgressive();
+                }
             }
             else
             {
@@ -973,6 +1064,14 @@ namespace mango::image::jpeg
         return p;
     }
 
+    bool Parser::skipProgressiveAC() const
+    {
+        // Refinement scans can only be parsed with the history of the earlier bands,
+        // so the AC scans are skipped only for components using the DC-only transform.
+        const Frame& frame = processState.frame[scanFrame - frames.data()];
+        return getScaledBlockBits(frame, m_scale) == 0;
+    }
+
     void Parser::processDQT(const u8* p)
     {
         printLine(Print::Info, "[ DQT ]");
@@ -1478,11 +1577,33 @@ namespace mango::image::jpeg
         }
 #endif
 
+        // multi-block idct; used by the AVX2 color conversion kernels
+        processState.idct2 = nullptr;
+        processState.idct4 = nullptr;
+
+#if defined(MANGO_ENABLE_AVX2)
+        if (flags & INTEL_AVX2)
+        {
+            processState.idct2 = idct_avx2;
+            m_idct_name = "iDCT: AVX2";
+        }
+#endif
+
+#if defined(MANGO_ENABLE_AVX512) && defined(__AVX512BW__)
+        if (flags & INTEL_AVX512BW)
+        {
+            processState.idct4 = idct_avx512;
+            m_idct_name = "iDCT: AVX-512";
+        }
+#endif
+
         if (precision == 12)
         {
             // Force 12 bit idct
             // This will round down to 8 bit precision until we have a 12 bit capable color conversion
             processState.idct = idct12;
+            processState.idct2 = nullptr;
+            processState.idct4 = nullptr;
             m_idct_name = "iDCT: 12 bit";
         }
 
@@ -1647,13 +1768,31 @@ namespace mango::image::jpeg
                 case JPEG_U8_Y:
                     break;
                 case JPEG_U8_BGR:
+                    processState.process_ycbcr_8x8   = process_ycbcr_bgr_8x8_avx2;
+                    processState.process_ycbcr_8x16  = process_ycbcr_bgr_8x16_avx2;
+                    processState.process_ycbcr_16x8  = process_ycbcr_bgr_16x8_avx2;
+                    processState.process_ycbcr_16x16 = process_ycbcr_bgr_16x16_avx2;
+                    simd = "AVX2";
                     break;
                 case JPEG_U8_RGB:
+                    processState.process_ycbcr_8x8   = process_ycbcr_rgb_8x8_avx2;
+                    processState.process_ycbcr_8x16  = process_ycbcr_rgb_8x16_avx2;
+                    processState.process_ycbcr_16x8  = process_ycbcr_rgb_16x8_avx2;
+                    processState.process_ycbcr_16x16 = process_ycbcr_rgb_16x16_avx2;
+                    simd = "AVX2";
                     break;
                 case JPEG_U8_BGRA:
+                    processState.process_ycbcr_8x8   = process_ycbcr_bgra_8x8_avx2;
+                    processState.process_ycbcr_8x16  = process_ycbcr_bgra_8x16_avx2;
+                    processState.process_ycbcr_16x8  = process_ycbcr_bgra_16x8_avx2;
+                    processState.process_ycbcr_16x16 = process_ycbcr_bgra_16x16_avx2;
+                    simd = "AVX2";
                     break;
                 case JPEG_U8_RGBA:
                     processState.process_ycbcr_8x8   = process_ycbcr_rgba_8x8_avx2;
+                    processState.process_ycbcr_8x16  = process_ycbcr_rgba_8x16_avx2;
+                    processState.process_ycbcr_16x8  = process_ycbcr_rgba_16x8_avx2;
+                    processState.process_ycbcr_16x16 = process_ycbcr_rgba_16x16_avx2;
                     simd = "AVX2";
                     break;
             }
@@ -1722,6 +1861,120 @@ namespace mango::image::jpeg
                 break;
         }
 
+        if (m_scale > 1)
+        {
+            // reduced-size decoding replaces the full-size innerloops
+            processState.scale = m_scale;
+            processState.hmax = Hmax;
+            processState.vmax = Vmax;
+
+            processState.idct_scaled[0] = precision == 12 ? idct12_1x1 : idct8_1x1;
+            processState.idct_scaled[1] = precision == 12 ? idct12_2x2 : idct8_2x2;
+            processState.idct_scaled[2] = precision == 12 ? idct12_4x4 : idct8_4x4;
+            processState.idct_scaled[3] = processState.idct;
+
+            simd = "";
+
+            switch (sample)
+            {
+                case JPEG_U8_Y:
+                    processState.convert_row = convert_y_8bit_row;
+                    break;
+                case JPEG_U8_BGR:
+                    processState.convert_row = components == 1 ? convert_y_24bit_row : convert_ycbcr_bgr_row;
+                    break;
+                case JPEG_U8_RGB:
+                    processState.convert_row = components == 1 ? convert_y_24bit_row : convert_ycbcr_rgb_row;
+                    break;
+                case JPEG_U8_BGRA:
+                    processState.convert_row = components == 1 ? convert_y_32bit_row : convert_ycbcr_bgra_row;
+                    break;
+                case JPEG_U8_RGBA:
+                    processState.convert_row = components == 1 ? convert_y_32bit_row : convert_ycbcr_rgba_row;
+                    break;
+            }
+
+            if (components == 3)
+            {
+
+#if defined(MANGO_ENABLE_NEON)
+
+                if (flags & ARM_NEON)
+                {
+                    switch (sample)
+                    {
+                        case JPEG_U8_Y:
+                            break;
+                        case JPEG_U8_BGR:
+                            processState.convert_row = convert_ycbcr_bgr_row_neon;
+                            simd = "NEON";
+                            break;
+                        case JPEG_U8_RGB:
+                            processState.convert_row = convert_ycbcr_rgb_row_neon;
+                            simd = "NEON";
+                            break;
+                        case JPEG_U8_BGRA:
+                            processState.convert_row = convert_ycbcr_bgra_row_neon;
+                            simd = "NEON";
+                            break;
+                        case JPEG_U8_RGBA:
+                            processState.convert_row = convert_ycbcr_rgba_row_neon;
+                            simd = "NEON";
+                            break;
+                    }
+                }
+
+#endif // MANGO_ENABLE_NEON
+
+#if defined(MANGO_ENABLE_SSE2)
+
+                if (flags & INTEL_SSE2)
+                {
+                    switch (sample)
+                    {
+                        case JPEG_U8_BGRA:
+                            processState.convert_row = convert_ycbcr_bgra_row_sse2;
+                            simd = "SSE2";
+                            break;
+                        case JPEG_U8_RGBA:
+                            processState.convert_row = convert_ycbcr_rgba_row_sse2;
+                            simd = "SSE2";
+                            break;
+                        default:
+                            break;
+                    }
+                }
+
+#endif // MANGO_ENABLE_SSE2
+
+#if defined(MANGO_ENABLE_SSE4_1)
+
+                if (flags & INTEL_SSSE3)
+                {
+                    switch (sample)
+                    {
+                        case JPEG_U8_BGR:
+                            processState.convert_row = convert_ycbcr_bgr_row_ssse3;
+                            simd = "SSSE3";
+                            break;
+                        case JPEG_U8_RGB:
+                            processState.convert_row = convert_ycbcr_rgb_row_ssse3;
+                            simd = "SSSE3";
+                            break;
+                        default:
+                            break;
+                    }
+                }
+
+#endif // MANGO_ENABLE_SSE4_1
+
+            }
+
+            processState.process = process_scaled;
+            id = fmt::format("{} 1/{} {}", components == 1 ? "Y" : components == 3 ? "YCbCr" : "CMYK", m_scale, simd);
+            m_idct_name = fmt::format("iDCT: {}x{}", 8 / m_scale, 8 / m_scale);
+        }
+
         m_ycbcr_name = id;
 
         printLine(Print::Info, "[ConfigureCPU]");
@@ -1747,15 +2000,70 @@ namespace mango::image::jpeg
             blockVector.resize(num_blocks * 64);
         }
 
+        m_index_buffer = options.index;
+
         // find best matching format
         SampleFormat sf = getSampleFormat(target.format);
 
+        // reduced-size decoding; lossless images are always decoded at full resolution
+        m_scale = 1;
+
+        if (!is_lossless)
+        {
+            m_scale = options.scale >= 8 ? 8 :
+                      options.scale >= 4 ? 4 :
+                      options.scale >= 2 ? 2 : 1;
+        }
+
+        xblock_scaled = xblock / m_scale;
+        yblock_scaled = yblock / m_scale;
+        xsize_scaled = (xsize + m_scale - 1) / m_scale;
+        ysize_scaled = (ysize + m_scale - 1) / m_scale;
+
+        // region-of-interest in destination pixels
+        int x0 = 0;
+        int y0 = 0;
+        int x1 = xsize_scaled;
+        int y1 = ysize_scaled;
+
+        if (options.roi.width > 0 && options.roi.height > 0)
+        {
+            x0 = std::clamp(options.roi.x, 0, xsize_scaled);
+            y0 = std::clamp(options.roi.y, 0, ysize_scaled);
+            x1 = std::clamp(options.roi.x + options.roi.width, x0, xsize_scaled);
+            y1 = std::clamp(options.roi.y + options.roi.height, y0, ysize_scaled);
+
+            if (x0 == x1 || y0 == y1)
+            {
+                status.setError("Region-of-interest is outside of the image.");
+                return status;
+            }
+        }
+
+        // MCUs covering the region; lossless images are decoded whole and cropped
+        m_region.x0 = 0;
+        m_region.y0 = 0;
+        m_region.x1 = xmcu;
+        m_region.y1 = ymcu;
+
+        if (!is_lossless)
+        {
+            m_region.x0 = x0 / xblock_scaled;
+            m_region.y0 = y0 / yblock_scaled;
+            m_region.x1 = (x1 + xblock_scaled - 1) / xblock_scaled;
+            m_region.y1 = (y1 + yblock_scaled - 1) / yblock_scaled;
+        }
+
         // configure innerloops based on CPU caps
         configureCPU(sf.sample, options);
 
         // configure multithreading
         m_hardware_concurrency = int(options.multithread ? ThreadPool::getHardwareConcurrency() : 1);
 
+        // progressive scans without restart intervals are collected and decoded concurrently
+        m_pipeline = is_progressive && !decodeState.is_arithmetic && m_hardware_concurrency > 1;
+        m_scans.clear();
+
         if (is_lossless)
         {
             // lossless only supports L8 and BGRA
@@ -1779,8 +2087,14 @@ namespace mango::image::jpeg
 
         status.direct = true;
 
-        if (target.width != xsize || target.height != ysize)
+        if (target.width != xsize_scaled || target.height != ysize_scaled)
+        {
+            status.direct = false;
+        }
+
+        if (x0 || y0 || x1 != xsize_scaled || y1 != ysize_scaled)
         {
+            // partial decoding into a temporary surface which covers only the region MCUs
             status.direct = false;
         }
 
@@ -1798,7 +2112,9 @@ namespace mango::image::jpeg
         if (!status.direct)
         {
             // create a temporary decoding target
-            temp = std::make_unique<Bitmap>(width, height, sf.format);
+            const int xmcu_region = m_region.x1 - m_region.x0;
+            const int ymcu_region = m_region.y1 - m_region.y0;
+            temp = std::make_unique<Bitmap>(xmcu_region * xblock_scaled, ymcu_region * yblock_scaled, sf.format);
             m_surface = temp.get();
         }
 
@@ -1810,14 +2126,20 @@ namespace mango::image::jpeg
             return status;
         }
 
-        if (is_progressive || is_multiscan)
+        if (!m_scans.empty())
+        {
+            decodeProgressivePipeline();
+        }
+        else if (is_progressive || is_multiscan)
         {
             finishProgressive();
         }
 
         if (!status.direct)
         {
-            target.blit(0, 0, *m_surface);
+            const int x = x0 - m_region.x0 * xblock_scaled;
+            const int y = y0 - m_region.y0 * yblock_scaled;
+            target.blit(0, 0, Surface(*m_surface, x, y, x1 - x0, y1 - y0));
         }
 
         if (icc_buffer.size() > 0 && options.icc)
@@ -2033,16 +2355,81 @@ namespace mango::image::jpeg
         }
         else
         {
-            if (m_hardware_concurrency > 1)
+            bool serial = !restartInterval && m_restart_offsets.empty() && !decodeState.is_arithmetic;
+
+            // speculative decoding walks the whole scan; a region which ends early is
+            // cheaper to reach with the serial decoder
+            bool speculative = serial && m_region.y1 == ymcu;
+
+            m_index.clear();
+            m_index_start = decodeState.buffer.ptr;
+
+            if (serial && m_index_buffer)
+            {
+                if (readScanIndex())
+                {
+                    decodeSequentialIndexed();
+                    return;
+                }
+
+                if (m_region.y0 == 0 && m_region.y1 == ymcu)
+                {
+                    // all MCU rows are decoded; build the index on the way
+                    ScanIndexEntry entry = { JPEG_INVALID_POSITION };
+                    m_index.resize(ymcu, entry);
+                }
+            }
+
+            if (m_hardware_concurrency > 1 && speculative && decodeSequentialSpeculative())
+            {
+                // decoded in parallel without restart markers
+            }
+            else if (m_hardware_concurrency > 1)
             {
-                int n = getTaskSize(ymcu);
+                int n = getTaskSize(m_region.y1);
                 decodeSequentialMT(n);
             }
             else
             {
                 decodeSequentialST();
             }
+
+            if (!m_index.empty())
+            {
+                writeScanIndex();
+            }
+
+            if (m_region.y1 < ymcu)
+            {
+                // MCUs below the region of interest are not needed; skip the rest of the scan
+                decodeState.buffer.ptr = decodeState.buffer.end;
+            }
+        }
+    }
+
+    int Parser::seekRestartInterval(const u8*& p) const
+    {
+        // The mango encoder stores offsets to the restart intervals (APP14:'Mango1' chunk),
+        // which lets us jump directly to the first interval in the region of interest.
+        // Otherwise the intervals are skipped one marker at a time by the caller.
+
+        if (m_region.y0 > 0 && m_decode_interval > 0 && restartInterval == xmcu * m_decode_interval)
+        {
+            const size_t index = m_region.y0 / m_decode_interval;
+
+            if (index > 0 && index <= m_restart_offsets.size())
+            {
+                const u32 offset = m_restart_offsets[index - 1];
+
+                if (offset < memory.size)
+                {
+                    p = memory.address + offset;
+                    return int(index) * restartInterval;
+                }
+            }
         }
+
+        return 0;
     }
 
     void Parser::decodeSequentialST()
@@ -2055,41 +2442,51 @@ namespace mango::image::jpeg
 
             const size_t stride = m_surface->stride;
             const size_t bytes_per_pixel = m_surface->format.bytes();
-            const size_t xstride = bytes_per_pixel * xblock;
-            const size_t ystride = stride * yblock;
+            const size_t xstride = bytes_per_pixel * xblock_scaled;
+            const size_t ystride = stride * yblock_scaled;
 
             AlignedStorage<s16> data(JPEG_MAX_SAMPLES_IN_MCU);
 
             const u8* p = decodeState.buffer.ptr;
             u8* image = m_surface->image;
 
-            for (int i = 0; i < mcus; i += restartInterval)
-            {
-                DecodeState state = decodeState;
-                state.buffer.ptr = p;
+            const int xmcu_last = xmcu - 1;
+            const int ymcu_last = ymcu - 1;
 
-                const int left = i + std::min(restartInterval, mcus - i);
+            const int xclip = xsize_scaled % xblock_scaled;
+            const int yclip = ysize_scaled % yblock_scaled;
+            const int xblock_last = xclip ? xclip : xblock_scaled;
+            const int yblock_last = yclip ? yclip : yblock_scaled;
 
-                const int xmcu_last = xmcu - 1;
-                const int ymcu_last = ymcu - 1;
+            // MCUs in the region of interest are in the range [first, last)
+            const int first = m_region.y0 * xmcu + m_region.x0;
+            const int last = (m_region.y1 - 1) * xmcu + m_region.x1;
 
-                const int xclip = xsize % xblock;
-                const int yclip = ysize % yblock;
-                const int xblock_last = xclip ? xclip : xblock;
-                const int yblock_last = yclip ? yclip : yblock;
+            for (int i = seekRestartInterval(p); i < last; i += restartInterval)
+            {
+                const int left = std::min(i + restartInterval, last);
 
-                for (int j = i; j < left; ++j)
+                if (left > first)
                 {
-                    state.decode(data, &state);
+                    DecodeState state = decodeState;
+                    state.buffer.ptr = p;
+
+                    for (int j = i; j < left; ++j)
+                    {
+                        state.decode(data, &state);
 
-                    int x = j % xmcu;
-                    int y = j / xmcu;
-                    u8* dest = image + y * ystride + x * xstride;
+                        int x = j % xmcu;
+                        int y = j / xmcu;
+                        if (!m_region.contains(x, y))
+                            continue;
 
-                    int width = x == xmcu_last ? xblock_last : xblock;
-                    int height = y == ymcu_last ? yblock_last : yblock;
+                        u8* dest = image + (y - m_region.y0) * ystride + (x - m_region.x0) * xstride;
 
-                    process_and_clip(dest, stride, data, width, height);
+                        int width = x == xmcu_last ? xblock_last : xblock_scaled;
+                        int height = y == ymcu_last ? yblock_last : yblock_scaled;
+
+                        process_and_clip(dest, stride, data, width, height);
+                    }
                 }
 
                 // seek next restart marker
@@ -2117,14 +2514,32 @@ namespace mango::image::jpeg
             void* aligned_ptr = aligned_malloc(ncount * mcu_data_size * sizeof(s16), 64);
             s16* data = reinterpret_cast<s16*>(aligned_ptr);
 
-            for (int y = 0; y < ymcu; y += N)
+            const bool indexing = !m_index.empty();
+
+            for (int y = 0; y < m_region.y1; y += N)
             {
                 const int y0 = y;
-                const int y1 = std::min(y + N, ymcu);
+                const int y1 = std::min(y + N, m_region.y1);
                 const int count = (y1 - y0) * xmcu;
 
+                if (y1 <= m_region.y0)
+                {
+                    // MCUs above the region of interest are decoded only to advance the bitstream
+                    for (int i = 0; i < count; ++i)
+                    {
+                        decodeState.decode(data, &decodeState);
+                    }
+
+                    continue;
+                }
+
                 for (int i = 0; i < count; ++i)
                 {
+                    if (indexing && !(i % xmcu))
+                    {
+                        indexScanRow(y0 + i / xmcu, decodeState.buffer, decodeState.huffman.last_dc_value);
+                    }
+
                     decodeState.decode(data + i * mcu_data_size, &decodeState);
                 }
 
@@ -2137,7 +2552,7 @@ namespace mango::image::jpeg
 
     void Parser::decodeSequentialMT(int N)
     {
-        ConcurrentQueue queue("jpeg:sequential", Priority::High);
+        ConcurrentQueue queue("jpeg:sequential", Priority::High, WaitPolicy::Scoped);
 
         if (!m_restart_offsets.empty())
         {
@@ -2147,8 +2562,8 @@ namespace mango::image::jpeg
 
             const size_t stride = m_surface->stride;
             const size_t bytes_per_pixel = m_surface->format.bytes();
-            const size_t xstride = bytes_per_pixel * xblock;
-            const size_t ystride = stride * yblock;
+            const size_t xstride = bytes_per_pixel * xblock_scaled;
+            const size_t ystride = stride * yblock_scaled;
 
             const u8* p = decodeState.buffer.ptr;
             u8* image = m_surface->image;
@@ -2169,18 +2584,18 @@ namespace mango::image::jpeg
 
                     const int xmcu_last = xmcu - 1;
                     const int ymcu_last = ymcu - 1;
-                    const int xclip = xsize % xblock;
-                    const int yclip = ysize % yblock;
-                    const int xblock_last = xclip ? xclip : xblock;
-                    const int yblock_last = yclip ? yclip : yblock;
+                    const int xclip = xsize_scaled % xblock_scaled;
+                    const int yclip = ysize_scaled % yblock_scaled;
+                    const int xblock_last = xclip ? xclip : xblock_scaled;
+                    const int yblock_last = yclip ? yclip : yblock_scaled;
 
                     u8* dest = image + y * ystride;
-                    int height = (y == ymcu_last) ? yblock_last : yblock;
+                    int height = (y == ymcu_last) ? yblock_last : yblock_scaled;
 
                     for (int x = 0; x < xmcu_last; ++x)
                     {
                         state.decode(data, &state);
-                        process_and_clip(dest, stride, data, xblock, height);
+                        process_and_clip(dest, stride, data, xblock_scaled, height);
                         dest += xstride;
                     }
 
@@ -2201,10 +2616,16 @@ namespace mango::image::jpeg
 
             const u32* offsets = m_restart_offsets.data();
 
-            for (int y = 0; y < ymcu; y += N)
+            // jump to the first MCU row in the region of interest
+            if (m_region.y0 > 0)
+            {
+                p = memory.address + offsets[m_region.y0 - 1];
+            }
+
+            for (int y = m_region.y0; y < m_region.y1; y += N)
             {
                 int y0 = y;
-                int y1 = std::min(y + N, ymcu);
+                int y1 = std::min(y + N, m_region.y1);
 
                 // enqueue task
                 queue.enqueue([=]
@@ -2213,10 +2634,10 @@ namespace mango::image::jpeg
 
                     const int xmcu_last = xmcu - 1;
                     const int ymcu_last = ymcu - 1;
-                    const int xclip = xsize % xblock;
-                    const int yclip = ysize % yblock;
-                    const int xblock_last = xclip ? xclip : xblock;
-                    const int yblock_last = yclip ? yclip : yblock;
+                    const int xclip = xsize_scaled % xblock_scaled;
+                    const int yclip = ysize_scaled % yblock_scaled;
+                    const int xblock_last = xclip ? xclip : xblock_scaled;
+                    const int yblock_last = yclip ? yclip : yblock_scaled;
 
                     const u8* ptr = p;
 
@@ -2226,19 +2647,20 @@ namespace mango::image::jpeg
                         state.buffer.ptr = ptr;
                         ptr = memory.address + offsets[i];
 
-                        u8* dest = image + i * ystride;
-                        int height = (i == ymcu_last) ? yblock_last : yblock;
+                        u8* dest = image + (i - m_region.y0) * ystride;
+                        int height = (i == ymcu_last) ? yblock_last : yblock_scaled;
 
-                        for (int x = 0; x < xmcu_last; ++x)
+                        for (int x = 0; x < m_region.x1; ++x)
                         {
                             state.decode(data, &state);
-                            process_and_clip(dest, stride, data, xblock, height);
-                            dest += xstride;
-                        }
 
-                        // last column
-                        state.decode(data, &state);
-                        process_and_clip(dest, stride, data, xblock_last, height);
+                            if (x >= m_region.x0)
+                            {
+                                int width = (x == xmcu_last) ? xblock_last : xblock_scaled;
+                                process_and_clip(dest, stride, data, width, height);
+                                dest += xstride;
+                            }
+                        }
                     }
                 });
 
@@ -2259,45 +2681,55 @@ namespace mango::image::jpeg
 
             const size_t stride = m_surface->stride;
             const size_t bytes_per_pixel = m_surface->format.bytes();
-            const size_t xstride = bytes_per_pixel * xblock;
-            const size_t ystride = stride * yblock;
+            const size_t xstride = bytes_per_pixel * xblock_scaled;
+            const size_t ystride = stride * yblock_scaled;
 
             u8* image = m_surface->image;
 
-            for (int i = 0; i < mcus; i += restartInterval)
+            // MCUs in the region of interest are in the range [first, last)
+            const int first = m_region.y0 * xmcu + m_region.x0;
+            const int last = (m_region.y1 - 1) * xmcu + m_region.x1;
+
+            for (int i = seekRestartInterval(p); i < last; i += restartInterval)
             {
-                // enqueue task
-                queue.enqueue([=]
+                const int left = std::min(i + restartInterval, last);
+
+                if (left > first)
                 {
-                    AlignedStorage<s16> data(JPEG_MAX_SAMPLES_IN_MCU);
+                    // enqueue task
+                    queue.enqueue([=]
+                    {
+                        AlignedStorage<s16> data(JPEG_MAX_SAMPLES_IN_MCU);
 
-                    DecodeState state = decodeState;
-                    state.buffer.ptr = p;
+                        DecodeState state = decodeState;
+                        state.buffer.ptr = p;
 
-                    const int left = i + std::min(restartInterval, mcus - i);
+                        const int xmcu_last = xmcu - 1;
+                        const int ymcu_last = ymcu - 1;
 
-                    const int xmcu_last = xmcu - 1;
-                    const int ymcu_last = ymcu - 1;
+                        const int xclip = xsize_scaled % xblock_scaled;
+                        const int yclip = ysize_scaled % yblock_scaled;
+                        const int xblock_last = xclip ? xclip : xblock_scaled;
+                        const int yblock_last = yclip ? yclip : yblock_scaled;
 
-                    const int xclip = xsize % xblock;
-                    const int yclip = ysize % yblock;
-                    const int xblock_last = xclip ? xclip : xblock;
-                    const int yblock_last = yclip ? yclip : yblock;
+                        for (int j = i; j < left; ++j)
+                        {
+                            state.decode(data, &state);
 
-                    for (int j = i; j < left; ++j)
-                    {
-                        state.decode(data, &state);
+                            int x = j % xmcu;
+                            int y = j / xmcu;
+                            if (!m_region.contains(x, y))
+                                continue;
 
-                        int x = j % xmcu;
-                        int y = j / xmcu;
-                        u8* dest = image + y * ystride + x * xstride;
+                            u8* dest = image + (y - m_region.y0) * ystride + (x - m_region.x0) * xstride;
 
-                        int width = x == xmcu_last ? xblock_last : xblock;
-                        int height = y == ymcu_last ? yblock_last : yblock;
+                            int width = x == xmcu_last ? xblock_last : xblock_scaled;
+                            int height = y == ymcu_last ? yblock_last : yblock_scaled;
 
-                        process_and_clip(dest, stride, data, width, height);
-                    }
-                });
+                            process_and_clip(dest, stride, data, width, height);
+                        }
+                    });
+                }
 
                 // seek next restart marker
                 p = seekMarker(p, decodeState.buffer.end);
@@ -2319,11 +2751,27 @@ namespace mango::image::jpeg
 
             const int mcu_data_size = blocks_in_mcu * 64;
 
-            for (int y = 0; y < ymcu; y += N)
+            AlignedStorage<s16> scratch(JPEG_MAX_SAMPLES_IN_MCU);
+
+            const bool indexing = !m_index.empty();
+
+            for (int y = 0; y < m_region.y1; y += N)
             {
                 const int y0 = y;
-                const int y1 = std::min(y + N, ymcu);
+                const int y1 = std::min(y + N, m_region.y1);
                 const int count = (y1 - y0) * xmcu;
+
+                if (y1 <= m_region.y0)
+                {
+                    // MCUs above the region of interest are decoded only to advance the bitstream
+                    for (int i = 0; i < count; ++i)
+                    {
+                        decodeState.decode(scratch, &decodeState);
+                    }
+
+                    continue;
+                }
+
                 printLine(Print::Info, "  Process: [{}, {}] --> ThreadPool.", y0, y1 - 1);
 
                 void* aligned_ptr = aligned_malloc(count * mcu_data_size * sizeof(s16), 64);
@@ -2331,6 +2779,11 @@ namespace mango::image::jpeg
 
                 for (int i = 0; i < count; ++i)
                 {
+                    if (indexing && !(i % xmcu))
+                    {
+                        indexScanRow(y0 + i / xmcu, decodeState.buffer, decodeState.huffman.last_dc_value);
+                    }
+
                     decodeState.decode(data + i * mcu_data_size, &decodeState);
                 }
 
@@ -2344,17 +2797,624 @@ namespace mango::image::jpeg
         }
     }
 
-    void Parser::decodeSequentialCompute()
+    // ----------------------------------------------------------------------------
+    // speculative decoding
+    // ----------------------------------------------------------------------------
+
+    /*
+        Baseline scans without restart markers are split into chunks at arbitrary byte
+        offsets. Each chunk is decoded speculatively as if an MCU started at its first
+        byte; Huffman codes are self-synchronizing so after a few MCUs the speculative
+        decoder lands on the same MCU boundaries as the real one. The chunk boundaries
+        are then resolved serially: decoding continues from the end of the previous
+        chunk until it reaches an MCU boundary recorded by the next chunk. From there on
+        the DC predictors differ only by a constant, which is fixed up before the chunks
+        are decoded in parallel from the synchronized positions.
+    */
+
+    struct SyncPoint
     {
-        ComputeDecoderInput input;
+        size_t position; // bit position in the scan
+        int mcu;         // MCU index, relative to the start of the chunk
+        int dc[JPEG_MAX_COMPS_IN_SCAN]; // DC predictors
+    };
 
-        if (!m_restart_offsets.empty())
-        {
-            // -----------------------------------------------------------------
-            // custom mango encoded file (APP14:'Mango1' chunk present)
-            // -----------------------------------------------------------------
+    struct SpeculativeChunk
+    {
+        const u8* start;
+        const u8* end;
+        std::vector<SyncPoint> points; // first MCU boundaries in the chunk
+        SyncPoint last; // first MCU boundary at or after the end of the chunk
+        bool complete = false; // last is valid
+    };
 
-            /* NOTE: Experimental don't use
+    struct SpeculativeSegment
+    {
+        size_t position;
+        int dc[JPEG_MAX_COMPS_IN_SCAN];
+        int mcu0;
+        int mcu1;
+    };
+
+    bool Parser::decodeSequentialSpeculative()
+    {
+        constexpr size_t min_chunk_size = 64 * 1024;
+        constexpr int max_points = 1024;
+
+        const u8* start = decodeState.buffer.ptr;
+        const u8* end = seekMarker(start, decodeState.buffer.end);
+
+        const size_t bytes = end - start;
+        const int count = int(std::min(size_t(m_hardware_concurrency), bytes / min_chunk_size));
+        if (count < 2)
+        {
+            return false;
+        }
+
+        printLine(Print::Info, "  Speculative: {} chunks, {} KB.", count, bytes / 1024);
+
+        std::vector<SpeculativeChunk> chunks(count);
+
+        for (int i = 0; i < count; ++i)
+        {
+            const u8* p = start + bytes * i / count;
+            if (i && p[-1] == 0xff)
+            {
+                // don't start from a stuffed zero byte
+                ++p;
+            }
+
+            chunks[i].start = p;
+            chunks[i].end = end;
+
+            if (i)
+            {
+                chunks[i - 1].end = p;
+            }
+        }
+
+        // speculative decoding
+
+        ConcurrentQueue queue("jpeg:speculative", Priority::High, WaitPolicy::Scoped);
+
+        for (int i = 0; i < count; ++i)
+        {
+            queue.enqueue([this, &chunks, i, start, end]
+            {
+                SpeculativeChunk& chunk = chunks[i];
+
+                DecodeState state = decodeState;
+                setBitPosition(state.buffer, start, end, size_t(chunk.start - start) * 8);
+                state.huffman.restart();
+
+                const bool is_last = chunk.end == end;
+                const size_t limit = size_t(chunk.end - start) * 8;
+                const int points = i ? max_points : 0;
+
+                chunk.points.reserve(points);
+
+                for (int mcu = 0; mcu < mcus; ++mcu)
+                {
+                    bool record = mcu < points;
+                    bool check = !is_last && state.buffer.ptr >= chunk.end;
+
+                    if (!record && !check)
+                    {
+                        if (is_last)
+                            break;
+
+                        huff_skip_mcu(&state);
+                        continue;
+                    }
+
+                    size_t position = getBitPosition(state.buffer, start, end);
+                    if (position == JPEG_INVALID_POSITION)
+                        break;
+
+                    SyncPoint point;
+
+                    point.position = position;
+                    point.mcu = mcu;
+                    std::memcpy(point.dc, state.huffman.last_dc_value, sizeof(point.dc));
+
+                    if (check && position >= limit)
+                    {
+                        chunk.last = point;
+                        chunk.complete = true;
+                        break;
+                    }
+
+                    if (record)
+                    {
+                        chunk.points.push_back(point);
+                    }
+
+                    huff_skip_mcu(&state);
+                }
+            });
+        }
+
+        queue.wait();
+
+        if (!chunks[0].complete)
+        {
+            return false;
+        }
+
+        // synchronization
+
+        std::vector<SpeculativeSegment> segments;
+
+        SpeculativeSegment segment;
+
+        segment.position = 0;
+        std::memset(segment.dc, 0, sizeof(segment.dc));
+        segment.mcu0 = 0;
+
+        DecodeState walker = decodeState;
+        SyncPoint current = chunks[0].last;
+        int mcu = 0;
+        bool reset = true;
+
+        for (int i = 1; i < count; ++i)
+        {
+            const std::vector<SyncPoint>& points = chunks[i].points;
+
+            if (reset)
+            {
+                // continue from the (correctly decoded) end of the previous chunk
+                setBitPosition(walker.buffer, start, end, current.position);
+                walker.huffman.restart();
+                std::memcpy(walker.huffman.last_dc_value, current.dc, sizeof(current.dc));
+                mcu = current.mcu;
+                reset = false;
+            }
+
+            size_t index = 0;
+            size_t position = JPEG_INVALID_POSITION;
+            bool synced = false;
+
+            while (mcu < mcus)
+            {
+                position = getBitPosition(walker.buffer, start, end);
+                if (position == JPEG_INVALID_POSITION)
+                    break;
+
+                while (index < points.size() && points[index].position < position)
+                {
+                    ++index;
+                }
+
+                if (index == points.size())
+                {
+                    // the speculative decoder did not synchronize; keep walking into the next chunk
+                    break;
+                }
+
+                if (points[index].position == position)
+                {
+                    synced = true;
+                    break;
+                }
+
+                huff_skip_mcu(&walker);
+                ++mcu;
+            }
+
+            if (!synced)
+                continue;
+
+            const SyncPoint& point = points[index];
+            const int* dc = walker.huffman.last_dc_value;
+
+            segment.mcu1 = mcu;
+            segments.push_back(segment);
+
+            segment.position = position;
+            std::memcpy(segment.dc, dc, sizeof(segment.dc));
+            segment.mcu0 = mcu;
+
+            if (chunks[i].complete)
+            {
+                const SyncPoint& last = chunks[i].last;
+
+                current.position = last.position;
+                current.mcu = mcu + last.mcu - point.mcu;
+
+                for (int j = 0; j < JPEG_MAX_COMPS_IN_SCAN; ++j)
+                {
+                    current.dc[j] = last.dc[j] + dc[j] - point.dc[j];
+                }
+
+                reset = true;
+            }
+        }
+
+        segment.mcu1 = mcus;
+        segments.push_back(segment);
+
+        printLine(Print::Info, "  Segments: {}", segments.size());
+
+        // decoding
+
+        const size_t stride = m_surface->stride;
+        const size_t bytes_per_pixel = m_surface->format.bytes();
+        const size_t xstride = bytes_per_pixel * xblock_scaled;
+        const size_t ystride = stride * yblock_scaled;
+
+        u8* image = m_surface->image;
+
+        // segments above the region of interest are not decoded
+        const int first = m_region.y0 * xmcu;
+
+        for (const SpeculativeSegment& segment : segments)
+        {
+            const int mcu0 = std::min(segment.mcu0, mcus);
+            const int mcu1 = std::min(segment.mcu1, mcus);
+            if (mcu0 >= mcu1 || mcu1 <= first)
+                continue;
+
+            queue.enqueue([=]
+            {
+                AlignedStorage<s16> data(JPEG_MAX_SAMPLES_IN_MCU);
+
+                DecodeState state = decodeState;
+                setBitPosition(state.buffer, start, end, segment.position);
+                state.huffman.restart();
+                std::memcpy(state.huffman.last_dc_value, segment.dc, sizeof(segment.dc));
+
+                const int xmcu_last = xmcu - 1;
+                const int ymcu_last = ymcu - 1;
+
+                const int xclip = xsize_scaled % xblock_scaled;
+                const int yclip = ysize_scaled % yblock_scaled;
+                const int xblock_last = xclip ? xclip : xblock_scaled;
+                const int yblock_last = yclip ? yclip : yblock_scaled;
+
+                const bool indexing = !m_index.empty();
+
+                for (int i = mcu0; i < mcu1; ++i)
+                {
+                    int x = i % xmcu;
+                    int y = i / xmcu;
+
+                    if (indexing && !x)
+                    {
+                        indexScanRow(y, state.buffer, state.huffman.last_dc_value);
+                    }
+
+                    state.decode(data, &state);
+
+                    if (!m_region.contains(x, y))
+                        continue;
+
+                    u8* dest = image + (y - m_region.y0) * ystride + (x - m_region.x0) * xstride;
+
+                    int width = x == xmcu_last ? xblock_last : xblock_scaled;
+                    int height = y == ymcu_last ? yblock_last : yblock_scaled;
+
+                    process_and_clip(dest, stride, data, width, height);
+                }
+            });
+        }
+
+        queue.wait();
+
+        decodeState.buffer.ptr = end;
+
+        return true;
+    }
+
+    // ----------------------------------------------------------------------------
+    // scan index
+    // ----------------------------------------------------------------------------
+
+    /*
+        The scan index records the decoder state at the start of every MCU row of a
+        sequential Huffman scan: the bit position in the scan and the DC predictors.
+        This is the same information the speculative decoder recovers when it
+        synchronizes, so with an index any MCU row can be decoded directly, which
+        turns files without restart markers into randomly accessible ones.
+
+        Layout (little-endian):
+
+            u32  magic 'JIDX'
+            u32  xmcu
+            u32  ymcu
+            u32  crc32 of the file before the scan (markers and tables)
+            u32  crc32 of chunks sampled across the scan
+            u64  scan offset in the file
+            u64  scan size in bytes
+            u64  file size in bytes
+            u32  number of indexed MCU rows
+            entries: u64 bit position, s32 DC predictor x 4, u32 crc32 of the row
+
+        The entropy coded data is validated lazily: only the rows which are decoded
+        are compared against their checksums so that a region is decoded without
+        reading the whole scan. The sampled chunks catch most changes elsewhere.
+    */
+
+    static constexpr u32 JPEG_INDEX_MAGIC = u32_mask('J', 'I', 'D', 'X');
+    static constexpr size_t JPEG_INDEX_HEADER_SIZE = 48;
+    static constexpr size_t JPEG_INDEX_ENTRY_SIZE = 12 + 4 * JPEG_MAX_COMPS_IN_SCAN;
+
+    static
+    u32 getHeaderChecksum(ConstMemory memory, const u8* start)
+    {
+        return crc32(0, ConstMemory(memory.address, size_t(start - memory.address)));
+    }
+
+    static
+    u32 getSampleChecksum(const u8* start, const u8* end)
+    {
+        // 32 chunks of 64 bytes at even intervals, the last one at the end of the scan
+        const size_t size = size_t(end - start);
+        const size_t bytes = std::min(size, size_t(64));
+
+        u32 crc = 0;
+
+        for (size_t i = 0; i < 32; ++i)
+        {
+            size_t offset = (size - bytes) * i / 31;
+            crc = crc32(crc, ConstMemory(start + offset, bytes));
+        }
+
+        return crc;
+    }
+
+    static
+    ConstMemory getIndexedRow(const std::vector<ScanIndexEntry>& index, size_t y, const u8* start, const u8* end)
+    {
+        // bytes holding the bits of the row; the last indexed row extends to the end of the scan
+        // because the rows after it are decoded by walking from it
+        const size_t size = size_t(end - start);
+        const size_t first = std::min(size_t(index[y].position / 8), size);
+        const size_t last = y + 1 < index.size() ? std::min(size_t((index[y + 1].position + 7) / 8), size) : size;
+        return ConstMemory(start + first, std::max(first, last) - first);
+    }
+
+    void Parser::indexScanRow(int y, const BitBuffer& buffer, const int* dc)
+    {
+        ScanIndexEntry& entry = m_index[y];
+
+        entry.position = getBitPosition(buffer, m_index_start, buffer.end);
+        std::memcpy(entry.dc, dc, sizeof(entry.dc));
+    }
+
+    bool Parser::readScanIndex()
+    {
+        const u8* p = m_index_buffer->data();
+        const size_t size = m_index_buffer->size();
+
+        if (size < JPEG_INDEX_HEADER_SIZE)
+            return false;
+
+        const u8* start = m_index_start;
+        const u8* end = decodeState.buffer.end;
+
+        // the checksum is computed last; the other fields are cheap to compare
+        if (littleEndian::uload32(p + 0) != JPEG_INDEX_MAGIC ||
+            littleEndian::uload32(p + 4) != u32(xmcu) ||
+            littleEndian::uload32(p + 8) != u32(ymcu) ||
+            littleEndian::uload64(p + 20) != u64(start - memory.address) ||
+            littleEndian::uload64(p + 28) != u64(end - start) ||
+            littleEndian::uload64(p + 36) != u64(memory.size) ||
+            littleEndian::uload32(p + 12) != getHeaderChecksum(memory, start) ||
+            littleEndian::uload32(p + 16) != getSampleChecksum(start, end))
+        {
+            printLine(Print::Info, "  Index: does not match the scan.");
+            return false;
+        }
+
+        const size_t count = littleEndian::uload32(p + 44);
+
+        if (!count || count > size_t(ymcu) || size != JPEG_INDEX_HEADER_SIZE + count * JPEG_INDEX_ENTRY_SIZE)
+        {
+            printLine(Print::Info, "  Index: corrupted.");
+            return false;
+        }
+
+        p += JPEG_INDEX_HEADER_SIZE;
+
+        const u64 bits = u64(end - start) * 8;
+
+        m_index.resize(count);
+        std::vector<u32> checksums(count);
+
+        for (size_t y = 0; y < count; ++y)
+        {
+            ScanIndexEntry& entry = m_index[y];
+
+            entry.position = littleEndian::uload64(p);
+
+            for (int i = 0; i < JPEG_MAX_COMPS_IN_SCAN; ++i)
+            {
+                entry.dc[i] = s32(littleEndian::uload32(p + 8 + i * 4));
+            }
+
+            checksums[y] = littleEndian::uload32(p + 8 + JPEG_MAX_COMPS_IN_SCAN * 4);
+
+            if (entry.position >= bits || (y && entry.position < m_index[y - 1].position))
+            {
+                printLine(Print::Info, "  Index: corrupted.");
+                m_index.clear();
+                return false;
+            }
+
+            p += JPEG_INDEX_ENTRY_SIZE;
+        }
+
+        // validate the rows which are decoded; the decoding starts from the nearest indexed row
+        const size_t y0 = std::min(size_t(m_region.y0), count - 1);
+        const size_t y1 = std::min(size_t(m_region.y1), count);
+
+        for (size_t y = y0; y < y1; ++y)
+        {
+            if (crc32(0, getIndexedRow(m_index, y, start, end)) != checksums[y])
+            {
+                printLine(Print::Info, "  Index: does not match the scan.");
+                m_index.clear();
+                return false;
+            }
+        }
+
+        printLine(Print::Info, "  Index: {} MCU rows.", count);
+
+        return true;
+    }
+
+    void Parser::writeScanIndex()
+    {
+        // the index ends at the first row without a known position
+        size_t count = 0;
+
+        while (count < m_index.size() && m_index[count].position != JPEG_INVALID_POSITION)
+        {
+            ++count;
+        }
+
+        if (!count)
+            return;
+
+        m_index.resize(count);
+
+        const u8* start = m_index_start;
+        const u8* end = decodeState.buffer.end;
+
+        Buffer& buffer = *m_index_buffer;
+        buffer.reset(JPEG_INDEX_HEADER_SIZE + count * JPEG_INDEX_ENTRY_SIZE);
+
+        u8* p = buffer.data();
+
+        littleEndian::ustore32(p + 0, JPEG_INDEX_MAGIC);
+        littleEndian::ustore32(p + 4, u32(xmcu));
+        littleEndian::ustore32(p + 8, u32(ymcu));
+        littleEndian::ustore32(p + 12, getHeaderChecksum(memory, start));
+        littleEndian::ustore32(p + 16, getSampleChecksum(start, end));
+        littleEndian::ustore64(p + 20, u64(start - memory.address));
+        littleEndian::ustore64(p + 28, u64(end - start));
+        littleEndian::ustore64(p + 36, u64(memory.size));
+        littleEndian::ustore32(p + 44, u32(count));
+        p += JPEG_INDEX_HEADER_SIZE;
+
+        for (size_t y = 0; y < count; ++y)
+        {
+            const ScanIndexEntry& entry = m_index[y];
+
+            littleEndian::ustore64(p, entry.position);
+
+            for (int i = 0; i < JPEG_MAX_COMPS_IN_SCAN; ++i)
+            {
+                littleEndian::ustore32(p + 8 + i * 4, u32(entry.dc[i]));
+            }
+
+            // the whole scan was just decoded so checksumming it is a small extra cost
+            littleEndian::ustore32(p + 8 + JPEG_MAX_COMPS_IN_SCAN * 4, crc32(0, getIndexedRow(m_index, y, start, end)));
+
+            p += JPEG_INDEX_ENTRY_SIZE;
+        }
+
+        printLine(Print::Info, "  Index: {} MCU rows ({} bytes).", count, buffer.size());
+    }
+
+    void Parser::decodeSequentialIndexed()
+    {
+        const size_t stride = m_surface->stride;
+        const size_t bytes_per_pixel = m_surface->format.bytes();
+        const size_t xstride = bytes_per_pixel * xblock_scaled;
+        const size_t ystride = stride * yblock_scaled;
+
+        u8* image = m_surface->image;
+
+        const u8* start = m_index_start;
+        const u8* end = decodeState.buffer.end;
+        const int count = int(m_index.size());
+
+        auto decodeRows = [=] (int y0, int y1)
+        {
+            AlignedStorage<s16> data(JPEG_MAX_SAMPLES_IN_MCU);
+
+            // start from the nearest indexed MCU row
+            const int y = std::min(y0, count - 1);
+            const ScanIndexEntry& entry = m_index[y];
+
+            DecodeState state = decodeState;
+            setBitPosition(state.buffer, start, end, entry.position);
+            state.huffman.restart();
+            std::memcpy(state.huffman.last_dc_value, entry.dc, sizeof(entry.dc));
+
+            for (int i = y * xmcu; i < y0 * xmcu; ++i)
+            {
+                state.decode(data, &state);
+            }
+
+            const int xmcu_last = xmcu - 1;
+            const int ymcu_last = ymcu - 1;
+            const int xclip = xsize_scaled % xblock_scaled;
+            const int yclip = ysize_scaled % yblock_scaled;
+            const int xblock_last = xclip ? xclip : xblock_scaled;
+            const int yblock_last = yclip ? yclip : yblock_scaled;
+
+            for (int i = y0; i < y1; ++i)
+            {
+                u8* dest = image + (i - m_region.y0) * ystride;
+                int height = (i == ymcu_last) ? yblock_last : yblock_scaled;
+
+                // the last row is decoded only up to the end of the region
+                const int xcount = i < y1 - 1 ? xmcu : m_region.x1;
+
+                for (int x = 0; x < xcount; ++x)
+                {
+                    state.decode(data, &state);
+
+                    if (x >= m_region.x0 && x < m_region.x1)
+                    {
+                        int width = (x == xmcu_last) ? xblock_last : xblock_scaled;
+                        process_and_clip(dest, stride, data, width, height);
+                        dest += xstride;
+                    }
+                }
+            }
+        };
+
+        const int rows = m_region.y1 - m_region.y0;
+        const int n = getTaskSize(rows);
+
+        if (n)
+        {
+            ConcurrentQueue queue("jpeg:sequential.indexed", Priority::High, WaitPolicy::Scoped);
+
+            for (int y = m_region.y0; y < m_region.y1; y += n)
+            {
+                int y0 = y;
+                int y1 = std::min(y + n, m_region.y1);
+
+                queue.enqueue([=]
+                {
+                    decodeRows(y0, y1);
+                });
+            }
+        }
+        else
+        {
+            decodeRows(m_region.y0, m_region.y1);
+        }
+
+        // the rest of the scan is not walked
+        decodeState.buffer.ptr = decodeState.buffer.end;
+    }
+
+    void Parser::decodeSequentialCompute()
+    {
+        ComputeDecoderInput input;
+
+        if (!m_restart_offsets.empty())
+        {
+            // -----------------------------------------------------------------
+            // custom mango encoded file (APP14:'Mango1' chunk present)
+            // -----------------------------------------------------------------
+
+            /* NOTE: Experimental don't use
             const u8* p = decodeState.buffer.ptr;
 
             int i = 0;
@@ -2496,25 +3556,33 @@ namespace mango::image::jpeg
 
             const u8* p = decodeState.buffer.ptr;
 
-            ConcurrentQueue queue("jpeg:progressive.dc", Priority::High);
+            ConcurrentQueue queue("jpeg:progressive.dc", Priority::High, WaitPolicy::Scoped);
+
+            // intervals outside of the region of interest MCU rows are skipped
+            const int first = m_region.y0 * xmcu;
+            const int last = m_region.y1 * xmcu;
 
             for (int i = 0; i < mcus; i += restartInterval)
             {
-                // enqueue task
-                queue.enqueue([=]
+                const int left = std::min(restartInterval, mcus - i);
+
+                if (i + left > first && i < last)
                 {
-                    DecodeState state = decodeState;
-                    state.buffer.ptr = p;
+                    // enqueue task
+                    queue.enqueue([=]
+                    {
+                        DecodeState state = decodeState;
+                        state.buffer.ptr = p;
 
-                    s16* dest = data + i * blocks_in_mcu * 64;
+                        s16* dest = data + i * blocks_in_mcu * 64;
 
-                    const int left = std::min(restartInterval, mcus - i);
-                    for (int j = 0; j < left; ++j)
-                    {
-                        state.decode(dest, &state);
-                        dest += blocks_in_mcu * 64;
-                    }
-                });
+                        for (int j = 0; j < left; ++j)
+                        {
+                            state.decode(dest, &state);
+                            dest += blocks_in_mcu * 64;
+                        }
+                    });
+                }
 
                 // seek next restart marker
                 p = seekMarker(p, decodeState.buffer.end);
@@ -2530,11 +3598,19 @@ namespace mango::image::jpeg
         {
             s16* data = blockVector;
 
-            for (int i = 0; i < mcus; ++i)
+            // MCU rows below the region of interest are not decoded
+            const int count = m_region.y1 * xmcu;
+
+            for (int i = 0; i < count; ++i)
             {
                 decodeState.decode(data, &decodeState);
                 data += blocks_in_mcu * 64;
             }
+
+            if (count < mcus)
+            {
+                decodeState.buffer.ptr = seekScanEnd(decodeState.buffer.ptr, decodeState.buffer.end);
+            }
         }
     }
 
@@ -2560,43 +3636,47 @@ namespace mango::image::jpeg
 
             printLine(Print::Info, "    blocks: {} x {} ({} x {})", xs, ys, xs * hsize, ys * vsize);
 
-            MANGO_UNREFERENCED(xs);
-            MANGO_UNREFERENCED(ys);
-            MANGO_UNREFERENCED(hsize);
-            MANGO_UNREFERENCED(vsize);
-
             const int HMask = (1 << hsf) - 1;
             const int VMask = (1 << vsf) - 1;
 
-            ConcurrentQueue queue("jpeg:progressive.ac", Priority::High);
+            ConcurrentQueue queue("jpeg:progressive.ac", Priority::High, WaitPolicy::Scoped);
 
             const u8* p = decodeState.buffer.ptr;
 
+            // intervals outside of the region of interest MCU rows are skipped
+            const int first = (m_region.y0 << vsf) * xs;
+            const int last = (m_region.y1 << vsf) * xs;
+
             for (int i = 0; i < cnt; i += restartInterval)
             {
-                // enqueue task
-                queue.enqueue([=]
-                {
-                    DecodeState state = decodeState;
-                    state.buffer.ptr = p;
+                // non-interleaved scan; the restart interval is counted in blocks
+                const int left = std::min(restartInterval, cnt - i);
 
-                    const int left = std::min(restartInterval, mcus - i);
-                    for (int j = 0; j < left; ++j)
+                if (i + left > first && i < last)
+                {
+                    // enqueue task
+                    queue.enqueue([=]
                     {
-                        int n = i + j;
-                        int x = n % xmcu;
-                        int y = n / xmcu;
+                        DecodeState state = decodeState;
+                        state.buffer.ptr = p;
 
-                        int mcu_yoffset = (y >> vsf) * xmcu;
-                        int block_yoffset = ((y & VMask) << hsf) + scan_offset;
+                        for (int j = 0; j < left; ++j)
+                        {
+                            int n = i + j;
+                            int x = n % xs;
+                            int y = n / xs;
 
-                        int mcu_offset = (mcu_yoffset + (x >> hsf)) * blocks_in_mcu;
-                        int block_offset = (x & HMask) + block_yoffset;
-                        s16* dest = data + (block_offset + mcu_offset) * 64;
+                            int mcu_yoffset = (y >> vsf) * xmcu;
+                            int block_yoffset = ((y & VMask) << hsf) + scan_offset;
 
-                        state.decode(dest, &state);
-                    }
-                });
+                            int mcu_offset = (mcu_yoffset + (x >> hsf)) * blocks_in_mcu;
+                            int block_offset = (x & HMask) + block_yoffset;
+                            s16* dest = data + (block_offset + mcu_offset) * 64;
+
+                            state.decode(dest, &state);
+                        }
+                    });
+                }
 
                 // seek next restart marker
                 p = seekMarker(p, decodeState.buffer.end);
@@ -2630,7 +3710,10 @@ namespace mango::image::jpeg
             const int HMask = (1 << hsf) - 1;
             const int VMask = (1 << vsf) - 1;
 
-            for (int y = 0; y < ys; ++y)
+            // block rows below the region of interest are not decoded
+            const int ylast = std::min(ys, m_region.y1 << vsf);
+
+            for (int y = 0; y < ylast; ++y)
             {
                 int mcu_yoffset = (y >> vsf) * xmcu;
                 int block_yoffset = ((y & VMask) << hsf) + scan_offset;
@@ -2644,38 +3727,230 @@ namespace mango::image::jpeg
                     decodeState.decode(mcudata, &decodeState);
                 }
             }
+
+            if (ylast < ys)
+            {
+                decodeState.buffer.ptr = seekScanEnd(decodeState.buffer.ptr, decodeState.buffer.end);
+            }
         }
     }
 
-    void Parser::finishProgressive()
+    void Parser::appendProgressiveScan()
     {
-        int n = getTaskSize(ymcu);
-        if (n)
+        ProgressiveScan scan;
+
+        scan.state = decodeState;
+        scan.frame = scanFrame;
+        scan.components = 0;
+        scan.spectral_start = decodeState.spectral_start;
+        scan.spectral_end = decodeState.spectral_end;
+        scan.restart_interval = restartInterval;
+        scan.restart_counter = restartInterval;
+
+        for (int i = 0; i < decodeState.blocks; ++i)
         {
-            ConcurrentQueue queue("jpeg:progressive.finish", Priority::High);
+            scan.components |= 1u << decodeState.block[i].pred;
+        }
 
-            size_t mcu_stride = size_t(xmcu) * blocks_in_mcu * 64;
+        if (decodeState.spectral_start == 0)
+        {
+            if (decodeState.comps_in_scan == 1 && decodeState.blocks > 1)
+            {
+                // same as decodeProgressive(): non-interleaved DC scan is decoded in AC order
+                scan.state.block[0].offset = 0;
+                scan.state.blocks = 1;
+                scan.interleaved = false;
+            }
+            else
+            {
+                scan.interleaved = true;
+            }
 
-            for (int y = 0; y < ymcu; y += n)
+            if (!decodeState.successive_high)
             {
-                const int y0 = y;
-                const int y1 = std::min(y + n, ymcu);
+                // first DC scan clears the whole block
+                scan.spectral_end = 63;
+            }
+        }
+        else
+        {
+            scan.interleaved = false;
+        }
 
-                s16* data = blockVector + y0 * mcu_stride;
+        m_scans.push_back(scan);
 
-                printLine(Print::Info, "  Process: [{}, {}] --> ThreadPool.", y0, y1 - 1);
+        // skip the entropy coded segment; the scan is decoded later
+        decodeState.buffer.ptr = seekScanEnd(decodeState.buffer.ptr, decodeState.buffer.end);
+    }
 
-                // enqueue task
-                queue.enqueue([=]
+    void Parser::decodeProgressiveScan(ProgressiveScan& scan, int y0, int y1)
+    {
+        DecodeState& state = scan.state;
+        s16* data = blockVector;
+
+        auto restart = [&] ()
+        {
+            if (scan.restart_interval > 0 && !--scan.restart_counter)
+            {
+                scan.restart_counter = scan.restart_interval;
+
+                if (isRestartMarker(state.buffer.ptr))
                 {
-                    process_range(y0, y1, data);
+                    state.restart();
+                    state.buffer.ptr += 2;
+                }
+            }
+        };
+
+        if (scan.interleaved)
+        {
+            const int mcu_data_size = blocks_in_mcu * 64;
+
+            for (int i = y0 * xmcu; i < y1 * xmcu; ++i)
+            {
+                state.decode(data + i * mcu_data_size, &state);
+                restart();
+            }
+        }
+        else
+        {
+            const int hsf = u32_log2(scan.frame->hsf);
+            const int vsf = u32_log2(scan.frame->vsf);
+            const int hsize = (Hmax >> hsf) * 8;
+            const int vsize = (Vmax >> vsf) * 8;
+
+            const int scan_offset = scan.frame->offset;
+
+            const int xs = ((xsize + hsize - 1) / hsize);
+            const int ys = ((ysize + vsize - 1) / vsize);
+
+            const int HMask = (1 << hsf) - 1;
+            const int VMask = (1 << vsf) - 1;
+
+            // component block rows which belong to the MCU rows [y0, y1)
+            const int ys0 = y0 << vsf;
+            const int ys1 = std::min(y1 << vsf, ys);
+
+            for (int y = ys0; y < ys1; ++y)
+            {
+                int mcu_yoffset = (y >> vsf) * xmcu;
+                int block_yoffset = ((y & VMask) << hsf) + scan_offset;
+
+                for (int x = 0; x < xs; ++x)
+                {
+                    int mcu_offset = (mcu_yoffset + (x >> hsf)) * blocks_in_mcu;
+                    int block_offset = (x & HMask) + block_yoffset;
+                    s16* mcudata = data + (block_offset + mcu_offset) * 64;
+
+                    state.decode(mcudata, &state);
+                    restart();
+                }
+            }
+        }
+    }
+
+    void Parser::decodeProgressivePipeline()
+    {
+        // Every scan is entropy decoded in bands of MCU rows; a band depends on the
+        // previous band of the same scan (bitstream order) and on the same band of
+        // earlier scans which write into the same coefficients. Scans for different
+        // components or disjoint spectral ranges run concurrently and later scans
+        // follow the earlier ones band by band. The color conversion of a band starts
+        // as soon as all scans have been decoded for it.
+
+        // MCU rows below the region of interest are not decoded
+        const int scans = int(m_scans.size());
+        const int band_size = std::max(1, ymcu / 32);
+        const int bands = (m_region.y1 + band_size - 1) / band_size;
+
+        const size_t mcu_stride = size_t(xmcu) * blocks_in_mcu * 64;
+
+        printLine(Print::Info, "  Pipeline: {} scans, {} bands of {} MCU rows.", scans, bands, band_size);
+
+        TaskGraph graph("jpeg:progressive.pipeline", Priority::High);
+
+        std::vector<TaskGraph::Node> nodes(size_t(scans) * bands);
+
+        for (int s = 0; s < scans; ++s)
+        {
+            ProgressiveScan& scan = m_scans[s];
+
+            for (int b = 0; b < bands; ++b)
+            {
+                const int y0 = b * band_size;
+                const int y1 = std::min(y0 + band_size, m_region.y1);
+
+                TaskGraph::Node node = graph.node([this, &scan, y0, y1]
+                {
+                    decodeProgressiveScan(scan, y0, y1);
                 });
+
+                nodes[s * bands + b] = node;
+
+                if (b > 0)
+                {
+                    graph.edge(nodes[s * bands + b - 1], node);
+                }
+
+                for (int t = 0; t < s; ++t)
+                {
+                    const ProgressiveScan& prev = m_scans[t];
+
+                    bool overlap = (prev.components & scan.components) &&
+                                   prev.spectral_start <= scan.spectral_end &&
+                                   scan.spectral_start <= prev.spectral_end;
+                    if (overlap)
+                    {
+                        graph.edge(nodes[t * bands + b], node);
+                    }
+                }
+            }
+        }
+
+        for (int b = m_region.y0 / band_size; b < bands; ++b)
+        {
+            const int y0 = b * band_size;
+            const int y1 = std::min(y0 + band_size, m_region.y1);
+
+            TaskGraph::Node node = graph.node([this, y0, y1, mcu_stride]
+            {
+                s16* data = blockVector + y0 * mcu_stride;
+                process_range(y0, y1, data);
+            });
+
+            for (int s = 0; s < scans; ++s)
+            {
+                graph.edge(nodes[s * bands + b], node);
             }
         }
+
+        graph.run();
+        graph.wait();
+
+        m_scans.clear();
+    }
+
+    void Parser::finishProgressive()
+    {
+        int n = getTaskSize(ymcu);
+        if (n)
+        {
+            ConcurrentQueue queue("jpeg:progressive.finish", Priority::High, WaitPolicy::Scoped);
+
+            size_t mcu_stride = size_t(xmcu) * blocks_in_mcu * 64;
+
+            printLine(Print::Info, "  Process: [{}, {}] --> ThreadPool.", m_region.y0, m_region.y1 - 1);
+
+            parallelFor(queue, m_region.y0, m_region.y1, 0, [=] (int y0, int y1)
+            {
+                s16* data = blockVector + y0 * mcu_stride;
+                process_range(y0, y1, data);
+            });
+        }
         else
         {
-            s16* data = blockVector;
-            process_range(0, ymcu, data);
+            s16* data = blockVector + m_region.y0 * size_t(xmcu) * blocks_in_mcu * 64;
+            process_range(m_region.y0, m_region.y1, data);
         }
     }
 
@@ -2683,8 +3958,8 @@ namespace mango::image::jpeg
     {
         const size_t stride = m_surface->stride;
         const size_t bytes_per_pixel = m_surface->format.bytes();
-        const size_t xstride = bytes_per_pixel * xblock;
-        const size_t ystride = stride * yblock;
+        const size_t xstride = bytes_per_pixel * xblock_scaled;
+        const size_t ystride = stride * yblock_scaled;
 
         u8* image = m_surface->image;
 
@@ -2693,38 +3968,44 @@ namespace mango::image::jpeg
         const int xmcu_last = xmcu - 1;
         const int ymcu_last = ymcu - 1;
 
-        const int xclip = xsize % xblock;
-        const int yclip = ysize % yblock;
-        const int xblock_last = xclip ? xclip : xblock;
-        const int yblock_last = yclip ? yclip : yblock;
+        const int xclip = xsize_scaled % xblock_scaled;
+        const int yclip = ysize_scaled % yblock_scaled;
+        const int xblock_last = xclip ? xclip : xblock_scaled;
+        const int yblock_last = yclip ? yclip : yblock_scaled;
 
-        for (int y = y0; y < y1; ++y)
+        // MCU rows outside the region of interest are skipped
+        const int ybegin = std::max(y0, m_region.y0);
+        const int yend = std::min(y1, m_region.y1);
+
+        data += (ybegin - y0) * xmcu * mcu_data_size;
+
+        for (int y = ybegin; y < yend; ++y)
         {
-            u8* dest = image + y * ystride;
-            int height = y == ymcu_last ? yblock_last : yblock;
+            u8* dest = image + (y - m_region.y0) * ystride;
+            int height = y == ymcu_last ? yblock_last : yblock_scaled;
+
+            const s16* src = data + m_region.x0 * mcu_data_size;
 
-            for (int x = 0; x < xmcu_last; ++x)
+            for (int x = m_region.x0; x < m_region.x1; ++x)
             {
-                process_and_clip(dest, stride, data, xblock, height);
-                data += mcu_data_size;
+                int width = x == xmcu_last ? xblock_last : xblock_scaled;
+                process_and_clip(dest, stride, src, width, height);
+                src += mcu_data_size;
                 dest += xstride;
             }
 
-            // last column
-            process_and_clip(dest, stride, data, xblock_last, height);
-            data += mcu_data_size;
-            dest += xstride;
+            data += xmcu * mcu_data_size;
         }
     }
 
     void Parser::process_and_clip(u8* dest, size_t stride, const s16* data, int width, int height)
     {
-        if (xblock != width || yblock != height)
+        if (xblock_scaled != width || yblock_scaled != height)
         {
             u8 temp[JPEG_MAX_SAMPLES_IN_MCU * 4];
 
             const int bytes_per_scan = width * m_surface->format.bytes();
-            const int block_stride = xblock * 4;
+            const int block_stride = xblock_scaled * 4;
             u8* src = temp;
 
             processState.process(temp, block_stride, data, &processState, width, height);
@@ -5,6 +5,7 @@
 #include <mango/core/pointer.hpp>
 #include "jpeg.hpp"
 #include <cstring>
+#include <mutex>
 
 namespace
 {
@@ -293,6 +294,317 @@ namespace
         }
     };
 
+    // ----------------------------------------------------------------------------
+    // HuffmanTable
+    // ----------------------------------------------------------------------------
+
+    const u8 g_zigzag_table_inverse [] =
+    {
+         0,  1,  8, 16,  9,  2,  3, 10,
+        17, 24, 32, 25, 18, 11,  4,  5,
+        12, 19, 26, 33, 40, 48, 41, 34,
+        27, 20, 13,  6,  7, 14, 21, 28,
+        35, 42, 49, 56, 57, 50, 43, 36,
+        29, 22, 15, 23, 30, 37, 44, 51,
+        58, 59, 52, 45, 38, 31, 39, 46,
+        53, 60, 61, 54, 47, 55, 62, 63,
+    };
+
+    static inline
+    int symbol_size(int value)
+    {
+        return value ? u32_log2(std::abs(value)) + 1 : 0;
+    }
+
+    struct HuffmanStatistics
+    {
+        // symbol frequencies for luminance and chrominance tables
+        u32 dc[2][256];
+        u32 ac[2][256];
+
+        HuffmanStatistics()
+        {
+            std::memset(this, 0, sizeof(HuffmanStatistics));
+        }
+
+        void add(const HuffmanStatistics& statistics)
+        {
+            for (int i = 0; i < 2; ++i)
+            {
+                for (int j = 0; j < 256; ++j)
+                {
+                    dc[i][j] += statistics.dc[i][j];
+                    ac[i][j] += statistics.ac[i][j];
+                }
+            }
+        }
+    };
+
+    struct HuffmanTable
+    {
+        u8 bits[17];     // number of codes of each length
+        u8 values[256];  // symbols in order of increasing code length
+        int count;       // number of symbols
+
+        u16 code[256];   // code for each symbol
+        u8 size[256];    // code length for each symbol
+
+        void build(const u32* frequency)
+        {
+            // Annex K.2: generate code lengths for the symbol frequencies
+            constexpr int MAX_CODE_SIZE = 64;
+
+            u64 freq[257];
+            int codesize[257];
+            int others[257];
+
+            for (int i = 0; i < 256; ++i)
+            {
+                freq[i] = frequency[i];
+                codesize[i] = 0;
+                others[i] = -1;
+            }
+
+            // reserve one code point so that no code consists of all ones
+            freq[256] = 1;
+            codesize[256] = 0;
+            others[256] = -1;
+
+            for (;;)
+            {
+                // find the two least frequent symbols; ties resolve to the larger value
+                int c1 = -1;
+                u64 v = ~0ull;
+
+                for (int i = 0; i <= 256; ++i)
+                {
+                    if (freq[i] && freq[i] <= v)
+                    {
+                        v = freq[i];
+                        c1 = i;
+                    }
+                }
+
+                int c2 = -1;
+                v = ~0ull;
+
+                for (int i = 0; i <= 256; ++i)
+                {
+                    if (freq[i] && freq[i] <= v && i != c1)
+                    {
+                        v = freq[i];
+                        c2 = i;
+                    }
+                }
+
+                if (c2 < 0)
+                {
+                    // only one tree left
+                    break;
+                }
+
+                // merge the trees
+                freq[c1] += freq[c2];
+                freq[c2] = 0;
+
+                ++codesize[c1];
+                while (others[c1] >= 0)
+                {
+                    c1 = others[c1];
+                    ++codesize[c1];
+                }
+
+                others[c1] = c2;
+
+                ++codesize[c2];
+                while (others[c2] >= 0)
+                {
+                    c2 = others[c2];
+                    ++codesize[c2];
+                }
+            }
+
+            int lengths[MAX_CODE_SIZE + 1] = { 0 };
+
+            for (int i = 0; i <= 256; ++i)
+            {
+                if (codesize[i])
+                {
+                    ++lengths[codesize[i]];
+                }
+            }
+
+            // limit the code lengths to 16 bits
+            for (int i = MAX_CODE_SIZE; i > 16; --i)
+            {
+                while (lengths[i] > 0)
+                {
+                    int j = i - 2;
+                    while (!lengths[j])
+                    {
+                        --j;
+                    }
+
+                    lengths[i] -= 2;
+                    lengths[i - 1]++;
+                    lengths[j + 1] += 2;
+                    lengths[j]--;
+                }
+            }
+
+            // remove the reserved code point from the longest codes
+            int i = 16;
+            while (i > 0 && !lengths[i])
+            {
+                --i;
+            }
+
+            if (i > 0)
+            {
+                lengths[i]--;
+            }
+
+            bits[0] = 0;
+
+            for (int i = 1; i <= 16; ++i)
+            {
+                bits[i] = u8(lengths[i]);
+            }
+
+            // sort the symbols by code length
+            count = 0;
+
+            for (int length = 1; length < MAX_CODE_SIZE; ++length)
+            {
+                for (int symbol = 0; symbol < 256; ++symbol)
+                {
+                    if (codesize[symbol] == length)
+                    {
+                        values[count++] = u8(symbol);
+                    }
+                }
+            }
+
+            // Annex C: generate the codes
+            std::memset(size, 0, sizeof(size));
+
+            u32 current = 0;
+            int index = 0;
+
+            for (int length = 1; length <= 16; ++length)
+            {
+                for (int j = 0; j < bits[length]; ++j)
+                {
+                    u8 symbol = values[index++];
+                    code[symbol] = u16(current++);
+                    size[symbol] = u8(length);
+                }
+
+                current <<= 1;
+            }
+        }
+    };
+
+    struct EncoderTable
+    {
+        // optimized huffman tables in the same layout as the Annex K tables;
+        // the codes are pre-shifted to make room for the coefficient bits
+        alignas(64) u32 ac_code[176];
+        u16 ac_size[176];
+        u32 dc_code[12];
+        u16 dc_size[12];
+
+        void build(const HuffmanTable& dc, const HuffmanTable& ac)
+        {
+            for (int s = 0; s < 12; ++s)
+            {
+                dc_code[s] = u32(dc.code[s]) << s;
+                dc_size[s] = u16(dc.size[s] + s);
+            }
+
+            std::memset(ac_code, 0, sizeof(ac_code));
+            std::memset(ac_size, 0, sizeof(ac_size));
+
+            // end of block and zero run length
+            ac_code[0] = ac.code[0x00];
+            ac_size[0] = ac.size[0x00];
+            ac_code[1] = ac.code[0xf0];
+            ac_size[1] = ac.size[0xf0];
+
+            for (int s = 1; s < 11; ++s)
+            {
+                for (int run = 0; run < 16; ++run)
+                {
+                    int symbol = (run << 4) | s;
+                    int index = s * 16 + run;
+                    ac_code[index] = u32(ac.code[symbol]) << s;
+                    ac_size[index] = u16(ac.size[symbol] + s);
+                }
+            }
+        }
+    };
+
+    // ----------------------------------------------------------------------------
+    // SymbolCounter / SymbolWriter
+    // ----------------------------------------------------------------------------
+
+    // The progressive scans are generated with the same code for both passes;
+    // the first pass counts the symbols and the second pass writes them.
+
+    struct SymbolCounter
+    {
+        u32 (*frequency)[256];
+
+        void put(int table, int symbol, int bits, int nbits)
+        {
+            MANGO_UNREFERENCED(bits);
+            MANGO_UNREFERENCED(nbits);
+            ++frequency[table][symbol];
+        }
+    };
+
+    struct SymbolWriter
+    {
+        static constexpr int buffer_size = 4096;
+        static constexpr int flush_threshold = buffer_size - 1024;
+
+        HuffmanEncoder huffman;
+        const HuffmanTable* tables;
+        Buffer& buffer;
+
+        u8 temp[buffer_size]; // encoding buffer
+        u8* ptr;
+
+        SymbolWriter(Buffer& buffer, const HuffmanTable* tables)
+            : tables(tables)
+            , buffer(buffer)
+            , ptr(temp)
+        {
+        }
+
+        void put(int table, int symbol, int bits, int nbits)
+        {
+            const HuffmanTable& t = tables[table];
+            u32 mask = (1 << nbits) - 1;
+            HuffmanType data = (HuffmanType(t.code[symbol]) << nbits) | (bits & mask);
+            ptr = huffman.putBits(ptr, data, t.size[symbol] + nbits);
+
+            // flush encoding buffer
+            if (ptr - temp > flush_threshold)
+            {
+                buffer.append(temp, ptr - temp);
+                ptr = temp;
+            }
+        }
+
+        void flush()
+        {
+            ptr = huffman.flush(ptr);
+            buffer.append(temp, ptr - temp);
+            ptr = temp;
+        }
+    };
+
     struct jpegEncoder
     {
         Surface m_surface;
@@ -302,6 +614,9 @@ namespace
         int mcu_width;
         int mcu_height;
         int mcu_stride;
+        int bytes_per_pixel;
+        int xsample = 1; // luminance blocks per MCU, horizontal
+        int ysample = 1; // luminance blocks per MCU, vertical
         int horizontal_mcus;
         int vertical_mcus;
         int cols_in_right_mcus;
@@ -325,6 +640,18 @@ namespace
         Channel channel[3];
         int components;
 
+        // channel for each block in the MCU; luminance blocks followed by Cb and Cr
+        const Channel* mcu_channel[6];
+        int blocks_in_mcu;
+
+        // optimized huffman tables
+        HuffmanTable dc_table[2];
+        HuffmanTable ac_table[2];
+        EncoderTable encoder_table[2];
+
+        // quantized coefficients in MCU order; used by the two-pass encoders
+        AlignedStorage<s16> coefficients;
+
         std::string info;
 
         u64 restart_offset = 0;
@@ -336,17 +663,55 @@ namespace
         void (*read)     (s16* block, const u8* input, size_t stride, int rows, int cols);
         void (*fdct)     (s16* dest, const s16* data, const s16* qtable);
         u8*  (*encode)   (HuffmanEncoder& encoder, u8* p, const s16* input, const Channel& channel);
+        void (*downsample) (s16* dest, const s16* src);
 
         jpegEncoder(const Surface& surface, SampleType sample, const ImageEncodeOptions& options);
         ~jpegEncoder();
 
         void writeMarkers(BigEndianStream& p, int interval);
+        void writeHuffmanTable(BigEndianStream& p, int table_class, int index, const HuffmanTable& table);
 
+        void readMCU(s16* block, const u8* input, size_t stride, int rows, int cols, ReadFunc read_func);
         void encodeScan(Buffer& buffer, HuffmanEncoder& huffman, const u8* src, size_t stride, ReadFunc read_func, int rows);
         void encodeInterval(Buffer& buffer, int y0, int y1, int restartCounter, const u8* image, size_t stride);
+
+        void computeCoefficients(int y0, int y1);
+        void gatherStatistics(HuffmanStatistics& statistics, int y0, int y1);
+        void buildTables(const HuffmanStatistics& statistics);
+        void encodeCoefficients(Buffer& buffer, int y0, int y1, int restartCounter);
+
+        void getComponentBlocks(int component, int& xblocks, int& yblocks) const;
+        const s16* getBlock(int component, int x, int y) const;
+
+        template <typename Sink>
+        void scanDC(Sink& sink, int y0, int y1);
+
+        template <typename Sink>
+        void scanAC(Sink& sink, int component, int ss, int se, int y0, int y1);
+
+        template <typename Func>
+        void processIntervals(int count, Func func);
+
+        template <typename Func>
+        void writeIntervals(BigEndianStream& s, int count, Func func);
+
+        void encodeSequential(BigEndianStream& s);
+        void encodeProgressive(BigEndianStream& s);
         ImageEncodeStatus encodeImage(Stream& stream);
     };
 
+    // ----------------------------------------------------------------------------
+    // fdct_copy
+    // ----------------------------------------------------------------------------
+
+    static
+    void fdct_copy(s16* dest, const s16* data, const s16* qtable)
+    {
+        // the data is already transformed and quantized
+        MANGO_UNREFERENCED(qtable);
+        std::memcpy(dest, data, BLOCK_SIZE * sizeof(s16));
+    }
+
     // ----------------------------------------------------------------------------
     // fdct_scalar
     // ----------------------------------------------------------------------------
@@ -1098,18 +1463,6 @@ namespace
 
         p = encode_dc(encoder, p, block[0], channel);
 
-        const u8 zigzag_table_inverse [] =
-        {
-             0,  1,  8, 16,  9,  2,  3, 10,
-            17, 24, 32, 25, 18, 11,  4,  5,
-            12, 19, 26, 33, 40, 48, 41, 34,
-            27, 20, 13,  6,  7, 14, 21, 28,
-            35, 42, 49, 56, 57, 50, 43, 36,
-            29, 22, 15, 23, 30, 37, 44, 51,
-            58, 59, 52, 45, 38, 31, 39, 46,
-            53, 60, 61, 54, 47, 55, 62, 63,
-        };
-
         const u32* ac_code = channel.ac_code;
         const u16* ac_size = channel.ac_size;
         const u32 zero16_code = ac_code[1];
@@ -1119,7 +1472,7 @@ namespace
 
         for (int i = 1; i < 64; ++i)
         {
-            int coeff = block[zigzag_table_inverse[i]];
+            int coeff = block[g_zigzag_table_inverse[i]];
             if (coeff)
             {
                 while (counter > 15)
@@ -1154,6 +1507,47 @@ namespace
         return p;
     }
 
+    // ----------------------------------------------------------------------------
+    // gather_block
+    // ----------------------------------------------------------------------------
+
+    static
+    void gather_block(u32* dc, u32* ac, int& last_dc, const s16* block)
+    {
+        // count the symbols the block encoders emit for quantized coefficients
+        int coeff = block[0] - last_dc;
+        last_dc = block[0];
+        ++dc[symbol_size(coeff)];
+
+        int counter = 0;
+
+        for (int i = 1; i < 64; ++i)
+        {
+            int coeff = block[g_zigzag_table_inverse[i]];
+            if (coeff)
+            {
+                while (counter > 15)
+                {
+                    counter -= 16;
+                    ++ac[0xf0];
+                }
+
+                ++ac[(counter << 4) | symbol_size(coeff)];
+                counter = 0;
+            }
+            else
+            {
+                ++counter;
+            }
+        }
+
+        if (counter)
+        {
+            // end of block
+            ++ac[0x00];
+        }
+    }
+
 #if defined(MANGO_ENABLE_SSE4_1)
 
     // ----------------------------------------------------------------------------
@@ -2204,91 +2598,282 @@ namespace
 
 #endif // MANGO_ENABLE_SSE4_1
 
-#if defined(MANGO_ENABLE_NEON)
+#if defined(MANGO_ENABLE_AVX2)
 
     static
-    void compute_ycbcr(s16* dest, int16x8_t r, int16x8_t g, int16x8_t b)
+    void compute_ycbcr(s16* dest, __m256i r, __m256i g, __m256i b)
     {
-        const int16x8_t c076 = vdupq_n_s16(76);
-        const int16x8_t c151 = vdupq_n_s16(151);
-        const int16x8_t c029 = vdupq_n_s16(29);
-        const int16x8_t c182 = vdupq_n_s16(182);
-        const int16x8_t c144 = vdupq_n_s16(144);
-        const int16x8_t c128 = vdupq_n_s16(128);
+        const __m256i c076 = _mm256_set1_epi16(76);
+        const __m256i c151 = _mm256_set1_epi16(151);
+        const __m256i c029 = _mm256_set1_epi16(29);
+        const __m256i c128 = _mm256_set1_epi16(128);
+        const __m256i c182 = _mm256_set1_epi16(182);
+        const __m256i c144 = _mm256_set1_epi16(144);
 
         // compute luminance
-        int16x8_t s = vmulq_s16(r, c076);
-        s = vmlaq_s16(s, g, c151);
-        s = vmlaq_s16(s, b, c029);
-        s = vreinterpretq_s16_u16(vshrq_n_u16(vreinterpretq_u16_s16(s), 8));
+        __m256i s0 = _mm256_mullo_epi16(r, c076);
+        __m256i s1 = _mm256_mullo_epi16(g, c151);
+        __m256i s2 = _mm256_mullo_epi16(b, c029);
+        __m256i s = _mm256_add_epi16(s0, _mm256_add_epi16(s1, s2));
+        s = _mm256_srli_epi16(s, 8);
 
         // compute chroma
-        int16x8_t cr = vmulq_s16(vsubq_s16(r, s), c182);
-        int16x8_t cb = vmulq_s16(vsubq_s16(b, s), c144);
-        cr = vshrq_n_s16(cr, 8);
-        cb = vshrq_n_s16(cb, 8);
+        __m256i cr = _mm256_sub_epi16(r, s);
+        __m256i cb = _mm256_sub_epi16(b, s);
+        cr = _mm256_mullo_epi16(cr, c182);
+        cb = _mm256_mullo_epi16(cb, c144);
+        cr = _mm256_srai_epi16(cr, 8);
+        cb = _mm256_srai_epi16(cb, 8);
 
         // adjust bias
-        s = vsubq_s16(s, c128);
+        s = _mm256_sub_epi16(s, c128);
 
         // store
-        vst1q_s16(dest +   0, s);
-        vst1q_s16(dest +  64, cb);
-        vst1q_s16(dest + 128, cr);
+        __m256i* ptr = reinterpret_cast<__m256i*>(dest);
+        _mm256_storeu_si256(ptr + 0, s);
+        _mm256_storeu_si256(ptr + 4, cb);
+        _mm256_storeu_si256(ptr + 8, cr);
+    }
+
+    static inline
+    __m256i pack_rows_avx2(__m256i v0, __m256i v1)
+    {
+        // pack 32 bit values from two rows and restore the pixel order
+        __m256i v = _mm256_packs_epi32(v0, v1);
+        return _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 1, 2, 0));
     }
 
     static
-    void read_y_format_neon(s16* block, const u8* input, size_t stride, int rows, int cols)
+    void read_bgra_format_avx2(s16* block, const u8* input, size_t stride, int rows, int cols)
     {
         MANGO_UNREFERENCED(rows);
         MANGO_UNREFERENCED(cols);
 
-        const int16x8_t c128 = vdupq_n_s16(128);
+        const __m256i mask = _mm256_set1_epi32(0xff);
 
-        for (int y = 0; y < 8; ++y)
+        // two rows per iteration
+        for (int y = 0; y < 8; y += 2)
         {
-            uint8x8_t v = vld1_u8(input);
-            int16x8_t s = vreinterpretq_s16_u16(vmovl_u8(v));
-            s = vsubq_s16(s, c128);
-            vst1q_s16(block, s);
+            __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input));
+            __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + stride));
+            __m256i g0 = _mm256_srli_epi32(b0, 8);
+            __m256i r0 = _mm256_srli_epi32(b0, 16);
+            __m256i g1 = _mm256_srli_epi32(b1, 8);
+            __m256i r1 = _mm256_srli_epi32(b1, 16);
+            b0 = _mm256_and_si256(b0, mask);
+            b1 = _mm256_and_si256(b1, mask);
+            g0 = _mm256_and_si256(g0, mask);
+            g1 = _mm256_and_si256(g1, mask);
+            r0 = _mm256_and_si256(r0, mask);
+            r1 = _mm256_and_si256(r1, mask);
+            __m256i b = pack_rows_avx2(b0, b1);
+            __m256i g = pack_rows_avx2(g0, g1);
+            __m256i r = pack_rows_avx2(r0, r1);
 
-            input += stride;
-            block += 8;
+            compute_ycbcr(block, r, g, b);
+
+            block += 16;
+            input += stride * 2;
         }
     }
 
     static
-    void read_bgra_format_neon(s16* block, const u8* input, size_t stride, int rows, int cols)
+    void read_rgba_format_avx2(s16* block, const u8* input, size_t stride, int rows, int cols)
     {
         MANGO_UNREFERENCED(rows);
         MANGO_UNREFERENCED(cols);
 
-        for (int y = 0; y < 8; ++y)
+        const __m256i mask = _mm256_set1_epi32(0xff);
+
+        // two rows per iteration
+        for (int y = 0; y < 8; y += 2)
         {
-            const uint8x8x4_t temp = vld4_u8(input);
-            int16x8_t r = vreinterpretq_s16_u16(vmovl_u8(temp.val[2]));
-            int16x8_t g = vreinterpretq_s16_u16(vmovl_u8(temp.val[1]));
-            int16x8_t b = vreinterpretq_s16_u16(vmovl_u8(temp.val[0]));
+            __m256i r0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input));
+            __m256i r1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + stride));
+            __m256i g0 = _mm256_srli_epi32(r0, 8);
+            __m256i b0 = _mm256_srli_epi32(r0, 16);
+            __m256i g1 = _mm256_srli_epi32(r1, 8);
+            __m256i b1 = _mm256_srli_epi32(r1, 16);
+            b0 = _mm256_and_si256(b0, mask);
+            b1 = _mm256_and_si256(b1, mask);
+            g0 = _mm256_and_si256(g0, mask);
+            g1 = _mm256_and_si256(g1, mask);
+            r0 = _mm256_and_si256(r0, mask);
+            r1 = _mm256_and_si256(r1, mask);
+            __m256i b = pack_rows_avx2(b0, b1);
+            __m256i g = pack_rows_avx2(g0, g1);
+            __m256i r = pack_rows_avx2(r0, r1);
 
             compute_ycbcr(block, r, g, b);
 
-            input += stride;
-            block += 8;
+            block += 16;
+            input += stride * 2;
         }
     }
 
     static
-    void read_rgba_format_neon(s16* block, const u8* input, size_t stride, int rows, int cols)
+    void read_bgr_format_avx2(s16* block, const u8* input, size_t stride, int rows, int cols)
     {
         MANGO_UNREFERENCED(rows);
         MANGO_UNREFERENCED(cols);
 
-        for (int y = 0; y < 8; ++y)
+        constexpr u8 n = 0x80;
+
+        // the shuffle masks are identical for both lanes
+        const __m256i mask_c0 = _mm256_broadcastsi128_si256(_mm_setr_epi8(0, n, 3, n, 6, n, 9, n, 12, n, 15, n, n, n, n, n));
+        const __m256i mask_c1 = _mm256_broadcastsi128_si256(_mm_setr_epi8(1, n, 4, n, 7, n, 10, n, 13, n, n, n, n, n, n, n));
+        const __m256i mask_c2 = _mm256_broadcastsi128_si256(_mm_setr_epi8(2, n, 5, n, 8, n, 11, n, 14, n, n, n, n, n, n, n));
+        const __m256i mask_d0 = _mm256_broadcastsi128_si256(_mm_setr_epi8(n, n, n, n, n, n, n, n, n, n, n, n, 2, n, 5, n));
+        const __m256i mask_d1 = _mm256_broadcastsi128_si256(_mm_setr_epi8(n, n, n, n, n, n, n, n, n, n, 0, n, 3, n, 6, n));
+        const __m256i mask_d2 = _mm256_broadcastsi128_si256(_mm_setr_epi8(n, n, n, n, n, n, n, n, n, n, 1, n, 4, n, 7, n));
+
+        // two rows per iteration; one row in each lane
+        for (int y = 0; y < 8; y += 2)
         {
-            const uint8x8x4_t temp = vld4_u8(input);
-            int16x8_t r = vreinterpretq_s16_u16(vmovl_u8(temp.val[0]));
-            int16x8_t g = vreinterpretq_s16_u16(vmovl_u8(temp.val[1]));
-            int16x8_t b = vreinterpretq_s16_u16(vmovl_u8(temp.val[2]));
+            const __m128i* ptr0 = reinterpret_cast<const __m128i*>(input);
+            const __m128i* ptr1 = reinterpret_cast<const __m128i*>(input + stride);
+
+            // load
+            __m256i v0 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(ptr0 + 0)), _mm_loadu_si128(ptr1 + 0), 1);
+            __m256i v1 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadl_epi64(ptr0 + 1)), _mm_loadl_epi64(ptr1 + 1), 1);
+
+            // unpack
+            __m256i b = _mm256_or_si256(_mm256_shuffle_epi8(v0, mask_c0), _mm256_shuffle_epi8(v1, mask_d0));
+            __m256i g = _mm256_or_si256(_mm256_shuffle_epi8(v0, mask_c1), _mm256_shuffle_epi8(v1, mask_d1));
+            __m256i r = _mm256_or_si256(_mm256_shuffle_epi8(v0, mask_c2), _mm256_shuffle_epi8(v1, mask_d2));
+
+            compute_ycbcr(block, r, g, b);
+
+            block += 16;
+            input += stride * 2;
+        }
+    }
+
+    static
+    void read_rgb_format_avx2(s16* block, const u8* input, size_t stride, int rows, int cols)
+    {
+        MANGO_UNREFERENCED(rows);
+        MANGO_UNREFERENCED(cols);
+
+        constexpr u8 n = 0x80;
+
+        // the shuffle masks are identical for both lanes
+        const __m256i mask_c0 = _mm256_broadcastsi128_si256(_mm_setr_epi8(0, n, 3, n, 6, n, 9, n, 12, n, 15, n, n, n, n, n));
+        const __m256i mask_c1 = _mm256_broadcastsi128_si256(_mm_setr_epi8(1, n, 4, n, 7, n, 10, n, 13, n, n, n, n, n, n, n));
+        const __m256i mask_c2 = _mm256_broadcastsi128_si256(_mm_setr_epi8(2, n, 5, n, 8, n, 11, n, 14, n, n, n, n, n, n, n));
+        const __m256i mask_d0 = _mm256_broadcastsi128_si256(_mm_setr_epi8(n, n, n, n, n, n, n, n, n, n, n, n, 2, n, 5, n));
+        const __m256i mask_d1 = _mm256_broadcastsi128_si256(_mm_setr_epi8(n, n, n, n, n, n, n, n, n, n, 0, n, 3, n, 6, n));
+        const __m256i mask_d2 = _mm256_broadcastsi128_si256(_mm_setr_epi8(n, n, n, n, n, n, n, n, n, n, 1, n, 4, n, 7, n));
+
+        // two rows per iteration; one row in each lane
+        for (int y = 0; y < 8; y += 2)
+        {
+            const __m128i* ptr0 = reinterpret_cast<const __m128i*>(input);
+            const __m128i* ptr1 = reinterpret_cast<const __m128i*>(input + stride);
+
+            // load
+            __m256i v0 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(ptr0 + 0)), _mm_loadu_si128(ptr1 + 0), 1);
+            __m256i v1 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadl_epi64(ptr0 + 1)), _mm_loadl_epi64(ptr1 + 1), 1);
+
+            // unpack
+            __m256i r = _mm256_or_si256(_mm256_shuffle_epi8(v0, mask_c0), _mm256_shuffle_epi8(v1, mask_d0));
+            __m256i g = _mm256_or_si256(_mm256_shuffle_epi8(v0, mask_c1), _mm256_shuffle_epi8(v1, mask_d1));
+            __m256i b = _mm256_or_si256(_mm256_shuffle_epi8(v0, mask_c2), _mm256_shuffle_epi8(v1, mask_d2));
+
+            compute_ycbcr(block, r, g, b);
+
+            block += 16;
+            input += stride * 2;
+        }
+    }
+
+#endif // MANGO_ENABLE_AVX2
+
+#if defined(MANGO_ENABLE_NEON)
+
+    static
+    void compute_ycbcr(s16* dest, int16x8_t r, int16x8_t g, int16x8_t b)
+    {
+        const int16x8_t c076 = vdupq_n_s16(76);
+        const int16x8_t c151 = vdupq_n_s16(151);
+        const int16x8_t c029 = vdupq_n_s16(29);
+        const int16x8_t c182 = vdupq_n_s16(182);
+        const int16x8_t c144 = vdupq_n_s16(144);
+        const int16x8_t c128 = vdupq_n_s16(128);
+
+        // compute luminance
+        int16x8_t s = vmulq_s16(r, c076);
+        s = vmlaq_s16(s, g, c151);
+        s = vmlaq_s16(s, b, c029);
+        s = vreinterpretq_s16_u16(vshrq_n_u16(vreinterpretq_u16_s16(s), 8));
+
+        // compute chroma
+        int16x8_t cr = vmulq_s16(vsubq_s16(r, s), c182);
+        int16x8_t cb = vmulq_s16(vsubq_s16(b, s), c144);
+        cr = vshrq_n_s16(cr, 8);
+        cb = vshrq_n_s16(cb, 8);
+
+        // adjust bias
+        s = vsubq_s16(s, c128);
+
+        // store
+        vst1q_s16(dest +   0, s);
+        vst1q_s16(dest +  64, cb);
+        vst1q_s16(dest + 128, cr);
+    }
+
+    static
+    void read_y_format_neon(s16* block, const u8* input, size_t stride, int rows, int cols)
+    {
+        MANGO_UNREFERENCED(rows);
+        MANGO_UNREFERENCED(cols);
+
+        const int16x8_t c128 = vdupq_n_s16(128);
+
+        for (int y = 0; y < 8; ++y)
+        {
+            uint8x8_t v = vld1_u8(input);
+            int16x8_t s = vreinterpretq_s16_u16(vmovl_u8(v));
+            s = vsubq_s16(s, c128);
+            vst1q_s16(block, s);
+
+            input += stride;
+            block += 8;
+        }
+    }
+
+    static
+    void read_bgra_format_neon(s16* block, const u8* input, size_t stride, int rows, int cols)
+    {
+        MANGO_UNREFERENCED(rows);
+        MANGO_UNREFERENCED(cols);
+
+        for (int y = 0; y < 8; ++y)
+        {
+            const uint8x8x4_t temp = vld4_u8(input);
+            int16x8_t r = vreinterpretq_s16_u16(vmovl_u8(temp.val[2]));
+            int16x8_t g = vreinterpretq_s16_u16(vmovl_u8(temp.val[1]));
+            int16x8_t b = vreinterpretq_s16_u16(vmovl_u8(temp.val[0]));
+
+            compute_ycbcr(block, r, g, b);
+
+            input += stride;
+            block += 8;
+        }
+    }
+
+    static
+    void read_rgba_format_neon(s16* block, const u8* input, size_t stride, int rows, int cols)
+    {
+        MANGO_UNREFERENCED(rows);
+        MANGO_UNREFERENCED(cols);
+
+        for (int y = 0; y < 8; ++y)
+        {
+            const uint8x8x4_t temp = vld4_u8(input);
+            int16x8_t r = vreinterpretq_s16_u16(vmovl_u8(temp.val[0]));
+            int16x8_t g = vreinterpretq_s16_u16(vmovl_u8(temp.val[1]));
+            int16x8_t b = vreinterpretq_s16_u16(vmovl_u8(temp.val[2]));
 
             compute_ycbcr(block, r, g, b);
 
@@ -2337,6 +2922,142 @@ namespace
         }
     }
 
+#endif // MANGO_ENABLE_NEON
+
+    // ----------------------------------------------------------------------------
+    // downsample_xxx
+    // ----------------------------------------------------------------------------
+
+    // Box filter one full resolution 8x8 chroma block into its part of the
+    // subsampled block; the destination stride is 8 samples.
+
+    static
+    void downsample_h2v1(s16* dest, const s16* src)
+    {
+        // 8x8 -> 4x8
+        for (int y = 0; y < 8; ++y)
+        {
+            for (int x = 0; x < 4; ++x)
+            {
+                dest[x] = s16((src[x * 2 + 0] + src[x * 2 + 1] + 1) >> 1);
+            }
+
+            src += 8;
+            dest += 8;
+        }
+    }
+
+    static
+    void downsample_h2v2(s16* dest, const s16* src)
+    {
+        // 8x8 -> 4x4
+        for (int y = 0; y < 4; ++y)
+        {
+            for (int x = 0; x < 4; ++x)
+            {
+                int s = src[x * 2 + 0] + src[x * 2 + 1] + src[x * 2 + 8] + src[x * 2 + 9];
+                dest[x] = s16((s + 2) >> 2);
+            }
+
+            src += 16;
+            dest += 8;
+        }
+    }
+
+#if defined(MANGO_ENABLE_SSE2)
+
+    static
+    void downsample_h2v1_sse2(s16* dest, const s16* src)
+    {
+        const __m128i one = _mm_set1_epi16(1);
+        const __m128i bias = _mm_set1_epi32(1);
+
+        for (int y = 0; y < 8; y += 2)
+        {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 0));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 8));
+
+            // horizontal pairs
+            a = _mm_madd_epi16(a, one);
+            b = _mm_madd_epi16(b, one);
+            a = _mm_srai_epi32(_mm_add_epi32(a, bias), 1);
+            b = _mm_srai_epi32(_mm_add_epi32(b, bias), 1);
+            __m128i v = _mm_packs_epi32(a, b);
+
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dest + 0), v);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dest + 8), _mm_unpackhi_epi64(v, v));
+
+            src += 16;
+            dest += 16;
+        }
+    }
+
+    static
+    void downsample_h2v2_sse2(s16* dest, const s16* src)
+    {
+        const __m128i one = _mm_set1_epi16(1);
+        const __m128i bias = _mm_set1_epi32(2);
+
+        for (int y = 0; y < 4; y += 2)
+        {
+            const __m128i* ptr = reinterpret_cast<const __m128i*>(src);
+
+            // vertical pairs
+            __m128i a = _mm_add_epi16(_mm_loadu_si128(ptr + 0), _mm_loadu_si128(ptr + 1));
+            __m128i b = _mm_add_epi16(_mm_loadu_si128(ptr + 2), _mm_loadu_si128(ptr + 3));
+
+            // horizontal pairs
+            a = _mm_madd_epi16(a, one);
+            b = _mm_madd_epi16(b, one);
+            a = _mm_srai_epi32(_mm_add_epi32(a, bias), 2);
+            b = _mm_srai_epi32(_mm_add_epi32(b, bias), 2);
+            __m128i v = _mm_packs_epi32(a, b);
+
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dest + 0), v);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dest + 8), _mm_unpackhi_epi64(v, v));
+
+            src += 32;
+            dest += 16;
+        }
+    }
+
+#endif // MANGO_ENABLE_SSE2
+
+#if defined(MANGO_ENABLE_NEON)
+
+    static
+    void downsample_h2v1_neon(s16* dest, const s16* src)
+    {
+        for (int y = 0; y < 8; ++y)
+        {
+            int16x8_t a = vld1q_s16(src);
+
+            // horizontal pairs
+            int32x4_t s = vpaddlq_s16(a);
+            vst1_s16(dest, vrshrn_n_s32(s, 1));
+
+            src += 8;
+            dest += 8;
+        }
+    }
+
+    static
+    void downsample_h2v2_neon(s16* dest, const s16* src)
+    {
+        for (int y = 0; y < 4; ++y)
+        {
+            int16x8_t a = vld1q_s16(src + 0);
+            int16x8_t b = vld1q_s16(src + 8);
+
+            // vertical and horizontal pairs
+            int32x4_t s = vpaddlq_s16(vaddq_s16(a, b));
+            vst1_s16(dest, vrshrn_n_s32(s, 2));
+
+            src += 16;
+            dest += 8;
+        }
+    }
+
 #endif // MANGO_ENABLE_NEON
 
     // ----------------------------------------------------------------------------
@@ -2373,7 +3094,7 @@ namespace
         channel[2].ac_code = g_chrominance_ac_code_table;
         channel[2].ac_size = g_chrominance_ac_size_table;
 
-        int bytes_per_pixel = 0;
+        bytes_per_pixel = 0;
         read_8x8 = nullptr;
 
         u64 flags = options.simd ? getCPUFlags() : 0;
@@ -2413,6 +3134,13 @@ namespace
                     sampler_name = "BGR 8x8 SSSE3";
                 }
 #endif
+#if defined(MANGO_ENABLE_AVX2)
+                if (flags & INTEL_AVX2)
+                {
+                    read_8x8 = read_bgr_format_avx2;
+                    sampler_name = "BGR 8x8 AVX2";
+                }
+#endif
 #if defined(MANGO_ENABLE_NEON)
                 if (flags & ARM_NEON)
                 {
@@ -2433,6 +3161,13 @@ namespace
                     sampler_name = "RGB 8x8 SSSE3";
                 }
 #endif
+#if defined(MANGO_ENABLE_AVX2)
+                if (flags & INTEL_AVX2)
+                {
+                    read_8x8 = read_rgb_format_avx2;
+                    sampler_name = "RGB 8x8 AVX2";
+                }
+#endif
 #if defined(MANGO_ENABLE_NEON)
                 if (flags & ARM_NEON)
                 {
@@ -2453,6 +3188,13 @@ namespace
                     sampler_name = "BGRA 8x8 SSE2";
                 }
 #endif
+#if defined(MANGO_ENABLE_AVX2)
+                if (flags & INTEL_AVX2)
+                {
+                    read_8x8 = read_bgra_format_avx2;
+                    sampler_name = "BGRA 8x8 AVX2";
+                }
+#endif
 #if defined(MANGO_ENABLE_NEON)
                 if (flags & ARM_NEON)
                 {
@@ -2473,6 +3215,13 @@ namespace
                     sampler_name = "RGBA 8x8 SSE2";
                 }
 #endif
+#if defined(MANGO_ENABLE_AVX2)
+                if (flags & INTEL_AVX2)
+                {
+                    read_8x8 = read_rgba_format_avx2;
+                    sampler_name = "RGBA 8x8 AVX2";
+                }
+#endif
 #if defined(MANGO_ENABLE_NEON)
                 if (flags & ARM_NEON)
                 {
@@ -2558,11 +3307,77 @@ namespace
         info += ", Encoder: ";
         info += encode_name;
 
-        mcu_width = 8;
-        mcu_height = 8;
+        // select chroma subsampling
+
+        const char* sampling_name = "4:4:4";
+
+        if (components == 3)
+        {
+            switch (options.subsampling)
+            {
+                case ImageEncodeOptions::S444:
+                    break;
+
+                case ImageEncodeOptions::S422:
+                    xsample = 2;
+                    ysample = 1;
+                    sampling_name = "4:2:2";
+                    break;
+
+                case ImageEncodeOptions::S420:
+                    xsample = 2;
+                    ysample = 2;
+                    sampling_name = "4:2:0";
+                    break;
+            }
+        }
+
+        downsample = ysample == 2 ? downsample_h2v2 : downsample_h2v1;
+
+#if defined(MANGO_ENABLE_SSE2)
+        if (flags & INTEL_SSE2)
+        {
+            downsample = ysample == 2 ? downsample_h2v2_sse2 : downsample_h2v1_sse2;
+        }
+#endif
+
+#if defined(MANGO_ENABLE_NEON)
+        if (flags & ARM_NEON)
+        {
+            downsample = ysample == 2 ? downsample_h2v2_neon : downsample_h2v1_neon;
+        }
+#endif
+
+        // luminance blocks are followed by one block for each chroma channel
+        blocks_in_mcu = 0;
+
+        for (int i = 0; i < xsample * ysample; ++i)
+        {
+            mcu_channel[blocks_in_mcu++] = &channel[0];
+        }
+
+        for (int i = 1; i < components; ++i)
+        {
+            mcu_channel[blocks_in_mcu++] = &channel[i];
+        }
+
+        info += ", Sampling: ";
+        info += sampling_name;
+
+        if (options.progressive)
+        {
+            info += ", Progressive";
+        }
+        else if (options.optimize)
+        {
+            info += ", Huffman: Optimized";
+        }
+
+        mcu_width = 8 * xsample;
+        mcu_height = 8 * ysample;
 
-        horizontal_mcus = (m_surface.width + mcu_width - 1) >> 3;
-        vertical_mcus   = (m_surface.height + mcu_height - 1) >> 3;
+        horizontal_mcus = (m_surface.width + mcu_width - 1) / mcu_width;
+        vertical_mcus   = (m_surface.height + mcu_height - 1) / mcu_height;
 
         rows_in_bottom_mcus = m_surface.height - (vertical_mcus - 1) * mcu_height;
         cols_in_right_mcus  = m_surface.width  - (horizontal_mcus - 1) * mcu_width;
@@ -2632,23 +3447,26 @@ namespace
             }
         }
 
-        // MANGO marker
-        const u8 magic_mango [] = { 0x4d, 0x61, 0x6e, 0x67, 0x6f, 0x31 }; // 'Mango1'
-        const u32 magic_mango_size = sizeof(magic_mango);
+        if (!m_options.progressive)
+        {
+            // MANGO marker
+            const u8 magic_mango [] = { 0x4d, 0x61, 0x6e, 0x67, 0x6f, 0x31 }; // 'Mango1'
+            const u32 magic_mango_size = sizeof(magic_mango);
 
-        int intervals = div_ceil(vertical_mcus, interval);
+            int intervals = div_ceil(vertical_mcus, interval);
 
-        p.write16(MARKER_APP14);
-        p.write16(u16(6 + magic_mango_size + intervals * sizeof(u32)));
-        p.write(magic_mango, magic_mango_size);
-        p.write32(interval);
+            p.write16(MARKER_APP14);
+            p.write16(u16(6 + magic_mango_size + intervals * sizeof(u32)));
+            p.write(magic_mango, magic_mango_size);
+            p.write32(interval);
 
-        restart_offset = p.offset();
+            restart_offset = p.offset();
 
-        for (int i = 0; i < intervals; ++i)
-        {
-            // reserve space for restart offsets
-            p.write32(0);
+            for (int i = 0; i < intervals; ++i)
+            {
+                // reserve space for restart offsets
+                p.write32(0);
+            }
         }
 
         // Quantization table marker
@@ -2668,7 +3486,7 @@ namespace
         p.write(chrominance_qtable, 64);
 
         // Start of frame marker
-        p.write16(MARKER_SOF0);
+        p.write16(m_options.progressive ? MARKER_SOF2 : MARKER_SOF0);
 
         u8 number_of_components = 0;
 
@@ -2694,19 +3512,38 @@ namespace
         p.write16(u16(m_surface.width)); // image width
         p.write8(number_of_components); // Nf
 
+        const u8 luminance_sampling = u8((xsample << 4) | ysample);
+
         const u8 nfdata[] =
         {
             0x01, 0x11, 0x00, // component 1
             0x00, 0x00, 0x00, // padding
-            0x01, 0x11, 0x00, // component 1
+            0x01, luminance_sampling, 0x00, // component 1
             0x02, 0x11, 0x01, // component 2
             0x03, 0x11, 0x01, // component 3
         };
 
         p.write(nfdata + (number_of_components - 1) * 3, number_of_components * 3);
 
+        if (m_options.progressive)
+        {
+            // huffman tables and scan headers are written with each scan
+            return;
+        }
+
         // huffman table (DHT)
-        p.write(g_marker_data, sizeof(g_marker_data));
+        if (m_options.optimize)
+        {
+            for (int i = 0; i < std::min(components, 2); ++i)
+            {
+                writeHuffmanTable(p, 0, i, dc_table[i]);
+                writeHuffmanTable(p, 1, i, ac_table[i]);
+            }
+        }
+        else
+        {
+            p.write(g_marker_data, sizeof(g_marker_data));
+        }
 
         // Define Restart Interval (DRI)
         p.write16(MARKER_DRI);
@@ -2731,36 +3568,94 @@ namespace
         p.write8(0x00);
     }
 
-    void jpegEncoder::encodeScan(Buffer& buffer, HuffmanEncoder& huffman, const u8* image, size_t stride, ReadFunc read_func, int rows)
+    void jpegEncoder::readMCU(s16* block, const u8* input, size_t stride, int rows, int cols, ReadFunc read_func)
     {
-        const int right_mcu = horizontal_mcus - 1;
-
-        constexpr int buffer_size = 4096;
-        constexpr int flush_threshold = buffer_size - 1024;
-
-        u8 temp[buffer_size]; // encoding buffer
-        u8* ptr = temp;
+        if (xsample == 1 && ysample == 1)
+        {
+            read_func(block, input, stride, rows, cols);
+            return;
+        }
 
-        int cols = mcu_width;
-        auto reader = read_func;
+        const int luminance_blocks = xsample * ysample;
+        s16* chroma = block + luminance_blocks * BLOCK_SIZE;
 
-        for (int x = 0; x < horizontal_mcus; ++x)
+        for (int qy = 0; qy < ysample; ++qy)
         {
-            if (x >= right_mcu)
+            for (int qx = 0; qx < xsample; ++qx)
             {
-                // horizontal clipping
+                int r = rows - qy * 8;
+                int c = cols - qx * 8;
+
+                const u8* src = input + qy * 8 * stride + qx * 8 * bytes_per_pixel;
+                ReadFunc reader = read_func;
+
+                if (r < 8 || c < 8)
+                {
+                    // the block is clipped by image edge
+                    reader = read;
+
+                    if (r <= 0)
+                    {
+                        // the block is outside the image; replicate the last row
+                        src = input + (rows - 1) * stride + qx * 8 * bytes_per_pixel;
+                        r = 1;
+                    }
+
+                    if (c <= 0)
+                    {
+                        // the block is outside the image; replicate the last column
+                        src = src - qx * 8 * bytes_per_pixel + (cols - 1) * bytes_per_pixel;
+                        c = 1;
+                    }
+                }
+
+                r = std::min(r, 8);
+                c = std::min(c, 8);
+
+                s16 temp[BLOCK_SIZE * 3];
+                reader(temp, src, stride, r, c);
+
+                // luminance is stored at full resolution
+                std::memcpy(block + (qy * xsample + qx) * BLOCK_SIZE, temp, BLOCK_SIZE * sizeof(s16));
+
+                // chroma is box filtered into its quadrant of the subsampled block
+                s16* dest = chroma + qy * 32 + qx * 4;
+                downsample(dest + 0 * BLOCK_SIZE, temp + 1 * BLOCK_SIZE);
+                downsample(dest + 1 * BLOCK_SIZE, temp + 2 * BLOCK_SIZE);
+            }
+        }
+    }
+
+    void jpegEncoder::encodeScan(Buffer& buffer, HuffmanEncoder& huffman, const u8* image, size_t stride, ReadFunc read_func, int rows)
+    {
+        const int right_mcu = horizontal_mcus - 1;
+
+        constexpr int buffer_size = 4096;
+        constexpr int flush_threshold = buffer_size - 1024;
+
+        u8 temp[buffer_size]; // encoding buffer
+        u8* ptr = temp;
+
+        int cols = mcu_width;
+        auto reader = read_func;
+
+        for (int x = 0; x < horizontal_mcus; ++x)
+        {
+            if (x >= right_mcu)
+            {
+                // horizontal clipping
                 cols = cols_in_right_mcus;
                 reader = read; // clipping reader
             }
 
             // read MCU data
-            s16 block[BLOCK_SIZE * 3];
-            reader(block, image, stride, rows, cols);
+            s16 block[BLOCK_SIZE * 6];
+            readMCU(block, image, stride, rows, cols, reader);
 
             // encode the data in MCU
-            for (int i = 0; i < components; ++i)
+            for (int i = 0; i < blocks_in_mcu; ++i)
             {
-                ptr = encode(huffman, ptr, block + i * BLOCK_SIZE, channel[i]);
+                ptr = encode(huffman, ptr, block + i * BLOCK_SIZE, *mcu_channel[i]);
             }
 
             // flush encoding buffer
@@ -2808,33 +3703,311 @@ namespace
         p.write16(MARKER_RST0 + (restartCounter & 7));
     }
 
-    ImageEncodeStatus jpegEncoder::encodeImage(Stream& stream)
+    void jpegEncoder::writeHuffmanTable(BigEndianStream& p, int table_class, int index, const HuffmanTable& table)
     {
-        const u8* image = m_surface.image;
-        size_t stride = m_surface.stride;
+        p.write16(MARKER_DHT);
+        p.write16(u16(2 + 1 + 16 + table.count));
+        p.write8(u8((table_class << 4) | index)); // Tc, Th
+        p.write(table.bits + 1, 16);
+        p.write(table.values, table.count);
+    }
 
-        BigEndianStream s(stream);
+    void jpegEncoder::computeCoefficients(int y0, int y1)
+    {
+        const size_t stride = m_surface.stride;
+        const int right_mcu = horizontal_mcus - 1;
 
-        // encode MCUs
-        int N = 1; // number of MCU scans per restart interval
-        int restartCounter = 0;
+        s16* dest = coefficients + size_t(y0) * horizontal_mcus * blocks_in_mcu * BLOCK_SIZE;
 
-        // writing marker data
-        writeMarkers(s, N);
+        for (int y = y0; y < y1; ++y)
+        {
+            const u8* image = m_surface.image + size_t(y) * mcu_height * stride;
+
+            int rows = mcu_height;
+            auto read_func = read_8x8; // default: optimized 8x8 reader
+
+            if (y >= vertical_mcus - 1)
+            {
+                // vertical clipping
+                rows = rows_in_bottom_mcus;
+                read_func = read; // clipping reader
+            }
+
+            int cols = mcu_width;
+            auto reader = read_func;
+
+            for (int x = 0; x < horizontal_mcus; ++x)
+            {
+                if (x >= right_mcu)
+                {
+                    // horizontal clipping
+                    cols = cols_in_right_mcus;
+                    reader = read; // clipping reader
+                }
+
+                s16 block[BLOCK_SIZE * 6];
+                readMCU(block, image, stride, rows, cols, reader);
+
+                for (int i = 0; i < blocks_in_mcu; ++i)
+                {
+                    fdct(dest, block + i * BLOCK_SIZE, mcu_channel[i]->qtable);
+                    dest += BLOCK_SIZE;
+                }
+
+                image += mcu_stride;
+            }
+        }
+    }
+
+    void jpegEncoder::gatherStatistics(HuffmanStatistics& statistics, int y0, int y1)
+    {
+        const s16* block = coefficients + size_t(y0) * horizontal_mcus * blocks_in_mcu * BLOCK_SIZE;
+        const int mcus = (y1 - y0) * horizontal_mcus;
+
+        // every interval starts with a fresh DC predictor
+        int last_dc[3] = { 0, 0, 0 };
+
+        for (int i = 0; i < mcus; ++i)
+        {
+            for (int j = 0; j < blocks_in_mcu; ++j)
+            {
+                int component = mcu_channel[j]->component;
+                int table = component ? 1 : 0;
+                gather_block(statistics.dc[table], statistics.ac[table], last_dc[component], block);
+                block += BLOCK_SIZE;
+            }
+        }
+    }
+
+    void jpegEncoder::buildTables(const HuffmanStatistics& statistics)
+    {
+        for (int i = 0; i < std::min(components, 2); ++i)
+        {
+            dc_table[i].build(statistics.dc[i]);
+            ac_table[i].build(statistics.ac[i]);
+            encoder_table[i].build(dc_table[i], ac_table[i]);
+        }
+
+        for (int i = 0; i < components; ++i)
+        {
+            const EncoderTable& table = encoder_table[i ? 1 : 0];
+            channel[i].dc_code = table.dc_code;
+            channel[i].dc_size = table.dc_size;
+            channel[i].ac_code = table.ac_code;
+            channel[i].ac_size = table.ac_size;
+        }
+    }
+
+    void jpegEncoder::encodeCoefficients(Buffer& buffer, int y0, int y1, int restartCounter)
+    {
+        HuffmanEncoder huffman;
+        huffman.fdct = fdct_copy;
+
+        constexpr int buffer_size = 4096;
+        constexpr int flush_threshold = buffer_size - 1024;
+
+        u8 temp[buffer_size]; // encoding buffer
+        u8* ptr = temp;
+
+        const s16* block = coefficients + size_t(y0) * horizontal_mcus * blocks_in_mcu * BLOCK_SIZE;
+        const int mcus = (y1 - y0) * horizontal_mcus;
+
+        for (int i = 0; i < mcus; ++i)
+        {
+            // encode the data in MCU
+            for (int j = 0; j < blocks_in_mcu; ++j)
+            {
+                ptr = encode(huffman, ptr, block, *mcu_channel[j]);
+                block += BLOCK_SIZE;
+            }
+
+            // flush encoding buffer
+            if (ptr - temp > flush_threshold)
+            {
+                buffer.append(temp, ptr - temp);
+                ptr = temp;
+            }
+        }
+
+        // flush huffman encoder
+        ptr = huffman.flush(ptr);
+        buffer.append(temp, ptr - temp);
+
+        // write restart marker
+        BigEndianPointer p = buffer.append(2);
+        p.write16(MARKER_RST0 + (restartCounter & 7));
+    }
+
+    void jpegEncoder::getComponentBlocks(int component, int& xblocks, int& yblocks) const
+    {
+        if (component)
+        {
+            // chroma has one block in each MCU
+            xblocks = horizontal_mcus;
+            yblocks = vertical_mcus;
+        }
+        else
+        {
+            // luminance blocks which are completely outside the image are not coded
+            xblocks = div_ceil(m_surface.width, 8);
+            yblocks = div_ceil(m_surface.height, 8);
+        }
+    }
+
+    const s16* jpegEncoder::getBlock(int component, int x, int y) const
+    {
+        int mcu;
+        int index;
+
+        if (component)
+        {
+            mcu = y * horizontal_mcus + x;
+            index = xsample * ysample + component - 1;
+        }
+        else
+        {
+            mcu = (y / ysample) * horizontal_mcus + x / xsample;
+            index = (y % ysample) * xsample + x % xsample;
+        }
+
+        return coefficients + (size_t(mcu) * blocks_in_mcu + index) * BLOCK_SIZE;
+    }
+
+    template <typename Sink>
+    void jpegEncoder::scanDC(Sink& sink, int y0, int y1)
+    {
+        const s16* block = coefficients + size_t(y0) * horizontal_mcus * blocks_in_mcu * BLOCK_SIZE;
+        const int mcus = (y1 - y0) * horizontal_mcus;
+
+        int last_dc[3] = { 0, 0, 0 };
+
+        for (int i = 0; i < mcus; ++i)
+        {
+            for (int j = 0; j < blocks_in_mcu; ++j)
+            {
+                int component = mcu_channel[j]->component;
+
+                int coeff = block[0] - last_dc[component];
+                last_dc[component] = block[0];
+
+                int size = symbol_size(coeff);
+                sink.put(component ? 1 : 0, size, coeff - (coeff < 0), size);
+
+                block += BLOCK_SIZE;
+            }
+        }
+    }
+
+    template <typename Sink>
+    void jpegEncoder::scanAC(Sink& sink, int component, int ss, int se, int y0, int y1)
+    {
+        const int table = component ? 1 : 0;
+
+        int xblocks;
+        int yblocks;
+        getComponentBlocks(component, xblocks, yblocks);
+
+        // number of consecutive blocks without coefficients left in the band
+        int eobrun = 0;
 
+        auto flushEOB = [&]
+        {
+            int size = u32_log2(eobrun);
+            sink.put(table, size << 4, eobrun, size);
+            eobrun = 0;
+        };
+
+        for (int y = y0; y < y1; ++y)
+        {
+            for (int x = 0; x < xblocks; ++x)
+            {
+                const s16* block = getBlock(component, x, y);
+
+                int counter = 0;
+
+                for (int i = ss; i <= se; ++i)
+                {
+                    int coeff = block[g_zigzag_table_inverse[i]];
+                    if (!coeff)
+                    {
+                        ++counter;
+                        continue;
+                    }
+
+                    if (eobrun)
+                    {
+                        flushEOB();
+                    }
+
+                    while (counter > 15)
+                    {
+                        counter -= 16;
+                        sink.put(table, 0xf0, 0, 0);
+                    }
+
+                    int size = symbol_size(coeff);
+                    sink.put(table, (counter << 4) | size, coeff - (coeff < 0), size);
+                    counter = 0;
+                }
+
+                if (counter)
+                {
+                    if (++eobrun == 0x7fff)
+                    {
+                        flushEOB();
+                    }
+                }
+            }
+        }
+
+        if (eobrun)
+        {
+            flushEOB();
+        }
+    }
+
+    template <typename Func>
+    void jpegEncoder::processIntervals(int count, Func func)
+    {
+        if (m_options.multithread)
+        {
+            ConcurrentQueue queue;
+
+            for (int i = 0; i < count; ++i)
+            {
+                queue.enqueue([func, i]
+                {
+                    func(i);
+                });
+            }
+
+            queue.wait();
+        }
+        else
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                func(i);
+            }
+        }
+    }
+
+    template <typename Func>
+    void jpegEncoder::writeIntervals(BigEndianStream& s, int count, Func func)
+    {
         if (m_options.multithread)
         {
             ConcurrentQueue queue;
             TicketQueue tk;
 
-            for (int y = 0; y < vertical_mcus; y += N)
+            for (int i = 0; i < count; ++i)
             {
                 auto ticket = tk.acquire();
 
-                queue.enqueue([this, &s, ticket, N, y, restartCounter, image, stride]
+                queue.enqueue([this, &s, ticket, func, i]
                 {
                     Buffer buffer;
-                    encodeInterval(buffer, y, std::min(vertical_mcus, y + N), restartCounter, image, stride);
+                    func(buffer, i);
 
                     Memory memory = buffer.acquire();
 
@@ -2850,9 +4023,6 @@ namespace
                         restart_offsets.push_back(offset);
                     });
                 });
-
-                ++restartCounter;
-                image += stride * mcu_height * N;
             }
 
             // wait until all work has been submitted
@@ -2863,10 +4033,10 @@ namespace
         }
         else
         {
-            for (int y = 0; y < vertical_mcus; y += N)
+            for (int i = 0; i < count; ++i)
             {
                 Buffer buffer;
-                encodeInterval(buffer, y, std::min(vertical_mcus, y + N), restartCounter, image, stride);
+                func(buffer, i);
 
                 // write encoded data
                 s.write(buffer);
@@ -2874,11 +4044,62 @@ namespace
                 // store offset
                 u64 offset = s.offset();
                 restart_offsets.push_back(offset);
-
-                ++restartCounter;
-                image += stride * mcu_height * N;
             }
         }
+    }
+
+    void jpegEncoder::encodeSequential(BigEndianStream& s)
+    {
+        const u8* image = m_surface.image;
+        size_t stride = m_surface.stride;
+
+        // encode MCUs
+        int N = 1; // number of MCU scans per restart interval
+        int intervals = div_ceil(vertical_mcus, N);
+
+        if (m_options.optimize)
+        {
+            // first pass: transform the image and gather symbol statistics for each interval
+            coefficients.resize(size_t(vertical_mcus) * horizontal_mcus * blocks_in_mcu * BLOCK_SIZE);
+
+            HuffmanStatistics statistics;
+            std::mutex mutex;
+
+            processIntervals(intervals, [this, &statistics, &mutex, N] (int i)
+            {
+                int y0 = i * N;
+                int y1 = std::min(vertical_mcus, y0 + N);
+
+                computeCoefficients(y0, y1);
+
+                HuffmanStatistics local;
+                gatherStatistics(local, y0, y1);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                statistics.add(local);
+            });
+
+            buildTables(statistics);
+        }
+
+        // writing marker data
+        writeMarkers(s, N);
+
+        writeIntervals(s, intervals, [this, image, stride, N] (Buffer& buffer, int i)
+        {
+            int y0 = i * N;
+            int y1 = std::min(vertical_mcus, y0 + N);
+
+            if (m_options.optimize)
+            {
+                // second pass: encode the stored coefficients with the optimized tables
+                encodeCoefficients(buffer, y0, y1, i);
+            }
+            else
+            {
+                encodeInterval(buffer, y0, y1, i, image + stride * mcu_height * y0, stride);
+            }
+        });
 
         // EOI marker
         s.write16(MARKER_EOI);
@@ -2890,6 +4111,172 @@ namespace
         {
             s.write32(offset);
         }
+    }
+
+    void jpegEncoder::encodeProgressive(BigEndianStream& s)
+    {
+        int N = 1; // number of MCU scans per restart interval
+
+        writeMarkers(s, N);
+
+        // transform the image
+        coefficients.resize(size_t(vertical_mcus) * horizontal_mcus * blocks_in_mcu * BLOCK_SIZE);
+
+        processIntervals(div_ceil(vertical_mcus, N), [this, N] (int i)
+        {
+            computeCoefficients(i * N, std::min(vertical_mcus, i * N + N));
+        });
+
+        struct Scan
+        {
+            int component; // -1: DC coefficients of all components
+            int ss;
+            int se;
+        };
+
+        // spectral selection; the DC and low frequency luminance scans
+        // give a usable preview before the rest of the data arrives
+        const Scan scans [] =
+        {
+            { -1, 0,  0 },
+            {  0, 1,  5 },
+            {  1, 1, 63 },
+            {  2, 1, 63 },
+            {  0, 6, 63 },
+        };
+
+        for (const Scan& scan : scans)
+        {
+            if (scan.component >= components)
+            {
+                continue;
+            }
+
+            const bool dc = scan.component < 0;
+
+            int rows;
+            int rows_in_interval;
+            int restart_interval;
+
+            if (dc)
+            {
+                rows = vertical_mcus;
+                rows_in_interval = N;
+                restart_interval = horizontal_mcus * N;
+            }
+            else
+            {
+                // non-interleaved scans count restart intervals in blocks
+                int xblocks;
+                getComponentBlocks(scan.component, xblocks, rows);
+                rows_in_interval = scan.component ? N : N * ysample;
+                restart_interval = xblocks * rows_in_interval;
+            }
+
+            const int intervals = div_ceil(rows, rows_in_interval);
+
+            // first pass: gather symbol statistics for each interval
+            HuffmanStatistics statistics;
+            std::mutex mutex;
+
+            processIntervals(intervals, [&] (int i)
+            {
+                int y0 = i * rows_in_interval;
+                int y1 = std::min(rows, y0 + rows_in_interval);
+
+                HuffmanStatistics local;
+                SymbolCounter counter { dc ? local.dc : local.ac };
+
+                if (dc)
+                    scanDC(counter, y0, y1);
+                else
+                    scanAC(counter, scan.component, scan.ss, scan.se, y0, y1);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                statistics.add(local);
+            });
+
+            // huffman tables (DHT)
+            HuffmanTable tables[2];
+
+            if (dc)
+            {
+                for (int i = 0; i < std::min(components, 2); ++i)
+                {
+                    tables[i].build(statistics.dc[i]);
+                    writeHuffmanTable(s, 0, i, tables[i]);
+                }
+            }
+            else
+            {
+                int i = scan.component ? 1 : 0;
+                tables[i].build(statistics.ac[i]);
+                writeHuffmanTable(s, 1, i, tables[i]);
+            }
+
+            // Define Restart Interval (DRI)
+            s.write16(MARKER_DRI);
+            s.write16(4);
+            s.write16(u16(restart_interval));
+
+            // Start of scan marker
+            int count = dc ? components : 1;
+
+            s.write16(MARKER_SOS);
+            s.write16(u16(6 + count * 2)); // header length
+            s.write8(u8(count)); // Ns
+
+            for (int i = 0; i < count; ++i)
+            {
+                int component = dc ? i : scan.component;
+                s.write8(u8(component + 1));
+                s.write8(component ? (dc ? 0x10 : 0x01) : 0x00); // Td, Ta
+            }
+
+            s.write8(u8(scan.ss));
+            s.write8(u8(scan.se));
+            s.write8(0x00); // Ah, Al
+
+            // second pass: encode
+            writeIntervals(s, intervals, [&] (Buffer& buffer, int i)
+            {
+                int y0 = i * rows_in_interval;
+                int y1 = std::min(rows, y0 + rows_in_interval);
+
+                SymbolWriter writer(buffer, tables);
+
+                if (dc)
+                    scanDC(writer, y0, y1);
+                else
+                    scanAC(writer, scan.component, scan.ss, scan.se, y0, y1);
+
+                writer.flush();
+
+                if (i < intervals - 1)
+                {
+                    // write restart marker
+                    BigEndianPointer p = buffer.append(2);
+                    p.write16(MARKER_RST0 + (i & 7));
+                }
+            });
+        }
+
+        // EOI marker
+        s.write16(MARKER_EOI);
+    }
+
+    ImageEncodeStatus jpegEncoder::encodeImage(Stream& stream)
+    {
+        BigEndianStream s(stream);
+
+        if (m_options.progressive)
+        {
+            encodeProgressive(s);
+        }
+        else
+        {
+            encodeSequential(s);
+        }
 
         ImageEncodeStatus status;
         status.info = info;
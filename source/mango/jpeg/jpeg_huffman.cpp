@@ -1,6 +1,6 @@
 /*
     MANGO Multimedia Development Platform
-    Copyright (C) 2012-2023 Twilight Finland 3D Oy Ltd. All rights reserved.
+    Copyright (C) 2012-2024 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
 #include <cstring>
 #include "jpeg.hpp"
@@ -448,4 +448,81 @@ namespace mango::image::jpeg
         }
     }
 
+    static inline
+    int huff_decode_symbol_safe(const HuffmanTable* table, BitBuffer& buffer)
+    {
+        buffer.ensure();
+
+        int index = buffer.peekBits(JPEG_HUFF_LOOKUP_BITS);
+        int size = table->lookupSize[index];
+
+        int symbol;
+
+        if (size <= JPEG_HUFF_LOOKUP_BITS)
+        {
+            symbol = table->lookupValue[index];
+        }
+        else
+        {
+            HuffmanType x = (buffer.data << (JPEG_REGISTER_BITS - buffer.remain));
+            while (x > table->maxcode[size])
+            {
+                ++size;
+            }
+
+            HuffmanType offset = (x >> (JPEG_REGISTER_BITS - size)) + table->valueOffset[size];
+            symbol = offset < 256 ? table->value[offset] : 0;
+        }
+
+        buffer.remain -= size;
+
+        return symbol;
+    }
+
+    void huff_skip_mcu(DecodeState* state)
+    {
+        // Consumes the same bits as huff_decode_mcu() and tracks the DC predictors but
+        // does not store the coefficients. Invalid codes are tolerated so that this can
+        // be used to decode from a guessed position in the bitstream.
+
+        HuffmanDecoder& huffman = state->huffman;
+        BitBuffer& buffer = state->buffer;
+
+        for (int j = 0; j < state->blocks; ++j)
+        {
+            const DecodeBlock* block = state->block + j;
+
+            const HuffmanTable* dc = &huffman.table[0][block->dc];
+            const HuffmanTable* ac = &huffman.table[1][block->ac];
+
+            // DC
+            int s = huff_decode_symbol_safe(dc, buffer) & 15;
+            if (s)
+            {
+                s = buffer.receive(s);
+            }
+
+            huffman.last_dc_value[block->pred] += s;
+
+            // AC
+            for (int i = 1; i < 64; )
+            {
+                s = huff_decode_symbol_safe(ac, buffer);
+                int x = s & 15;
+
+                if (x)
+                {
+                    i += (s >> 4) + 1;
+                    buffer.getBits(x);
+                }
+                else
+                {
+                    if (s < 16)
+                        break;
+                    i += 16;
+                }
+            }
+        }
+    }
+
 } // namespace mango::image::jpeg
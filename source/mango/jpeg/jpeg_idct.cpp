@@ -1,6 +1,6 @@
 /*
     MANGO Multimedia Development Platform
-    Copyright (C) 2012-2023 Twilight Finland 3D Oy Ltd. All rights reserved.
+    Copyright (C) 2012-2024 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
 #include "jpeg.hpp"
 
@@ -118,6 +118,95 @@ namespace
         }
     }
 
+    // ------------------------------------------------------------------------------------------------
+    // reduced-size idct
+    // ------------------------------------------------------------------------------------------------
+
+    /*
+        The reduced transforms evaluate the 8 point inverse DCT at the centers of 2x2, 4x4 and 8x8
+        pixel groups; only the lowest 4x4, 2x2 or 1x1 coefficients contribute to these samples.
+        The output is a compact NxN block.
+    */
+
+    template <int PRECISION>
+    void idct4x4(u8* dest, const s16* data, const s16* qt)
+    {
+        int temp[16];
+
+        for (int i = 0; i < 4; ++i)
+        {
+            // dequantize
+            const int s0 = data[i + 8 * 0] * qt[i + 8 * 0];
+            const int s1 = data[i + 8 * 1] * qt[i + 8 * 1];
+            const int s2 = data[i + 8 * 2] * qt[i + 8 * 2];
+            const int s3 = data[i + 8 * 3] * qt[i + 8 * 3];
+
+            const int e0 = (s0 + s2) * 2896;
+            const int e1 = (s0 - s2) * 2896;
+            const int o0 = s1 * 3784 + s3 * 1567;
+            const int o1 = s1 * 1567 - s3 * 3784;
+
+            const int bias = 0x400;
+            temp[i * 4 + 0] = (e0 + o0 + bias) >> 11;
+            temp[i * 4 + 1] = (e1 + o1 + bias) >> 11;
+            temp[i * 4 + 2] = (e1 - o1 + bias) >> 11;
+            temp[i * 4 + 3] = (e0 - o0 + bias) >> 11;
+        }
+
+        const int shift = PRECISION + 7;
+
+        for (int i = 0; i < 4; ++i)
+        {
+            const int s0 = temp[i + 0];
+            const int s1 = temp[i + 4];
+            const int s2 = temp[i + 8];
+            const int s3 = temp[i + 12];
+
+            const int bias = (1 << (shift - 1)) + (128 << shift);
+            const int e0 = (s0 + s2) * 2896 + bias;
+            const int e1 = (s0 - s2) * 2896 + bias;
+            const int o0 = s1 * 3784 + s3 * 1567;
+            const int o1 = s1 * 1567 - s3 * 3784;
+
+            dest[0] = byteclamp((e0 + o0) >> shift);
+            dest[1] = byteclamp((e1 + o1) >> shift);
+            dest[2] = byteclamp((e1 - o1) >> shift);
+            dest[3] = byteclamp((e0 - o0) >> shift);
+            dest += 4;
+        }
+    }
+
+    template <int PRECISION>
+    void idct2x2(u8* dest, const s16* data, const s16* qt)
+    {
+        const int s0 = data[0] * qt[0];
+        const int s1 = data[1] * qt[1];
+        const int s2 = data[8] * qt[8];
+        const int s3 = data[9] * qt[9];
+
+        const int shift = PRECISION - 5;
+        const int bias = (1 << (shift - 1)) + (128 << shift);
+
+        const int x0 = s0 + s1 + bias;
+        const int x1 = s0 - s1 + bias;
+        const int y0 = s2 + s3;
+        const int y1 = s2 - s3;
+
+        dest[0] = byteclamp((x0 + y0) >> shift);
+        dest[1] = byteclamp((x1 + y1) >> shift);
+        dest[2] = byteclamp((x0 - y0) >> shift);
+        dest[3] = byteclamp((x1 - y1) >> shift);
+    }
+
+    template <int PRECISION>
+    void idct1x1(u8* dest, const s16* data, const s16* qt)
+    {
+        // DC only; the AC coefficients are never looked at
+        const int shift = PRECISION - 5;
+        const int bias = (1 << (shift - 1)) + (128 << shift);
+        dest[0] = byteclamp((data[0] * qt[0] + bias) >> shift);
+    }
+
 } // namespace
 
 namespace mango::image::jpeg
@@ -137,6 +226,36 @@ namespace mango::image::jpeg
         idct<12>(dest, data, qt);
     }
 
+    void idct8_4x4(u8* dest, const s16* data, const s16* qt)
+    {
+        idct4x4<8>(dest, data, qt);
+    }
+
+    void idct8_2x2(u8* dest, const s16* data, const s16* qt)
+    {
+        idct2x2<8>(dest, data, qt);
+    }
+
+    void idct8_1x1(u8* dest, const s16* data, const s16* qt)
+    {
+        idct1x1<8>(dest, data, qt);
+    }
+
+    void idct12_4x4(u8* dest, const s16* data, const s16* qt)
+    {
+        idct4x4<12>(dest, data, qt);
+    }
+
+    void idct12_2x2(u8* dest, const s16* data, const s16* qt)
+    {
+        idct2x2<12>(dest, data, qt);
+    }
+
+    void idct12_1x1(u8* dest, const s16* data, const s16* qt)
+    {
+        idct1x1<12>(dest, data, qt);
+    }
+
 #if defined(MANGO_ENABLE_SSE2)
 
     // ------------------------------------------------------------------------------------------------
@@ -488,6 +607,694 @@ namespace mango::image::jpeg
 
 #endif // MANGO_ENABLE_SSE2
 
+#if defined(MANGO_ENABLE_AVX2)
+
+    // ------------------------------------------------------------------------------------------------
+    // AVX2 implementation
+    // ------------------------------------------------------------------------------------------------
+
+    // Same arithmetic as the SSE2 version; each 128 bit lane transforms one block.
+
+    static inline
+    __m256i idct_broadcast_avx2(const s16* table)
+    {
+        return _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i *>(table)));
+    }
+
+    static inline
+    __m256i idct_load_avx2(const s16* a, const s16* b)
+    {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b));
+        return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    }
+
+    void idct_avx2(u8* dest, const s16* data, const Block* block)
+    {
+        const s16* qt0 = block[0].qt;
+        const s16* qt1 = block[1].qt;
+
+        // Load and dequantize
+        __m256i v0 = _mm256_mullo_epi16(idct_load_avx2(data + 0, data + 64), idct_load_avx2(qt0 + 0, qt1 + 0));
+        __m256i v1 = _mm256_mullo_epi16(idct_load_avx2(data + 8, data + 72), idct_load_avx2(qt0 + 8, qt1 + 8));
+        __m256i v2 = _mm256_mullo_epi16(idct_load_avx2(data + 16, data + 80), idct_load_avx2(qt0 + 16, qt1 + 16));
+        __m256i v3 = _mm256_mullo_epi16(idct_load_avx2(data + 24, data + 88), idct_load_avx2(qt0 + 24, qt1 + 24));
+        __m256i v4 = _mm256_mullo_epi16(idct_load_avx2(data + 32, data + 96), idct_load_avx2(qt0 + 32, qt1 + 32));
+        __m256i v5 = _mm256_mullo_epi16(idct_load_avx2(data + 40, data + 104), idct_load_avx2(qt0 + 40, qt1 + 40));
+        __m256i v6 = _mm256_mullo_epi16(idct_load_avx2(data + 48, data + 112), idct_load_avx2(qt0 + 48, qt1 + 48));
+        __m256i v7 = _mm256_mullo_epi16(idct_load_avx2(data + 56, data + 120), idct_load_avx2(qt0 + 56, qt1 + 56));
+
+        __m256i r_xmm0, r_xmm1, r_xmm2, r_xmm3, r_xmm4, r_xmm5, r_xmm6, r_xmm7;
+        __m256i row0, row1, row2, row3, row4, row5, row6, row7;
+
+        // row 1 and Row 3
+
+        const __m256i table04 [] =
+        {
+            idct_broadcast_avx2(shortM128_tab_i_04 + 0),
+            idct_broadcast_avx2(shortM128_tab_i_04 + 8),
+            idct_broadcast_avx2(shortM128_tab_i_04 + 16),
+            idct_broadcast_avx2(shortM128_tab_i_04 + 24),
+        };
+        const __m256i table26 [] =
+        {
+            idct_broadcast_avx2(shortM128_tab_i_26 + 0),
+            idct_broadcast_avx2(shortM128_tab_i_26 + 8),
+            idct_broadcast_avx2(shortM128_tab_i_26 + 16),
+            idct_broadcast_avx2(shortM128_tab_i_26 + 24),
+        };
+
+        r_xmm0 = _mm256_shufflelo_epi16(v0, 0xd8);
+        r_xmm1 = _mm256_shuffle_epi32(r_xmm0, 0x00);
+        r_xmm1 = _mm256_madd_epi16(r_xmm1, table04[0]);
+        r_xmm3 = _mm256_shuffle_epi32(r_xmm0, 0x55);
+        r_xmm0 = _mm256_shufflehi_epi16(r_xmm0, 0xd8);
+        r_xmm3 = _mm256_madd_epi16(r_xmm3, table04[2]);
+        r_xmm2 = _mm256_shuffle_epi32(r_xmm0, 0xaa);
+        r_xmm0 = _mm256_shuffle_epi32(r_xmm0, 0xff);
+        r_xmm2 = _mm256_madd_epi16(r_xmm2, table04[1]);
+
+        const __m256i round_inv_row = _mm256_set1_epi32(2048);
+
+        r_xmm4 = _mm256_shufflehi_epi16(v2, 0xd8);
+        r_xmm1 = _mm256_add_epi32(r_xmm1, round_inv_row);
+        r_xmm4 = _mm256_shufflelo_epi16(r_xmm4, 0xd8);
+        r_xmm0 = _mm256_madd_epi16(r_xmm0, table04[3]);
+        r_xmm5 = _mm256_shuffle_epi32(r_xmm4, 0x00);
+        r_xmm6 = _mm256_shuffle_epi32(r_xmm4, 0xaa);
+        r_xmm5 = _mm256_madd_epi16(r_xmm5, table26[0]);
+        r_xmm1 = _mm256_add_epi32(r_xmm1, r_xmm2);
+        r_xmm7 = _mm256_shuffle_epi32(r_xmm4, 0x55);
+        r_xmm6 = _mm256_madd_epi16(r_xmm6, table26[1]);
+        r_xmm0 = _mm256_add_epi32(r_xmm0, r_xmm3);
+        r_xmm4 = _mm256_shuffle_epi32(r_xmm4, 0xff);
+        r_xmm2 = _mm256_sub_epi32(r_xmm1, r_xmm0);
+        r_xmm7 = _mm256_madd_epi16(r_xmm7, table26[2]);
+        r_xmm0 = _mm256_add_epi32(r_xmm0, r_xmm1);
+        r_xmm2 = _mm256_srai_epi32(r_xmm2, 12);
+        r_xmm5 = _mm256_add_epi32(r_xmm5, round_inv_row);
+        r_xmm4 = _mm256_madd_epi16(r_xmm4, table26[3]);
+        r_xmm5 = _mm256_add_epi32(r_xmm5, r_xmm6);
+        r_xmm0 = _mm256_srai_epi32(r_xmm0, 12);
+        r_xmm2 = _mm256_shuffle_epi32(r_xmm2, 0x1b);
+        row0 = _mm256_packs_epi32(r_xmm0, r_xmm2);
+
+        r_xmm4 = _mm256_add_epi32(r_xmm4, r_xmm7);
+        r_xmm6 = _mm256_sub_epi32(r_xmm5, r_xmm4);
+        r_xmm4 = _mm256_add_epi32(r_xmm4, r_xmm5);
+        r_xmm6 = _mm256_srai_epi32(r_xmm6, 12);
+        r_xmm4 = _mm256_srai_epi32(r_xmm4, 12);
+        r_xmm6 = _mm256_shuffle_epi32(r_xmm6, 0x1b);
+        row2 = _mm256_packs_epi32(r_xmm4, r_xmm6);
+
+        // row 5 and row 7
+
+        r_xmm0 = _mm256_shufflelo_epi16(v4, 0xd8);
+        r_xmm1 = _mm256_shuffle_epi32(r_xmm0, 0x00);
+        r_xmm1 = _mm256_madd_epi16(r_xmm1, table04[0]);
+        r_xmm3 = _mm256_shuffle_epi32(r_xmm0, 0x55);
+        r_xmm0 = _mm256_shufflehi_epi16(r_xmm0, 0xd8);
+        r_xmm3 = _mm256_madd_epi16(r_xmm3, table04[2]);
+        r_xmm2 = _mm256_shuffle_epi32(r_xmm0, 0xaa);
+        r_xmm0 = _mm256_shuffle_epi32(r_xmm0, 0xff);
+        r_xmm2 = _mm256_madd_epi16(r_xmm2, table04[1]);
+        r_xmm4 = _mm256_shufflehi_epi16(v6, 0xd8);
+        r_xmm1 = _mm256_add_epi32(r_xmm1, round_inv_row);
+        r_xmm4 = _mm256_shufflelo_epi16(r_xmm4, 0xd8);
+        r_xmm0 = _mm256_madd_epi16(r_xmm0, table04[3]);
+        r_xmm5 = _mm256_shuffle_epi32(r_xmm4, 0x00);
+        r_xmm6 = _mm256_shuffle_epi32(r_xmm4, 0xaa);
+        r_xmm5 = _mm256_madd_epi16(r_xmm5, table26[0]);
+        r_xmm1 = _mm256_add_epi32(r_xmm1, r_xmm2);
+        r_xmm7 = _mm256_shuffle_epi32(r_xmm4, 0x55);
+        r_xmm6 = _mm256_madd_epi16(r_xmm6, table26[1]);
+        r_xmm0 = _mm256_add_epi32(r_xmm0, r_xmm3);
+        r_xmm4 = _mm256_shuffle_epi32(r_xmm4, 0xff);
+        r_xmm2 = _mm256_sub_epi32(r_xmm1, r_xmm0);
+        r_xmm7 = _mm256_madd_epi16(r_xmm7, table26[2]);
+        r_xmm0 = _mm256_add_epi32(r_xmm0, r_xmm1);
+        r_xmm2 = _mm256_srai_epi32(r_xmm2, 12);
+        r_xmm5 = _mm256_add_epi32(r_xmm5, round_inv_row);
+        r_xmm4 = _mm256_madd_epi16(r_xmm4, table26[3]);
+        r_xmm5 = _mm256_add_epi32(r_xmm5, r_xmm6);
+        r_xmm0 = _mm256_srai_epi32(r_xmm0, 12);
+        r_xmm2 = _mm256_shuffle_epi32(r_xmm2, 0x1b);
+        row4 = _mm256_packs_epi32(r_xmm0, r_xmm2);
+
+        r_xmm4 = _mm256_add_epi32(r_xmm4, r_xmm7);
+        r_xmm6 = _mm256_sub_epi32(r_xmm5, r_xmm4);
+        r_xmm4 = _mm256_add_epi32(r_xmm4, r_xmm5);
+        r_xmm6 = _mm256_srai_epi32(r_xmm6, 12);
+        r_xmm4 = _mm256_srai_epi32(r_xmm4, 12);
+        r_xmm6 = _mm256_shuffle_epi32(r_xmm6, 0x1b);
+        row6 = _mm256_packs_epi32(r_xmm4, r_xmm6);
+
+        // row 4 and row 2
+
+        const __m256i table35 [] =
+        {
+            idct_broadcast_avx2(shortM128_tab_i_35 + 0),
+            idct_broadcast_avx2(shortM128_tab_i_35 + 8),
+            idct_broadcast_avx2(shortM128_tab_i_35 + 16),
+            idct_broadcast_avx2(shortM128_tab_i_35 + 24),
+        };
+        const __m256i table17 [] =
+        {
+            idct_broadcast_avx2(shortM128_tab_i_17 + 0),
+            idct_broadcast_avx2(shortM128_tab_i_17 + 8),
+            idct_broadcast_avx2(shortM128_tab_i_17 + 16),
+            idct_broadcast_avx2(shortM128_tab_i_17 + 24),
+        };
+
+        r_xmm0 = _mm256_shufflelo_epi16(v3, 0xd8);
+        r_xmm1 = _mm256_shuffle_epi32(r_xmm0, 0x00);
+        r_xmm1 = _mm256_madd_epi16(r_xmm1, table35[0]);
+        r_xmm3 = _mm256_shuffle_epi32(r_xmm0, 0x55);
+        r_xmm0 = _mm256_shufflehi_epi16(r_xmm0, 0xd8);
+        r_xmm3 = _mm256_madd_epi16(r_xmm3, table35[2]);
+        r_xmm2 = _mm256_shuffle_epi32(r_xmm0, 0xaa);
+        r_xmm0 = _mm256_shuffle_epi32(r_xmm0, 0xff);
+        r_xmm2 = _mm256_madd_epi16(r_xmm2, table35[1]);
+        r_xmm4 = _mm256_shufflehi_epi16(v1, 0xd8);
+        r_xmm1 = _mm256_add_epi32(r_xmm1, round_inv_row);
+        r_xmm4 = _mm256_shufflelo_epi16(r_xmm4, 0xd8);
+        r_xmm0 = _mm256_madd_epi16(r_xmm0, table35[3]);
+        r_xmm5 = _mm256_shuffle_epi32(r_xmm4, 0x00);
+        r_xmm6 = _mm256_shuffle_epi32(r_xmm4, 0xaa);
+        r_xmm5 = _mm256_madd_epi16(r_xmm5, table17[0]);
+        r_xmm1 = _mm256_add_epi32(r_xmm1, r_xmm2);
+        r_xmm7 = _mm256_shuffle_epi32(r_xmm4, 0x55);
+        r_xmm6 = _mm256_madd_epi16(r_xmm6, table17[1]);
+        r_xmm0 = _mm256_add_epi32(r_xmm0, r_xmm3);
+        r_xmm4 = _mm256_shuffle_epi32(r_xmm4, 0xff);
+        r_xmm2 = _mm256_sub_epi32(r_xmm1, r_xmm0);
+        r_xmm7 = _mm256_madd_epi16(r_xmm7, table17[2]);
+        r_xmm0 = _mm256_add_epi32(r_xmm0, r_xmm1);
+        r_xmm2 = _mm256_srai_epi32(r_xmm2, 12);
+        r_xmm5 = _mm256_add_epi32(r_xmm5, round_inv_row);
+        r_xmm4 = _mm256_madd_epi16(r_xmm4, table17[3]);
+        r_xmm5 = _mm256_add_epi32(r_xmm5, r_xmm6);
+        r_xmm0 = _mm256_srai_epi32(r_xmm0, 12);
+        r_xmm2 = _mm256_shuffle_epi32(r_xmm2, 0x1b);
+        row3 = _mm256_packs_epi32(r_xmm0, r_xmm2);
+
+        r_xmm4 = _mm256_add_epi32(r_xmm4, r_xmm7);
+        r_xmm6 = _mm256_sub_epi32(r_xmm5, r_xmm4);
+        r_xmm4 = _mm256_add_epi32(r_xmm5, r_xmm4);
+        r_xmm6 = _mm256_srai_epi32(r_xmm6, 12);
+        r_xmm4 = _mm256_srai_epi32(r_xmm4, 12);
+        r_xmm6 = _mm256_shuffle_epi32(r_xmm6, 0x1b);
+        row1 = _mm256_packs_epi32(r_xmm4, r_xmm6);
+
+        // row 6 and row 8
+
+        r_xmm0 = _mm256_shufflelo_epi16(v5, 0xd8);
+        r_xmm1 = _mm256_shuffle_epi32(r_xmm0, 0x00);
+        r_xmm1 = _mm256_madd_epi16(r_xmm1, table35[0]);
+        r_xmm3 = _mm256_shuffle_epi32(r_xmm0, 0x55);
+        r_xmm0 = _mm256_shufflehi_epi16(r_xmm0, 0xd8);
+        r_xmm3 = _mm256_madd_epi16(r_xmm3, table35[2]);
+        r_xmm2 = _mm256_shuffle_epi32(r_xmm0, 0xaa);
+        r_xmm0 = _mm256_shuffle_epi32(r_xmm0, 0xff);
+        r_xmm2 = _mm256_madd_epi16(r_xmm2, table35[1]);
+        r_xmm4 = _mm256_shufflehi_epi16(v7, 0xd8);
+        r_xmm1 = _mm256_add_epi32(r_xmm1, round_inv_row);
+        r_xmm4 = _mm256_shufflelo_epi16(r_xmm4, 0xd8);
+        r_xmm0 = _mm256_madd_epi16(r_xmm0, table35[3]);
+        r_xmm5 = _mm256_shuffle_epi32(r_xmm4, 0x00);
+        r_xmm6 = _mm256_shuffle_epi32(r_xmm4, 0xaa);
+        r_xmm5 = _mm256_madd_epi16(r_xmm5, table17[0]);
+        r_xmm1 = _mm256_add_epi32(r_xmm1, r_xmm2);
+        r_xmm7 = _mm256_shuffle_epi32(r_xmm4, 0x55);
+        r_xmm6 = _mm256_madd_epi16(r_xmm6, table17[1]);
+        r_xmm0 = _mm256_add_epi32(r_xmm0, r_xmm3);
+        r_xmm4 = _mm256_shuffle_epi32(r_xmm4, 0xff);
+        r_xmm2 = _mm256_sub_epi32(r_xmm1, r_xmm0);
+        r_xmm7 = _mm256_madd_epi16(r_xmm7, table17[2]);
+        r_xmm0 = _mm256_add_epi32(r_xmm0, r_xmm1);
+        r_xmm2 = _mm256_srai_epi32(r_xmm2, 12);
+        r_xmm5 = _mm256_add_epi32(r_xmm5, round_inv_row);
+        r_xmm4 = _mm256_madd_epi16(r_xmm4, table17[3]);
+        r_xmm5 = _mm256_add_epi32(r_xmm5, r_xmm6);
+        r_xmm0 = _mm256_srai_epi32(r_xmm0, 12);
+        r_xmm2 = _mm256_shuffle_epi32(r_xmm2, 0x1b);
+        row5 = _mm256_packs_epi32(r_xmm0, r_xmm2);
+
+        r_xmm4 = _mm256_add_epi32(r_xmm4, r_xmm7);
+        r_xmm6 = _mm256_sub_epi32(r_xmm5, r_xmm4);
+        r_xmm4 = _mm256_add_epi32(r_xmm5, r_xmm4);
+        r_xmm6 = _mm256_srai_epi32(r_xmm6, 12);
+        r_xmm4 = _mm256_srai_epi32(r_xmm4, 12);
+        r_xmm6 = _mm256_shuffle_epi32(r_xmm6, 0x1b);
+        row7 = _mm256_packs_epi32(r_xmm4, r_xmm6);
+
+        const __m256i tg = _mm256_broadcastsi128_si256(_mm_set_epi16(-19195, -19195, -21746, -21746, 27146, 27146, 13036, 13036));
+        const __m256i one = _mm256_set1_epi16(1);
+
+        r_xmm1 = _mm256_shuffle_epi32(tg, 0xaa);
+        r_xmm0 = _mm256_mulhi_epi16(r_xmm1, row5);
+        r_xmm1 = _mm256_mulhi_epi16(r_xmm1, row3);
+        r_xmm5 = _mm256_shuffle_epi32(tg, 0x00);
+        r_xmm4 = _mm256_mulhi_epi16(r_xmm5, row7);
+        r_xmm5 = _mm256_mulhi_epi16(r_xmm5, row1);
+        r_xmm0 = _mm256_adds_epi16(r_xmm0, row5);
+        r_xmm1 = _mm256_adds_epi16(r_xmm1, row3);
+        r_xmm0 = _mm256_adds_epi16(r_xmm0, row3);
+        r_xmm3 = _mm256_shuffle_epi32(tg, 0x55);
+        r_xmm7 = _mm256_mulhi_epi16(r_xmm3, row6);
+        r_xmm3 = _mm256_mulhi_epi16(r_xmm3, row2);
+        r_xmm5 = _mm256_subs_epi16(r_xmm5, row7);
+        r_xmm4 = _mm256_adds_epi16(r_xmm4, row1);
+        r_xmm2 = _mm256_subs_epi16(r_xmm2, r_xmm1);
+        r_xmm1 = _mm256_adds_epi16(r_xmm0, r_xmm4);
+        r_xmm1 = _mm256_adds_epi16(r_xmm1, one);
+        r_xmm4 = _mm256_subs_epi16(r_xmm4, r_xmm0);
+        r_xmm6 = _mm256_adds_epi16(r_xmm5, r_xmm2);
+        r_xmm5 = _mm256_subs_epi16(r_xmm5, r_xmm2);
+        r_xmm5 = _mm256_adds_epi16(r_xmm5, one);
+
+        __m256i temp7 = r_xmm1;
+        __m256i temp3 = r_xmm6;
+
+        r_xmm0 = _mm256_shuffle_epi32(tg, 0xff);
+        r_xmm1 = _mm256_subs_epi16(r_xmm4, r_xmm5);
+        r_xmm4 = _mm256_adds_epi16(r_xmm4, r_xmm5);
+        r_xmm2 = _mm256_mulhi_epi16(r_xmm0, r_xmm4);
+        r_xmm7 = _mm256_adds_epi16(r_xmm7, row2);
+        r_xmm3 = _mm256_subs_epi16(r_xmm3, row6);
+        r_xmm0 = _mm256_mulhi_epi16(r_xmm0, r_xmm1);
+        r_xmm0 = _mm256_adds_epi16(r_xmm0, r_xmm1);
+        r_xmm5 = _mm256_adds_epi16(row0, row4);
+        r_xmm6 = _mm256_subs_epi16(row0, row4);
+        r_xmm4 = _mm256_adds_epi16(r_xmm4, r_xmm2);
+
+        r_xmm4 = _mm256_or_si256(r_xmm4, one);
+        r_xmm0 = _mm256_or_si256(r_xmm0, one);
+
+        const s16 bias = 128 << 5;
+        const __m256i round_inv_col = _mm256_set1_epi16(16 + bias);
+        const __m256i round_inv_corr = _mm256_sub_epi16(round_inv_col, one);
+
+        r_xmm1 = _mm256_subs_epi16(r_xmm6, r_xmm3);
+        r_xmm1 = _mm256_adds_epi16(r_xmm1, round_inv_corr);
+        r_xmm2 = _mm256_subs_epi16(r_xmm5, r_xmm7);
+        r_xmm2 = _mm256_adds_epi16(r_xmm2, round_inv_corr);
+        r_xmm5 = _mm256_adds_epi16(r_xmm5, r_xmm7);
+        r_xmm5 = _mm256_adds_epi16(r_xmm5, round_inv_col);
+        r_xmm6 = _mm256_adds_epi16(r_xmm6, r_xmm3);
+        r_xmm6 = _mm256_adds_epi16(r_xmm6, round_inv_col);
+
+        __m256i r0 = _mm256_adds_epi16(r_xmm5, temp7);
+        __m256i r1 = _mm256_adds_epi16(r_xmm6, r_xmm4);
+        __m256i r2 = _mm256_adds_epi16(r_xmm1, r_xmm0);
+        __m256i r3 = _mm256_adds_epi16(r_xmm2, temp3);
+        __m256i r4 = _mm256_subs_epi16(r_xmm2, temp3);
+        __m256i r5 = _mm256_subs_epi16(r_xmm1, r_xmm0);
+        __m256i r6 = _mm256_subs_epi16(r_xmm6, r_xmm4);
+        __m256i r7 = _mm256_subs_epi16(r_xmm5, temp7);
+
+        r0 = _mm256_srai_epi16(r0, 5);
+        r1 = _mm256_srai_epi16(r1, 5);
+        r2 = _mm256_srai_epi16(r2, 5);
+        r3 = _mm256_srai_epi16(r3, 5);
+        r4 = _mm256_srai_epi16(r4, 5);
+        r5 = _mm256_srai_epi16(r5, 5);
+        r6 = _mm256_srai_epi16(r6, 5);
+        r7 = _mm256_srai_epi16(r7, 5);
+
+        __m256i s0 = _mm256_packus_epi16(r0, r1);
+        __m256i s1 = _mm256_packus_epi16(r2, r3);
+        __m256i s2 = _mm256_packus_epi16(r4, r5);
+        __m256i s3 = _mm256_packus_epi16(r6, r7);
+
+        // store
+        __m256i* d = reinterpret_cast<__m256i *>(dest);
+        _mm256_storeu_si256(d + 0, _mm256_permute2x128_si256(s0, s1, 0x20));
+        _mm256_storeu_si256(d + 1, _mm256_permute2x128_si256(s2, s3, 0x20));
+        _mm256_storeu_si256(d + 2, _mm256_permute2x128_si256(s0, s1, 0x31));
+        _mm256_storeu_si256(d + 3, _mm256_permute2x128_si256(s2, s3, 0x31));
+    }
+
+#endif // MANGO_ENABLE_AVX2
+
+#if defined(MANGO_ENABLE_AVX512) && defined(__AVX512BW__)
+
+    // ------------------------------------------------------------------------------------------------
+    // AVX-512 implementation
+    // ------------------------------------------------------------------------------------------------
+
+    // Same arithmetic as the SSE2 version; each 128 bit lane transforms one block.
+
+    static inline
+    __m512i idct_broadcast_avx512(const s16* table)
+    {
+        return _mm512_broadcast_i32x4(_mm_load_si128(reinterpret_cast<const __m128i *>(table)));
+    }
+
+    static inline
+    void idct_transpose_avx512(__m512i& a, __m512i& b, __m512i& c, __m512i& d)
+    {
+        // 4x4 transpose of the 128 bit lanes
+        __m512i t0 = _mm512_shuffle_i64x2(a, b, 0x44);
+        __m512i t1 = _mm512_shuffle_i64x2(c, d, 0x44);
+        __m512i t2 = _mm512_shuffle_i64x2(a, b, 0xee);
+        __m512i t3 = _mm512_shuffle_i64x2(c, d, 0xee);
+        a = _mm512_shuffle_i64x2(t0, t1, 0x88);
+        b = _mm512_shuffle_i64x2(t0, t1, 0xdd);
+        c = _mm512_shuffle_i64x2(t2, t3, 0x88);
+        d = _mm512_shuffle_i64x2(t2, t3, 0xdd);
+    }
+
+    void idct_avx512(u8* dest, const s16* data, const Block* block)
+    {
+        // Load; rows 0..3 and 4..7 of each block, transposed so that each vector holds the same row of all four blocks
+        __m512i v0 = _mm512_loadu_si512(data +   0);
+        __m512i v1 = _mm512_loadu_si512(data +  64);
+        __m512i v2 = _mm512_loadu_si512(data + 128);
+        __m512i v3 = _mm512_loadu_si512(data + 192);
+        __m512i v4 = _mm512_loadu_si512(data +  32);
+        __m512i v5 = _mm512_loadu_si512(data +  96);
+        __m512i v6 = _mm512_loadu_si512(data + 160);
+        __m512i v7 = _mm512_loadu_si512(data + 224);
+        idct_transpose_avx512(v0, v1, v2, v3);
+        idct_transpose_avx512(v4, v5, v6, v7);
+
+        __m512i q0 = _mm512_loadu_si512(block[0].qt +  0);
+        __m512i q1 = _mm512_loadu_si512(block[1].qt +  0);
+        __m512i q2 = _mm512_loadu_si512(block[2].qt +  0);
+        __m512i q3 = _mm512_loadu_si512(block[3].qt +  0);
+        __m512i q4 = _mm512_loadu_si512(block[0].qt + 32);
+        __m512i q5 = _mm512_loadu_si512(block[1].qt + 32);
+        __m512i q6 = _mm512_loadu_si512(block[2].qt + 32);
+        __m512i q7 = _mm512_loadu_si512(block[3].qt + 32);
+        idct_transpose_avx512(q0, q1, q2, q3);
+        idct_transpose_avx512(q4, q5, q6, q7);
+
+        // Dequantize
+        v0 = _mm512_mullo_epi16(v0, q0);
+        v1 = _mm512_mullo_epi16(v1, q1);
+        v2 = _mm512_mullo_epi16(v2, q2);
+        v3 = _mm512_mullo_epi16(v3, q3);
+        v4 = _mm512_mullo_epi16(v4, q4);
+        v5 = _mm512_mullo_epi16(v5, q5);
+        v6 = _mm512_mullo_epi16(v6, q6);
+        v7 = _mm512_mullo_epi16(v7, q7);
+
+        __m512i r_xmm0, r_xmm1, r_xmm2, r_xmm3, r_xmm4, r_xmm5, r_xmm6, r_xmm7;
+        __m512i row0, row1, row2, row3, row4, row5, row6, row7;
+
+        // row 1 and Row 3
+
+        const __m512i table04 [] =
+        {
+            idct_broadcast_avx512(shortM128_tab_i_04 + 0),
+            idct_broadcast_avx512(shortM128_tab_i_04 + 8),
+            idct_broadcast_avx512(shortM128_tab_i_04 + 16),
+            idct_broadcast_avx512(shortM128_tab_i_04 + 24),
+        };
+        const __m512i table26 [] =
+        {
+            idct_broadcast_avx512(shortM128_tab_i_26 + 0),
+            idct_broadcast_avx512(shortM128_tab_i_26 + 8),
+            idct_broadcast_avx512(shortM128_tab_i_26 + 16),
+            idct_broadcast_avx512(shortM128_tab_i_26 + 24),
+        };
+
+        r_xmm0 = _mm512_shufflelo_epi16(v0, 0xd8);
+        r_xmm1 = _mm512_shuffle_epi32(r_xmm0, _MM_PERM_ENUM(0x00));
+        r_xmm1 = _mm512_madd_epi16(r_xmm1, table04[0]);
+        r_xmm3 = _mm512_shuffle_epi32(r_xmm0, _MM_PERM_ENUM(0x55));
+        r_xmm0 = _mm512_shufflehi_epi16(r_xmm0, 0xd8);
+        r_xmm3 = _mm512_madd_epi16(r_xmm3, table04[2]);
+        r_xmm2 = _mm512_shuffle_epi32(r_xmm0, _MM_PERM_ENUM(0xaa));
+        r_xmm0 = _mm512_shuffle_epi32(r_xmm0, _MM_PERM_ENUM(0xff));
+        r_xmm2 = _mm512_madd_epi16(r_xmm2, table04[1]);
+
+        const __m512i round_inv_row = _mm512_set1_epi32(2048);
+
+        r_xmm4 = _mm512_shufflehi_epi16(v2, 0xd8);
+        r_xmm1 = _mm512_add_epi32(r_xmm1, round_inv_row);
+        r_xmm4 = _mm512_shufflelo_epi16(r_xmm4, 0xd8);
+        r_xmm0 = _mm512_madd_epi16(r_xmm0, table04[3]);
+        r_xmm5 = _mm512_shuffle_epi32(r_xmm4, _MM_PERM_ENUM(0x00));
+        r_xmm6 = _mm512_shuffle_epi32(r_xmm4, _MM_PERM_ENUM(0xaa));
+        r_xmm5 = _mm512_madd_epi16(r_xmm5, table26[0]);
+        r_xmm1 = _mm512_add_epi32(r_xmm1, r_xmm2);
+        r_xmm7 = _mm512_shuffle_epi32(r_xmm4, _MM_PERM_ENUM(0x55));
+        r_xmm6 = _mm512_madd_epi16(r_xmm6, table26[1]);
+        r_xmm0 = _mm512_add_epi32(r_xmm0, r_xmm3);
+        r_xmm4 = _mm512_shuffle_epi32(r_xmm4, _MM_PERM_ENUM(0xff));
+        r_xmm2 = _mm512_sub_epi32(r_xmm1, r_xmm0);
+        r_xmm7 = _mm512_madd_epi16(r_xmm7, table26[2]);
+        r_xmm0 = _mm512_add_epi32(r_xmm0, r_xmm1);
+        r_xmm2 = _mm512_srai_epi32(r_xmm2, 12);
+        r_xmm5 = _mm512_add_epi32(r_xmm5, round_inv_row);
+        r_xmm4 = _mm512_madd_epi16(r_xmm4, table26[3]);
+        r_xmm5 = _mm512_add_epi32(r_xmm5, r_xmm6);
+        r_xmm0 = _mm512_srai_epi32(r_xmm0, 12);
+        r_xmm2 = _mm512_shuffle_epi32(r_xmm2, _MM_PERM_ENUM(0x1b));
+        row0 = _mm512_packs_epi32(r_xmm0, r_xmm2);
+
+        r_xmm4 = _mm512_add_epi32(r_xmm4, r_xmm7);
+        r_xmm6 = _mm512_sub_epi32(r_xmm5, r_xmm4);
+        r_xmm4 = _mm512_add_epi32(r_xmm4, r_xmm5);
+        r_xmm6 = _mm512_srai_epi32(r_xmm6, 12);
+        r_xmm4 = _mm512_srai_epi32(r_xmm4, 12);
+        r_xmm6 = _mm512_shuffle_epi32(r_xmm6, _MM_PERM_ENUM(0x1b));
+        row2 = _mm512_packs_epi32(r_xmm4, r_xmm6);
+
+        // row 5 and row 7
+
+        r_xmm0 = _mm512_shufflelo_epi16(v4, 0xd8);
+        r_xmm1 = _mm512_shuffle_epi32(r_xmm0, _MM_PERM_ENUM(0x00));
+        r_xmm1 = _mm512_madd_epi16(r_xmm1, table04[0]);
+        r_xmm3 = _mm512_shuffle_epi32(r_xmm0, _MM_PERM_ENUM(0x55));
+        r_xmm0 = _mm512_shufflehi_epi16(r_xmm0, 0xd8);
+        r_xmm3 = _mm512_madd_epi16(r_xmm3, table04[2]);
+        r_xmm2 = _mm512_shuffle_epi32(r_xmm0, _MM_PERM_ENUM(0xaa));
+        r_xmm0 = _mm512_shuffle_epi32(r_xmm0, _MM_PERM_ENUM(0xff));
+        r_xmm2 = _mm512_madd_epi16(r_xmm2, table04[1]);
+        r_xmm4 = _mm512_shufflehi_epi16(v6, 0xd8);
+        r_xmm1 = _mm512_add_epi32(r_xmm1, round_inv_row);
+        r_xmm4 = _mm512_shufflelo_epi16(r_xmm4, 0xd8);
+        r_xmm0 = _mm512_madd_epi16(r_xmm0, table04[3]);
+        r_xmm5 = _mm512_shuffle_epi32(r_xmm4, _MM_PERM_ENUM(0x00));
+        r_xmm6 = _mm512_shuffle_epi32(r_xmm4, _MM_PERM_ENUM(0xaa));
+        r_xmm5 = _mm512_madd_epi16(r_xmm5, table26[0]);
+        r_xmm1 = _mm512_add_epi32(r_xmm1, r_xmm2);
+        r_xmm7 = _mm512_shuffle_epi32(r_xmm4, _MM_PERM_ENUM(0x55));
+        r_xmm6 = _mm512_madd_epi16(r_xmm6, table26[1]);
+        r_xmm0 = _mm512_add_epi32(r_xmm0, r_xmm3);
+        r_xmm4 = _mm512_shuffle_epi32(r_xmm4, _MM_PERM_ENUM(0xff));
+        r_xmm2 = _mm512_sub_epi32(r_xmm1, r_xmm0);
+        r_xmm7 = _mm512_madd_epi16(r_xmm7, table26[2]);
+        r_xmm0 = _mm512_add_epi32(r_xmm0, r_xmm1);
+        r_xmm2 = _mm512_srai_epi32(r_xmm2, 12);
+        r_xmm5 = _mm512_add_epi32(r_xmm5, round_inv_row);
+        r_xmm4 = _mm512_madd_epi16(r_xmm4, table26[3]);
+        r_xmm5 = _mm512_add_epi32(r_xmm5, r_xmm6);
+        r_xmm0 = _mm512_srai_epi32(r_xmm0, 12);
+        r_xmm2 = _mm512_shuffle_epi32(r_xmm2, _MM_PERM_ENUM(0x1b));
+        row4 = _mm512_packs_epi32(r_xmm0, r_xmm2);
+
+        r_xmm4 = _mm512_add_epi32(r_xmm4, r_xmm7);
+        r_xmm6 = _mm512_sub_epi32(r_xmm5, r_xmm4);
+        r_xmm4 = _mm512_add_epi32(r_xmm4, r_xmm5);
+        r_xmm6 = _mm512_srai_epi32(r_xmm6, 12);
+        r_xmm4 = _mm512_srai_epi32(r_xmm4, 12);
+        r_xmm6 = _mm512_shuffle_epi32(r_xmm6, _MM_PERM_ENUM(0x1b));
+        row6 = _mm512_packs_epi32(r_xmm4, r_xmm6);
+
+        // row 4 and row 2
+
+        const __m512i table35 [] =
+        {
+            idct_broadcast_avx512(shortM128_tab_i_35 + 0),
+            idct_broadcast_avx512(shortM128_tab_i_35 + 8),
+            idct_broadcast_avx512(shortM128_tab_i_35 + 16),
+            idct_broadcast_avx512(shortM128_tab_i_35 + 24),
+        };
+        const __m512i table17 [] =
+        {
+            idct_broadcast_avx512(shortM128_tab_i_17 + 0),
+            idct_broadcast_avx512(shortM128_tab_i_17 + 8),
+            idct_broadcast_avx512(shortM128_tab_i_17 + 16),
+            idct_broadcast_avx512(shortM128_tab_i_17 + 24),
+        };
+
+        r_xmm0 = _mm512_shufflelo_epi16(v3, 0xd8);
+        r_xmm1 = _mm512_shuffle_epi32(r_xmm0, _MM_PERM_ENUM(0x00));
+        r_xmm1 = _mm512_madd_epi16(r_xmm1, table35[0]);
+        r_xmm3 = _mm512_shuffle_epi32(r_xmm0, _MM_PERM_ENUM(0x55));
+        r_xmm0 = _mm512_shufflehi_epi16(r_xmm0, 0xd8);
+        r_xmm3 = _mm512_madd_epi16(r_xmm3, table35[2]);
+        r_xmm2 = _mm512_shuffle_epi32(r_xmm0, _MM_PERM_ENUM(0xaa));
+        r_xmm0 = _mm512_shuffle_epi32(r_xmm0, _MM_PERM_ENUM(0xff));
+        r_xmm2 = _mm512_madd_epi16(r_xmm2, table35[1]);
+        r_xmm4 = _mm512_shufflehi_epi16(v1, 0xd8);
+        r_xmm1 = _mm512_add_epi32(r_xmm1, round_inv_row);
+        r_xmm4 = _mm512_shufflelo_epi16(r_xmm4, 0xd8);
+        r_xmm0 = _mm512_madd_epi16(r_xmm0, table35[3]);
+        r_xmm5 = _mm512_shuffle_epi32(r_xmm4, _MM_PERM_ENUM(0x00));
+        r_xmm6 = _mm512_shuffle_epi32(r_xmm4, _MM_PERM_ENUM(0xaa));
+        r_xmm5 = _mm512_madd_epi16(r_xmm5, table17[0]);
+        r_xmm1 = _mm512_add_epi32(r_xmm1, r_xmm2);
+        r_xmm7 = _mm512_shuffle_epi32(r_xmm4, _MM_PERM_ENUM(0x55));
+        r_xmm6 = _mm512_madd_epi16(r_xmm6, table17[1]);
+        r_xmm0 = _mm512_add_epi32(r_xmm0, r_xmm3);
+        r_xmm4 = _mm512_shuffle_epi32(r_xmm4, _MM_PERM_ENUM(0xff));
+        r_xmm2 = _mm512_sub_epi32(r_xmm1, r_xmm0);
+        r_xmm7 = _mm512_madd_epi16(r_xmm7, table17[2]);
+        r_xmm0 = _mm512_add_epi32(r_xmm0, r_xmm1);
+        r_xmm2 = _mm512_srai_epi32(r_xmm2, 12);
+        r_xmm5 = _mm512_add_epi32(r_xmm5, round_inv_row);
+        r_xmm4 = _mm512_madd_epi16(r_xmm4, table17[3]);
+        r_xmm5 = _mm512_add_epi32(r_xmm5, r_xmm6);
+        r_xmm0 = _mm512_srai_epi32(r_xmm0, 12);
+        r_xmm2 = _mm512_shuffle_epi32(r_xmm2, _MM_PERM_ENUM(0x1b));
+        row3 = _mm512_packs_epi32(r_xmm0, r_xmm2);
+
+        r_xmm4 = _mm512_add_epi32(r_xmm4, r_xmm7);
+        r_xmm6 = _mm512_sub_epi32(r_xmm5, r_xmm4);
+        r_xmm4 = _mm512_add_epi32(r_xmm5, r_xmm4);
+        r_xmm6 = _mm512_srai_epi32(r_xmm6, 12);
+        r_xmm4 = _mm512_srai_epi32(r_xmm4, 12);
+        r_xmm6 = _mm512_shuffle_epi32(r_xmm6, _MM_PERM_ENUM(0x1b));
+        row1 = _mm512_packs_epi32(r_xmm4, r_xmm6);
+
+        // row 6 and row 8
+
+        r_xmm0 = _mm512_shufflelo_epi16(v5, 0xd8);
+        r_xmm1 = _mm512_shuffle_epi32(r_xmm0, _MM_PERM_ENUM(0x00));
+        r_xmm1 = _mm512_madd_epi16(r_xmm1, table35[0]);
+        r_xmm3 = _mm512_shuffle_epi32(r_xmm0, _MM_PERM_ENUM(0x55));
+        r_xmm0 = _mm512_shufflehi_epi16(r_xmm0, 0xd8);
+        r_xmm3 = _mm512_madd_epi16(r_xmm3, table35[2]);
+        r_xmm2 = _mm512_shuffle_epi32(r_xmm0, _MM_PERM_ENUM(0xaa));
+        r_xmm0 = _mm512_shuffle_epi32(r_xmm0, _MM_PERM_ENUM(0xff));
+        r_xmm2 = _mm512_madd_epi16(r_xmm2, table35[1]);
+        r_xmm4 = _mm512_shufflehi_epi16(v7, 0xd8);
+        r_xmm1 = _mm512_add_epi32(r_xmm1, round_inv_row);
+        r_xmm4 = _mm512_shufflelo_epi16(r_xmm4, 0xd8);
+        r_xmm0 = _mm512_madd_epi16(r_xmm0, table35[3]);
+        r_xmm5 = _mm512_shuffle_epi32(r_xmm4, _MM_PERM_ENUM(0x00));
+        r_xmm6 = _mm512_shuffle_epi32(r_xmm4, _MM_PERM_ENUM(0xaa));
+        r_xmm5 = _mm512_madd_epi16(r_xmm5, table17[0]);
+        r_xmm1 = _mm512_add_epi32(r_xmm1, r_xmm2);
+        r_xmm7 = _mm512_shuffle_epi32(r_xmm4, _MM_PERM_ENUM(0x55));
+        r_xmm6 = _mm512_madd_epi16(r_xmm6, table17[1]);
+        r_xmm0 = _mm512_add_epi32(r_xmm0, r_xmm3);
+        r_xmm4 = _mm512_shuffle_epi32(r_xmm4, _MM_PERM_ENUM(0xff));
+        r_xmm2 = _mm512_sub_epi32(r_xmm1, r_xmm0);
+        r_xmm7 = _mm512_madd_epi16(r_xmm7, table17[2]);
+        r_xmm0 = _mm512_add_epi32(r_xmm0, r_xmm1);
+        r_xmm2 = _mm512_srai_epi32(r_xmm2, 12);
+        r_xmm5 = _mm512_add_epi32(r_xmm5, round_inv_row);
+        r_xmm4 = _mm512_madd_epi16(r_xmm4, table17[3]);
+        r_xmm5 = _mm512_add_epi32(r_xmm5, r_xmm6);
+        r_xmm0 = _mm512_srai_epi32(r_xmm0, 12);
+        r_xmm2 = _mm512_shuffle_epi32(r_xmm2, _MM_PERM_ENUM(0x1b));
+        row5 = _mm512_packs_epi32(r_xmm0, r_xmm2);
+
+        r_xmm4 = _mm512_add_epi32(r_xmm4, r_xmm7);
+        r_xmm6 = _mm512_sub_epi32(r_xmm5, r_xmm4);
+        r_xmm4 = _mm512_add_epi32(r_xmm5, r_xmm4);
+        r_xmm6 = _mm512_srai_epi32(r_xmm6, 12);
+        r_xmm4 = _mm512_srai_epi32(r_xmm4, 12);
+        r_xmm6 = _mm512_shuffle_epi32(r_xmm6, _MM_PERM_ENUM(0x1b));
+        row7 = _mm512_packs_epi32(r_xmm4, r_xmm6);
+
+        const __m512i tg = _mm512_broadcast_i32x4(_mm_set_epi16(-19195, -19195, -21746, -21746, 27146, 27146, 13036, 13036));
+        const __m512i one = _mm512_set1_epi16(1);
+
+        r_xmm1 = _mm512_shuffle_epi32(tg, _MM_PERM_ENUM(0xaa));
+        r_xmm0 = _mm512_mulhi_epi16(r_xmm1, row5);
+        r_xmm1 = _mm512_mulhi_epi16(r_xmm1, row3);
+        r_xmm5 = _mm512_shuffle_epi32(tg, _MM_PERM_ENUM(0x00));
+        r_xmm4 = _mm512_mulhi_epi16(r_xmm5, row7);
+        r_xmm5 = _mm512_mulhi_epi16(r_xmm5, row1);
+        r_xmm0 = _mm512_adds_epi16(r_xmm0, row5);
+        r_xmm1 = _mm512_adds_epi16(r_xmm1, row3);
+        r_xmm0 = _mm512_adds_epi16(r_xmm0, row3);
+        r_xmm3 = _mm512_shuffle_epi32(tg, _MM_PERM_ENUM(0x55));
+        r_xmm7 = _mm512_mulhi_epi16(r_xmm3, row6);
+        r_xmm3 = _mm512_mulhi_epi16(r_xmm3, row2);
+        r_xmm5 = _mm512_subs_epi16(r_xmm5, row7);
+        r_xmm4 = _mm512_adds_epi16(r_xmm4, row1);
+        r_xmm2 = _mm512_subs_epi16(r_xmm2, r_xmm1);
+        r_xmm1 = _mm512_adds_epi16(r_xmm0, r_xmm4);
+        r_xmm1 = _mm512_adds_epi16(r_xmm1, one);
+        r_xmm4 = _mm512_subs_epi16(r_xmm4, r_xmm0);
+        r_xmm6 = _mm512_adds_epi16(r_xmm5, r_xmm2);
+        r_xmm5 = _mm512_subs_epi16(r_xmm5, r_xmm2);
+        r_xmm5 = _mm512_adds_epi16(r_xmm5, one);
+
+        __m512i temp7 = r_xmm1;
+        __m512i temp3 = r_xmm6;
+
+        r_xmm0 = _mm512_shuffle_epi32(tg, _MM_PERM_ENUM(0xff));
+        r_xmm1 = _mm512_subs_epi16(r_xmm4, r_xmm5);
+        r_xmm4 = _mm512_adds_epi16(r_xmm4, r_xmm5);
+        r_xmm2 = _mm512_mulhi_epi16(r_xmm0, r_xmm4);
+        r_xmm7 = _mm512_adds_epi16(r_xmm7, row2);
+        r_xmm3 = _mm512_subs_epi16(r_xmm3, row6);
+        r_xmm0 = _mm512_mulhi_epi16(r_xmm0, r_xmm1);
+        r_xmm0 = _mm512_adds_epi16(r_xmm0, r_xmm1);
+        r_xmm5 = _mm512_adds_epi16(row0, row4);
+        r_xmm6 = _mm512_subs_epi16(row0, row4);
+        r_xmm4 = _mm512_adds_epi16(r_xmm4, r_xmm2);
+
+        r_xmm4 = _mm512_or_si512(r_xmm4, one);
+        r_xmm0 = _mm512_or_si512(r_xmm0, one);
+
+        const s16 bias = 128 << 5;
+        const __m512i round_inv_col = _mm512_set1_epi16(16 + bias);
+        const __m512i round_inv_corr = _mm512_sub_epi16(round_inv_col, one);
+
+        r_xmm1 = _mm512_subs_epi16(r_xmm6, r_xmm3);
+        r_xmm1 = _mm512_adds_epi16(r_xmm1, round_inv_corr);
+        r_xmm2 = _mm512_subs_epi16(r_xmm5, r_xmm7);
+        r_xmm2 = _mm512_adds_epi16(r_xmm2, round_inv_corr);
+        r_xmm5 = _mm512_adds_epi16(r_xmm5, r_xmm7);
+        r_xmm5 = _mm512_adds_epi16(r_xmm5, round_inv_col);
+        r_xmm6 = _mm512_adds_epi16(r_xmm6, r_xmm3);
+        r_xmm6 = _mm512_adds_epi16(r_xmm6, round_inv_col);
+
+        __m512i r0 = _mm512_adds_epi16(r_xmm5, temp7);
+        __m512i r1 = _mm512_adds_epi16(r_xmm6, r_xmm4);
+        __m512i r2 = _mm512_adds_epi16(r_xmm1, r_xmm0);
+        __m512i r3 = _mm512_adds_epi16(r_xmm2, temp3);
+        __m512i r4 = _mm512_subs_epi16(r_xmm2, temp3);
+        __m512i r5 = _mm512_subs_epi16(r_xmm1, r_xmm0);
+        __m512i r6 = _mm512_subs_epi16(r_xmm6, r_xmm4);
+        __m512i r7 = _mm512_subs_epi16(r_xmm5, temp7);
+
+        r0 = _mm512_srai_epi16(r0, 5);
+        r1 = _mm512_srai_epi16(r1, 5);
+        r2 = _mm512_srai_epi16(r2, 5);
+        r3 = _mm512_srai_epi16(r3, 5);
+        r4 = _mm512_srai_epi16(r4, 5);
+        r5 = _mm512_srai_epi16(r5, 5);
+        r6 = _mm512_srai_epi16(r6, 5);
+        r7 = _mm512_srai_epi16(r7, 5);
+
+        __m512i s0 = _mm512_packus_epi16(r0, r1);
+        __m512i s1 = _mm512_packus_epi16(r2, r3);
+        __m512i s2 = _mm512_packus_epi16(r4, r5);
+        __m512i s3 = _mm512_packus_epi16(r6, r7);
+
+        // transpose back so that each block is contiguous
+        idct_transpose_avx512(s0, s1, s2, s3);
+
+        // store
+        _mm512_storeu_si512(dest +   0, s0);
+        _mm512_storeu_si512(dest +  64, s1);
+        _mm512_storeu_si512(dest + 128, s2);
+        _mm512_storeu_si512(dest + 192, s3);
+    }
+
+#endif // MANGO_ENABLE_AVX512
+
 #if defined(MANGO_ENABLE_NEON)
 
     // ------------------------------------------------------------------------------------------------
@@ -1,6 +1,6 @@
 /*
     MANGO Multimedia Development Platform
-    Copyright (C) 2012-2023 Twilight Finland 3D Oy Ltd. All rights reserved.
+    Copyright (C) 2012-2024 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
 #include "jpeg.hpp"
 
@@ -89,6 +89,48 @@ void process_y_32bit(u8* dest, size_t stride, const s16* data, ProcessState* sta
     }
 }
 
+static inline
+u32 convert_cmyk_bgra(ColorSpace colorspace, int y0, int cb, int cr, int ck)
+{
+    int C;
+    int M;
+    int Y;
+    int K;
+
+    switch (colorspace)
+    {
+        case ColorSpace::CMYK:
+            C = y0;
+            M = cb;
+            Y = cr;
+            K = ck;
+            break;
+        case ColorSpace::YCCK:
+            // convert YCCK to CMYK
+            C = 255 - (y0 + ((5734 * cr - 735052) >> 12));
+            M = 255 - (y0 + ((-1410 * cb - 2925 * cr + 554844) >> 12));
+            Y = 255 - (y0 + ((7258 * cb - 929038) >> 12));
+            K = ck;
+            break;
+        default:
+        case ColorSpace::YCBCR:
+            C = 0;
+            M = 0;
+            Y = 0;
+            K = 0;
+            break;
+    }
+
+    int r = (C * K) / 255;
+    int g = (M * K) / 255;
+    int b = (Y * K) / 255;
+
+    r = byteclamp(r);
+    g = byteclamp(g);
+    b = byteclamp(b);
+    return image::makeBGRA(r, g, b, 0xff);
+}
+
 void process_cmyk_bgra(u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height)
 {
     u8 result[JPEG_MAX_SAMPLES_IN_MCU];
@@ -155,43 +197,7 @@ void process_cmyk_bgra(u8* dest, size_t stride, const s16* data, ProcessState* s
                     u8 cr = cr_scan[x >> cr_xshift];
                     u8 ck = ck_scan[x >> ck_xshift];
 
-                    int C;
-                    int M;
-                    int Y;
-                    int K;
-
-                    switch (colorspace)
-                    {
-                        case ColorSpace::CMYK:
-                            C = y0;
-                            M = cb;
-                            Y = cr;
-                            K = ck;
-                            break;
-                        case ColorSpace::YCCK:
-                            // convert YCCK to CMYK
-                            C = 255 - (y0 + ((5734 * cr - 735052) >> 12));
-                            M = 255 - (y0 + ((-1410 * cb - 2925 * cr + 554844) >> 12));
-                            Y = 255 - (y0 + ((7258 * cb - 929038) >> 12));
-                            K = ck;
-                            break;
-                        default:
-                        case ColorSpace::YCBCR:
-                            C = 0;
-                            M = 0;
-                            Y = 0;
-                            K = 0;
-                            break;
-                    }
-
-                    int r = (C * K) / 255;
-                    int g = (M * K) / 255;
-                    int b = (Y * K) / 255;
-
-                    r = byteclamp(r);
-                    g = byteclamp(g);
-                    b = byteclamp(b);
-                    d[x] = image::makeBGRA(r, g, b, 0xff);
+                    d[x] = convert_cmyk_bgra(colorspace, y0, cb, cr, ck);
                 }
                 dest_block += stride;
                 y_block += 8;
@@ -343,6 +349,216 @@ void write_color_rgb(u8* dest, int y, int r, int g, int b)
 #undef FUNCTION_YCBCR_16x8
 #undef FUNCTION_YCBCR_16x16
 
+// ----------------------------------------------------------------------------
+// Reduced-size decoding
+// ----------------------------------------------------------------------------
+
+void convert_y_8bit_row(u8* dest, const u8* y, const u8* cb, const u8* cr, int count)
+{
+    std::memcpy(dest, y, count);
+
+    MANGO_UNREFERENCED(cb);
+    MANGO_UNREFERENCED(cr);
+}
+
+void convert_y_24bit_row(u8* dest, const u8* y, const u8* cb, const u8* cr, int count)
+{
+    for (int x = 0; x < count; ++x)
+    {
+        u8 v = y[x];
+        dest[0] = v;
+        dest[1] = v;
+        dest[2] = v;
+        dest += 3;
+    }
+
+    MANGO_UNREFERENCED(cb);
+    MANGO_UNREFERENCED(cr);
+}
+
+void convert_y_32bit_row(u8* dest, const u8* y, const u8* cb, const u8* cr, int count)
+{
+    u32* d = reinterpret_cast<u32*>(dest);
+
+    for (int x = 0; x < count; ++x)
+    {
+        u32 v = y[x];
+        d[x] = 0xff000000 | (v << 16) | (v << 8) | v;
+    }
+
+    MANGO_UNREFERENCED(cb);
+    MANGO_UNREFERENCED(cr);
+}
+
+template <void (*WRITE_COLOR)(u8*, int, int, int, int), int XSTEP>
+void convert_ycbcr_row(u8* dest, const u8* y, const u8* cb, const u8* cr, int count)
+{
+    for (int x = 0; x < count; ++x)
+    {
+        int r, g, b;
+        COMPUTE_CBCR(cb[x], cr[x]);
+        WRITE_COLOR(dest, y[x], r, g, b);
+        dest += XSTEP;
+    }
+}
+
+void convert_ycbcr_bgr_row(u8* dest, const u8* y, const u8* cb, const u8* cr, int count)
+{
+    convert_ycbcr_row<write_color_bgr, 3>(dest, y, cb, cr, count);
+}
+
+void convert_ycbcr_rgb_row(u8* dest, const u8* y, const u8* cb, const u8* cr, int count)
+{
+    convert_ycbcr_row<write_color_rgb, 3>(dest, y, cb, cr, count);
+}
+
+void convert_ycbcr_bgra_row(u8* dest, const u8* y, const u8* cb, const u8* cr, int count)
+{
+    convert_ycbcr_row<write_color_bgra, 4>(dest, y, cb, cr, count);
+}
+
+void convert_ycbcr_rgba_row(u8* dest, const u8* y, const u8* cb, const u8* cr, int count)
+{
+    convert_ycbcr_row<write_color_rgba, 4>(dest, y, cb, cr, count);
+}
+
+void process_scaled(u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height)
+{
+    struct Component
+    {
+        const u8* data;
+        int bits;    // log2 of the reduced block size
+        int xup;     // upsampling shift
+        int yup;
+        int xdown;   // decimation shift
+        int ydown;
+        int xblocks;
+    };
+
+    Component component[JPEG_MAX_COMPS_IN_SCAN];
+
+    u8 result[JPEG_MAX_SAMPLES_IN_MCU];
+    u8* ptr = result;
+
+    const int frames = state->frames;
+    const int scale_bits = u32_log2(8 / state->scale);
+
+    for (int i = 0; i < frames; ++i)
+    {
+        const Frame& frame = state->frame[i];
+
+        const int bits = getScaledBlockBits(frame, state->scale);
+        const int extra = bits - scale_bits;
+        const int size = 1 << (bits * 2);
+
+        Component& c = component[i];
+
+        c.data = ptr;
+        c.bits = bits;
+        c.xup = std::max(0, frame.hsf - extra);
+        c.yup = std::max(0, frame.vsf - extra);
+        c.xdown = std::max(0, extra - frame.hsf);
+        c.ydown = std::max(0, extra - frame.vsf);
+        c.xblocks = state->hmax >> frame.hsf;
+
+        const int blocks = c.xblocks * (state->vmax >> frame.vsf);
+
+        for (int j = 0; j < blocks; ++j)
+        {
+            const int offset = frame.offset + j;
+            state->idct_scaled[bits](ptr, data + offset * 64, state->block[offset].qt);
+            ptr += size;
+        }
+    }
+
+    // one row of samples per component; padded for 8 pixel wide SIMD loads
+    u8 scan[JPEG_MAX_COMPS_IN_SCAN][32];
+    const u8* row[JPEG_MAX_COMPS_IN_SCAN] = { scan[0], scan[1], scan[2], scan[3] };
+
+    for (int y = 0; y < height; ++y)
+    {
+        for (int i = 0; i < frames; ++i)
+        {
+            const Component& c = component[i];
+
+            const int size = 1 << c.bits;
+            const int mask = size - 1;
+            const int sy = (y << c.ydown) >> c.yup;
+            const u8* src = c.data + (((sy >> c.bits) * c.xblocks) << (c.bits * 2)) + ((sy & mask) << c.bits);
+
+            if (c.xdown | c.ydown)
+            {
+                // non-square subsampling: average the samples covered by the output pixel
+                const int xcount = 1 << c.xdown;
+                const int ycount = 1 << c.ydown;
+                const int shift = c.xdown + c.ydown;
+                const int bias = (1 << shift) >> 1;
+
+                for (int x = 0; x < width; ++x)
+                {
+                    const int sx = (x << c.xdown) >> c.xup;
+                    const u8* s = src + ((sx >> c.bits) << (c.bits * 2)) + (sx & mask);
+
+                    int sum = bias;
+
+                    for (int j = 0; j < ycount; ++j)
+                    {
+                        for (int k = 0; k < xcount; ++k)
+                        {
+                            sum += s[(j << c.bits) + k];
+                        }
+                    }
+
+                    scan[i][x] = u8(sum >> shift);
+                }
+
+                row[i] = scan[i];
+            }
+            else if (c.xup)
+            {
+                for (int x = 0; x < width; ++x)
+                {
+                    const int sx = x >> c.xup;
+                    scan[i][x] = src[((sx >> c.bits) << (c.bits * 2)) + (sx & mask)];
+                }
+
+                row[i] = scan[i];
+            }
+            else if (c.xblocks > 1)
+            {
+                // gather the row from horizontally adjacent blocks
+                for (int x = 0; x < c.xblocks; ++x)
+                {
+                    std::memcpy(scan[i] + x * size, src + (x << (c.bits * 2)), size);
+                }
+
+                row[i] = scan[i];
+            }
+            else
+            {
+                // the block row can be used directly
+                row[i] = src;
+            }
+        }
+
+        if (frames == 4)
+        {
+            u32* d = reinterpret_cast<u32*>(dest);
+
+            for (int x = 0; x < width; ++x)
+            {
+                d[x] = convert_cmyk_bgra(state->colorspace, row[0][x], row[1][x], row[2][x], row[3][x]);
+            }
+        }
+        else
+        {
+            state->convert_row(dest, row[0], row[1], row[2], width);
+        }
+
+        dest += stride;
+    }
+}
+
 #undef COMPUTE_CBCR
 
 // ------------------------------------------------------------------------------------------------
@@ -435,6 +651,7 @@ void convert_ycbcr_rgb_8x1_neon(u8* dest, int16x8_t y, int16x8_t cb, int16x8_t c
 #define FUNCTION_YCBCR_8x16  process_ycbcr_bgra_8x16_neon
 #define FUNCTION_YCBCR_16x8  process_ycbcr_bgra_16x8_neon
 #define FUNCTION_YCBCR_16x16 process_ycbcr_bgra_16x16_neon
+#define FUNCTION_YCBCR_ROW   convert_ycbcr_bgra_row_neon
 #include "jpeg_process_neon.hpp"
 #undef INNERLOOP_YCBCR
 #undef XSTEP
@@ -442,6 +659,7 @@ void convert_ycbcr_rgb_8x1_neon(u8* dest, int16x8_t y, int16x8_t cb, int16x8_t c
 #undef FUNCTION_YCBCR_8x16
 #undef FUNCTION_YCBCR_16x8
 #undef FUNCTION_YCBCR_16x16
+#undef FUNCTION_YCBCR_ROW
 
 // Generate YCBCR to RGBA functions
 #define INNERLOOP_YCBCR      convert_ycbcr_rgba_8x1_neon
@@ -450,6 +668,7 @@ void convert_ycbcr_rgb_8x1_neon(u8* dest, int16x8_t y, int16x8_t cb, int16x8_t c
 #define FUNCTION_YCBCR_8x16  process_ycbcr_rgba_8x16_neon
 #define FUNCTION_YCBCR_16x8  process_ycbcr_rgba_16x8_neon
 #define FUNCTION_YCBCR_16x16 process_ycbcr_rgba_16x16_neon
+#define FUNCTION_YCBCR_ROW   convert_ycbcr_rgba_row_neon
 #include "jpeg_process_neon.hpp"
 #undef INNERLOOP_YCBCR
 #undef XSTEP
@@ -457,6 +676,7 @@ void convert_ycbcr_rgb_8x1_neon(u8* dest, int16x8_t y, int16x8_t cb, int16x8_t c
 #undef FUNCTION_YCBCR_8x16
 #undef FUNCTION_YCBCR_16x8
 #undef FUNCTION_YCBCR_16x16
+#undef FUNCTION_YCBCR_ROW
 
 // Generate YCBCR to BGR functions
 #define INNERLOOP_YCBCR      convert_ycbcr_bgr_8x1_neon
@@ -465,6 +685,7 @@ void convert_ycbcr_rgb_8x1_neon(u8* dest, int16x8_t y, int16x8_t cb, int16x8_t c
 #define FUNCTION_YCBCR_8x16  process_ycbcr_bgr_8x16_neon
 #define FUNCTION_YCBCR_16x8  process_ycbcr_bgr_16x8_neon
 #define FUNCTION_YCBCR_16x16 process_ycbcr_bgr_16x16_neon
+#define FUNCTION_YCBCR_ROW   convert_ycbcr_bgr_row_neon
 #include "jpeg_process_neon.hpp"
 #undef INNERLOOP_YCBCR
 #undef XSTEP
@@ -472,6 +693,7 @@ void convert_ycbcr_rgb_8x1_neon(u8* dest, int16x8_t y, int16x8_t cb, int16x8_t c
 #undef FUNCTION_YCBCR_8x16
 #undef FUNCTION_YCBCR_16x8
 #undef FUNCTION_YCBCR_16x16
+#undef FUNCTION_YCBCR_ROW
 
 // Generate YCBCR to RGB functions
 #define INNERLOOP_YCBCR      convert_ycbcr_rgb_8x1_neon
@@ -480,6 +702,7 @@ void convert_ycbcr_rgb_8x1_neon(u8* dest, int16x8_t y, int16x8_t cb, int16x8_t c
 #define FUNCTION_YCBCR_8x16  process_ycbcr_rgb_8x16_neon
 #define FUNCTION_YCBCR_16x8  process_ycbcr_rgb_16x8_neon
 #define FUNCTION_YCBCR_16x16 process_ycbcr_rgb_16x16_neon
+#define FUNCTION_YCBCR_ROW   convert_ycbcr_rgb_row_neon
 #include "jpeg_process_neon.hpp"
 #undef INNERLOOP_YCBCR
 #undef XSTEP
@@ -487,6 +710,7 @@ void convert_ycbcr_rgb_8x1_neon(u8* dest, int16x8_t y, int16x8_t cb, int16x8_t c
 #undef FUNCTION_YCBCR_8x16
 #undef FUNCTION_YCBCR_16x8
 #undef FUNCTION_YCBCR_16x16
+#undef FUNCTION_YCBCR_ROW
 
 #endif // MANGO_ENABLE_NEON
 
@@ -621,6 +845,7 @@ void convert_ycbcr_rgba_8x1_sse2(u8* dest, __m128i y, __m128i cb, __m128i cr, __
 #define FUNCTION_YCBCR_8x16  process_ycbcr_bgra_8x16_sse2
 #define FUNCTION_YCBCR_16x8  process_ycbcr_bgra_16x8_sse2
 #define FUNCTION_YCBCR_16x16 process_ycbcr_bgra_16x16_sse2
+#define FUNCTION_YCBCR_ROW   convert_ycbcr_bgra_row_sse2
 #include "jpeg_process_sse2.hpp"
 #undef INNERLOOP_YCBCR
 #undef XSTEP
@@ -628,6 +853,7 @@ void convert_ycbcr_rgba_8x1_sse2(u8* dest, __m128i y, __m128i cb, __m128i cr, __
 #undef FUNCTION_YCBCR_8x16
 #undef FUNCTION_YCBCR_16x8
 #undef FUNCTION_YCBCR_16x16
+#undef FUNCTION_YCBCR_ROW
 
 // Generate YCBCR to RGBA functions
 #define INNERLOOP_YCBCR      convert_ycbcr_rgba_8x1_sse2
@@ -636,6 +862,7 @@ void convert_ycbcr_rgba_8x1_sse2(u8* dest, __m128i y, __m128i cb, __m128i cr, __
 #define FUNCTION_YCBCR_8x16  process_ycbcr_rgba_8x16_sse2
 #define FUNCTION_YCBCR_16x8  process_ycbcr_rgba_16x8_sse2
 #define FUNCTION_YCBCR_16x16 process_ycbcr_rgba_16x16_sse2
+#define FUNCTION_YCBCR_ROW   convert_ycbcr_rgba_row_sse2
 #include "jpeg_process_sse2.hpp"
 #undef INNERLOOP_YCBCR
 #undef XSTEP
@@ -643,6 +870,7 @@ void convert_ycbcr_rgba_8x1_sse2(u8* dest, __m128i y, __m128i cb, __m128i cr, __
 #undef FUNCTION_YCBCR_8x16
 #undef FUNCTION_YCBCR_16x8
 #undef FUNCTION_YCBCR_16x16
+#undef FUNCTION_YCBCR_ROW
 
 #endif // MANGO_ENABLE_SSE2
 
@@ -775,6 +1003,7 @@ void convert_ycbcr_rgb_8x1_ssse3(u8* dest, __m128i y, __m128i cb, __m128i cr, __
 #define FUNCTION_YCBCR_8x16  process_ycbcr_bgr_8x16_ssse3
 #define FUNCTION_YCBCR_16x8  process_ycbcr_bgr_16x8_ssse3
 #define FUNCTION_YCBCR_16x16 process_ycbcr_bgr_16x16_ssse3
+#define FUNCTION_YCBCR_ROW   convert_ycbcr_bgr_row_ssse3
 #include "jpeg_process_sse2.hpp"
 #undef INNERLOOP_YCBCR
 #undef XSTEP
@@ -782,6 +1011,7 @@ void convert_ycbcr_rgb_8x1_ssse3(u8* dest, __m128i y, __m128i cb, __m128i cr, __
 #undef FUNCTION_YCBCR_8x16
 #undef FUNCTION_YCBCR_16x8
 #undef FUNCTION_YCBCR_16x16
+#undef FUNCTION_YCBCR_ROW
 
 // Generate YCBCR to RGB functions
 #define INNERLOOP_YCBCR      convert_ycbcr_rgb_8x1_ssse3
@@ -790,6 +1020,7 @@ void convert_ycbcr_rgb_8x1_ssse3(u8* dest, __m128i y, __m128i cb, __m128i cr, __
 #define FUNCTION_YCBCR_8x16  process_ycbcr_rgb_8x16_ssse3
 #define FUNCTION_YCBCR_16x8  process_ycbcr_rgb_16x8_ssse3
 #define FUNCTION_YCBCR_16x16 process_ycbcr_rgb_16x16_ssse3
+#define FUNCTION_YCBCR_ROW   convert_ycbcr_rgb_row_ssse3
 #include "jpeg_process_sse2.hpp"
 #undef INNERLOOP_YCBCR
 #undef XSTEP
@@ -797,6 +1028,7 @@ void convert_ycbcr_rgb_8x1_ssse3(u8* dest, __m128i y, __m128i cb, __m128i cr, __
 #undef FUNCTION_YCBCR_8x16
 #undef FUNCTION_YCBCR_16x8
 #undef FUNCTION_YCBCR_16x16
+#undef FUNCTION_YCBCR_ROW
 
 #endif // MANGO_ENABLE_SSE4_1
 
@@ -809,7 +1041,35 @@ void convert_ycbcr_rgb_8x1_ssse3(u8* dest, __m128i y, __m128i cb, __m128i cr, __
 #define JPEG_CONST_AVX2(x, y)  _mm256_setr_epi16(x, y, x, y, x, y, x, y, x, y, x, y, x, y, x, y)
 
 static inline
-u8* convert_ycbcr_rgba_8x2_avx2(u8* dest, size_t stride, __m256i y, __m256i cb, __m256i cr, __m256i s0, __m256i s1, __m256i s2, __m256i rounding)
+void idct_blocks_avx2(u8* dest, const s16* data, ProcessState* state, int count)
+{
+    const Block* block = state->block;
+    int i = 0;
+
+    if (state->idct4)
+    {
+        for ( ; i + 4 <= count; i += 4)
+        {
+            state->idct4(dest + i * 64, data + i * 64, block + i);
+        }
+    }
+
+    if (state->idct2)
+    {
+        for ( ; i + 2 <= count; i += 2)
+        {
+            state->idct2(dest + i * 64, data + i * 64, block + i);
+        }
+    }
+
+    for ( ; i < count; ++i)
+    {
+        state->idct(dest + i * 64, data + i * 64, block[i].qt);
+    }
+}
+
+static inline
+void convert_ycbcr_8x2_avx2(__m256i& r, __m256i& g, __m256i& b, __m256i y, __m256i cb, __m256i cr, __m256i s0, __m256i s1, __m256i s2, __m256i rounding)
 {
     __m256i zero = _mm256_setzero_si256();
 
@@ -843,79 +1103,160 @@ u8* convert_ycbcr_rgba_8x2_avx2(u8* dest, size_t stride, __m256i y, __m256i cb,
     g_l = _mm256_srai_epi32(g_l, JPEG_PREC);
     g_h = _mm256_srai_epi32(g_h, JPEG_PREC);
 
-    __m256i r = _mm256_packs_epi32(r_l, r_h);
-    __m256i g = _mm256_packs_epi32(g_l, g_h);
-    __m256i b = _mm256_packs_epi32(b_l, b_h);
+    r = _mm256_packs_epi32(r_l, r_h);
+    g = _mm256_packs_epi32(g_l, g_h);
+    b = _mm256_packs_epi32(b_l, b_h);
+
+    // 8 pixels in the low half of each lane
+    r = _mm256_packus_epi16(r, r);
+    g = _mm256_packus_epi16(g, g);
+    b = _mm256_packus_epi16(b, b);
+}
+
+static inline
+void convert_ycbcr_bgra_8x2_avx2(u8* dest, size_t stride, __m256i y, __m256i cb, __m256i cr, __m256i s0, __m256i s1, __m256i s2, __m256i rounding)
+{
+    __m256i r, g, b;
+    convert_ycbcr_8x2_avx2(r, g, b, y, cb, cr, s0, s1, s2, rounding);
     __m256i a = _mm256_cmpeq_epi8(r, r);
 
-    __m256i pair0 = _mm256_packus_epi16(r, g);
-    __m256i pair1 = _mm256_packus_epi16(b, a);
-    __m256i pair2 = _mm256_unpacklo_epi8(pair0, pair1);
-    __m256i pair3 = _mm256_unpackhi_epi8(pair0, pair1);
-    __m256i color0 = _mm256_unpacklo_epi8(pair2, pair3);
-    __m256i color1 = _mm256_unpackhi_epi8(pair2, pair3);
-
-    __m256i c0 = _mm256_permute2x128_si256(color0, color1, _MM_SHUFFLE(3, 2, 1, 0));
-    __m256i c1 = _mm256_permute2x128_si256(color0, color1, _MM_SHUFFLE(1, 2, 3, 0));
-    __m256i c2 = _mm256_permute2x128_si256(color0, color1, _MM_SHUFFLE(3, 2, 0, 1));
-    __m256i c3 = _mm256_permute2x128_si256(color0, color1, _MM_SHUFFLE(0, 3, 2, 1));
-    color0 = _mm256_blend_epi32(c0, c1, 0xf0);
-    color1 = _mm256_blend_epi32(c2, c3, 0xf0);
-
-    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest +  0), color0);
-    dest += stride;
+    __m256i bg = _mm256_unpacklo_epi8(b, g);
+    __m256i ra = _mm256_unpacklo_epi8(r, a);
 
-    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest +  0), color1);
-    dest += stride;
+    __m256i bgra0 = _mm256_unpacklo_epi16(bg, ra);
+    __m256i bgra1 = _mm256_unpackhi_epi16(bg, ra);
 
-    return dest;
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest), _mm256_permute2x128_si256(bgra0, bgra1, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest + stride), _mm256_permute2x128_si256(bgra0, bgra1, 0x31));
 }
 
-void process_ycbcr_rgba_8x8_avx2(u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height)
+static inline
+void convert_ycbcr_rgba_8x2_avx2(u8* dest, size_t stride, __m256i y, __m256i cb, __m256i cr, __m256i s0, __m256i s1, __m256i s2, __m256i rounding)
 {
-    u8 result[64 * 3];
+    __m256i r, g, b;
+    convert_ycbcr_8x2_avx2(r, g, b, y, cb, cr, s0, s1, s2, rounding);
+    __m256i a = _mm256_cmpeq_epi8(r, r);
 
-    state->idct(result +   0, data +   0, state->block[0].qt); // Y
-    state->idct(result +  64, data +  64, state->block[1].qt); // Cb
-    state->idct(result + 128, data + 128, state->block[2].qt); // Cr
+    __m256i rg = _mm256_unpacklo_epi8(r, g);
+    __m256i ba = _mm256_unpacklo_epi8(b, a);
 
-    // color conversion
-    const __m256i s0 = JPEG_CONST_AVX2(JPEG_FIXED( 1.00000), JPEG_FIXED( 1.40200));
-    const __m256i s1 = JPEG_CONST_AVX2(JPEG_FIXED( 1.00000), JPEG_FIXED( 1.77200));
-    const __m256i s2 = JPEG_CONST_AVX2(JPEG_FIXED(-0.34414), JPEG_FIXED(-0.71414));
-    const __m256i rounding = _mm256_set1_epi32(1 << (JPEG_PREC - 1));
-    const __m256i tosigned = _mm256_set1_epi16(128);
+    __m256i rgba0 = _mm256_unpacklo_epi16(rg, ba);
+    __m256i rgba1 = _mm256_unpackhi_epi16(rg, ba);
 
-    for (int y = 0; y < 2; ++y)
-    {
-        __m256i y0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(result + y * 32 + 0));
-        __m256i cb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(result + y * 32 + 64));
-        __m256i cr = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(result + y * 32 + 128));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest), _mm256_permute2x128_si256(rgba0, rgba1, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest + stride), _mm256_permute2x128_si256(rgba0, rgba1, 0x31));
+}
 
-        y0 = _mm256_permute4x64_epi64(y0, _MM_SHUFFLE(3, 1, 2, 0));
-        cb = _mm256_permute4x64_epi64(cb, _MM_SHUFFLE(3, 1, 2, 0));
-        cr = _mm256_permute4x64_epi64(cr, _MM_SHUFFLE(3, 1, 2, 0));
+static inline
+void convert_ycbcr_bgr_8x2_avx2(u8* dest, size_t stride, __m256i y, __m256i cb, __m256i cr, __m256i s0, __m256i s1, __m256i s2, __m256i rounding)
+{
+    __m256i r, g, b;
+    convert_ycbcr_8x2_avx2(r, g, b, y, cb, cr, s0, s1, s2, rounding);
 
-        __m256i zero = _mm256_setzero_si256();
+    __m256i bg = _mm256_unpacklo_epi64(b, g);
 
-        __m256i cb0 = _mm256_unpacklo_epi8(cb, zero);
-        __m256i cr0 = _mm256_unpacklo_epi8(cr, zero);
-        __m256i cb1 = _mm256_unpackhi_epi8(cb, zero);
-        __m256i cr1 = _mm256_unpackhi_epi8(cr, zero);
+    constexpr u8 n = 0x80;
 
-        cb0 = _mm256_sub_epi16(cb0, tosigned);
-        cr0 = _mm256_sub_epi16(cr0, tosigned);
-        cb1 = _mm256_sub_epi16(cb1, tosigned);
-        cr1 = _mm256_sub_epi16(cr1, tosigned);
+    __m256i bg0 = _mm256_shuffle_epi8(bg, _mm256_broadcastsi128_si256(_mm_setr_epi8(0, 8, n, 1, 9, n, 2, 10, n, 3, 11, n, 4, 12, n, 5)));
+    __m256i bg1 = _mm256_shuffle_epi8(bg, _mm256_broadcastsi128_si256(_mm_setr_epi8(13, n, 6, 14, n, 7, 15, n, n, n, n, n, n, n, n, n)));
+    __m256i r0 = _mm256_shuffle_epi8(r, _mm256_broadcastsi128_si256(_mm_setr_epi8(n, n, 0, n, n, 1, n, n, 2, n, n, 3, n, n, 4, n)));
+    __m256i r1 = _mm256_shuffle_epi8(r, _mm256_broadcastsi128_si256(_mm_setr_epi8(n, 5, n, n, 6, n, n, 7, n, n, n, n, n, n, n, n)));
+    __m256i bgr0 = _mm256_or_si256(bg0, r0);
+    __m256i bgr1 = _mm256_or_si256(bg1, r1);
 
-        dest = convert_ycbcr_rgba_8x2_avx2(dest, stride, _mm256_unpacklo_epi8(y0, zero), cb0, cr0, s0, s1, s2, rounding);
-        dest = convert_ycbcr_rgba_8x2_avx2(dest, stride, _mm256_unpackhi_epi8(y0, zero), cb1, cr1, s0, s1, s2, rounding);
-    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dest +  0), _mm256_castsi256_si128(bgr0));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(dest + 16), _mm256_castsi256_si128(bgr1));
+    dest += stride;
 
-    MANGO_UNREFERENCED(width);
-    MANGO_UNREFERENCED(height);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dest +  0), _mm256_extracti128_si256(bgr0, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(dest + 16), _mm256_extracti128_si256(bgr1, 1));
 }
 
+static inline
+void convert_ycbcr_rgb_8x2_avx2(u8* dest, size_t stride, __m256i y, __m256i cb, __m256i cr, __m256i s0, __m256i s1, __m256i s2, __m256i rounding)
+{
+    __m256i r, g, b;
+    convert_ycbcr_8x2_avx2(r, g, b, y, cb, cr, s0, s1, s2, rounding);
+
+    __m256i rg = _mm256_unpacklo_epi64(r, g);
+
+    constexpr u8 n = 0x80;
+
+    __m256i rg0 = _mm256_shuffle_epi8(rg, _mm256_broadcastsi128_si256(_mm_setr_epi8(0, 8, n, 1, 9, n, 2, 10, n, 3, 11, n, 4, 12, n, 5)));
+    __m256i rg1 = _mm256_shuffle_epi8(rg, _mm256_broadcastsi128_si256(_mm_setr_epi8(13, n, 6, 14, n, 7, 15, n, n, n, n, n, n, n, n, n)));
+    __m256i b0 = _mm256_shuffle_epi8(b, _mm256_broadcastsi128_si256(_mm_setr_epi8(n, n, 0, n, n, 1, n, n, 2, n, n, 3, n, n, 4, n)));
+    __m256i b1 = _mm256_shuffle_epi8(b, _mm256_broadcastsi128_si256(_mm_setr_epi8(n, 5, n, n, 6, n, n, 7, n, n, n, n, n, n, n, n)));
+    __m256i rgb0 = _mm256_or_si256(rg0, b0);
+    __m256i rgb1 = _mm256_or_si256(rg1, b1);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dest +  0), _mm256_castsi256_si128(rgb0));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(dest + 16), _mm256_castsi256_si128(rgb1));
+    dest += stride;
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dest +  0), _mm256_extracti128_si256(rgb0, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(dest + 16), _mm256_extracti128_si256(rgb1, 1));
+}
+
+// Generate YCBCR to BGR functions
+#define INNERLOOP_YCBCR      convert_ycbcr_bgr_8x2_avx2
+#define XSTEP                24
+#define FUNCTION_YCBCR_8x8   process_ycbcr_bgr_8x8_avx2
+#define FUNCTION_YCBCR_8x16  process_ycbcr_bgr_8x16_avx2
+#define FUNCTION_YCBCR_16x8  process_ycbcr_bgr_16x8_avx2
+#define FUNCTION_YCBCR_16x16 process_ycbcr_bgr_16x16_avx2
+#include "jpeg_process_avx2.hpp"
+#undef INNERLOOP_YCBCR
+#undef XSTEP
+#undef FUNCTION_YCBCR_8x8
+#undef FUNCTION_YCBCR_8x16
+#undef FUNCTION_YCBCR_16x8
+#undef FUNCTION_YCBCR_16x16
+
+// Generate YCBCR to RGB functions
+#define INNERLOOP_YCBCR      convert_ycbcr_rgb_8x2_avx2
+#define XSTEP                24
+#define FUNCTION_YCBCR_8x8   process_ycbcr_rgb_8x8_avx2
+#define FUNCTION_YCBCR_8x16  process_ycbcr_rgb_8x16_avx2
+#define FUNCTION_YCBCR_16x8  process_ycbcr_rgb_16x8_avx2
+#define FUNCTION_YCBCR_16x16 process_ycbcr_rgb_16x16_avx2
+#include "jpeg_process_avx2.hpp"
+#undef INNERLOOP_YCBCR
+#undef XSTEP
+#undef FUNCTION_YCBCR_8x8
+#undef FUNCTION_YCBCR_8x16
+#undef FUNCTION_YCBCR_16x8
+#undef FUNCTION_YCBCR_16x16
+
+// Generate YCBCR to BGRA functions
+#define INNERLOOP_YCBCR      convert_ycbcr_bgra_8x2_avx2
+#define XSTEP                32
+#define FUNCTION_YCBCR_8x8   process_ycbcr_bgra_8x8_avx2
+#define FUNCTION_YCBCR_8x16  process_ycbcr_bgra_8x16_avx2
+#define FUNCTION_YCBCR_16x8  process_ycbcr_bgra_16x8_avx2
+#define FUNCTION_YCBCR_16x16 process_ycbcr_bgra_16x16_avx2
+#include "jpeg_process_avx2.hpp"
+#undef INNERLOOP_YCBCR
+#undef XSTEP
+#undef FUNCTION_YCBCR_8x8
+#undef FUNCTION_YCBCR_8x16
+#undef FUNCTION_YCBCR_16x8
+#undef FUNCTION_YCBCR_16x16
+
+// Generate YCBCR to RGBA functions
+#define INNERLOOP_YCBCR      convert_ycbcr_rgba_8x2_avx2
+#define XSTEP                32
+#define FUNCTION_YCBCR_8x8   process_ycbcr_rgba_8x8_avx2
+#define FUNCTION_YCBCR_8x16  process_ycbcr_rgba_8x16_avx2
+#define FUNCTION_YCBCR_16x8  process_ycbcr_rgba_16x8_avx2
+#define FUNCTION_YCBCR_16x16 process_ycbcr_rgba_16x16_avx2
+#include "jpeg_process_avx2.hpp"
+#undef INNERLOOP_YCBCR
+#undef XSTEP
+#undef FUNCTION_YCBCR_8x8
+#undef FUNCTION_YCBCR_8x16
+#undef FUNCTION_YCBCR_16x8
+#undef FUNCTION_YCBCR_16x16
+
 #endif // MANGO_ENABLE_AVX2
 
 } // namespace mango::image::jpeg
@@ -0,0 +1,259 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2024 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+
+// NOTE: The innerloop converts two rows of 8 pixels at a time; the first row is in the
+//       low 128 bit lane and the second row in the high lane. Loading 4 rows (32 bytes) of
+//       the idct output and permuting the 64 bit quads as (0, 2, 1, 3) gives that layout
+//       for rows (0, 1) in the low bytes and (2, 3) in the high bytes.
+
+#ifdef FUNCTION_YCBCR_8x8
+
+void FUNCTION_YCBCR_8x8(u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height)
+{
+    u8 result[64 * 3];
+
+    idct_blocks_avx2(result, data, state, 3); // Y, Cb, Cr
+
+    // color conversion
+    const __m256i s0 = JPEG_CONST_AVX2(JPEG_FIXED( 1.00000), JPEG_FIXED( 1.40200));
+    const __m256i s1 = JPEG_CONST_AVX2(JPEG_FIXED( 1.00000), JPEG_FIXED( 1.77200));
+    const __m256i s2 = JPEG_CONST_AVX2(JPEG_FIXED(-0.34414), JPEG_FIXED(-0.71414));
+    const __m256i rounding = _mm256_set1_epi32(1 << (JPEG_PREC - 1));
+    const __m256i tosigned = _mm256_set1_epi16(128);
+
+    for (int y = 0; y < 2; ++y)
+    {
+        __m256i y0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(result + y * 32 + 0));
+        __m256i cb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(result + y * 32 + 64));
+        __m256i cr = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(result + y * 32 + 128));
+
+        y0 = _mm256_permute4x64_epi64(y0, _MM_SHUFFLE(3, 1, 2, 0));
+        cb = _mm256_permute4x64_epi64(cb, _MM_SHUFFLE(3, 1, 2, 0));
+        cr = _mm256_permute4x64_epi64(cr, _MM_SHUFFLE(3, 1, 2, 0));
+
+        __m256i zero = _mm256_setzero_si256();
+
+        __m256i cb0 = _mm256_unpacklo_epi8(cb, zero);
+        __m256i cr0 = _mm256_unpacklo_epi8(cr, zero);
+        __m256i cb1 = _mm256_unpackhi_epi8(cb, zero);
+        __m256i cr1 = _mm256_unpackhi_epi8(cr, zero);
+
+        cb0 = _mm256_sub_epi16(cb0, tosigned);
+        cr0 = _mm256_sub_epi16(cr0, tosigned);
+        cb1 = _mm256_sub_epi16(cb1, tosigned);
+        cr1 = _mm256_sub_epi16(cr1, tosigned);
+
+        INNERLOOP_YCBCR(dest, stride, _mm256_unpacklo_epi8(y0, zero), cb0, cr0, s0, s1, s2, rounding);
+        dest += stride * 2;
+
+        INNERLOOP_YCBCR(dest, stride, _mm256_unpackhi_epi8(y0, zero), cb1, cr1, s0, s1, s2, rounding);
+        dest += stride * 2;
+    }
+
+    MANGO_UNREFERENCED(width);
+    MANGO_UNREFERENCED(height);
+}
+
+#endif
+
+#ifdef FUNCTION_YCBCR_8x16
+
+void FUNCTION_YCBCR_8x16(u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height)
+{
+    u8 result[64 * 4];
+
+    idct_blocks_avx2(result, data, state, 4); // Y0, Y1, Cb, Cr
+
+    // color conversion
+    const __m256i s0 = JPEG_CONST_AVX2(JPEG_FIXED( 1.00000), JPEG_FIXED( 1.40200));
+    const __m256i s1 = JPEG_CONST_AVX2(JPEG_FIXED( 1.00000), JPEG_FIXED( 1.77200));
+    const __m256i s2 = JPEG_CONST_AVX2(JPEG_FIXED(-0.34414), JPEG_FIXED(-0.71414));
+    const __m256i rounding = _mm256_set1_epi32(1 << (JPEG_PREC - 1));
+    const __m256i tosigned = _mm256_set1_epi16(128);
+
+    for (int y = 0; y < 4; ++y)
+    {
+        __m256i y0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(result + y * 32 + 0));
+        y0 = _mm256_permute4x64_epi64(y0, _MM_SHUFFLE(3, 1, 2, 0));
+
+        // two chroma rows, both lanes have the same rows
+        __m256i cb = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(result + y * 16 + 128)));
+        __m256i cr = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(result + y * 16 + 192)));
+
+        __m256i zero = _mm256_setzero_si256();
+
+        __m256i cb0 = _mm256_unpacklo_epi8(cb, zero);
+        __m256i cr0 = _mm256_unpacklo_epi8(cr, zero);
+        __m256i cb1 = _mm256_unpackhi_epi8(cb, zero);
+        __m256i cr1 = _mm256_unpackhi_epi8(cr, zero);
+
+        cb0 = _mm256_sub_epi16(cb0, tosigned);
+        cr0 = _mm256_sub_epi16(cr0, tosigned);
+        cb1 = _mm256_sub_epi16(cb1, tosigned);
+        cr1 = _mm256_sub_epi16(cr1, tosigned);
+
+        INNERLOOP_YCBCR(dest, stride, _mm256_unpacklo_epi8(y0, zero), cb0, cr0, s0, s1, s2, rounding);
+        dest += stride * 2;
+
+        INNERLOOP_YCBCR(dest, stride, _mm256_unpackhi_epi8(y0, zero), cb1, cr1, s0, s1, s2, rounding);
+        dest += stride * 2;
+    }
+
+    MANGO_UNREFERENCED(width);
+    MANGO_UNREFERENCED(height);
+}
+
+#endif
+
+#ifdef FUNCTION_YCBCR_16x8
+
+void FUNCTION_YCBCR_16x8(u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height)
+{
+    u8 result[64 * 4];
+
+    idct_blocks_avx2(result, data, state, 4); // Y0, Y1, Cb, Cr
+
+    // color conversion
+    const __m256i s0 = JPEG_CONST_AVX2(JPEG_FIXED( 1.00000), JPEG_FIXED( 1.40200));
+    const __m256i s1 = JPEG_CONST_AVX2(JPEG_FIXED( 1.00000), JPEG_FIXED( 1.77200));
+    const __m256i s2 = JPEG_CONST_AVX2(JPEG_FIXED(-0.34414), JPEG_FIXED(-0.71414));
+    const __m256i rounding = _mm256_set1_epi32(1 << (JPEG_PREC - 1));
+    const __m256i tosigned = _mm256_set1_epi16(128);
+
+    for (int y = 0; y < 2; ++y)
+    {
+        __m256i y0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(result + y * 32 + 0));
+        __m256i y1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(result + y * 32 + 64));
+        __m256i cb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(result + y * 32 + 128));
+        __m256i cr = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(result + y * 32 + 192));
+
+        y0 = _mm256_permute4x64_epi64(y0, _MM_SHUFFLE(3, 1, 2, 0));
+        y1 = _mm256_permute4x64_epi64(y1, _MM_SHUFFLE(3, 1, 2, 0));
+        cb = _mm256_permute4x64_epi64(cb, _MM_SHUFFLE(3, 1, 2, 0));
+        cr = _mm256_permute4x64_epi64(cr, _MM_SHUFFLE(3, 1, 2, 0));
+
+        __m256i zero = _mm256_setzero_si256();
+        __m256i cb0;
+        __m256i cb1;
+        __m256i cr0;
+        __m256i cr1;
+
+        cb0 = _mm256_unpacklo_epi8(cb, cb);
+        cr0 = _mm256_unpacklo_epi8(cr, cr);
+
+        cb1 = _mm256_unpackhi_epi8(cb0, zero);
+        cr1 = _mm256_unpackhi_epi8(cr0, zero);
+        cb0 = _mm256_unpacklo_epi8(cb0, zero);
+        cr0 = _mm256_unpacklo_epi8(cr0, zero);
+
+        cb0 = _mm256_sub_epi16(cb0, tosigned);
+        cr0 = _mm256_sub_epi16(cr0, tosigned);
+        cb1 = _mm256_sub_epi16(cb1, tosigned);
+        cr1 = _mm256_sub_epi16(cr1, tosigned);
+
+        INNERLOOP_YCBCR(dest + 0 * XSTEP, stride, _mm256_unpacklo_epi8(y0, zero), cb0, cr0, s0, s1, s2, rounding);
+        INNERLOOP_YCBCR(dest + 1 * XSTEP, stride, _mm256_unpacklo_epi8(y1, zero), cb1, cr1, s0, s1, s2, rounding);
+        dest += stride * 2;
+
+        cb0 = _mm256_unpackhi_epi8(cb, cb);
+        cr0 = _mm256_unpackhi_epi8(cr, cr);
+
+        cb1 = _mm256_unpackhi_epi8(cb0, zero);
+        cr1 = _mm256_unpackhi_epi8(cr0, zero);
+        cb0 = _mm256_unpacklo_epi8(cb0, zero);
+        cr0 = _mm256_unpacklo_epi8(cr0, zero);
+
+        cb0 = _mm256_sub_epi16(cb0, tosigned);
+        cr0 = _mm256_sub_epi16(cr0, tosigned);
+        cb1 = _mm256_sub_epi16(cb1, tosigned);
+        cr1 = _mm256_sub_epi16(cr1, tosigned);
+
+        INNERLOOP_YCBCR(dest + 0 * XSTEP, stride, _mm256_unpackhi_epi8(y0, zero), cb0, cr0, s0, s1, s2, rounding);
+        INNERLOOP_YCBCR(dest + 1 * XSTEP, stride, _mm256_unpackhi_epi8(y1, zero), cb1, cr1, s0, s1, s2, rounding);
+        dest += stride * 2;
+    }
+
+    MANGO_UNREFERENCED(width);
+    MANGO_UNREFERENCED(height);
+}
+
+#endif
+
+#ifdef FUNCTION_YCBCR_16x16
+
+void FUNCTION_YCBCR_16x16(u8* dest, size_t stride, const s16* data, ProcessState* state, int width, int height)
+{
+    u8 result[64 * 6];
+
+    idct_blocks_avx2(result, data, state, 6); // Y0, Y1, Y2, Y3, Cb, Cr
+
+    // color conversion
+    const __m256i s0 = JPEG_CONST_AVX2(JPEG_FIXED( 1.00000), JPEG_FIXED( 1.40200));
+    const __m256i s1 = JPEG_CONST_AVX2(JPEG_FIXED( 1.00000), JPEG_FIXED( 1.77200));
+    const __m256i s2 = JPEG_CONST_AVX2(JPEG_FIXED(-0.34414), JPEG_FIXED(-0.71414));
+    const __m256i rounding = _mm256_set1_epi32(1 << (JPEG_PREC - 1));
+    const __m256i tosigned = _mm256_set1_epi16(128);
+
+    for (int y = 0; y < 4; ++y)
+    {
+        // Y0 and Y1 for the top half, Y2 and Y3 for the bottom half
+        const u8* luma = result + (y >> 1) * 128 + (y & 1) * 32;
+
+        __m256i y0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(luma + 0));
+        __m256i y1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(luma + 64));
+
+        y0 = _mm256_permute4x64_epi64(y0, _MM_SHUFFLE(3, 1, 2, 0));
+        y1 = _mm256_permute4x64_epi64(y1, _MM_SHUFFLE(3, 1, 2, 0));
+
+        // two chroma rows, both lanes have the same rows
+        __m256i cb = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(result + y * 16 + 256)));
+        __m256i cr = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(result + y * 16 + 320)));
+
+        __m256i zero = _mm256_setzero_si256();
+        __m256i cb0;
+        __m256i cb1;
+        __m256i cr0;
+        __m256i cr1;
+
+        cb0 = _mm256_unpacklo_epi8(cb, cb);
+        cr0 = _mm256_unpacklo_epi8(cr, cr);
+
+        cb1 = _mm256_unpackhi_epi8(cb0, zero);
+        cr1 = _mm256_unpackhi_epi8(cr0, zero);
+        cb0 = _mm256_unpacklo_epi8(cb0, zero);
+        cr0 = _mm256_unpacklo_epi8(cr0, zero);
+
+        cb0 = _mm256_sub_epi16(cb0, tosigned);
+        cr0 = _mm256_sub_epi16(cr0, tosigned);
+        cb1 = _mm256_sub_epi16(cb1, tosigned);
+        cr1 = _mm256_sub_epi16(cr1, tosigned);
+
+        INNERLOOP_YCBCR(dest + 0 * XSTEP, stride, _mm256_unpacklo_epi8(y0, zero), cb0, cr0, s0, s1, s2, rounding);
+        INNERLOOP_YCBCR(dest + 1 * XSTEP, stride, _mm256_unpacklo_epi8(y1, zero), cb1, cr1, s0, s1, s2, rounding);
+        dest += stride * 2;
+
+        cb0 = _mm256_unpackhi_epi8(cb, cb);
+        cr0 = _mm256_unpackhi_epi8(cr, cr);
+
+        cb1 = _mm256_unpackhi_epi8(cb0, zero);
+        cr1 = _mm256_unpackhi_epi8(cr0, zero);
+        cb0 = _mm256_unpacklo_epi8(cb0, zero);
+        cr0 = _mm256_unpacklo_epi8(cr0, zero);
+
+        cb0 = _mm256_sub_epi16(cb0, tosigned);
+        cr0 = _mm256_sub_epi16(cr0, tosigned);
+        cb1 = _mm256_sub_epi16(cb1, tosigned);
+        cr1 = _mm256_sub_epi16(cr1, tosigned);
+
+        INNERLOOP_YCBCR(dest + 0 * XSTEP, stride, _mm256_unpackhi_epi8(y0, zero), cb0, cr0, s0, s1, s2, rounding);
+        INNERLOOP_YCBCR(dest + 1 * XSTEP, stride, _mm256_unpackhi_epi8(y1, zero), cb1, cr1, s0, s1, s2, rounding);
+        dest += stride * 2;
+    }
+
+    MANGO_UNREFERENCED(width);
+    MANGO_UNREFERENCED(height);
+}
+
+#endif